@@ -0,0 +1,126 @@
+#ifndef ASYNCBUNDLEREADER_H
+#define ASYNCBUNDLEREADER_H
+
+#include <stdlib.h>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <set>
+
+#if defined(__BUILD_LINUX__) && defined(__USE_IO_URING__)
+  #include <liburing.h>
+#endif
+
+/** One file of an AsyncBundleReader batch. */
+struct BundleReadRequest
+{
+    // File to read; the string must stay valid until the request completes
+    const char* m_fileName;
+
+    // Whether to add an extra zero ('\0') after the data; see
+    // ReadBundleFile()
+    bool m_zeropad;
+
+    // Optional caller supplied buffer and its size. If NULL, a buffer is
+    // allocated with malloc() and the caller must free() it.
+    void* m_buffer;
+    size_t m_bufferSize;
+
+    // Results: number of bytes in m_buffer (including the padding) and
+    // whether the read succeeded
+    size_t m_size;
+    bool m_success;
+};
+
+/**
+ * Called once per request when it completes, on a background thread.
+ *
+ * @param request the completed request
+ * @param userData user data given to Submit()
+ */
+typedef void (*BundleReadCallback)(BundleReadRequest* request,
+                                   void* userData);
+
+/**
+ * Reads batches of bundle files asynchronously so that the latencies of
+ * the individual reads overlap, eg. the six faces of a cube map or the two
+ * stages of a shader. ReadBundleFile() remains the blocking equivalent.
+ *
+ * On Linux builds with __USE_IO_URING__ every batch is submitted to the
+ * kernel at once through io_uring and completed by a reaper thread. Files
+ * in mounted resource packs, other platforms and kernels without io_uring
+ * use reads on g_threadPool instead.
+ */
+class AsyncBundleReader
+{
+public: // Construction and destruction
+    /**
+     * Constructs the reader.
+     *
+     * @param queueDepth maximum number of reads in flight in the kernel
+     */
+    AsyncBundleReader(unsigned int queueDepth = 64);
+
+    /** Waits for all submitted requests to complete. */
+    virtual ~AsyncBundleReader();
+
+public: // Public API
+    /**
+     * Submits a batch of reads. Thread safe.
+     *
+     * @param requests requests to read; must stay valid until the batch
+     * completes
+     * @param count number of requests
+     * @param callback optional callback for each completed request
+     * @param userData passed to the callback
+     * @return future that becomes ready once the whole batch has completed;
+     * its value tells whether every request succeeded
+     */
+    std::future<bool> Submit(BundleReadRequest* requests, int count,
+                             BundleReadCallback callback = NULL,
+                             void* userData = NULL);
+
+    /** Whether reads go through io_uring. */
+    bool IsUsingIoUring() const { return m_useIoUring; }
+
+private:
+    struct Batch;
+    struct ReadOperation;
+
+    void ReadOnThreadPool(Batch* batch, BundleReadRequest* request);
+    void CompleteRequest(Batch* batch, BundleReadRequest* request,
+                         bool success);
+
+#if defined(__BUILD_LINUX__) && defined(__USE_IO_URING__)
+    ReadOperation* OpenRead(Batch* batch, BundleReadRequest* request);
+    void CloseRead(ReadOperation* operation);
+    void QueueRead(ReadOperation* operation);
+    void FinishRead(ReadOperation* operation, int result);
+    void FailReads(int error);
+    void ReaperMain();
+#endif
+
+private: // Data
+    bool m_useIoUring;
+
+    // Number of requests submitted but not yet completed
+    std::atomic<int> m_numPending;
+    std::mutex m_pendingMutex;
+    std::condition_variable m_pendingCondition;
+
+#if defined(__BUILD_LINUX__) && defined(__USE_IO_URING__)
+    struct io_uring m_ring;
+    std::mutex m_submitMutex;
+    std::thread m_reaperThread;
+    std::atomic<bool> m_stopping;
+
+    // Reads in the ring, and whether the ring has failed; reads then go
+    // through the thread pool. Both guarded by m_submitMutex.
+    std::set<ReadOperation*> m_operations;
+    bool m_ringFailed;
+#endif
+};
+
+#endif // ASYNCBUNDLEREADER_H
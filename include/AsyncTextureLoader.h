@@ -0,0 +1,129 @@
+#ifndef ASYNCTEXTURELOADER_H
+#define ASYNCTEXTURELOADER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+
+#include "OpenGLAPI.h"
+#include "GLResources.h"
+
+/**
+ * Called on the GL thread once a texture requested from AsyncTextureLoader
+ * has its final contents, or has failed to load (it then keeps showing
+ * the placeholder).
+ *
+ * @param texture the handle returned by Load()
+ * @param success whether the image was loaded
+ * @param userData user data given to Load()
+ */
+typedef void (*TextureLoadedCallback)(TextureHandle texture, bool success,
+                                      void* userData);
+
+/**
+ * Loads bundled images into textures without stalling the GL thread.
+ * Load() returns a texture handle at once, showing a 1x1 placeholder
+ * color; the image is decoded and flipped on g_threadPool and uploaded by
+ * Update() a strip of rows at a time, within a per-frame budget of bytes
+ * and milliseconds. The upload goes into a separate texture object that
+ * replaces the placeholder behind the handle when complete, so a partially
+ * uploaded image is never visible.
+ *
+ * All methods must be called on the GL thread.
+ */
+class AsyncTextureLoader
+{
+public: // Construction and destruction
+    /**
+     * Constructs the loader.
+     *
+     * @param budgetBytes maximum pixel bytes uploaded per Update()
+     * @param budgetMillis maximum time spent per Update()
+     */
+    AsyncTextureLoader(size_t budgetBytes = 4 * 1024 * 1024,
+                       float budgetMillis = 2.0);
+
+    /** Waits for running decodes; unfinished loads are dropped. */
+    virtual ~AsyncTextureLoader();
+
+public: // Public API
+    /**
+     * Starts loading an image into a texture.
+     *
+     * @param imageName image (file) name to load
+     * @param clamp if true, GL_CLAMP_TO_EDGE is set for both s, t
+     * @param useMipmaps whether to generate mipmaps once uploaded
+     * @param callback optional completion callback
+     * @param userData passed to the callback
+     * @return handle to the texture, owned by the caller; valid immediately
+     */
+    TextureHandle Load(const char* imageName, bool clamp, bool useMipmaps,
+                       TextureLoadedCallback callback = NULL,
+                       void* userData = NULL);
+
+    /**
+     * Uploads decoded images within the budget and calls the callbacks of
+     * completed loads. Call once per frame; GLController::BeginFrame() does
+     * so for its loader. At least one strip of rows is uploaded per call
+     * while anything is waiting, so loading always progresses.
+     *
+     * @return number of textures completed
+     */
+    int Update();
+
+    /** Sets the per-frame upload budget. */
+    void SetBudget(size_t budgetBytes, float budgetMillis);
+
+    /** Sets the placeholder color of textures loaded from now on. */
+    void SetPlaceholderColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+
+    /** Returns the number of loads not yet completed. */
+    int GetNumPending() const { return m_numPending; }
+
+private:
+    struct Job
+    {
+        std::string m_imageName;
+        TextureHandle m_texture;
+        bool m_clamp;
+        bool m_useMipmaps;
+        TextureLoadedCallback m_callback;
+        void* m_userData;
+
+        // Decoded pixels; set by the worker
+        void* m_pixels;
+        int m_width;
+        int m_height;
+        bool m_decoded;
+
+        // Texture being uploaded and number of rows uploaded into it
+        GLuint m_uploadTexture;
+        int m_numRowsUploaded;
+    };
+
+    void Decode(Job* job);
+    void Finish(Job* job, bool success);
+
+private: // Data
+    size_t m_budgetBytes;
+    float m_budgetMillis;
+    uint8_t m_placeholderColor[4];
+    int m_numPending;
+
+    // Job being uploaded; only touched by the GL thread
+    Job* m_currentJob;
+
+    // Decoded jobs waiting for upload
+    std::deque<Job*> m_decodedJobs;
+
+    // Number of jobs on the worker threads
+    int m_numDecoding;
+
+    std::mutex m_mutex;
+    std::condition_variable m_decodeCondition;
+};
+
+#endif // ASYNCTEXTURELOADER_H
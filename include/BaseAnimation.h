@@ -42,6 +42,16 @@ public: // Public API
      */
     virtual bool IsActive(const TimeSample& time) const;
 
+    /**
+     * Returns the time until the animation next needs a frame drawn, using
+     * the given time as the 'current time'; eg. for sleeping between
+     * frames when nothing is animating.
+     *
+     * @return time in seconds; 0 if the animation is active, negative if
+     * it has completed
+     */
+    virtual float TimeUntilNextUpdate(const TimeSample& time) const;
+
     /**
      * Resets the base time of this animation to current time.
      */
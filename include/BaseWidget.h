@@ -33,6 +33,10 @@ struct WidgetContext
     GLint m_textureShaderTextureLoc;
     GLint m_textureShaderHighlightLoc;
 
+    // Texture bound to texture unit 0 while drawing the widgets; widgets
+    // sharing a texture (eg. a TextureAtlas page) skip binding it again
+    GLuint m_boundTexture;
+
     // Shader program for rendering a widget with color
     GLuint m_colorShaderProgram;
     GLint m_colorShaderMvpLoc;
@@ -41,10 +45,39 @@ struct WidgetContext
     // The widget currently being pressed, NULL if none
     BaseWidget* m_pressedWidget;
 
+    // Set when widgets change in a way that affects how they are drawn;
+    // cleared when the widgets have been redrawn (see WidgetBatch)
+    bool m_widgetsChanged;
+
     // Pointer to a GLController that manages the widgets
     GLController* m_glController;
 };
 
+/**
+ * A widget drawn as a single textured or colored rectangle; lets the
+ * widget be drawn in a batch with others (see WidgetBatch).
+ *
+ * @author Matti Dahlbom
+ * @since 1.0
+ */
+struct WidgetQuad
+{
+    // Rectangle in viewport coordinates
+    Rect m_rect;
+
+    // Texture and the texture coordinates of the upper left (u1, v1) and
+    // lower right (u2, v2) corners, as taken by DrawImage2D(); texture 0
+    // for a colored rectangle
+    GLuint m_texture;
+    float m_u1;
+    float m_v1;
+    float m_u2;
+    float m_v2;
+
+    // RGBA color of a colored rectangle
+    float m_color[4];
+};
+
 /**
  * Touch listener for widgets.
  *
@@ -87,8 +120,21 @@ public: // Public API
 
     /** Returns the widget's bounds. */
     virtual Rect GetBounds();
+
+    /**
+     * Returns a reference to the widget's bounds; Invalidate() must be
+     * called after changing them through it.
+     */
     virtual Rect& BoundsRef() { return m_bounds; }
 
+    /**
+     * Marks the widgets to be redrawn and re-indexes the widget for hit
+     * testing; called by the widget whenever its bounds or appearance
+     * change, and to be called by the user after changing them behind the
+     * widget's back (eg. through BoundsRef()).
+     */
+    virtual void Invalidate();
+
     /** Sets visibility of the widget. */
     virtual void SetVisible(bool visible);
 
@@ -110,10 +156,30 @@ protected: // Construction and destruction
     virtual ~BaseWidget();
 
 protected:
-    // Returns widget bounds transformed by the widgets' parents
-    Rect TransformedRect();
+    /**
+     * Returns widget bounds transformed by the widgets' parents; cached
+     * until the bounds of the widget or of any of its parents change.
+     */
+    const Rect& TransformedRect();
+
+    /**
+     * Marks the cached transformed bounds of the widget and of any widgets
+     * within it stale.
+     */
+    virtual void InvalidateTransformedRect();
+
+    /** Called when a widget within this one is invalidated. */
+    virtual void ChildInvalidated();
     virtual void Render() = 0;
 
+    /**
+     * Describes the widget as a single rectangle, so it can be drawn in a
+     * batch instead of with Render().
+     *
+     * @return false if the widget must be drawn with Render()
+     */
+    virtual bool GetQuad(WidgetQuad* quad);
+
 private:
     // These get called by GLController; the coordinates are viewport
     // coordinates. Classes inheriting this should NOT keep any state with
@@ -125,6 +191,11 @@ protected: // Data
     WidgetType m_type;
     BaseWidget* m_parent;
     Rect m_bounds;
+
+    // Bounds transformed by the parents, and whether they are stale; a
+    // widget's cache is only ever valid if its parents' caches are
+    Rect m_transformedRect;
+    bool m_transformedRectDirty;
     bool m_isVisible;
     std::list<WidgetTouchListener*> m_touchListeners;
 
@@ -133,6 +204,8 @@ protected: // Data
 
     // Allow GLController access to privates
     friend class ::GLController;
+    friend class WidgetBatch;
+    friend class WidgetGrid;
 
     // Allow inheritants access to m_parent
     friend class Container;
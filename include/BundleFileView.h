@@ -0,0 +1,87 @@
+#ifndef BUNDLEFILEVIEW_H
+#define BUNDLEFILEVIEW_H
+
+#include <stdlib.h>
+
+/**
+ * Read-only view of the contents of a bundled resource file, filled in by
+ * MapBundleFile(). Depending on the platform the data is a memory mapping
+ * of the file, memory owned by the platform (eg. a Qt resource compiled
+ * into the binary) or a heap copy; in every case it stays valid until the
+ * view is reset or destroyed.
+ *
+ *   BundleFileView view;
+ *   if ( MapBundleFile("mesh.bin", false, &view) )
+ *   {
+ *       ParseMesh(view.GetData(), view.GetSize());
+ *   }
+ */
+class BundleFileView
+{
+public:
+    /**
+     * Releases the memory behind a view.
+     *
+     * @param data view data
+     * @param size view size
+     * @param context platform specific value given to Set()
+     */
+    typedef void (*ReleaseFunc)(const void* data, size_t size, void* context);
+
+public: // Construction and destruction
+    BundleFileView();
+    ~BundleFileView();
+
+public: // Public API
+    /** Returns the file contents. */
+    const void* GetData() const { return m_data; }
+
+    /**
+     * Returns the contents as a C string; only valid if the view was mapped
+     * with zero padding.
+     */
+    const char* GetString() const { return (const char*)m_data; }
+
+    /** Returns the file size, not including any zero padding. */
+    size_t GetSize() const { return m_size; }
+
+    /** Whether the view holds data. */
+    bool IsValid() const { return (m_data != NULL); }
+
+    /** Releases the data; the view becomes invalid. */
+    void Reset();
+
+    /**
+     * Sets the data of the view, releasing any previous data. Used by the
+     * MapBundleFile() implementations.
+     *
+     * @param release called with data, size and context to release the data;
+     * may be NULL if the memory needs no releasing
+     */
+    void Set(const void* data, size_t size, ReleaseFunc release,
+             void* context);
+
+    /** ReleaseFunc for data allocated with malloc(). */
+    static void FreeData(const void* data, size_t size, void* context);
+
+    /**
+     * Fills the view with a heap copy of a file read with ReadBundleFile();
+     * the fallback for when a file cannot be mapped.
+     *
+     * @return true on success
+     */
+    bool ReadCopy(const char* fileName, bool zeropad);
+
+private:
+    // Non-copyable
+    BundleFileView(const BundleFileView&);
+    BundleFileView& operator=(const BundleFileView&);
+
+private: // Data
+    const void* m_data;
+    size_t m_size;
+    ReleaseFunc m_release;
+    void* m_releaseContext;
+};
+
+#endif // BUNDLEFILEVIEW_H
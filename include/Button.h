@@ -5,6 +5,7 @@
 
 #include "BaseWidget.h"
 #include "OpenGLAPI.h"
+#include "TextureAtlas.h"
 
 namespace CommonGL {
 
@@ -25,8 +26,9 @@ public:
 };
 
 /**
- * A clickable (tappable) button with an image. The button object does not
- * own the OpenGL texture object.
+ * A clickable (tappable) button with an image; either a whole texture or
+ * a region of a TextureAtlas. The button object does not own the OpenGL
+ * texture object or the atlas.
  *
  * @author Matti Dahlbom
  * @since 1.0
@@ -37,6 +39,13 @@ public: // Construction and destruction
     /** Constructs a button without bounds; must be set later. */
     Button(GLuint texture, ButtonListener* listener = NULL);
     Button(Rect bounds, GLuint texture, ButtonListener* listener = NULL);
+
+    /**
+     * Constructs a button showing an image of an atlas. The region must
+     * stay in the atlas for the lifetime of the button.
+     */
+    Button(Rect bounds, const TextureAtlas* atlas, const AtlasRegion* region,
+           ButtonListener* listener = NULL);
     virtual ~Button();
 
 public: // Public API
@@ -51,12 +60,15 @@ public: // Public API
 
 protected:
     virtual void Render();
+    virtual bool GetQuad(WidgetQuad* quad);
 
 private:
     virtual void TouchUpInside(int x, int y);
 
 private: // Data
     GLuint m_texture;
+    const TextureAtlas* m_atlas;
+    const AtlasRegion* m_region;
     std::list<ButtonListener*> m_listeners;
 
     // Provide GLController access to the privates
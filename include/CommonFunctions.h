@@ -6,6 +6,9 @@
 #include <math.h>
 
 #include "OpenGLAPI.h"
+#include "GLResources.h"
+#include "BundleFileView.h"
+#include "TextureFormat.h"
 #include "Rect.h"
 
 // Workaround for Necessitas bug(?) that incorrectly announces DEBUG
@@ -119,7 +122,8 @@ void DrawQuad2D(const CommonGL::Rect& rect,
 void DrawQuad2D(GLuint vertexBuffer, GLuint indexBuffer);
 
 /**
- * Loads 6 named image files into a OpenGL Cube texture.
+ * Loads 6 named image files into a OpenGL Cube texture. The images are
+ * decoded in parallel on g_threadPool and uploaded once all have loaded.
  *
  * @param texture this will hold a valid texture id on success
  * @return true on success
@@ -132,6 +136,34 @@ bool LoadCubeTextureFromBundle(const char* xnegImageName,
                                const char* zposImageName,
                                GLuint* texture);
 
+/**
+ * Decodes the 6 named image files of a cube map in parallel on
+ * g_threadPool, without making any OpenGL calls; eg. for CubeMapFilter.
+ *
+ * @param faces receives the RGBA8 face images in the order of the
+ * GL_TEXTURE_CUBE_MAP_POSITIVE_X + i targets: +X, -X, +Y, -Y, +Z, -Z;
+ * caller must call free() on each
+ * @param faceSize where the width (and height) of the faces is stored
+ * @return true on success
+ */
+bool LoadCubeFaceDataFromBundle(const char* xnegImageName,
+                                const char* xposImageName,
+                                const char* ynegImageName,
+                                const char* yposImageName,
+                                const char* znegImageName,
+                                const char* zposImageName,
+                                void* faces[6], int* faceSize);
+
+/**
+ * Creates a OpenGL Cube texture from 6 RGBA8 images of the same size.
+ *
+ * @param faceSize width and height of each face (in pixels)
+ * @param faces the face images in the order of the
+ * GL_TEXTURE_CUBE_MAP_POSITIVE_X + i targets: +X, -X, +Y, -Y, +Z, -Z
+ * @param texture this will hold a valid texture id on success
+ * @return true on success
+ */
+bool CreateCubeTexture(int faceSize, void* const faces[6], GLuint* texture);
 
 /**
  * Loads a shader from bundled resource files.
@@ -158,6 +190,68 @@ bool LoadShaderFromBundle(const char* fileName, GLuint* program);
 bool Create2DTexture(int width, int height, void* data,
                      GLuint* texture, bool clamp, bool useMipmaps);
 
+/**
+ * Creates a 2D OpenGL texture in a given format, eg. TextureFormatRGB565
+ * for opaque images or TextureFormatA8 for a font atlas.
+ *
+ * @param data texture data in the given format, rows not padded; eg. from
+ * ConvertTextureData(). If NULL, the texture object is merely created.
+ * @return true on success
+ */
+bool Create2DTexture(int width, int height, const void* data,
+                     GLuint* texture, bool clamp, bool useMipmaps,
+                     TextureFormat format);
+
+/**
+ * Sets the filtering and wrapping of the texture bound to GL_TEXTURE_2D
+ * as Create2DTexture() does, generating the mipmaps if requested.
+ */
+void SetTexture2DParameters(bool clamp, bool useMipmaps);
+
+/**
+ * Sets the filtering of the texture bound to a target: bilinear without
+ * mipmaps, otherwise bi- or trilinear with anisotropic filtering if
+ * maxAnisotropy is above 1 and the driver supports it.
+ */
+void SetTextureFiltering(GLenum target, bool useMipmaps, bool trilinear,
+                         float maxAnisotropy);
+
+/**
+ * Sets GL_UNPACK_ALIGNMENT for the lifetime of the object, restoring the
+ * previous value when it goes out of scope; eg. an alignment of 1 for
+ * uploading rows that are not padded to 4 bytes.
+ */
+class ScopedUnpackAlignment
+{
+public:
+    ScopedUnpackAlignment(GLint alignment);
+    ~ScopedUnpackAlignment();
+
+private:
+    GLint m_previousAlignment;
+};
+
+/**
+ * Loads a named image file into a OpenGL texture owned by the
+ * global resource registry.
+ *
+ * @param texture this will hold a valid texture handle on success
+ * @return true on success
+ */
+bool Load2DTextureFromBundle(const char* imageName, TextureHandle* texture,
+                             bool clamp, bool useMipmaps);
+
+/**
+ * Loads a named image file into a OpenGL texture of a given format owned
+ * by the global resource registry; see LoadImageDataFromBundle().
+ *
+ * @param texture this will hold a valid texture handle on success
+ * @return true on success
+ */
+bool Load2DTextureFromBundle(const char* imageName, TextureHandle* texture,
+                             bool clamp, bool useMipmaps,
+                             TextureFormat format, int conversionFlags = 0);
+
 /** Loads a shader program */
 bool LoadShader(GLuint* shaderProgram,
                 const char* vertexShaderSource,
@@ -166,15 +260,33 @@ bool LoadShader(GLuint* shaderProgram,
 /** Detaches shaders from a program, deletes them and the program. */
 void UnloadShader(GLuint shaderProgram);
 
+/**
+ * Checks whether the driver lists an extension; false if there is no
+ * current context.
+ */
+bool ExtensionPresent(const char* extension);
+
 /** Checks for depth buffer extensions. */
 bool DepthBufferExtensionPresent();
 
 /** Checks for packed depth + stencil buffer extension. */
 bool PackedDepthStencilExtensionPresent();
 
+/**
+ * Returns the major version of the current OpenGL ES context, or 0 if the
+ * context is not OpenGL ES (eg. desktop OpenGL).
+ */
+int GetGLESMajorVersion();
+
 /** Returns the total amount of physical RAM on the host (in kilobytes). */
 size_t GetTotalRam();
 
+/**
+ * Returns the default budget for resident textures (in bytes): a share of
+ * the physical RAM, or a fixed amount if that is not known.
+ */
+size_t DefaultTextureBudget();
+
 /** Creates a depth buffer FBO, usable for Shadow Mapping and such. */
 bool CreateDepthTextureAndFBO(GLuint* fboId, GLuint* depthTextureId,
                               GLuint* renderBuffer, int width, int height,
@@ -197,6 +309,61 @@ void LogMatrix(const float* matrix);
 bool ReadBundleFile(const char* fileName, bool zeropad, 
                     size_t* size, void** buffer);
 
+/**
+ * Maps a bundled resource file into a read-only view without copying it
+ * where the platform allows; the data is released with the view. Prefer
+ * this over ReadBundleFile() for large files.
+ *
+ * @param fileName file name with no path
+ * @param zeropad whether a zero ('\0') must follow the data (useful when
+ * reading C strings); when the mapping cannot provide one, the file is
+ * copied instead
+ * @param view receives the file contents
+ * @return true on success
+ */
+bool MapBundleFile(const char* fileName, bool zeropad, BundleFileView* view);
+
+/**
+ * Returns the size and modification time of a bundled resource file, eg.
+ * to validate data derived from it. For a file in a mounted resource pack
+ * the modification time is that of the pack.
+ *
+ * @param fileName file name with no path
+ * @param size where the file size is stored
+ * @param modificationTime where the modification time is stored, in
+ * platform specific units
+ * @return true if the file exists
+ */
+bool GetBundleFileInfo(const char* fileName, size_t* size,
+                       int64_t* modificationTime);
+
+/**
+ * Returns a writable directory for data that can be regenerated if lost,
+ * eg. TextureDiskCache files, creating it if needed.
+ *
+ * @return the path ending with a separator, or an empty string if there
+ * is no such directory
+ */
+std::string GetCacheDirectory();
+
+/**
+ * Decodes a named image file into RGBA pixels, rows ordered bottom-up as
+ * OpenGL expects. Makes no OpenGL calls and may be called from any thread.
+ *
+ * @param imageName image (file) name to load
+ * @param data will be allocated if successful; caller must call free() on it
+ * @param width where the image width is stored
+ * @param height where the image height is stored
+ * @param format format to convert the pixels into; see ConvertTextureData()
+ * @param conversionFlags TextureConversionFlags for the conversion, which
+ * is done in the same pass as any flipping the platform decoder needs
+ * @return true on success
+ */
+bool LoadImageDataFromBundle(const char* imageName, void** data,
+                             int* width, int* height,
+                             TextureFormat format = TextureFormatRGBA8888,
+                             int conversionFlags = 0);
+
 /**
  * Loads a named image file into a OpenGL texture.
  *
@@ -221,13 +388,41 @@ bool LoadCubeMapTargetTexture(GLenum target, const char* imageName);
  */
 std::string RandomUuid();
 
+#if defined(__BUILD_LINUX__)
+/**
+ * Sets the directory bundle files are read from. Defaults to the value of
+ * the COMMONGL_RESOURCE_ROOT environment variable, or the working
+ * directory if it is not set. Not thread safe; to be called before any
+ * files are loaded.
+ */
+void SetResourceRoot(const char* path);
+
+/** Returns the file system path of a bundle file. */
+std::string GetBundleFilePath(const char* fileName);
+
+/**
+ * Creates an offscreen OpenGL ES 2.0 context and makes it current on the
+ * calling thread. Uses surfaceless EGL, or OSMesa when built with
+ * __USE_OSMESA__; both work with a software rasterizer on a machine with
+ * no GPU.
+ *
+ * @param width width of the default framebuffer
+ * @param height height of the default framebuffer
+ * @return true on success
+ */
+bool CreateHeadlessContext(int width, int height);
+
+/** Destroys the context created by CreateHeadlessContext(). */
+void DestroyHeadlessContext();
+#endif
+
 #define LOG_INFO(...) PrintLogDebug(__VA_ARGS__)
 #ifdef DEBUG
   #define DEBUG_ASSERT(x) DebugAssert(x)
   #define LOG_DEBUG(...) PrintLogDebug(__VA_ARGS__)
 #else
   #define LOG_DEBUG(...)
-  #define DEBUG_ASSERT(x) (x)
+  #define DEBUG_ASSERT(x) ((void)(x))
 #endif
 
 void PrintLogDebug(const char* fmt, ...);
@@ -27,16 +27,42 @@ public: // Public API
 
     /**
      * Returns a pointer to the background color of this Container;
-     * contains 4 values for RGBA.
+     * contains 4 values for RGBA. Invalidate() must be called after
+     * changing the color.
      */
     virtual float* ColorPtr() { return m_color; }
 
+    /**
+     * Sets whether the container and the widgets within it are drawn as a
+     * single quad from a rendering of them cached in a texture; for complex
+     * panels that seldom change. The rendering is updated when the
+     * container or any widget within it is invalidated. Off by default.
+     */
+    void SetCached(bool cached);
+
+    /** Returns whether the container is drawn from a cached rendering. */
+    bool IsCached() const { return m_cached; }
+
+public: // From BaseWidget
+    virtual void Invalidate();
+
 protected:
     virtual void Render();
+    virtual bool GetQuad(WidgetQuad* quad);
+    virtual void InvalidateTransformedRect();
+    virtual void ChildInvalidated();
 
 private: // Data
     std::list<BaseWidget*> m_children;
     float m_color[4];
+
+    // Whether drawn from a cached rendering, and whether the rendering is
+    // out of date
+    bool m_cached;
+    bool m_cacheDirty;
+
+    // Allow WidgetBatch to maintain the cached rendering
+    friend class WidgetBatch;
 };
 
 } // namespace CommonGL
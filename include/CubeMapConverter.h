@@ -0,0 +1,119 @@
+#ifndef CUBEMAPCONVERTER_H
+#define CUBEMAPCONVERTER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "OpenGLAPI.h"
+
+/**
+ * Returns the (unnormalized) direction of a point on a cube map face, in
+ * face coordinates (sc, tc) of [-1, 1] as in the OpenGL ES specification.
+ *
+ * @param face index of the GL_TEXTURE_CUBE_MAP_POSITIVE_X + i target
+ */
+inline void CubeFaceDirection(int face, float sc, float tc, float* dir)
+{
+    switch ( face )
+    {
+        case 0: // +X
+            dir[0] = 1.0f; dir[1] = -tc; dir[2] = -sc;
+            break;
+        case 1: // -X
+            dir[0] = -1.0f; dir[1] = -tc; dir[2] = sc;
+            break;
+        case 2: // +Y
+            dir[0] = sc; dir[1] = 1.0f; dir[2] = tc;
+            break;
+        case 3: // -Y
+            dir[0] = sc; dir[1] = -1.0f; dir[2] = -tc;
+            break;
+        case 4: // +Z
+            dir[0] = sc; dir[1] = -tc; dir[2] = 1.0f;
+            break;
+        default: // -Z
+            dir[0] = -sc; dir[1] = -tc; dir[2] = -1.0f;
+            break;
+    }
+}
+
+/**
+ * Returns the cube map face a direction points at, as selected by the
+ * OpenGL ES specification, and the texture coordinates (s, t) of [0, 1] on
+ * it; the inverse of CubeFaceDirection().
+ */
+inline int CubeDirectionToFace(float x, float y, float z, float* s,
+                               float* t)
+{
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float az = fabsf(z);
+    float sc, tc, ma;
+    int face;
+
+    if ( (ax >= ay) && (ax >= az) )
+    {
+        face = (x > 0.0f) ? 0 : 1;
+        sc = (x > 0.0f) ? -z : z;
+        tc = -y;
+        ma = ax;
+    }
+    else if ( ay >= az )
+    {
+        face = (y > 0.0f) ? 2 : 3;
+        sc = x;
+        tc = (y > 0.0f) ? z : -z;
+        ma = ay;
+    }
+    else
+    {
+        face = (z > 0.0f) ? 4 : 5;
+        sc = (z > 0.0f) ? x : -x;
+        tc = -y;
+        ma = az;
+    }
+
+    *s = 0.5f * (sc / ma + 1.0f);
+    *t = 0.5f * (tc / ma + 1.0f);
+
+    return face;
+}
+
+/**
+ * Builds the 6 faces of a cube map from an equirectangular (latitude /
+ * longitude) panorama with bilinear filtering. The rows of all faces are
+ * resampled in parallel on g_threadPool; the filtering uses SSE2 / NEON
+ * where available. Can be called on any thread.
+ *
+ * The panorama is centered on -Z, with +Y up and +X to the right. The
+ * faces are laid out as the OpenGL ES specification maps directions onto
+ * cube map faces (see CubeFaceDirection()), the first row of each face
+ * being at t = 0.
+ *
+ * @param data RGBA8 panorama, rows bottom-up as LoadImageDataFromBundle()
+ * returns them
+ * @param width panorama width (in pixels); normally twice the height
+ * @param height panorama height (in pixels)
+ * @param faceSize width and height of each face (in pixels)
+ * @param faces 6 buffers of faceSize * faceSize RGBA8 pixels each, in the
+ * order of the GL_TEXTURE_CUBE_MAP_POSITIVE_X + i targets
+ */
+void EquirectToCubeMap(const void* data, int width, int height,
+                       int faceSize, void* const faces[6]);
+
+/**
+ * Loads a named equirectangular panorama into a OpenGL Cube texture; see
+ * EquirectToCubeMap(). Shipping one panorama instead of 6 face images cuts
+ * the file I/O and decoding.
+ *
+ * @param imageName image (file) name to load
+ * @param faceSize face size (in pixels); 0 for a quarter of the panorama
+ * width, which roughly preserves its resolution
+ * @param texture this will hold a valid texture id on success
+ * @return true on success
+ */
+bool LoadEquirectCubeTextureFromBundle(const char* imageName, int faceSize,
+                                       GLuint* texture);
+
+#endif // CUBEMAPCONVERTER_H
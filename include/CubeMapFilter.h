@@ -0,0 +1,139 @@
+#ifndef CUBEMAPFILTER_H
+#define CUBEMAPFILTER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+
+#include "OpenGLAPI.h"
+
+//
+// Image based lighting from a cube map, prefiltered on the CPU. The cube
+// maps are given as 6 RGBA8 face images in the order of the
+// GL_TEXTURE_CUBE_MAP_POSITIVE_X + i targets, eg. from
+// LoadCubeFaceDataFromBundle(), and texel directions are the ones OpenGL
+// samples them with. All of the functions can be called on any thread.
+//
+
+/**
+ * Diffuse irradiance of a cube map as 9 spherical harmonics coefficients
+ * (3 bands) per color channel. The coefficients are convolved with the
+ * cosine lobe and have the basis function constants folded in, so that
+ * the irradiance for a unit normal n is
+ *
+ *   c0 + c1 n.y + c2 n.z + c3 n.x + c4 n.x n.y + c5 n.y n.z +
+ *   c6 (3 n.z n.z - 1) + c7 n.x n.z + c8 (n.x n.x - n.y n.y)
+ *
+ * which a shader evaluates from a uniform vec3 array of 9 (see
+ * GetCoefficients()) instead of sampling the cube map.
+ */
+struct SHIrradiance
+{
+    // RGB of each coefficient, in the order of the formula above
+    float m_coefficients[9][3];
+
+    /** Returns the coefficients as 9 RGB triplets for glUniform3fv(). */
+    const float* GetCoefficients() const { return &m_coefficients[0][0]; }
+
+    /**
+     * Evaluates the irradiance for a unit normal.
+     *
+     * @param rgb receives the linear irradiance, 3 floats
+     */
+    void Evaluate(float x, float y, float z, float* rgb) const;
+};
+
+/**
+ * Computes the diffuse irradiance of a cube map in a single pass over its
+ * texels, weighted by their solid angle. The rows are processed in
+ * parallel on g_threadPool; the accumulation uses SSE2 / NEON where
+ * available.
+ *
+ * @param faceSize width and height of each face (in pixels)
+ * @param faces the face images
+ * @param srgb whether the images are sRGB encoded; the irradiance is
+ * always linear
+ * @param irradiance receives the coefficients
+ */
+void ComputeSHIrradiance(int faceSize, const void* const faces[6], bool srgb,
+                         SHIrradiance* irradiance);
+
+/**
+ * A cube map prefiltered for specular (GGX) image based lighting: a full
+ * mip chain in which each level holds the environment convolved for a
+ * roughness, from mirror-like at level 0 to fully rough at the last
+ * level. A shader picks the level for a roughness r with
+ * r * (GetNumLevels() - 1) as the LOD (eg. textureCubeLodEXT()), instead
+ * of taking many samples of the cube map per fragment.
+ *
+ * The levels are importance sampled from a box filtered mip chain of the
+ * source, choosing the source level by the sample density to avoid
+ * aliasing. The rows of all faces of a level are filtered in parallel on
+ * g_threadPool.
+ */
+class PrefilteredCubeMap
+{
+public: // Construction and destruction
+    PrefilteredCubeMap();
+    virtual ~PrefilteredCubeMap();
+
+public: // Public API
+    /**
+     * Generates the levels from a cube map.
+     *
+     * @param faceSize width and height of each face (in pixels)
+     * @param faces the face images
+     * @param srgb whether the images are sRGB encoded; if so, filtering is
+     * done in linear light and the output is sRGB encoded too
+     * @param numSamples number of GGX samples per texel
+     */
+    void Generate(int faceSize, const void* const faces[6], bool srgb,
+                  int numSamples = 64);
+
+    /**
+     * Uploads all levels of all faces with glTexImage2D() into the texture
+     * bound to GL_TEXTURE_CUBE_MAP.
+     */
+    void Upload() const;
+
+    /** Returns the number of levels, including level 0. */
+    int GetNumLevels() const { return m_numLevels; }
+
+    /** Returns the width (and height) of the faces of a level. */
+    int GetLevelSize(int level) const
+    {
+        int size = m_faceSize >> level;
+        return (size > 0) ? size : 1;
+    }
+
+    /** Returns the roughness a level has been filtered for. */
+    float GetRoughness(int level) const
+    {
+        return (m_numLevels > 1) ? ((float)level / (m_numLevels - 1)) : 0.0;
+    }
+
+    /** Returns the RGBA8 pixels of a face of a level. */
+    const uint8_t* GetFaceData(int level, int face) const
+    {
+        return &m_faces[level * 6 + face][0];
+    }
+
+private: // Data
+    // Face images by level and face
+    std::vector<std::vector<uint8_t> > m_faces;
+
+    int m_faceSize;
+    int m_numLevels;
+};
+
+/**
+ * Creates a OpenGL Cube texture holding the levels of a
+ * PrefilteredCubeMap, with trilinear filtering.
+ *
+ * @param texture this will hold a valid texture id on success
+ * @return true on success
+ */
+bool CreatePrefilteredCubeTexture(int faceSize, const void* const faces[6],
+                                  bool srgb, GLuint* texture);
+
+#endif // CUBEMAPFILTER_H
@@ -0,0 +1,131 @@
+#ifndef DYNAMICTEXTURE_H
+#define DYNAMICTEXTURE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+
+#include "OpenGLAPI.h"
+#include "GLResources.h"
+#include "TextureFormat.h"
+#include "Rect.h"
+
+/**
+ * A 2D texture whose contents change often, eg. video frames, dynamic
+ * charts or procedurally updated maps. Its storage is allocated once;
+ * changes are written into a shadow copy and the changed regions (dirty
+ * rectangles, merged as they come) are uploaded once per frame by Flush()
+ * with glTexSubImage2D().
+ *
+ * With more than one buffer, each buffer is a texture object of its own:
+ * Flush() brings the least recently used one up to date and makes it the
+ * one GetTexture() returns, so a texture is never written while draws
+ * issued in the previous frame(s) may still be sampling it.
+ *
+ * Update() may be called on any thread; the other methods must be called
+ * on the GL thread.
+ */
+class DynamicTexture
+{
+public: // Construction and destruction
+    DynamicTexture();
+    virtual ~DynamicTexture();
+
+public: // Public API
+    /**
+     * Allocates the textures and the (zeroed) shadow copy.
+     *
+     * @param width texture width (in pixels)
+     * @param height texture height (in pixels)
+     * @param format pixel format of the texture and of the updates
+     * @param numBuffers number of textures to rotate between; 1 to 3
+     * @param clamp if true, GL_CLAMP_TO_EDGE is set for both s, t
+     * @return true on success
+     */
+    bool Create(int width, int height,
+                TextureFormat format = TextureFormatRGBA8888,
+                int numBuffers = 2, bool clamp = true);
+
+    /** Releases the textures and the shadow copy. */
+    void Destroy();
+
+    /**
+     * Writes pixels into a rectangle of the texture; the change is visible
+     * after the next Flush(). Rows are in texture order (row 0 is t = 0).
+     *
+     * @param x left edge of the rectangle (in pixels)
+     * @param y first row of the rectangle
+     * @param width rectangle width (in pixels)
+     * @param height number of rows
+     * @param data pixels in the format of the texture
+     * @param pitch bytes between the starts of the rows of data; 0 if the
+     * rows are packed
+     */
+    void Update(int x, int y, int width, int height, const void* data,
+                size_t pitch = 0);
+
+    /**
+     * Uploads the changes the next buffer is missing into it and makes it
+     * current. Call once per frame, before drawing with the texture.
+     *
+     * Selects texture unit 0 and leaves the buffer bound to GL_TEXTURE_2D
+     * there; bindings cached by the caller (eg.
+     * WidgetContext::m_boundTexture) must be reset.
+     *
+     * @return true if anything was uploaded
+     */
+    bool Flush();
+
+    /** Returns the texture to draw with. */
+    TextureHandle GetTexture() const { return m_textures[m_currentBuffer]; }
+
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    TextureFormat GetFormat() const { return m_format; }
+    int GetNumBuffers() const { return m_numBuffers; }
+
+    /**
+     * Returns the current contents of the texture, including changes not
+     * flushed yet; rows are in texture order and packed.
+     */
+    const void* GetData() const { return m_shadow.data(); }
+
+    /** Returns the number of bytes uploaded by the last Flush(). */
+    size_t GetNumBytesUploaded() const { return m_numBytesUploaded; }
+
+private:
+    void AddDirtyRect(std::vector<CommonGL::Rect>& dirtyRects,
+                      CommonGL::Rect rect);
+    void UploadRect(const CommonGL::Rect& rect, GLenum glFormat,
+                    GLenum glType);
+
+private: // Data
+    static const int MaxBuffers = 3;
+
+    TextureHandle m_textures[MaxBuffers];
+
+    // Regions each buffer has not received yet
+    std::vector<CommonGL::Rect> m_dirtyRects[MaxBuffers];
+
+    // Current contents of the texture
+    std::vector<uint8_t> m_shadow;
+
+    // Rows of a rectangle packed for upload, when the driver cannot
+    // read them directly from the shadow copy
+    std::vector<uint8_t> m_staging;
+
+    int m_width;
+    int m_height;
+    TextureFormat m_format;
+    int m_pixelSize;
+    int m_numBuffers;
+    int m_currentBuffer;
+    bool m_hasUnpackRowLength;
+    size_t m_numBytesUploaded;
+
+    // Guards the shadow copy and the dirty rectangles
+    std::mutex m_mutex;
+};
+
+#endif // DYNAMICTEXTURE_H
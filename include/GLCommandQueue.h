@@ -0,0 +1,146 @@
+#ifndef GLCOMMANDQUEUE_H
+#define GLCOMMANDQUEUE_H
+
+#include <stdlib.h>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+
+#include "OpenGLAPI.h"
+#include "GLResources.h"
+
+/**
+ * A unit of work to be executed on the GL thread. Commands are allocated by
+ * the enqueuing thread and deleted by the queue after execution.
+ */
+class GLCommand
+{
+public:
+    GLCommand() : m_next(NULL) {}
+    virtual ~GLCommand() {}
+
+    /** Performs the command; called on the GL thread. */
+    virtual void Execute() = 0;
+
+private:
+    // Intrusive queue link
+    std::atomic<GLCommand*> m_next;
+
+    friend class GLCommandQueue;
+};
+
+/** Command executing a function and delivering its result to a future. */
+template <typename R>
+class GLFunctionCommand : public GLCommand
+{
+public:
+    GLFunctionCommand(const std::function<R()>& function)
+        : m_task(function) {}
+
+    std::future<R> GetFuture() { return m_task.get_future(); }
+
+    virtual void Execute() { m_task(); }
+
+private:
+    std::packaged_task<R()> m_task;
+};
+
+/**
+ * Multiple producer, single consumer lock-free queue of GL commands. Any
+ * thread may enqueue commands; the GL thread executes them by calling
+ * Drain(), typically once per frame through GLController::BeginFrame().
+ *
+ * The implementation is the intrusive MPSC node queue by Dmitry Vyukov;
+ * enqueuing is a single atomic exchange and never blocks.
+ */
+class GLCommandQueue
+{
+public: // Construction and destruction
+    GLCommandQueue();
+    virtual ~GLCommandQueue();
+
+public: // Public API
+    /** Enqueues a command; the queue takes ownership. Thread safe. */
+    void Enqueue(GLCommand* command);
+
+    /**
+     * Enqueues a function to be run on the GL thread.
+     *
+     * @return future for the function's return value
+     */
+    template <typename R>
+    std::future<R> Enqueue(const std::function<R()>& function)
+    {
+        GLFunctionCommand<R>* command = new GLFunctionCommand<R>(function);
+        std::future<R> future = command->GetFuture();
+        Enqueue(command);
+        return future;
+    }
+
+    /**
+     * Enqueues a callable, eg. a lambda, to be run on the GL thread.
+     *
+     * @return future for the callable's return value
+     */
+    template <typename F>
+    auto Enqueue(F function) -> std::future<decltype(function())>
+    {
+        return Enqueue(std::function<decltype(function())()>(function));
+    }
+
+    /**
+     * Enqueues creation of a buffer object and upload of its data. The
+     * data is copied, so the caller's buffer may be freed immediately.
+     */
+    std::future<BufferHandle> UploadBuffer(GLenum target, const void* data,
+                                           size_t size, GLenum usage);
+
+    /**
+     * Enqueues creation of a 2D RGBA texture; see Create2DTexture(). The
+     * queue takes ownership of the pixel data which must have been
+     * allocated with malloc().
+     */
+    std::future<TextureHandle> CreateTexture(int width, int height,
+                                             void* pixels, bool clamp,
+                                             bool useMipmaps);
+
+    /** Enqueues compiling and linking a shader program from sources. */
+    std::future<ProgramHandle> LoadShader(const char* vertexShaderSource,
+                                          const char* fragmentShaderSource);
+
+    /**
+     * Executes queued commands until the queue is empty or the time budget
+     * runs out. At least one command is executed if any are queued. Must be
+     * called on the GL thread.
+     *
+     * @param budgetMillis time budget in milliseconds; negative for no limit
+     * @return number of executed commands
+     */
+    int Drain(float budgetMillis);
+
+    /**
+     * Whether there are no commands to execute. Commands being enqueued
+     * concurrently count as queued. Must be called on the GL thread.
+     */
+    bool IsEmpty() const;
+
+private:
+    // Placeholder node that keeps the queue non-empty
+    class StubCommand : public GLCommand
+    {
+    public:
+        virtual void Execute() {}
+    };
+
+    GLCommand* Dequeue();
+
+private: // Data
+    // Producers push at the head, consumer pops at the tail
+    std::atomic<GLCommand*> m_head;
+    GLCommand* m_tail;
+    StubCommand m_stub;
+};
+
+#endif // GLCOMMANDQUEUE_H
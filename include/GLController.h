@@ -7,10 +7,18 @@
 // include OpenGL API
 #include "OpenGLAPI.h"
 
+#include "GLResources.h"
+#include "GLCommandQueue.h"
+#include "AsyncTextureLoader.h"
+#include "RenderTargetPool.h"
 #include "Rect.h"
+#include "TimeSample.h"
 #include "BaseWidget.h"
+#include "WidgetBatch.h"
+#include "WidgetGrid.h"
 
 // Forward declarations
+class BaseAnimation;
 
 /**
  * This class provides some generic OpenGL related functionality.
@@ -35,9 +43,89 @@ public:
     /** Inheriting classes must call when OpenGL viewport is resized */
     virtual void ViewportResized(int width, int height);
 
-    /** Draws the widgets; should be called by implementing class. */
+    /**
+     * Draws the widgets; should be called by implementing class. The
+     * widgets are drawn from a batch that is only rebuilt when they change.
+     */
     virtual void DrawWidgets();
 
+    /**
+     * Marks the widgets changed, so that they are redrawn from a rebuilt
+     * batch along with the renderings of cached containers; eg. after
+     * defragmenting a TextureAtlas the widgets use.
+     */
+    void InvalidateWidgets();
+
+    /**
+     * Re-indexes a widget for hit testing after its bounds or visibility
+     * changed, along with any added widgets within it; called by
+     * BaseWidget::Invalidate().
+     */
+    void WidgetChanged(CommonGL::BaseWidget* widget);
+
+    /** Marks the whole view to be redrawn. */
+    void Invalidate();
+
+    /**
+     * Marks an area of the view to be redrawn. Changes to the widgets mark
+     * their areas automatically.
+     *
+     * @param rect area in viewport coordinates, 0,0 being upper left
+     */
+    void Invalidate(const CommonGL::Rect& rect);
+
+    /**
+     * Registers an animation (or a SimpleTimer) whose progress requires
+     * frames to be drawn; see NeedsRedraw(). The controller neither
+     * animates nor owns it.
+     */
+    void AddAnimation(BaseAnimation* animation);
+
+    /** Unregisters an animation. */
+    void RemoveAnimation(BaseAnimation* animation);
+
+    /**
+     * Whether a frame should be drawn now: part of the view has been
+     * invalidated, a registered animation is active, a timer is due, or
+     * there are queued commands or textures to upload. When it returns
+     * false the host loop may sleep for GetRedrawDelay(), or until input
+     * arrives.
+     */
+    bool NeedsRedraw();
+
+    /**
+     * Returns the time until a frame needs to be drawn, in seconds; 0 if
+     * NeedsRedraw(), negative if nothing is scheduled.
+     */
+    float GetRedrawDelay();
+
+    /**
+     * Sets whether frames are drawn only within the invalidated area, by
+     * scissoring the default framebuffer to the bounding rectangle of the
+     * area in BeginFrame(). Frames without invalidated areas, eg. those
+     * drawn for animations, are not restricted. Requires the contents of
+     * the framebuffer to be preserved between frames, and the application
+     * to Invalidate() whatever it changes other than widgets. Off by
+     * default.
+     */
+    void SetPartialRedraw(bool enabled) { m_partialRedraw = enabled; }
+
+    /**
+     * Starts a frame; executes commands queued from other threads within
+     * the command time budget and uploads asynchronously loaded textures
+     * within their budget. Takes the invalidated area for the frame,
+     * scissoring to it for partial redraws. Should be called by
+     * implementing class at the beginning of Draw().
+     */
+    virtual void BeginFrame();
+
+    /**
+     * Finishes a frame; flushes deferred OpenGL object deletions and ends
+     * the frame of the render target pool. Should be called by
+     * implementing class after each frame has been drawn.
+     */
+    virtual void EndFrame();
+
     /** Request a redraw. */
     virtual void Redraw() = 0;
 
@@ -90,10 +178,44 @@ public:
     /** Removes a widget. */
     virtual void Remove(CommonGL::BaseWidget* widget);
 
+    /**
+     * Returns the queue for running GL commands from other threads, eg.
+     * uploading resources loaded by worker threads.
+     */
+    GLCommandQueue& GetCommandQueue() { return m_commandQueue; }
+
+    /**
+     * Returns the loader for loading textures without blocking; its uploads
+     * are made in BeginFrame().
+     */
+    AsyncTextureLoader& GetTextureLoader() { return m_textureLoader; }
+
+    /**
+     * Returns the pool of render targets shared by the widgets (see
+     * Container::SetCached()) and the application; its memory budget
+     * limits the cached renderings of the widgets. Its EndFrame() is
+     * called by EndFrame().
+     */
+    RenderTargetPool& GetRenderTargetPool() { return m_renderTargetPool; }
+
+    /**
+     * Sets the time budget per frame for executing queued commands in
+     * BeginFrame().
+     *
+     * @param milliseconds time budget; negative for no limit
+     */
+    void SetCommandBudget(float milliseconds)
+    {
+        m_commandBudget = milliseconds;
+    }
+
 protected:
     virtual bool InitWidgets();
     virtual void DeinitWidgets();
     CommonGL::BaseWidget* FindWidget(int x, int y);
+    void SetPressedWidget(CommonGL::BaseWidget* widget);
+    void InvalidateWidget(const CommonGL::BaseWidget* widget);
+    void UpdateWidget(CommonGL::BaseWidget* widget);
 
 protected:
     // Whether to automatically init widget system in InitController()
@@ -108,6 +230,7 @@ protected:
     int m_viewportWidth;
     int m_viewportHeight;
     GLuint m_fullscreenRectVertexBuffer;
+    BufferHandle m_fullscreenRectVertexBufferHandle;
     CommonGL::Rect m_fullScreenRect;
 
     // Whether depth textures are supported
@@ -122,11 +245,42 @@ protected:
     // List of added widgets
     std::list<CommonGL::BaseWidget*> m_widgets;
 
+    // Render targets, eg. for the cached renderings of the widgets
+    RenderTargetPool m_renderTargetPool;
+
+    // Retained vertex data of the widgets
+    CommonGL::WidgetBatch m_widgetBatch;
+
+    // Screen bounds of the widgets for hit testing
+    CommonGL::WidgetGrid m_widgetGrid;
+
     // id of the default frame buffer
     GLuint m_defaultFrameBuffer;
 
     // Orthographic projection matrix
     float m_orthoProjectionMatrix[16];
+
+    // Commands from other threads, and time budget (ms) per frame for them
+    GLCommandQueue m_commandQueue;
+    float m_commandBudget;
+
+    // Asynchronous texture loads
+    AsyncTextureLoader m_textureLoader;
+
+    // Area invalidated since the last frame began; m_damageRect is its
+    // bounding rectangle unless the whole view is invalidated
+    bool m_damaged;
+    bool m_fullDamage;
+    CommonGL::Rect m_damageRect;
+
+    // Animations requiring frames, and when the last frame began
+    std::list<BaseAnimation*> m_animations;
+    TimeSample m_frameTime;
+
+    // Whether to scissor frames to the invalidated area, and whether the
+    // current frame is scissored
+    bool m_partialRedraw;
+    bool m_scissored;
 };
 
 #endif // GLCONTROLLER_H
@@ -0,0 +1,174 @@
+#ifndef GLRESOURCES_H
+#define GLRESOURCES_H
+
+#include <stdint.h>
+#include <vector>
+#include <list>
+#include <mutex>
+
+#include "OpenGLAPI.h"
+
+/** Types of OpenGL objects managed by GLResourceRegistry. */
+enum GLResourceType
+{
+    ResourceTypeBuffer = 0,
+    ResourceTypeTexture,
+    ResourceTypeProgram,
+    NumResourceTypes
+};
+
+/**
+ * Typed, generational handle to an OpenGL object owned by the
+ * GLResourceRegistry. The handle value packs a slot index (low 20 bits,
+ * offset by one so that zero is the null handle) and the generation of
+ * the slot (high 12 bits). Once the resource has been released, the slot
+ * generation changes and any old copies of the handle become stale.
+ */
+template <GLResourceType Type>
+struct GLResourceHandle
+{
+    GLResourceHandle() : m_value(0) {}
+    explicit GLResourceHandle(uint32_t value) : m_value(value) {}
+
+    /** Returns true if this is the null handle. */
+    bool IsNull() const { return (m_value == 0); }
+
+    bool operator==(const GLResourceHandle& other) const
+    {
+        return (m_value == other.m_value);
+    }
+
+    bool operator!=(const GLResourceHandle& other) const
+    {
+        return (m_value != other.m_value);
+    }
+
+    uint32_t m_value;
+};
+
+typedef GLResourceHandle<ResourceTypeBuffer> BufferHandle;
+typedef GLResourceHandle<ResourceTypeTexture> TextureHandle;
+typedef GLResourceHandle<ResourceTypeProgram> ProgramHandle;
+
+/**
+ * Owns OpenGL buffer, texture and program objects and hands out generational
+ * handles to them. Releasing a handle does not delete the GL object
+ * immediately; the deletion is queued and performed in batches by
+ * FlushDeletions() once the GPU is known to be done with the frame (using a
+ * fence where available). Handles may be released from any thread, while
+ * creating and flushing must happen on the GL thread.
+ */
+class GLResourceRegistry
+{
+public: // Construction and destruction
+    GLResourceRegistry();
+    virtual ~GLResourceRegistry();
+
+public: // Public API
+    /** Creates a new buffer object (glGenBuffers()) and returns its handle. */
+    BufferHandle CreateBuffer();
+
+    /** Creates a new texture object (glGenTextures()); returns its handle. */
+    TextureHandle CreateTexture();
+
+    /**
+     * Takes ownership of existing GL objects; eg. ones created by
+     * LoadShader() or Create2DTexture().
+     */
+    BufferHandle AdoptBuffer(GLuint buffer);
+    TextureHandle AdoptTexture(GLuint texture);
+    ProgramHandle AdoptProgram(GLuint program);
+
+    /**
+     * Returns the GL object id for a handle, or 0 if the handle is null or
+     * stale. Stale handles are asserted on in debug builds.
+     */
+    GLuint Get(BufferHandle handle) const;
+    GLuint Get(TextureHandle handle) const;
+    GLuint Get(ProgramHandle handle) const;
+
+    /** Checks whether a handle refers to a live resource. */
+    bool IsValid(BufferHandle handle) const;
+    bool IsValid(TextureHandle handle) const;
+    bool IsValid(ProgramHandle handle) const;
+
+    /**
+     * Releases the resource referred to by the handle and sets the handle
+     * to null. The GL object is queued for deletion. Can be called from
+     * any thread.
+     */
+    void Release(BufferHandle* handle);
+    void Release(TextureHandle* handle);
+    void Release(ProgramHandle* handle);
+
+    /**
+     * Swaps the GL object behind a live handle, eg. to replace a placeholder
+     * texture with its final contents; the previous object is queued for
+     * deletion and existing copies of the handle stay valid.
+     *
+     * @return false if the handle is null or stale, in which case the
+     * caller still owns the new object
+     */
+    bool Replace(BufferHandle handle, GLuint buffer);
+    bool Replace(TextureHandle handle, GLuint texture);
+
+    /**
+     * Deletes queued GL objects whose frame the GPU has finished with. Must
+     * be called on the GL thread once per frame, after all drawing.
+     */
+    void FlushDeletions();
+
+    /**
+     * Deletes all queued GL objects immediately, without waiting for the GPU;
+     * to be used when tearing down the GL context.
+     */
+    void FlushAllDeletions();
+
+    /** Returns the number of GL objects waiting for deletion. */
+    size_t GetNumPendingDeletions() const;
+
+private:
+    struct Slot
+    {
+        GLuint m_id;
+        uint16_t m_generation;
+        bool m_inUse;
+    };
+
+    // GL objects released during a single frame
+    struct RetiredBatch
+    {
+        std::vector<GLuint> m_ids[NumResourceTypes];
+        unsigned int m_frame;
+#ifdef HAVE_GL_FENCE_SYNC
+        GLsync m_fence;
+#endif
+    };
+
+    uint32_t Allocate(GLResourceType type, GLuint id);
+    const Slot* FindSlot(GLResourceType type, uint32_t value) const;
+    GLuint Lookup(GLResourceType type, uint32_t value) const;
+    bool IsLive(GLResourceType type, uint32_t value) const;
+    void Free(GLResourceType type, uint32_t* value);
+    bool Rebind(GLResourceType type, uint32_t value, GLuint id);
+    bool IsBatchComplete(RetiredBatch& batch) const;
+    void DeleteBatch(RetiredBatch& batch);
+
+private: // Data
+    std::vector<Slot> m_slots[NumResourceTypes];
+    std::vector<uint32_t> m_freeSlots[NumResourceTypes];
+
+    // Objects released during the current frame
+    std::vector<GLuint> m_released[NumResourceTypes];
+
+    // Earlier frames' released objects waiting for the GPU
+    std::list<RetiredBatch> m_retired;
+
+    unsigned int m_frameCounter;
+    mutable std::mutex m_mutex;
+};
+
+// The global resource registry
+extern GLResourceRegistry g_resourceRegistry;
+
+#endif // GLRESOURCES_H
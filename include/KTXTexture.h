@@ -0,0 +1,149 @@
+#ifndef KTXTEXTURE_H
+#define KTXTEXTURE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+
+#include "OpenGLAPI.h"
+#include "GLResources.h"
+#include "BundleFileView.h"
+
+/** One image (mip level of a face) of a KTX texture. */
+struct KTXImage
+{
+    const uint8_t* m_data;
+    size_t m_size;
+    int m_width;
+    int m_height;
+};
+
+/**
+ * A texture in a KTX (version 1) or KTX2 container, holding a complete
+ * mip chain of a 2D texture or a cube map, usually in a compressed format
+ * (ETC1/ETC2, DXT/S3TC, ASTC). KTX2 files may be zstd supercompressed when
+ * building with __USE_ZSTD__; Basis Universal files are not supported.
+ *
+ * The images are uploaded as they are stored, so the files must have
+ * their first row at the bottom like the rest of the library's textures
+ * (eg. 'toktx --lower_left_maps_to_s0t0'); compressed blocks cannot be
+ * flipped at load time.
+ */
+class KTXTexture
+{
+public: // Construction and destruction
+    KTXTexture();
+    virtual ~KTXTexture();
+
+public: // Public API
+    /**
+     * Maps and parses a KTX file from the bundle.
+     *
+     * @return true on success
+     */
+    bool Load(const char* fileName);
+
+    /**
+     * Parses a KTX file in memory. The data is not copied and must remain
+     * valid as long as this object is used.
+     *
+     * @return true on success
+     */
+    bool Parse(const void* data, size_t size);
+
+    /**
+     * Whether the texture can be uploaded in the current context, either
+     * as it is or decoded on the CPU.
+     */
+    bool CanUpload() const;
+
+    /**
+     * Whether the driver supports the format of the texture, so that it
+     * uploads without decoding.
+     */
+    bool IsFormatSupported() const;
+
+    /**
+     * Uploads the texture into a new texture object. Compressed formats
+     * the driver does not support are decoded on the CPU into RGB565
+     * (opaque formats) or RGBA8 where possible.
+     *
+     * @param texture this will hold a valid texture id on success
+     * @param clamp if true, GL_CLAMP_TO_EDGE is set for both s, t
+     * @param useMipmaps whether to use mipmaps; the ones in the file are
+     * used and any missing ones generated if the format allows
+     * @return true on success
+     */
+    bool Upload(GLuint* texture, bool clamp, bool useMipmaps) const;
+
+    /** Returns an image; face is 0 for 2D textures. */
+    const KTXImage& GetImage(int level, int face) const
+    {
+        return m_images[level * m_numFaces + face];
+    }
+
+    /** Returns the OpenGL internal format, eg. GL_ETC1_RGB8_OES. */
+    GLenum GetInternalFormat() const { return m_internalFormat; }
+
+    /** Whether the format is a compressed one. */
+    bool IsCompressed() const { return (m_type == 0); }
+
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    int GetNumLevels() const { return m_numLevels; }
+    int GetNumFaces() const { return m_numFaces; }
+
+private:
+    void Clear();
+    bool ParseData(const uint8_t* data, size_t size);
+    bool ParseKTX1(const uint8_t* data, size_t size);
+    bool ParseKTX2(const uint8_t* data, size_t size);
+    bool AddImage(int level, const uint8_t* data, size_t size);
+    bool AddLevel(int level, const uint8_t* data, size_t size);
+
+private: // Data
+    BundleFileView m_file;
+
+    // Decompressed levels of supercompressed KTX2 files
+    std::vector<uint8_t> m_inflated;
+
+    // Images by level and face
+    std::vector<KTXImage> m_images;
+
+    GLenum m_internalFormat;
+
+    // Format and type of uncompressed data; zero for compressed formats
+    GLenum m_format;
+    GLenum m_type;
+
+    int m_width;
+    int m_height;
+    int m_numLevels;
+    int m_numFaces;
+};
+
+/**
+ * Loads a KTX / KTX2 file into a OpenGL texture owned by the global
+ * resource registry; see KTXTexture::Upload().
+ *
+ * @param texture this will hold a valid texture handle on success
+ * @return true on success
+ */
+bool LoadKTXTextureFromBundle(const char* fileName, TextureHandle* texture,
+                              bool clamp, bool useMipmaps);
+
+/**
+ * Loads the best variant of a texture shipped in several compressed
+ * formats: <baseName>.astc, .etc2, .dxt and .etc1 with the extension .ktx2
+ * or .ktx, in this order of preference. The first variant the driver
+ * supports is used; if there is none, the first one that can be decoded on
+ * the CPU.
+ *
+ * @param texture this will hold a valid texture handle on success
+ * @return true on success
+ */
+bool LoadBestKTXTextureFromBundle(const char* baseName,
+                                  TextureHandle* texture, bool clamp,
+                                  bool useMipmaps);
+
+#endif // KTXTEXTURE_H
@@ -0,0 +1,171 @@
+#ifndef MIPMAPGENERATOR_H
+#define MIPMAPGENERATOR_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+
+#include "OpenGLAPI.h"
+
+/** Downsampling filters of MipmapChain. */
+enum MipmapFilter
+{
+    // 2x2 average; fastest
+    MipmapFilterBox = 0,
+
+    // Kaiser windowed sinc over 8x8 texels; sharper, less aliasing
+    MipmapFilterKaiser
+};
+
+/** How a mipmapped texture is generated and sampled. */
+struct MipmapSettings
+{
+    MipmapSettings()
+        : m_filter(MipmapFilterBox),
+          m_srgb(false),
+          m_trilinear(true),
+          m_maxAnisotropy(1.0) {}
+
+    MipmapFilter m_filter;
+
+    // Whether the color channels are sRGB encoded and should be filtered
+    // in linear light; alpha is always linear
+    bool m_srgb;
+
+    // GL_LINEAR_MIPMAP_LINEAR if true, GL_LINEAR_MIPMAP_NEAREST otherwise
+    bool m_trilinear;
+
+    // Anisotropic filtering level; used if the driver has
+    // EXT_texture_filter_anisotropic, and clamped to its maximum
+    float m_maxAnisotropy;
+};
+
+/**
+ * Lookup tables for converting RGBA8 colors to floats and back, shared by
+ * the CPU image filters. Built once, on first use.
+ */
+struct ColorTables
+{
+    // Resolution of the linear to sRGB table
+    static const int LinearToSrgbTableSize = 4096;
+
+    ColorTables();
+
+    /** Returns the tables; can be called on any thread. */
+    static const ColorTables& Get();
+
+    /**
+     * Encodes a value, clamped to [0, 1], as a byte; sRGB encoded if srgb
+     * is true, otherwise linearly.
+     */
+    uint8_t Encode(float value, bool srgb) const
+    {
+        value = (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+        if ( srgb )
+        {
+            return m_linearToSrgb[
+                    (int)(value * (LinearToSrgbTableSize - 1) + 0.5f)];
+        }
+        return (uint8_t)(value * 255.0f + 0.5f);
+    }
+
+    // Bytes as [0, 1] floats, as is and sRGB decoded to linear
+    float m_byteToFloat[256];
+    float m_srgbToLinear[256];
+
+    uint8_t m_linearToSrgb[LinearToSrgbTableSize];
+};
+
+/**
+ * A full mip chain of an RGBA8 image, generated on the CPU instead of with
+ * glGenerateMipmap(), which is slow on some drivers and stalls the GL
+ * thread. The rows of each level are filtered in parallel on g_threadPool;
+ * the 8-bit box filter uses SSE2 / NEON where available.
+ *
+ * All levels are stored one after another in a single buffer, so the chain
+ * may be saved and restored as it is.
+ */
+class MipmapChain
+{
+public: // Construction and destruction
+    MipmapChain();
+    virtual ~MipmapChain();
+
+public: // Public API
+    /**
+     * Generates the mip chain of an image, down to 1x1. Can be called on
+     * any thread.
+     *
+     * @param data RGBA8 pixels of level 0
+     * @param width image width (in pixels)
+     * @param height image height (in pixels)
+     * @param filter downsampling filter
+     * @param srgb whether to filter the color channels in linear light
+     * @param wrap whether the image repeats, ie. whether the filter wraps
+     * around at the edges instead of clamping
+     */
+    void Generate(const void* data, int width, int height,
+                  MipmapFilter filter, bool srgb, bool wrap);
+
+    /**
+     * Uploads every level with glTexImage2D() into the texture bound to a
+     * target (eg. GL_TEXTURE_2D or a cube map face).
+     */
+    void Upload(GLenum target) const;
+
+    /** Returns the number of levels, including level 0. */
+    int GetNumLevels() const { return (int)m_levels.size(); }
+
+    /** Returns the pixels of a level. */
+    const uint8_t* GetLevelData(int level) const
+    {
+        return &m_data[0] + m_levels[level].m_offset;
+    }
+
+    int GetLevelWidth(int level) const { return m_levels[level].m_width; }
+    int GetLevelHeight(int level) const { return m_levels[level].m_height; }
+
+    /** Returns all levels as a single buffer, level 0 first. */
+    const uint8_t* GetData() const { return &m_data[0]; }
+    size_t GetDataSize() const { return m_data.size(); }
+
+    /**
+     * Sets the chain from a buffer returned by GetData() for an image of
+     * the given size.
+     *
+     * @return false if the buffer size does not match
+     */
+    bool SetData(const void* data, size_t size, int width, int height);
+
+    /** Returns the number of levels in a full chain for an image size. */
+    static int CountLevels(int width, int height);
+
+private:
+    struct Level
+    {
+        size_t m_offset;
+        int m_width;
+        int m_height;
+    };
+
+    void SetupLevels(int width, int height);
+
+private: // Data
+    std::vector<uint8_t> m_data;
+    std::vector<Level> m_levels;
+};
+
+/**
+ * Creates a 2D OpenGL texture with a mip chain generated on the CPU, as
+ * Create2DTexture() does with glGenerateMipmap().
+ *
+ * @param data RGBA8 texture data
+ * @param texture this will hold a valid texture id on success
+ * @param clamp if true, GL_CLAMP_TO_EDGE is set for both s, t
+ * @return true on success
+ */
+bool CreateMipmapped2DTexture(int width, int height, const void* data,
+                              GLuint* texture, bool clamp,
+                              const MipmapSettings& settings);
+
+#endif // MIPMAPGENERATOR_H
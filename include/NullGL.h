@@ -0,0 +1,97 @@
+#ifndef NULLGL_H
+#define NULLGL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+//
+// Recording / null OpenGL ES 2.0 backend. Selected by building with
+// __BUILD_NULLGL__ defined (see OpenGLAPI.h); the GLES2 headers then only
+// provide the types, constants and prototypes while NullGL.cpp implements
+// the entry points used by the library as stubs that draw nothing. The stubs
+// count the calls per entry point and the amount of data uploaded, and may
+// write the command stream into a file, so the CPU cost, call counts and
+// upload volumes of the library can be measured without a GPU.
+//
+
+// Entry points implemented by the null backend
+#define NULLGL_ENTRY_POINTS(X) \
+    X(glActiveTexture) X(glAttachShader) X(glBindAttribLocation) \
+    X(glBindBuffer) X(glBindFramebuffer) X(glBindRenderbuffer) \
+    X(glBindTexture) X(glBlendFunc) X(glBlendFuncSeparate) \
+    X(glBufferData) X(glBufferSubData) \
+    X(glCheckFramebufferStatus) X(glClear) X(glClearColor) \
+    X(glClearDepthf) X(glClearStencil) X(glColorMask) X(glCompileShader) \
+    X(glCompressedTexImage2D) X(glCreateProgram) X(glCreateShader) \
+    X(glCullFace) X(glDeleteBuffers) X(glDeleteFramebuffers) \
+    X(glDeleteProgram) X(glDeleteRenderbuffers) X(glDeleteShader) \
+    X(glDeleteTextures) X(glDepthFunc) X(glDepthMask) X(glDisable) \
+    X(glDisableVertexAttribArray) X(glDrawArrays) X(glDrawElements) \
+    X(glEnable) X(glEnableVertexAttribArray) X(glFinish) X(glFlush) \
+    X(glFramebufferRenderbuffer) X(glFramebufferTexture2D) \
+    X(glGenBuffers) X(glGenFramebuffers) X(glGenRenderbuffers) \
+    X(glGenTextures) X(glGenerateMipmap) X(glGetAttachedShaders) \
+    X(glGetError) X(glGetFloatv) X(glGetIntegerv) X(glGetProgramInfoLog) \
+    X(glGetProgramiv) X(glGetShaderInfoLog) X(glGetShaderiv) \
+    X(glGetString) X(glGetUniformLocation) X(glLinkProgram) \
+    X(glPixelStorei) X(glReadPixels) X(glRenderbufferStorage) \
+    X(glScissor) X(glShaderSource) X(glTexImage2D) X(glTexParameterf) \
+    X(glTexParameteri) X(glTexSubImage2D) X(glUniform1f) X(glUniform1i) \
+    X(glUniform3fv) X(glUniform4fv) X(glUniformMatrix4fv) \
+    X(glUseProgram) X(glVertexAttribPointer) X(glViewport)
+
+#define NULLGL_ENUM_ENTRY(name) NullGL_##name,
+
+/** Identifiers of the entry points implemented by the null backend. */
+enum NullGLEntryPoint
+{
+    NULLGL_ENTRY_POINTS(NULLGL_ENUM_ENTRY)
+    NumNullGLEntryPoints
+};
+
+#undef NULLGL_ENUM_ENTRY
+
+/** Statistics collected by the null backend. */
+struct NullGLStats
+{
+    // Number of calls per entry point
+    uint64_t m_calls[NumNullGLEntryPoints];
+    uint64_t m_totalCalls;
+
+    // Bytes uploaded with glBufferData() / glBufferSubData()
+    uint64_t m_bufferBytesUploaded;
+
+    // Bytes uploaded with glTexImage2D() / glTexSubImage2D() /
+    // glCompressedTexImage2D()
+    uint64_t m_textureBytesUploaded;
+
+    // Number of draw calls and vertices / indices submitted with them
+    uint64_t m_drawCalls;
+    uint64_t m_verticesDrawn;
+};
+
+/** Returns the statistics collected since the last reset. */
+const NullGLStats& NullGLGetStats();
+
+/** Clears the collected statistics. */
+void NullGLResetStats();
+
+/** Returns the name of an entry point, eg. "glDrawElements". */
+const char* NullGLEntryPointName(int entryPoint);
+
+/**
+ * Sets a stream into which every call is written as a line of text;
+ * NULL (the default) disables recording.
+ */
+void NullGLSetRecordStream(FILE* stream);
+
+/** Writes the non-zero call counts and upload volumes into a stream. */
+void NullGLPrintStats(FILE* stream);
+
+/**
+ * Sets the string returned by glGetString(GL_EXTENSIONS); by default the
+ * extensions the library looks for are reported as present.
+ */
+void NullGLSetExtensions(const char* extensions);
+
+#endif // NULLGL_H
@@ -1,7 +1,12 @@
 #ifndef OPENGLAPI_H
 #define OPENGLAPI_H
 
-#if defined(QT_OPENGL_LIB)
+#if defined(__BUILD_NULLGL__)
+  // Recording stub backend for headless benchmarking; see NullGL.h
+  #include <GLES2/gl2.h>
+  #include <GLES2/gl2ext.h>
+  #include "NullGL.h"
+#elif defined(QT_OPENGL_LIB)
   #if defined(__USE_QTOPENGL__)
     #include <QtOpenGL> // Use Qt OpenGL - for Qt Quick/QQuickItem
   #else
@@ -16,6 +21,10 @@
 #elif defined(__BUILD_IOS__)
   #import <OpenGLES/ES2/gl.h>
   #import <OpenGLES/ES2/glext.h>
+#elif defined(__BUILD_LINUX__)
+  // Headless Linux; context from EGL or OSMesa, see CommonFunctionsLinux.cpp
+  #include <GLES2/gl2.h>
+  #include <GLES2/gl2ext.h>
 #elif defined(__TIZEN__)
   #include <egl.h>
   #include <eglext.h>
@@ -37,6 +46,55 @@
   #endif
 #endif
 
+// Compressed texture formats; not all headers define them
+#ifndef GL_ETC1_RGB8_OES
+  #define GL_ETC1_RGB8_OES 0x8D64
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+  #define GL_COMPRESSED_RGB8_ETC2 0x9274
+  #define GL_COMPRESSED_SRGB8_ETC2 0x9275
+  #define GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2 0x9276
+  #define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+  #define GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC 0x9279
+#endif
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+  #define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+  #define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+  #define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+  #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+  #define GL_COMPRESSED_RGBA_ASTC_4x4_KHR 0x93B0
+  #define GL_COMPRESSED_RGBA_ASTC_6x6_KHR 0x93B4
+  #define GL_COMPRESSED_RGBA_ASTC_8x8_KHR 0x93B7
+  #define GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR 0x93D0
+#endif
+
+// Anisotropic filtering (EXT_texture_filter_anisotropic)
+#ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
+  #define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+  #define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
+#endif
+
+// Unpack row length (OpenGL ES 3.0 / EXT_unpack_subimage)
+#ifndef GL_UNPACK_ROW_LENGTH
+  #define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+
+// Mip level range of a texture (OpenGL ES 3.0)
+#ifndef GL_TEXTURE_BASE_LEVEL
+  #define GL_TEXTURE_BASE_LEVEL 0x813C
+  #define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
+
+// Fence sync objects (OpenGL ES 3.0 / desktop GL 3.2 / ARB_sync); when not
+// available, GPU completion is approximated by frame latency
+#if defined(GL_SYNC_GPU_COMMANDS_COMPLETE) && !defined(__BUILD_IOS__)
+  #define HAVE_GL_FENCE_SYNC
+#endif
+
 #define _SFY(x) #x
 #define STRINGIFY(x) _SFY(x)
 
@@ -57,6 +115,21 @@ static const char* const DepthTextureExtension = "OES_depth_texture";
 // Packed depth / stencil buffer extension
 static const char* const PackedDepthStencilExtension = "OES_packed_depth_stencil";
 
+// Compressed texture format extensions
+static const char* const ETC1TextureExtension =
+        "OES_compressed_ETC1_RGB8_texture";
+static const char* const S3TCTextureExtension =
+        "EXT_texture_compression_s3tc";
+static const char* const ASTCTextureExtension =
+        "KHR_texture_compression_astc_ldr";
+
+// Anisotropic texture filtering extension
+static const char* const AnisotropicFilteringExtension =
+        "EXT_texture_filter_anisotropic";
+
+// Sub-image unpacking (GL_UNPACK_ROW_LENGTH) extension
+static const char* const UnpackSubimageExtension = "EXT_unpack_subimage";
+
 /** Indices to bind different OpenGL vertex attributes to. */
 enum AttribIndex
 {
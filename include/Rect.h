@@ -41,7 +41,7 @@ public: // Public API
     void SetCentered(int centerX, int centerY, int width, int height);
 
     /** Detects if the given coordinates are inside the rect. */
-    bool IsInside(int x, int y);
+    bool IsInside(int x, int y) const;
 
     int GetWidth() const { return m_right - m_left; }
     int GetHeight() const { return m_bottom - m_top; }
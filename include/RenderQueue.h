@@ -0,0 +1,140 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "OpenGLAPI.h"
+
+// Forward declarations
+struct RenderCommand;
+
+/**
+ * Called for a command after its program, texture and buffers have been
+ * bound and before it is drawn; use to set up per-draw uniforms.
+ */
+typedef void (*RenderCommandCallback)(const RenderCommand& command,
+                                      void* userData);
+
+/** Vertex data layouts understood by RenderQueue. */
+enum RenderVertexFormat
+{
+    VertexFormatCoordsOnly = 0, // VertexAttribsCoordsOnly
+    VertexFormatTexCoords,      // VertexAttribsTexCoords
+    VertexFormatFull,           // VertexAttribs
+    VertexFormatTangent         // VertexAttribsTangent
+};
+
+/**
+ * A single draw call. This is a POD type; fill it in and pass it to
+ * RenderQueue::Submit(). If m_indexBuffer is 0, the command is drawn with
+ * glDrawArrays(), otherwise with glDrawElements() using GL_UNSIGNED_SHORT
+ * indices.
+ */
+struct RenderCommand
+{
+    // Sort key; see RenderQueue::MakeSortKey()
+    uint64_t m_sortKey;
+
+    // OpenGL state
+    GLuint m_program;
+    GLuint m_texture;
+    GLuint m_vertexBuffer;
+    GLuint m_indexBuffer;
+    int m_vertexFormat;
+    bool m_translucent;
+
+    // Draw call parameters; m_first is the first vertex, or the first index
+    // when drawing indexed
+    GLenum m_primitive;
+    GLint m_first;
+    GLsizei m_count;
+
+    // Optional uniform setup callback
+    RenderCommandCallback m_callback;
+    void* m_userData;
+};
+
+/** State change statistics for a single RenderQueue::Execute(). */
+struct RenderQueueStats
+{
+    int m_numDraws;
+    int m_programChanges;
+    int m_textureChanges;
+    int m_vertexBufferChanges;
+    int m_indexBufferChanges;
+    int m_blendChanges;
+};
+
+/**
+ * Collects draw commands during a frame, sorts them by their 64-bit sort
+ * keys and executes them with the minimum amount of OpenGL state changes.
+ * Opaque commands are drawn front-to-back, grouped by program, texture and
+ * vertex buffer; translucent ones are drawn back-to-front after them.
+ *
+ * The sort key layout (MSB first) is:
+ *
+ *   opaque:      layer:4 | 0:1 | program:9 | texture:14 | vbo:12 | depth:24
+ *   translucent: layer:4 | 1:1 | ~depth:24 | program:9 | texture:14 | vbo:12
+ *
+ * Object ids wider than their fields only affect grouping, not correctness.
+ */
+class RenderQueue
+{
+public: // Construction and destruction
+    RenderQueue(size_t initialCapacity = 1024);
+    virtual ~RenderQueue();
+
+public: // Public API
+    /**
+     * Creates a sort key.
+     *
+     * @param layer render layer 0..15; lower layers are drawn first
+     * @param translucent whether the draw needs blending
+     * @param depth normalized view depth of the object, 0.0 (near) .. 1.0
+     */
+    static uint64_t MakeSortKey(int layer, bool translucent, GLuint program,
+                                GLuint texture, GLuint vertexBuffer,
+                                float depth);
+
+    /**
+     * Adds a command to the queue; the command is copied. Commands with an
+     * unknown vertex format are dropped.
+     */
+    void Submit(const RenderCommand& command);
+
+    /** Sorts the queued commands by their sort keys. */
+    void Sort();
+
+    /**
+     * Sorts and draws all the queued commands, then clears the queue.
+     * Statistics for the executed commands are available through GetStats().
+     */
+    void Execute();
+
+    /** Removes all queued commands without drawing them. */
+    void Clear();
+
+    /** Returns the number of queued commands. */
+    size_t GetNumCommands() const { return m_commands.size(); }
+
+    /** Returns the statistics of the latest Execute(). */
+    const RenderQueueStats& GetStats() const { return m_stats; }
+
+private:
+    void SetVertexFormat(int vertexFormat);
+
+private: // Data
+    std::vector<RenderCommand> m_commands;
+
+    // Sort keys and the command indices, and scratch space for sorting
+    std::vector<uint64_t> m_keys;
+    std::vector<uint32_t> m_order;
+    std::vector<uint64_t> m_keyScratch;
+    std::vector<uint32_t> m_orderScratch;
+    bool m_sorted;
+
+    RenderQueueStats m_stats;
+};
+
+#endif // RENDERQUEUE_H
@@ -0,0 +1,186 @@
+#ifndef RENDERTARGETPOOL_H
+#define RENDERTARGETPOOL_H
+
+#include <stdlib.h>
+#include <list>
+#include <vector>
+
+#include "OpenGLAPI.h"
+
+/** Color attachment formats for render targets. */
+enum RenderTargetColorFormat
+{
+    ColorFormatNone = 0,
+    ColorFormatRGBA8888,
+    ColorFormatRGB565
+};
+
+/** Depth / stencil attachment formats for render targets. */
+enum RenderTargetDepthFormat
+{
+    DepthFormatNone = 0,
+    DepthFormatRenderbuffer16,  // 16-bit depth renderbuffer
+    DepthFormatTexture,         // depth texture; needs OES_depth_texture
+    DepthFormatDepth24Stencil8  // needs OES_packed_depth_stencil
+};
+
+/** Describes the size and attachments of a render target. */
+struct RenderTargetDesc
+{
+    int m_width;
+    int m_height;
+    int m_colorFormat;
+    int m_depthFormat;
+
+    bool operator==(const RenderTargetDesc& other) const
+    {
+        return ( (m_width == other.m_width) &&
+                 (m_height == other.m_height) &&
+                 (m_colorFormat == other.m_colorFormat) &&
+                 (m_depthFormat == other.m_depthFormat) );
+    }
+};
+
+/** A framebuffer object with its attachments, owned by RenderTargetPool. */
+struct RenderTarget
+{
+    RenderTargetDesc m_desc;
+    GLuint m_framebuffer;
+    GLuint m_colorTexture;
+    GLuint m_depthTexture;
+    GLuint m_depthRenderbuffer;
+
+    // Approximate amount of GPU memory held by the attachments
+    size_t m_sizeInBytes;
+
+    // Pool bookkeeping
+    bool m_inUse;
+    unsigned int m_lastUsedFrame;
+};
+
+/**
+ * Recycles framebuffer objects and their attachments. Targets are handed out
+ * by Acquire() keyed by their RenderTargetDesc and returned with Release();
+ * targets that have not been used for a number of frames are deleted.
+ *
+ * In addition, per-frame passes may be declared along with the transient
+ * targets they use; Compile() then assigns the same physical target to
+ * transient targets with identical descriptions and non-overlapping pass
+ * ranges, so eg. the targets of consecutive post-processing passes can
+ * share memory:
+ *
+ *   int shadowPass = pool.AddPass();
+ *   int blurPass = pool.AddPass();
+ *   int shadow = pool.DeclareTransient(shadowDesc, shadowPass, blurPass);
+ *   ...
+ *   pool.Compile();
+ *   RenderTarget* target = pool.GetTransient(shadow);
+ *   ...
+ *   pool.EndFrame();
+ *
+ * All methods must be called on the GL thread.
+ */
+class RenderTargetPool
+{
+public: // Construction and destruction
+    /**
+     * @param maxUnusedFrames number of frames an unused target is kept
+     * around before deleting it
+     */
+    RenderTargetPool(unsigned int maxUnusedFrames = 3);
+    virtual ~RenderTargetPool();
+
+public: // Public API
+    /**
+     * Returns a render target matching the description, creating one if no
+     * unused one exists. If creating it would exceed the memory budget,
+     * unused targets are deleted first, longest unused first, until it
+     * fits.
+     *
+     * @return the target or NULL on failure or if it does not fit in the
+     * budget
+     */
+    RenderTarget* Acquire(const RenderTargetDesc& desc);
+
+    /** Returns a render target to the pool. */
+    void Release(RenderTarget* target);
+
+    /** Declares the next pass of this frame; returns the pass index. */
+    int AddPass();
+
+    /**
+     * Declares a transient render target used from pass firstPass to
+     * lastPass (inclusive) in this frame.
+     *
+     * @return the transient target id
+     */
+    int DeclareTransient(const RenderTargetDesc& desc,
+                         int firstPass, int lastPass);
+
+    /**
+     * Assigns physical render targets to the transient targets declared
+     * for this frame.
+     *
+     * @return true on success
+     */
+    bool Compile();
+
+    /** Returns the physical target for a transient target id. */
+    RenderTarget* GetTransient(int transientId);
+
+    /**
+     * Ends the frame; releases this frame's transient targets, clears the
+     * pass declarations and deletes targets that have been unused too long.
+     */
+    void EndFrame();
+
+    /** Deletes all targets not currently in use. */
+    void Purge();
+
+    /** Returns the amount of GPU memory currently held by the pool. */
+    size_t GetCurrentMemory() const { return m_currentMemory; }
+
+    /** Returns the largest amount of GPU memory held by the pool. */
+    size_t GetPeakMemory() const { return m_peakMemory; }
+
+    /** Returns the number of render targets held by the pool. */
+    size_t GetNumTargets() const { return m_targets.size(); }
+
+    /**
+     * Sets the most GPU memory the pool may hold; 0 (the default) for no
+     * limit. Targets already held are kept even if over the budget.
+     */
+    void SetBudget(size_t budgetBytes) { m_budget = budgetBytes; }
+
+    /** Returns the GPU memory needed by a target of a description. */
+    static size_t GetTargetSize(const RenderTargetDesc& desc);
+
+private:
+    struct TransientTarget
+    {
+        RenderTargetDesc m_desc;
+        int m_firstPass;
+        int m_lastPass;
+        RenderTarget* m_target;
+    };
+
+    RenderTarget* CreateTarget(const RenderTargetDesc& desc);
+    bool MakeRoom(size_t size);
+    void DeleteTarget(RenderTarget* target);
+
+private: // Data
+    std::list<RenderTarget*> m_targets;
+    std::vector<TransientTarget> m_transients;
+
+    // Physical targets backing this frame's transient targets
+    std::vector<RenderTarget*> m_frameTargets;
+
+    int m_numPasses;
+    unsigned int m_frame;
+    unsigned int m_maxUnusedFrames;
+    size_t m_currentMemory;
+    size_t m_peakMemory;
+    size_t m_budget;
+};
+
+#endif // RENDERTARGETPOOL_H
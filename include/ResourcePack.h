@@ -0,0 +1,208 @@
+#ifndef RESOURCEPACK_H
+#define RESOURCEPACK_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <memory>
+
+#include "BundleFileView.h"
+
+//
+// Resource pack file format, written by tools/mkpack.py. All values are
+// little endian:
+//
+//   ResourcePackHeader
+//   entry data, each entry starting at a 64 byte aligned offset
+//   ResourcePackEntry[numEntries], sorted by (nameHash, name)
+//   name table; names are not zero terminated
+//
+// Entry names are bundle file names (paths relative to the packed
+// directory, '/' separated) and are hashed with 32-bit FNV-1a.
+//
+
+/** Compression methods of pack entries. */
+enum ResourcePackCompression
+{
+    PackCompressionNone = 0,
+    PackCompressionLZ4 = 1,  // LZ4 block format
+    PackCompressionZstd = 2  // zstd frame; needs a build with __USE_ZSTD__
+};
+
+/** Pack file header. */
+struct ResourcePackHeader
+{
+    char m_magic[8];  // "CGLPACK\0"
+    uint32_t m_version;
+    uint32_t m_numEntries;
+    uint64_t m_indexOffset;
+    uint64_t m_namesOffset;
+    uint32_t m_namesSize;
+    uint32_t m_reserved[7];
+};
+
+/** Index entry of a packed file. */
+struct ResourcePackEntry
+{
+    uint64_t m_dataOffset;
+    uint32_t m_storedSize;  // size in the pack
+    uint32_t m_size;        // size after decompression
+    uint32_t m_nameHash;
+    uint32_t m_nameOffset;  // offset into the name table
+    uint16_t m_nameLength;
+    uint8_t m_compression;
+    uint8_t m_reserved[5];
+};
+
+/** One file of a ResourcePack::ReadBatch() request. */
+struct ResourcePackRequest
+{
+    // File to read
+    const char* m_name;
+
+    // Caller's buffer for the file contents and its size in bytes
+    void* m_buffer;
+    size_t m_bufferSize;
+
+    // Set by ReadBatch()
+    bool m_success;
+};
+
+/**
+ * Read access to a resource pack: many small resource files stored in a
+ * single file with an index, so that a lookup costs a binary search instead
+ * of a file system operation. The pack itself is mapped with
+ * MapBundleFile() and entries are decompressed on demand into caller
+ * supplied buffers.
+ *
+ * Packs are usually mounted with MountResourcePack(), after which
+ * ReadBundleFile() and MapBundleFile() find the files in them before
+ * looking at the platform's file system.
+ */
+class ResourcePack
+{
+public: // Construction and destruction
+    ResourcePack();
+    virtual ~ResourcePack();
+
+public: // Public API
+    /**
+     * Opens and validates a pack.
+     *
+     * @param fileName name of the pack as a bundle file
+     * @return true on success
+     */
+    bool Open(const char* fileName);
+
+    /** Returns the entry for a file name, or NULL if the pack has none. */
+    const ResourcePackEntry* Find(const char* name) const;
+
+    /**
+     * Decompresses an entry into a buffer.
+     *
+     * @param bufferSize must be at least entry->m_size
+     * @return true on success
+     */
+    bool Read(const ResourcePackEntry* entry, void* buffer,
+              size_t bufferSize) const;
+
+    /**
+     * Reads a file into a newly allocated buffer; the semantics match
+     * ReadBundleFile().
+     */
+    bool Read(const char* name, bool zeropad, size_t* size,
+              void** buffer) const;
+
+    /**
+     * Reads a file into a view; uncompressed entries are referenced in
+     * place when no zero padding is asked for, and then remain valid only
+     * as long as the pack is open. See also the shared pack version, whose
+     * views keep the pack open.
+     */
+    bool Map(const char* name, bool zeropad, BundleFileView* view) const;
+
+    /**
+     * Reads a file of a shared pack into a view like Map(); a view
+     * referencing the pack in place holds a reference to the pack, so it
+     * stays valid after the pack is unmounted or otherwise let go of.
+     */
+    static bool Map(const std::shared_ptr<ResourcePack>& pack,
+                    const char* name, bool zeropad, BundleFileView* view);
+
+    /**
+     * Reads a batch of files into caller supplied buffers, decompressing
+     * them in parallel on g_threadPool.
+     *
+     * @return number of files read successfully
+     */
+    int ReadBatch(ResourcePackRequest* requests, int count) const;
+
+    /** Returns the number of files in the pack. */
+    int GetNumEntries() const { return m_numEntries; }
+
+    /** Returns the bundle file name the pack was opened from. */
+    const std::string& GetFileName() const { return m_fileName; }
+
+    /** Computes the 32-bit FNV-1a hash used for entry names. */
+    static uint32_t HashName(const char* name, size_t length);
+
+private:
+    static void ReleasePack(const void* data, size_t size, void* context);
+
+private: // Data
+    std::string m_fileName;
+    BundleFileView m_file;
+    const uint8_t* m_data;
+    const ResourcePackEntry* m_entries;
+    const char* m_names;
+    int m_numEntries;
+};
+
+/**
+ * Opens a pack and adds it to the packs searched by ReadBundleFile() and
+ * MapBundleFile(); packs mounted later take precedence.
+ *
+ * @return true on success
+ */
+bool MountResourcePack(const char* fileName);
+
+/**
+ * Unmounts all resource packs. Views mapped from them remain valid; a pack
+ * is closed once the last of its views is released.
+ */
+void UnmountResourcePacks();
+
+/** Whether any of the mounted packs has a file. */
+bool ResourcePackHasFile(const char* fileName);
+
+/**
+ * Looks up a file in the mounted packs; used by the GetBundleFileInfo()
+ * implementations.
+ *
+ * @param size where the (uncompressed) file size is stored
+ * @param packFileName where the bundle file name of the pack holding the
+ * file is stored
+ * @return true if a mounted pack has the file
+ */
+bool FindResourcePackFile(const char* fileName, size_t* size,
+                          std::string* packFileName);
+
+/**
+ * Reads a file from the mounted packs; used by the ReadBundleFile()
+ * implementations.
+ *
+ * @return true if a mounted pack has the file and it was read successfully
+ */
+bool ReadResourcePackFile(const char* fileName, bool zeropad,
+                          size_t* size, void** buffer);
+
+/**
+ * Maps a file from the mounted packs; used by the MapBundleFile()
+ * implementations.
+ *
+ * @return true if a mounted pack has the file and it was read successfully
+ */
+bool MapResourcePackFile(const char* fileName, bool zeropad,
+                         BundleFileView* view);
+
+#endif // RESOURCEPACK_H
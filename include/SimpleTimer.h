@@ -44,6 +44,9 @@ public: // From BaseAnimation
     virtual bool Animate(const TimeSample& time);
     virtual bool HasCompleted(const TimeSample& time) const;
 
+    /** The timer only needs a frame when the next signal is due. */
+    virtual float TimeUntilNextUpdate(const TimeSample& time) const;
+
 private: // Data
     int m_timerId;
     bool m_repeat;
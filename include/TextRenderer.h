@@ -4,6 +4,7 @@
 #include <stdlib.h>
 
 #include "OpenGLAPI.h"
+#include "GLResources.h"
 
 /** Describes a renderable character. */
 struct AlphabetCharInfo
@@ -104,7 +105,7 @@ protected: // Data
 
     // OpenGL resources
     GLuint m_indexBuffer;
-    GLuint m_fontTextureAtlas;
+    TextureHandle m_fontTextureAtlas;
     GLuint m_textProgram;
     GLuint m_textProgramTextureLoc;
     GLuint m_textProgramMvpLoc;
@@ -116,7 +117,7 @@ protected: // Data
     
     // Character construct for rendering 
     //VertexAttribsTexCoords m_textVertices[4];
-    GLuint m_vertexBuffer;
+    BufferHandle m_vertexBuffer;
     VertexAttribsTexCoords* m_textVertices;
     size_t m_textVerticesCapacityInChars;
 };
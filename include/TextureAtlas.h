@@ -0,0 +1,172 @@
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "OpenGLAPI.h"
+#include "DynamicTexture.h"
+
+/** An image packed into a TextureAtlas. */
+struct AtlasRegion
+{
+    AtlasRegion()
+        : m_page(-1),
+          m_x(0),
+          m_y(0),
+          m_width(0),
+          m_height(0),
+          m_u1(0.0),
+          m_v1(0.0),
+          m_u2(0.0),
+          m_v2(0.0) {}
+
+    /** Whether the region holds an image. */
+    bool IsValid() const { return (m_page >= 0); }
+
+    // Index of the page the image is on
+    int m_page;
+
+    // Position and size of the image on the page (in pixels); rows are in
+    // texture order
+    int m_x;
+    int m_y;
+    int m_width;
+    int m_height;
+
+    // Texture coordinates of the upper left (u1, v1) and lower right
+    // (u2, v2) corners of the image, as taken by DrawImage2D()
+    float m_u1;
+    float m_v1;
+    float m_u2;
+    float m_v2;
+};
+
+/**
+ * Packs images into a few large textures (pages) at runtime, so that UI
+ * elements using different images can be drawn without switching
+ * textures. Images are placed with a skyline packer, each surrounded by a
+ * gutter of its edge pixels repeated so that neither bilinear filtering nor
+ * mipmapping bleeds neighbouring images into it.
+ *
+ * Images can be added at any time; the changed parts of the pages are
+ * uploaded by Upload(). Removing an image does not free its space on the
+ * page until Defragment() repacks the remaining images.
+ *
+ * The regions returned by the atlas stay at the same addresses for as long
+ * as the image is in the atlas, so they may be referenced directly (see
+ * Button); only their contents change when the atlas is defragmented.
+ * All methods must be called on the GL thread.
+ */
+class TextureAtlas
+{
+public: // Construction and destruction
+    /**
+     * Constructs an empty atlas.
+     *
+     * @param pageSize width and height of the pages (in pixels)
+     * @param padding width of the gutter around each image (in pixels)
+     * @param useMipmaps whether the pages are mipmapped; images are then
+     * placed on 4 pixel boundaries so the first mip levels keep them apart
+     */
+    TextureAtlas(int pageSize = 1024, int padding = 2,
+                 bool useMipmaps = false);
+    virtual ~TextureAtlas();
+
+public: // Public API
+    /**
+     * Adds an image, replacing any image of the same name.
+     *
+     * @param name name to refer to the image by
+     * @param width image width (in pixels)
+     * @param height image height (in pixels)
+     * @param data RGBA8 pixels, rows ordered bottom-up as OpenGL expects
+     * @return the region of the image, or NULL if it does not fit on a page;
+     * an existing image of the name is then kept
+     */
+    const AtlasRegion* Add(const char* name, int width, int height,
+                           const void* data);
+
+    /**
+     * Loads a named image file into the atlas, by the name of the file.
+     *
+     * @return the region of the image, or NULL if it could not be loaded
+     * or does not fit on a page
+     */
+    const AtlasRegion* AddImage(const char* imageName);
+
+    /** Removes an image; its region becomes invalid. */
+    void Remove(const char* name);
+
+    /** Returns the region of an image, or NULL if there is no such image. */
+    const AtlasRegion* Find(const char* name) const;
+
+    /**
+     * Uploads the changes to the pages; call before drawing with them, eg.
+     * once per frame. Selects texture unit 0 and changes its GL_TEXTURE_2D
+     * binding, so call it outside WidgetBatch::Draw() or reset
+     * WidgetContext::m_boundTexture afterwards.
+     */
+    void Upload();
+
+    /**
+     * Repacks all images, largest first, onto as few pages as possible,
+     * reclaiming the space of removed images. Updates the regions in place.
+     */
+    void Defragment();
+
+    /** Removes all images and releases the pages. */
+    void Clear();
+
+    /** Returns the texture of a page; 0 if there is no such page. */
+    GLuint GetTexture(int page) const;
+
+    int GetNumPages() const { return (int)m_pages.size(); }
+    int GetPageSize() const { return m_pageSize; }
+
+    /** Returns the share of the page area used by images and gutters. */
+    float GetOccupancy() const;
+
+private:
+    // A horizontal span of the top edge of the packed area of a page
+    struct SkylineNode
+    {
+        int m_x;
+        int m_y;
+        int m_width;
+    };
+
+    struct Page
+    {
+        DynamicTexture* m_texture;
+        std::vector<SkylineNode> m_skyline;
+        size_t m_usedArea;
+    };
+
+    typedef std::map<std::string, AtlasRegion> RegionMap;
+
+    Page* CreatePage();
+    bool FindPosition(const Page& page, int width, int height, int* x,
+                      int* y) const;
+    void Allocate(Page& page, int x, int y, int width, int height);
+    int GetBlockSize(int size) const;
+    void FreeArea(const AtlasRegion& region);
+    bool Place(AtlasRegion* region, int width, int height, const void* data);
+    void ReleasePages(std::vector<Page*>& pages);
+
+private: // Data
+    std::vector<Page*> m_pages;
+    RegionMap m_regions;
+    int m_pageSize;
+    int m_padding;
+    int m_alignment;
+    bool m_useMipmaps;
+
+    // Pixels of an image and its gutter, passed to the page
+    std::vector<uint32_t> m_block;
+};
+
+#endif // TEXTUREATLAS_H
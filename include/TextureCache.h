@@ -0,0 +1,153 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <map>
+
+#include "OpenGLAPI.h"
+#include "GLResources.h"
+#include "TextureFormat.h"
+
+/** Counters of a TextureCache. */
+struct TextureCacheStats
+{
+    // Number of Acquire() calls served from the cache / loaded
+    unsigned int m_hits;
+    unsigned int m_misses;
+
+    // Number of textures evicted to stay within the budget
+    unsigned int m_evictions;
+
+    // Number of resident textures, and how many of them are referenced
+    int m_numTextures;
+    int m_numReferenced;
+
+    // Estimated texture memory of the resident textures, including mips
+    size_t m_residentBytes;
+    size_t m_budgetBytes;
+
+    /** Returns the share of Acquire() calls served from the cache. */
+    float GetHitRate() const
+    {
+        unsigned int total = m_hits + m_misses;
+        return (total > 0) ? ((float)m_hits / total) : 0.0;
+    }
+};
+
+/**
+ * Shares textures loaded from the bundle by image name, so that loading
+ * the same image again returns the texture already loaded. Textures are
+ * reference counted; unreferenced ones stay resident for reuse until the
+ * estimated texture memory exceeds the budget, after which the least
+ * recently used of them are evicted.
+ *
+ * The budget defaults to 1/8 of the physical RAM (see
+ * DefaultTextureBudget()).
+ * All methods must be called on the GL thread.
+ */
+class TextureCache
+{
+public: // Construction and destruction
+    /**
+     * Constructs the cache.
+     *
+     * @param budgetBytes texture memory budget; 0 for the default
+     */
+    TextureCache(size_t budgetBytes = 0);
+    virtual ~TextureCache();
+
+public: // Public API
+    /**
+     * Returns the texture of an image, loading it if not resident, and adds
+     * a reference to it. The same image in another format or with other
+     * parameters is a separate texture.
+     *
+     * @param imageName image (file) name to load
+     * @param clamp if true, GL_CLAMP_TO_EDGE is set for both s, t
+     * @param useMipmaps whether to generate mipmaps
+     * @param format format to store the texture in
+     * @return handle to the texture owned by the cache, or a null handle if
+     * loading failed. Must be given back with Release(), not released into
+     * g_resourceRegistry.
+     */
+    TextureHandle Acquire(const char* imageName, bool clamp, bool useMipmaps,
+                          TextureFormat format = TextureFormatRGBA8888);
+
+    /**
+     * Drops a reference acquired with Acquire() and sets the handle to
+     * null. The texture stays resident until evicted.
+     */
+    void Release(TextureHandle* handle);
+
+    /**
+     * Evicts unreferenced textures, least recently used first, until the
+     * resident textures fit within a number of bytes.
+     */
+    void Trim(size_t targetBytes);
+
+    /** Evicts all unreferenced textures, eg. on a low memory warning. */
+    void Purge() { Trim(0); }
+
+    /**
+     * Releases all textures, referenced or not; to be used when tearing
+     * down the GL context. Existing handles become stale.
+     */
+    void Clear();
+
+    /** Sets the budget and evicts down to it; 0 for the default. */
+    void SetBudget(size_t budgetBytes);
+
+    size_t GetBudget() const { return m_budgetBytes; }
+
+    /** Returns the counters and residency of the cache. */
+    TextureCacheStats GetStats() const;
+
+    /** Resets the hit, miss and eviction counters. */
+    void ResetStats();
+
+    /**
+     * Returns the estimated texture memory of an image of a format,
+     * including the mip chain if any.
+     */
+    static size_t EstimateSize(int width, int height, TextureFormat format,
+                               bool useMipmaps);
+
+private:
+    struct Entry
+    {
+        std::string m_key;
+        TextureHandle m_texture;
+        size_t m_size;
+        int m_refCount;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    static std::string MakeKey(const char* imageName, bool clamp,
+                               bool useMipmaps, TextureFormat format);
+    void Evict(EntryList::iterator iter);
+
+private: // Data
+    // Entries in the order of use, most recently used first
+    EntryList m_entries;
+
+    // Entries by key and by texture handle value
+    std::map<std::string, EntryList::iterator> m_entriesByKey;
+    std::map<uint32_t, EntryList::iterator> m_entriesByTexture;
+
+    size_t m_budgetBytes;
+    size_t m_residentBytes;
+    int m_numReferenced;
+
+    unsigned int m_hits;
+    unsigned int m_misses;
+    unsigned int m_evictions;
+};
+
+// The global texture cache
+extern TextureCache g_textureCache;
+
+#endif // TEXTURECACHE_H
@@ -0,0 +1,60 @@
+#ifndef TEXTURECOMPRESSION_H
+#define TEXTURECOMPRESSION_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "OpenGLAPI.h"
+
+/** Block layout of a compressed texture format. */
+struct CompressedFormatInfo
+{
+    // Block dimensions in texels and size in bytes
+    int m_blockWidth;
+    int m_blockHeight;
+    int m_blockSize;
+
+    // Whether the format has no alpha channel
+    bool m_opaque;
+
+    // Whether DecodeCompressedImage() can decode it
+    bool m_decodable;
+};
+
+/**
+ * Returns the block layout of a compressed internal format.
+ *
+ * @return false if the format is not known
+ */
+bool GetCompressedFormatInfo(GLenum internalFormat,
+                             CompressedFormatInfo* info);
+
+/** Returns the size of a compressed image in bytes. */
+size_t GetCompressedImageSize(GLenum internalFormat, int width, int height);
+
+/**
+ * Checks whether the current context can sample a compressed format, from
+ * the extension string, the context version (ETC2 is core in OpenGL ES 3.0)
+ * and GL_COMPRESSED_TEXTURE_FORMATS. The answer is cached per format, so
+ * this must be called with the same context current.
+ */
+bool CompressedFormatSupported(GLenum internalFormat);
+
+/**
+ * Decodes a compressed image on the CPU, for drivers that do not support
+ * the format. ETC1 and DXT1/3/5 (S3TC) are decodable; the rows stay in the
+ * order they are stored in.
+ *
+ * @param internalFormat compressed format of data
+ * @param width image width (in pixels)
+ * @param height image height (in pixels)
+ * @param toRGB565 if true, the output is RGB565 (2 bytes per pixel) and
+ * any alpha is dropped; otherwise it is RGBA8 (4 bytes per pixel)
+ * @param output output buffer of width * height pixels
+ * @return true on success
+ */
+bool DecodeCompressedImage(GLenum internalFormat, const void* data,
+                           size_t size, int width, int height, bool toRGB565,
+                           void* output);
+
+#endif // TEXTURECOMPRESSION_H
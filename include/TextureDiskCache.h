@@ -0,0 +1,149 @@
+#ifndef TEXTUREDISKCACHE_H
+#define TEXTUREDISKCACHE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include "OpenGLAPI.h"
+#include "GLResources.h"
+#include "TextureFormat.h"
+#include "BundleFileView.h"
+
+/**
+ * Header of a texture cache file. The header is followed by the source
+ * image name and, at m_dataOffset, the pixels of all mip levels one after
+ * another, level 0 first, with unpadded rows; ie. exactly what is handed
+ * to glTexImage2D(), so a mapped file is uploaded without copying.
+ */
+struct TextureCacheFileHeader
+{
+    char m_magic[8];  // "CGLTEXC\0"
+    uint32_t m_version;
+    uint32_t m_format;  // TextureFormat
+    uint32_t m_conversionFlags;
+    uint32_t m_numLevels;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint64_t m_sourceSize;
+    int64_t m_sourceModificationTime;
+    uint32_t m_nameLength;
+    uint32_t m_dataOffset;
+    uint64_t m_dataSize;
+};
+
+/**
+ * On-disk cache of decoded, converted texture data, so that images are
+ * decoded (and flipped, converted and mipmapped) only once rather than on
+ * every launch. Cache files are keyed by the image name and the
+ * conversion options, and are valid as long as the size and modification
+ * time of the source file match (see GetBundleFileInfo()).
+ *
+ * On a miss the image is decoded and uploaded as usual, and the cache
+ * file is written on g_threadPool; a hit maps the cache file and uploads
+ * straight from the mapping. Files are written under a temporary name and
+ * renamed into place, so an interrupted write never leaves a corrupt file.
+ *
+ * Load2DTexture() must be called on the GL thread.
+ */
+class TextureDiskCache
+{
+public: // Construction and destruction
+    TextureDiskCache();
+    virtual ~TextureDiskCache();
+
+public: // Public API
+    /**
+     * Loads a named image file into a OpenGL texture owned by the global
+     * resource registry, through the cache.
+     *
+     * @param imageName image (file) name to load
+     * @param texture this will hold a valid texture handle on success
+     * @param clamp if true, GL_CLAMP_TO_EDGE is set for both s, t
+     * @param useMipmaps whether to use mipmaps; these are generated on the
+     * CPU and cached with the image
+     * @param format format to store the texture in
+     * @param conversionFlags TextureConversionFlags; see
+     * LoadImageDataFromBundle()
+     * @return true on success
+     */
+    bool Load2DTexture(const char* imageName, TextureHandle* texture,
+                       bool clamp, bool useMipmaps,
+                       TextureFormat format = TextureFormatRGBA8888,
+                       int conversionFlags = 0);
+
+    /**
+     * Maps the cache file of an image, decoding the image and writing the
+     * file first (on the calling thread) if there is no valid one. If the
+     * cache is disabled or the file cannot be written, the view holds a
+     * heap copy instead. Either way the view starts with a
+     * TextureCacheFileHeader; see its description for the layout.
+     *
+     * @param imageName image (file) name to load
+     * @param useMipmaps whether to generate and include the mip chain
+     * @param format format of the pixel data
+     * @param conversionFlags TextureConversionFlags
+     * @param view this will hold the file contents on success
+     * @return true on success
+     */
+    bool Map(const char* imageName, bool useMipmaps, TextureFormat format,
+             int conversionFlags, BundleFileView* view);
+
+    /**
+     * Sets the directory of the cache files; defaults to
+     * GetCacheDirectory() as of constructing the cache (ie. static
+     * initialization for g_textureDiskCache). An empty path disables the
+     * cache. Not thread safe; to be called before the cache is used.
+     */
+    void SetDirectory(const char* path);
+
+    /** Waits until all queued cache files have been written. */
+    void WaitForWrites();
+
+    /** Deletes the cache file of an image, if any. */
+    void Remove(const char* imageName, bool useMipmaps, TextureFormat format,
+                int conversionFlags);
+
+    unsigned int GetNumHits() const { return m_numHits; }
+    unsigned int GetNumMisses() const { return m_numMisses; }
+    unsigned int GetNumWrites() const { return m_writeState->m_numWrites; }
+
+private:
+    // Bookkeeping of the cache file writes; shared with the queued writes,
+    // which may outlive the cache
+    struct WriteState
+    {
+        WriteState()
+            : m_numWrites(0),
+              m_numPendingWrites(0) {}
+
+        std::atomic<unsigned int> m_numWrites;
+
+        // Number of cache files being written
+        int m_numPendingWrites;
+        std::mutex m_mutex;
+        std::condition_variable m_writeCondition;
+    };
+
+    std::string GetFilePath(const char* imageName, bool useMipmaps,
+                            TextureFormat format, int conversionFlags);
+    static bool Write(const std::string& path,
+                      const std::vector<uint8_t>& data, WriteState& state);
+
+private: // Data
+    std::string m_directory;
+
+    std::atomic<unsigned int> m_numHits;
+    std::atomic<unsigned int> m_numMisses;
+    std::shared_ptr<WriteState> m_writeState;
+};
+
+// The global texture disk cache
+extern TextureDiskCache g_textureDiskCache;
+
+#endif // TEXTUREDISKCACHE_H
@@ -0,0 +1,70 @@
+#ifndef TEXTUREFORMAT_H
+#define TEXTUREFORMAT_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "OpenGLAPI.h"
+
+/** Uncompressed texture formats that RGBA8 image data can be stored in. */
+enum TextureFormat
+{
+    TextureFormatRGBA8888 = 0,  // 4 bytes per pixel
+    TextureFormatRGB888,        // 3 bytes; opaque
+    TextureFormatRGB565,        // 2 bytes; opaque
+    TextureFormatRGBA4444,      // 2 bytes
+    TextureFormatLA88,          // 2 bytes; luminance + alpha
+    TextureFormatL8,            // 1 byte; luminance (grayscale), opaque
+    TextureFormatA8             // 1 byte; alpha only, eg. a font atlas
+};
+
+/** Flags for ConvertTextureData(). */
+enum TextureConversionFlags
+{
+    // Multiply the color channels by alpha
+    ConvertPremultiply = 0x1,
+
+    // Apply a 4x4 ordered dither when reducing to RGB565 / RGBA4444,
+    // hiding the banding of smooth gradients
+    ConvertDither = 0x2,
+
+    // Reverse the order of the rows, eg. to turn a top-down decoded image
+    // into the bottom-up order of OpenGL
+    ConvertFlip = 0x4
+};
+
+/** Returns the size of a pixel of a format in bytes. */
+int GetTextureFormatPixelSize(TextureFormat format);
+
+/** Returns the glTexImage2D() format and type of a format. */
+void GetTextureFormatGL(TextureFormat format, GLenum* glFormat,
+                        GLenum* glType);
+
+/**
+ * Converts RGBA8 pixels into another format in a single pass, also
+ * premultiplying, dithering and flipping as requested. The common
+ * reductions (RGB565, RGBA4444, A8) use SSE2 / NEON where available.
+ *
+ * @param data RGBA8 pixels, width * height of them
+ * @param width image width (in pixels)
+ * @param height image height (in pixels)
+ * @param format target format
+ * @param flags TextureConversionFlags combined with |
+ * @param output output buffer of width * height pixels of the target
+ * format; the rows are not padded. May equal data unless flipping, as
+ * no format is larger than RGBA8.
+ */
+void ConvertTextureData(const void* data, int width, int height,
+                        TextureFormat format, int flags, void* output);
+
+/**
+ * Converts an RGBA8 image allocated with malloc() as ConvertTextureData()
+ * does; in place unless flipping, and then shrinks the buffer.
+ *
+ * @param data the image; replaced if a new buffer is needed
+ * @return false if out of memory
+ */
+bool ConvertTextureBuffer(void** data, int width, int height,
+                          TextureFormat format, int flags);
+
+#endif // TEXTUREFORMAT_H
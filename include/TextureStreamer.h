@@ -0,0 +1,189 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <map>
+
+#include "OpenGLAPI.h"
+#include "GLResources.h"
+#include "TextureFormat.h"
+#include "TextureDiskCache.h"
+
+class Camera;
+
+/**
+ * Keeps only the mip levels of textures that are actually needed resident.
+ * A streamed texture starts out with just its small levels; each frame the
+ * renderer reports the most detailed level each texture is drawn at (see
+ * EstimateLevel()) and Update() uploads the missing levels, one step per
+ * texture per frame, and drops the ones no longer needed.
+ *
+ * When the requested levels do not fit within the memory budget, textures
+ * not requested lately lose their detail first, then the largest levels of
+ * the rest, until they fit.
+ *
+ * The pixel data of all levels is kept in the texture's disk cache file
+ * (see TextureDiskCache::Map()), memory mapped, so levels are uploaded
+ * without decoding again and the data of dropped levels may be paged out.
+ *
+ * Where GL_TEXTURE_BASE_LEVEL is supported (OpenGL ES 3.0), levels are
+ * added and dropped in place; otherwise the texture is re-specified with
+ * the new levels and swapped in behind the same handle.
+ *
+ * All methods must be called on the GL thread.
+ */
+class TextureStreamer
+{
+public: // Construction and destruction
+    /**
+     * Constructs the streamer.
+     *
+     * @param budgetBytes texture memory budget; 0 for the default of 1/8
+     * of the physical RAM
+     */
+    TextureStreamer(size_t budgetBytes = 0);
+    virtual ~TextureStreamer();
+
+public: // Public API
+    /**
+     * Adds a streamed texture with its levels up to a size resident.
+     *
+     * @param imageName image (file) name to load
+     * @param clamp if true, GL_CLAMP_TO_EDGE is set for both s, t
+     * @param format format to store the texture in
+     * @param conversionFlags TextureConversionFlags; see
+     * LoadImageDataFromBundle()
+     * @param initialSize largest width / height of the levels resident
+     * from the start and never dropped
+     * @return handle to the texture owned by the streamer, or a null handle
+     * if loading failed. Must be given back with Remove().
+     */
+    TextureHandle Add(const char* imageName, bool clamp,
+                      TextureFormat format = TextureFormatRGBA8888,
+                      int conversionFlags = 0, int initialSize = 64);
+
+    /** Removes a streamed texture and sets the handle to null. */
+    void Remove(TextureHandle* texture);
+
+    /**
+     * Reports that a texture is drawn this frame at a mip level; the most
+     * detailed level reported during a frame is the one streamed in.
+     */
+    void RequestLevel(TextureHandle texture, int level);
+
+    /**
+     * Reports that a texture is drawn this frame on an object, at the level
+     * EstimateLevel() gives for its bounds.
+     */
+    void RequestLevel(TextureHandle texture, Camera* camera,
+                      const float* center, float radius, int viewportHeight);
+
+    /**
+     * Applies the requests of the frame: drops levels, then uploads missing
+     * ones up to the upload limit. Call once per frame, before drawing.
+     * Selects texture unit 0 and changes its GL_TEXTURE_2D binding.
+     */
+    void Update();
+
+    /**
+     * Forgets all textures, eg. when tearing down the GL context. Existing
+     * handles become stale.
+     */
+    void Clear();
+
+    /** Sets the budget and applies it on the next Update(). */
+    void SetBudget(size_t budgetBytes);
+
+    size_t GetBudget() const { return m_budgetBytes; }
+
+    /**
+     * Sets the number of bytes Update() uploads at most per frame, to keep
+     * streaming from causing frame drops; at least one upload is always
+     * made.
+     */
+    void SetMaxUploadBytes(size_t bytes) { m_maxUploadBytes = bytes; }
+
+    /** Returns the most detailed level of a texture that is resident. */
+    int GetResidentLevel(TextureHandle texture) const;
+
+    /** Returns the texture memory of the resident levels. */
+    size_t GetResidentBytes() const { return m_residentBytes; }
+
+    /** Returns the number of bytes uploaded by the last Update(). */
+    size_t GetNumBytesUploaded() const { return m_numBytesUploaded; }
+
+    /**
+     * Estimates the mip level a texture is sampled at when drawn on an
+     * object, assuming the texture spans the diameter of the object's
+     * bounding sphere once.
+     *
+     * @param textureSize largest width / height of the texture
+     * @param camera camera whose inverse camera matrix has been calculated
+     * @param center center of the bounding sphere (in world space), float[3]
+     * @param radius radius of the bounding sphere
+     * @param viewportHeight viewport height (in pixels)
+     * @return estimated level; 0 if the camera is within the bounds
+     */
+    static int EstimateLevel(int textureSize, Camera* camera,
+                             const float* center, float radius,
+                             int viewportHeight);
+
+private:
+    struct Entry
+    {
+        BundleFileView m_file;
+        const TextureCacheFileHeader* m_header;
+        TextureHandle m_texture;
+        bool m_clamp;
+        int m_numLevels;
+
+        // Offsets of the levels from the start of the pixel data, and the
+        // offset of the end of the data as the last item
+        std::vector<size_t> m_levelOffsets;
+
+        // Least detailed level streamed; the levels from it on are always
+        // resident
+        int m_minLevel;
+
+        // Most detailed resident level
+        int m_residentLevel;
+
+        // Level to stream towards
+        int m_targetLevel;
+
+        // Most detailed level requested this frame, or NoRequest
+        int m_requestedLevel;
+        unsigned int m_lastRequestFrame;
+    };
+
+    typedef std::map<uint32_t, Entry*> EntryMap;
+
+    Entry* FindEntry(TextureHandle texture) const;
+    size_t GetLevelsSize(const Entry* entry, int level) const;
+    void ApplyBudget();
+    void UploadLevel(const Entry* entry, int level, int glLevel);
+    bool Specify(Entry* entry, int level);
+    void SetResidentLevel(Entry* entry, int level);
+
+private: // Data
+    static const int NoRequest = 0x7fffffff;
+
+    EntryMap m_entries;
+
+    size_t m_budgetBytes;
+    size_t m_maxUploadBytes;
+    size_t m_residentBytes;
+    size_t m_numBytesUploaded;
+    unsigned int m_frame;
+
+    // Whether GL_TEXTURE_BASE_LEVEL is supported; checked on first use
+    bool m_hasBaseLevel;
+    bool m_capsChecked;
+};
+
+// The global texture streamer
+extern TextureStreamer g_textureStreamer;
+
+#endif // TEXTURESTREAMER_H
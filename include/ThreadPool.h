@@ -0,0 +1,77 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/**
+ * Fixed size pool of worker threads executing queued tasks in FIFO order.
+ * The threads are started on first use, so a pool may be a global object.
+ * Tasks must not touch OpenGL; results meant for the GL thread can be
+ * handed over through GLCommandQueue.
+ */
+class ThreadPool
+{
+public: // Construction and destruction
+    /**
+     * Constructs the pool.
+     *
+     * @param numThreads number of worker threads; 0 for the number of
+     * hardware threads (at least one)
+     */
+    ThreadPool(int numThreads = 0);
+    virtual ~ThreadPool();
+
+public: // Public API
+    /** Queues a task for execution. Thread safe. */
+    void Enqueue(const std::function<void()>& task);
+
+    /**
+     * Queues a function for execution. Thread safe.
+     *
+     * @return future for the function's return value
+     */
+    template <typename R>
+    std::future<R> Enqueue(const std::function<R()>& function)
+    {
+        std::shared_ptr<std::packaged_task<R()> > task =
+                std::make_shared<std::packaged_task<R()> >(function);
+        std::future<R> future = task->get_future();
+        Enqueue(std::function<void()>([task]() { (*task)(); }));
+        return future;
+    }
+
+    /**
+     * Calls function(i) for every i in [0, count) spread over the worker
+     * threads and returns when all calls have completed. The calling thread
+     * takes part, so this may also be called from a task.
+     */
+    void ParallelFor(int count, const std::function<void(int)>& function);
+
+    /** Returns the number of worker threads. */
+    int GetNumThreads() const { return m_numThreads; }
+
+private:
+    void Start();
+    void WorkerMain();
+
+private: // Data
+    int m_numThreads;
+    bool m_started;
+    bool m_stopping;
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()> > m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+};
+
+/** Shared pool for background work such as file decoding. */
+extern ThreadPool g_threadPool;
+
+#endif // THREADPOOL_H
@@ -2,6 +2,7 @@
 #define TORUS_H
 
 #include "OpenGLAPI.h"
+#include "GLResources.h"
 
 /**
  * Classic donut / torus model with configurable geometry. The torus is
@@ -36,8 +37,8 @@ private:
     
 private: // Data
     // vertex/index buffers
-    GLuint m_vertexBuffer;
-    GLuint m_indexBuffer;
+    BufferHandle m_vertexBuffer;
+    BufferHandle m_indexBuffer;
     
     int m_numIndices;
 };
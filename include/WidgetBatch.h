@@ -0,0 +1,176 @@
+#ifndef WIDGETBATCH_H
+#define WIDGETBATCH_H
+
+#include <list>
+#include <vector>
+#include <map>
+
+#include "OpenGLAPI.h"
+#include "GLResources.h"
+#include "RenderTargetPool.h"
+#include "BaseWidget.h"
+
+namespace CommonGL {
+
+// Forward declarations
+class Container;
+
+/**
+ * Retained renderer for the widgets of a GLController. The quads of all
+ * visible widgets are kept in a single vertex buffer, in drawing order,
+ * and consecutive quads drawn with the same program, texture and uniforms
+ * are drawn with a single call. The buffer is rebuilt only when the
+ * widgets change (see WidgetContext::m_widgetsChanged), the pressed widget
+ * changes or the viewport is resized; otherwise a frame costs a draw call
+ * per run of alike widgets and no uploads.
+ *
+ * Widgets that cannot describe themselves as a quad (see
+ * BaseWidget::GetQuad()) are drawn with their Render() in between.
+ *
+ * A cached container (see Container::SetCached()) is drawn along with the
+ * widgets within it into a render target of its size when the batch is
+ * rebuilt after any of them changed, and is then drawn as a single quad.
+ * Cached containers within a cached container are drawn as part of it.
+ *
+ * @author Matti Dahlbom
+ * @since 1.0
+ */
+class WidgetBatch
+{
+public: // Construction and destruction
+    WidgetBatch();
+    virtual ~WidgetBatch();
+
+public: // Public API
+    /**
+     * Rebuilds the batch if anything affecting it has changed.
+     *
+     * @param widgets top level widgets, topmost first
+     * @param context widget context
+     * @return true if the batch was rebuilt
+     */
+    bool Update(const std::list<BaseWidget*>& widgets,
+                WidgetContext* context);
+
+    /**
+     * Draws the batch.
+     *
+     * @param context widget context
+     * @param mvpMatrix orthographic projection for the widgets
+     */
+    void Draw(WidgetContext* context, const float* mvpMatrix);
+
+    /** Forces a rebuild on the next Update(). */
+    void Invalidate() { m_valid = false; }
+
+    /**
+     * Forces the renderings of all cached containers to be updated on the
+     * next Update(), along with a rebuild.
+     */
+    void InvalidateCaches();
+
+    /**
+     * Releases the buffers and the renderings of cached containers; to be
+     * used when the GL context goes away.
+     */
+    void Release();
+
+    /**
+     * Sets the pool the renderings of cached containers are allocated
+     * from. Without a pool, or if the pool's budget runs out, cached
+     * containers are drawn like any other.
+     */
+    void SetRenderTargetPool(RenderTargetPool* pool)
+    {
+        m_renderTargetPool = pool;
+    }
+
+    /** Returns the number of draw calls made by the last Draw(). */
+    int GetNumDrawCalls() const { return m_numDrawCalls; }
+
+    /** Returns the number of times the batch has been rebuilt. */
+    unsigned int GetNumBuilds() const { return m_numBuilds; }
+
+    /** Returns the number of times cached containers have been rendered. */
+    unsigned int GetNumCacheRenders() const { return m_numCacheRenders; }
+
+private:
+    // Consecutive alike quads, or a widget drawing itself
+    struct Run
+    {
+        BaseWidget* m_widget;
+        GLuint m_texture;
+        bool m_highlight;
+        bool m_premultiplied;
+        float m_color[4];
+        int m_firstQuad;
+        int m_numQuads;
+    };
+
+    // Rendering of a cached container and the widgets within it
+    struct Cache
+    {
+        WidgetBatch* m_batch;
+        RenderTarget* m_target;
+
+        // State the rendering was made with
+        BaseWidget* m_pressedWidget;
+        int m_viewportWidth;
+        int m_viewportHeight;
+
+        // Whether the rendering must be updated regardless of the above
+        bool m_dirty;
+
+        // Whether the container is still in the batch
+        bool m_used;
+    };
+
+    typedef std::map<const BaseWidget*, Cache> CacheMap;
+
+    void Build(const std::list<BaseWidget*>& widgets,
+               WidgetContext* context);
+    void AddQuad(const WidgetQuad& quad, bool highlight, bool premultiplied,
+                 const WidgetContext* context);
+    Container* FindCachedContainer(BaseWidget* widget) const;
+    void UpdateCaches(const std::list<BaseWidget*>& widgets,
+                      WidgetContext* context);
+    void UpdateCache(Container* container, Cache& cache,
+                     const std::list<BaseWidget*>& widgets,
+                     WidgetContext* context);
+    void RenderCache(Container* container, Cache& cache,
+                     WidgetContext* context);
+    void ReleaseCache(Cache& cache);
+    void SetupBuffers();
+    void UseProgram(WidgetContext* context, GLuint program,
+                    const float* mvpMatrix);
+
+private: // Data
+    std::vector<Run> m_runs;
+    std::vector<VertexAttribsTexCoords> m_vertices;
+    int m_numQuads;
+
+    BufferHandle m_vertexBuffer;
+    BufferHandle m_indexBuffer;
+    int m_indexCapacity;
+
+    // State the batch was built with
+    bool m_valid;
+    BaseWidget* m_pressedWidget;
+    int m_viewportWidth;
+    int m_viewportHeight;
+
+    // Program in use during Draw()
+    GLuint m_currentProgram;
+
+    // Renderings of the cached containers
+    RenderTargetPool* m_renderTargetPool;
+    CacheMap m_caches;
+
+    int m_numDrawCalls;
+    unsigned int m_numBuilds;
+    unsigned int m_numCacheRenders;
+};
+
+} // namespace CommonGL
+
+#endif // WIDGETBATCH_H
@@ -0,0 +1,114 @@
+#ifndef WIDGETGRID_H
+#define WIDGETGRID_H
+
+#include <vector>
+#include <map>
+
+#include "Rect.h"
+
+namespace CommonGL {
+
+// Forward declarations
+class BaseWidget;
+
+/**
+ * Uniform grid index of the screen bounds of widgets, for finding the
+ * topmost widget at a point without testing every widget. Each cell lists
+ * the visible widgets overlapping it in z order, so a lookup only tests
+ * the few widgets of one cell, against bounds cached when the widget was
+ * indexed rather than recomputed through its parents.
+ *
+ * Widgets are indexed on Add() and must be re-indexed with Update()
+ * whenever their bounds (or their parents' bounds) or visibility change.
+ *
+ * @author Matti Dahlbom
+ * @since 1.0
+ */
+class WidgetGrid
+{
+public: // Construction and destruction
+    WidgetGrid();
+    virtual ~WidgetGrid();
+
+public: // Public API
+    /**
+     * Sets the area covered by the grid, re-indexing all widgets. Points
+     * outside it fall into the nearest edge cells.
+     */
+    void SetSize(int width, int height);
+
+    /** Adds a widget on top of the others. */
+    void Add(BaseWidget* widget);
+
+    /** Removes a widget. */
+    void Remove(BaseWidget* widget);
+
+    /** Re-indexes a widget after its bounds or visibility changed. */
+    void Update(BaseWidget* widget);
+
+    /** Removes all widgets. */
+    void Clear();
+
+    /**
+     * Returns the topmost visible widget whose bounds contain a point, or
+     * NULL if there is none.
+     */
+    BaseWidget* Find(int x, int y) const;
+
+    /**
+     * Whether the indexed bounds of a widget contain a point; false if the
+     * widget is not indexed or not visible.
+     */
+    bool Contains(const BaseWidget* widget, int x, int y) const;
+
+    /**
+     * Gets the indexed bounds of a widget; returns false if the widget is
+     * not indexed or not visible.
+     */
+    bool GetRect(const BaseWidget* widget, Rect* rect) const;
+
+private:
+    struct Entry
+    {
+        // Bounds on screen, ie. transformed by the parents
+        Rect m_rect;
+
+        // Position in z order; larger is higher
+        unsigned int m_order;
+
+        // Whether the widget is in the cells, ie. visible
+        bool m_inCells;
+    };
+
+    struct CellItem
+    {
+        bool operator<(const CellItem& other) const
+        {
+            return (m_order < other.m_order);
+        }
+
+        unsigned int m_order;
+        BaseWidget* m_widget;
+        Rect m_rect;
+    };
+
+    typedef std::map<const BaseWidget*, Entry> EntryMap;
+    typedef std::vector<CellItem> Cell;
+
+    void GetCellRange(const Rect& rect, int* col1, int* row1, int* col2,
+                      int* row2) const;
+    int GetCellIndex(int x, int y) const;
+    void Insert(BaseWidget* widget, Entry& entry);
+    void Erase(const BaseWidget* widget, Entry& entry);
+
+private: // Data
+    EntryMap m_entries;
+    std::vector<Cell> m_cells;
+    int m_numColumns;
+    int m_numRows;
+    unsigned int m_nextOrder;
+};
+
+} // namespace CommonGL
+
+#endif // WIDGETGRID_H
@@ -0,0 +1,472 @@
+#include <string.h>
+#include <vector>
+
+#if defined(__BUILD_LINUX__) && defined(__USE_IO_URING__)
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/stat.h>
+#endif
+
+#include "AsyncBundleReader.h"
+#include "ResourcePack.h"
+#include "ThreadPool.h"
+#include "CommonFunctions.h"
+
+/** State of a submitted batch; deleted when its last request completes. */
+struct AsyncBundleReader::Batch
+{
+    Batch(BundleReadCallback callback, void* userData, int count)
+        : m_callback(callback),
+          m_userData(userData),
+          m_numRemaining(count),
+          m_allSucceeded(true) {}
+
+    BundleReadCallback m_callback;
+    void* m_userData;
+    std::atomic<int> m_numRemaining;
+    std::atomic<bool> m_allSucceeded;
+    std::promise<bool> m_promise;
+};
+
+/** A file being read through io_uring. */
+struct AsyncBundleReader::ReadOperation
+{
+    Batch* m_batch;
+    BundleReadRequest* m_request;
+    int m_fd;
+    char* m_data;
+    size_t m_fileSize;
+
+    // Bytes read so far; reads may complete short
+    size_t m_offset;
+
+    // Whether m_data was allocated by us
+    bool m_ownsBuffer;
+};
+
+AsyncBundleReader::AsyncBundleReader(unsigned int queueDepth)
+    : m_useIoUring(false),
+      m_numPending(0)
+{
+#if defined(__BUILD_LINUX__) && defined(__USE_IO_URING__)
+    m_stopping = false;
+    m_ringFailed = false;
+
+    int result = io_uring_queue_init(queueDepth, &m_ring, 0);
+    if ( result < 0 )
+    {
+        LOG_DEBUG("AsyncBundleReader: io_uring not available (%d), "
+                  "using the thread pool", result);
+        return;
+    }
+
+    m_useIoUring = true;
+    m_reaperThread = std::thread(&AsyncBundleReader::ReaperMain, this);
+#else
+    (void)queueDepth;
+#endif
+}
+
+AsyncBundleReader::~AsyncBundleReader()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_pendingMutex);
+        while ( m_numPending.load() > 0 )
+        {
+            m_pendingCondition.wait(lock);
+        }
+    }
+
+#if defined(__BUILD_LINUX__) && defined(__USE_IO_URING__)
+    if ( m_useIoUring )
+    {
+        // Wake up the reaper with a no-op carrying no operation
+        {
+            std::lock_guard<std::mutex> lock(m_submitMutex);
+            m_stopping = true;
+            struct io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+            while ( sqe == NULL )
+            {
+                io_uring_submit(&m_ring);
+                sqe = io_uring_get_sqe(&m_ring);
+            }
+            io_uring_prep_nop(sqe);
+            io_uring_sqe_set_data(sqe, NULL);
+            io_uring_submit(&m_ring);
+        }
+        m_reaperThread.join();
+        io_uring_queue_exit(&m_ring);
+    }
+#endif
+}
+
+std::future<bool> AsyncBundleReader::Submit(BundleReadRequest* requests,
+                                            int count,
+                                            BundleReadCallback callback,
+                                            void* userData)
+{
+    Batch* batch = new Batch(callback, userData, count);
+    std::future<bool> future = batch->m_promise.get_future();
+
+    if ( count <= 0 )
+    {
+        batch->m_promise.set_value(true);
+        delete batch;
+        return future;
+    }
+
+    m_numPending += count;
+
+    for ( int i = 0; i < count; i++ )
+    {
+        requests[i].m_size = 0;
+        requests[i].m_success = false;
+    }
+
+#if defined(__BUILD_LINUX__) && defined(__USE_IO_URING__)
+    if ( m_useIoUring )
+    {
+        // The files are opened before taking the lock, so that slow opens
+        // do not hold up other submitters or the reaper. Failed opens are
+        // completed after that, as the callback might submit more work.
+        std::vector<ReadOperation*> operations;
+        std::vector<BundleReadRequest*> failed;
+        for ( int i = 0; i < count; i++ )
+        {
+            // Pack contents are in memory already; they only need
+            // decompressing
+            if ( ResourcePackHasFile(requests[i].m_fileName) )
+            {
+                ReadOnThreadPool(batch, requests + i);
+                continue;
+            }
+
+            ReadOperation* operation = OpenRead(batch, requests + i);
+            if ( operation != NULL )
+            {
+                operations.push_back(operation);
+            }
+            else
+            {
+                failed.push_back(requests + i);
+            }
+        }
+
+        bool ringFailed;
+        {
+            std::lock_guard<std::mutex> lock(m_submitMutex);
+            ringFailed = m_ringFailed;
+            if ( !ringFailed )
+            {
+                for ( size_t i = 0; i < operations.size(); i++ )
+                {
+                    m_operations.insert(operations[i]);
+                    QueueRead(operations[i]);
+                }
+                io_uring_submit(&m_ring);
+            }
+        }
+
+        if ( ringFailed )
+        {
+            for ( size_t i = 0; i < operations.size(); i++ )
+            {
+                BundleReadRequest* request = operations[i]->m_request;
+                CloseRead(operations[i]);
+                ReadOnThreadPool(batch, request);
+            }
+        }
+
+        for ( size_t i = 0; i < failed.size(); i++ )
+        {
+            CompleteRequest(batch, failed[i], false);
+        }
+
+        return future;
+    }
+#endif
+
+    for ( int i = 0; i < count; i++ )
+    {
+        ReadOnThreadPool(batch, requests + i);
+    }
+
+    return future;
+}
+
+void AsyncBundleReader::ReadOnThreadPool(Batch* batch,
+                                         BundleReadRequest* request)
+{
+    g_threadPool.Enqueue(std::function<void()>([this, batch, request]() {
+        bool success = false;
+
+        if ( request->m_buffer == NULL )
+        {
+            void* data;
+            size_t size;
+            success = ReadBundleFile(request->m_fileName, request->m_zeropad,
+                                     &size, &data);
+            if ( success )
+            {
+                request->m_buffer = data;
+                request->m_size = size;
+            }
+        }
+        else
+        {
+            // Copy once from the mapping into the caller's buffer
+            BundleFileView view;
+            if ( MapBundleFile(request->m_fileName, false, &view) )
+            {
+                size_t size = view.GetSize();
+                size_t totalSize = request->m_zeropad ? (size + 1) : size;
+                if ( totalSize <= request->m_bufferSize )
+                {
+                    memcpy(request->m_buffer, view.GetData(), size);
+                    if ( request->m_zeropad )
+                    {
+                        ((char*)request->m_buffer)[size] = '\0';
+                    }
+                    request->m_size = totalSize;
+                    success = true;
+                }
+                else
+                {
+                    LOG_DEBUG("AsyncBundleReader: buffer too small for %s",
+                              request->m_fileName);
+                }
+            }
+        }
+
+        CompleteRequest(batch, request, success);
+    }));
+}
+
+void AsyncBundleReader::CompleteRequest(Batch* batch,
+                                        BundleReadRequest* request,
+                                        bool success)
+{
+    request->m_success = success;
+    if ( !success )
+    {
+        batch->m_allSucceeded = false;
+    }
+
+    if ( batch->m_callback != NULL )
+    {
+        batch->m_callback(request, batch->m_userData);
+    }
+
+    if ( --batch->m_numRemaining == 0 )
+    {
+        batch->m_promise.set_value(batch->m_allSucceeded.load());
+        delete batch;
+    }
+
+    // Decrement under the lock, so that the destructor cannot see zero
+    // and destroy the lock and condition before they are used here
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    if ( --m_numPending == 0 )
+    {
+        m_pendingCondition.notify_all();
+    }
+}
+
+#if defined(__BUILD_LINUX__) && defined(__USE_IO_URING__)
+
+AsyncBundleReader::ReadOperation* AsyncBundleReader::OpenRead(
+        Batch* batch, BundleReadRequest* request)
+{
+    std::string path = GetBundleFilePath(request->m_fileName);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 )
+    {
+        LOG_DEBUG("AsyncBundleReader: Failed to open file: %s", path.c_str());
+        return NULL;
+    }
+
+    struct stat st;
+    if ( fstat(fd, &st) != 0 )
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t fileSize = st.st_size;
+    size_t totalSize = request->m_zeropad ? (fileSize + 1) : fileSize;
+
+    char* data = (char*)request->m_buffer;
+    bool ownsBuffer = (data == NULL);
+    if ( ownsBuffer )
+    {
+        data = (char*)malloc((totalSize > 0) ? totalSize : 1);
+        if ( data == NULL )
+        {
+            close(fd);
+            return NULL;
+        }
+    }
+    else if ( totalSize > request->m_bufferSize )
+    {
+        LOG_DEBUG("AsyncBundleReader: buffer too small for %s",
+                  request->m_fileName);
+        close(fd);
+        return NULL;
+    }
+
+    ReadOperation* operation = new ReadOperation;
+    operation->m_batch = batch;
+    operation->m_request = request;
+    operation->m_fd = fd;
+    operation->m_data = data;
+    operation->m_fileSize = fileSize;
+    operation->m_offset = 0;
+    operation->m_ownsBuffer = ownsBuffer;
+
+    return operation;
+}
+
+void AsyncBundleReader::CloseRead(ReadOperation* operation)
+{
+    close(operation->m_fd);
+    if ( operation->m_ownsBuffer )
+    {
+        free(operation->m_data);
+    }
+    delete operation;
+}
+
+void AsyncBundleReader::QueueRead(ReadOperation* operation)
+{
+    // Called with m_submitMutex held
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+    while ( sqe == NULL )
+    {
+        // Submission queue full; hand the queued reads to the kernel
+        io_uring_submit(&m_ring);
+        sqe = io_uring_get_sqe(&m_ring);
+    }
+
+    // Zero-length files get a zero-length read, which completes at once
+    io_uring_prep_read(sqe, operation->m_fd,
+                       operation->m_data + operation->m_offset,
+                       operation->m_fileSize - operation->m_offset,
+                       operation->m_offset);
+    io_uring_sqe_set_data(sqe, operation);
+}
+
+void AsyncBundleReader::ReaperMain()
+{
+    while ( true )
+    {
+        struct io_uring_cqe* cqe;
+        int result = io_uring_wait_cqe(&m_ring, &cqe);
+        if ( result < 0 )
+        {
+            if ( result == -EINTR )
+            {
+                continue;
+            }
+            LOG_DEBUG("AsyncBundleReader: io_uring_wait_cqe() failed: %d",
+                      result);
+            FailReads(result);
+            return;
+        }
+
+        ReadOperation* operation = (ReadOperation*)io_uring_cqe_get_data(cqe);
+        int numRead = cqe->res;
+        io_uring_cqe_seen(&m_ring, cqe);
+
+        if ( operation == NULL )
+        {
+            // Wake-up from the destructor
+            if ( m_stopping )
+            {
+                return;
+            }
+            continue;
+        }
+
+        if ( (numRead == -EINTR) || (numRead == -EAGAIN) )
+        {
+            std::lock_guard<std::mutex> lock(m_submitMutex);
+            QueueRead(operation);
+            io_uring_submit(&m_ring);
+            continue;
+        }
+
+        if ( numRead > 0 )
+        {
+            operation->m_offset += numRead;
+            if ( operation->m_offset < operation->m_fileSize )
+            {
+                // Short read; continue where it left off
+                std::lock_guard<std::mutex> lock(m_submitMutex);
+                QueueRead(operation);
+                io_uring_submit(&m_ring);
+                continue;
+            }
+        }
+
+        // Done: all read, end of file (file truncated) or an error
+        FinishRead(operation, numRead);
+    }
+}
+
+void AsyncBundleReader::FinishRead(ReadOperation* operation, int result)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_submitMutex);
+        m_operations.erase(operation);
+    }
+
+    BundleReadRequest* request = operation->m_request;
+    bool success = (result >= 0);
+    close(operation->m_fd);
+
+    if ( success )
+    {
+        size_t size = operation->m_offset;
+        if ( request->m_zeropad )
+        {
+            operation->m_data[size++] = '\0';
+        }
+        request->m_buffer = operation->m_data;
+        request->m_size = size;
+    }
+    else
+    {
+        LOG_DEBUG("AsyncBundleReader: Failed to read file: %s (%d)",
+                  request->m_fileName, result);
+        if ( operation->m_ownsBuffer )
+        {
+            free(operation->m_data);
+        }
+    }
+
+    Batch* batch = operation->m_batch;
+    delete operation;
+    CompleteRequest(batch, request, success);
+}
+
+void AsyncBundleReader::FailReads(int error)
+{
+    // No completions will be reaped any more; fail the reads in the ring so
+    // that their batches complete, and read through the thread pool from
+    // now on
+    std::set<ReadOperation*> operations;
+    {
+        std::lock_guard<std::mutex> lock(m_submitMutex);
+        m_ringFailed = true;
+        operations.swap(m_operations);
+    }
+
+    std::set<ReadOperation*>::iterator iter;
+    for ( iter = operations.begin(); iter != operations.end(); iter++ )
+    {
+        FinishRead(*iter, error);
+    }
+}
+
+#endif // __BUILD_LINUX__ && __USE_IO_URING__
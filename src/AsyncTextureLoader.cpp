@@ -0,0 +1,235 @@
+#include "AsyncTextureLoader.h"
+#include "ThreadPool.h"
+#include "TimeSample.h"
+#include "CommonFunctions.h"
+
+static const int RGBAPixelSize = 4;
+
+AsyncTextureLoader::AsyncTextureLoader(size_t budgetBytes,
+                                       float budgetMillis)
+    : m_budgetBytes(budgetBytes),
+      m_budgetMillis(budgetMillis),
+      m_numPending(0),
+      m_currentJob(NULL),
+      m_numDecoding(0)
+{
+    SetPlaceholderColor(128, 128, 128, 255);
+}
+
+AsyncTextureLoader::~AsyncTextureLoader()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while ( m_numDecoding > 0 )
+    {
+        m_decodeCondition.wait(lock);
+    }
+
+    if ( m_currentJob != NULL )
+    {
+        m_decodedJobs.push_front(m_currentJob);
+        m_currentJob = NULL;
+    }
+
+    while ( !m_decodedJobs.empty() )
+    {
+        Job* job = m_decodedJobs.front();
+        m_decodedJobs.pop_front();
+        if ( job->m_uploadTexture != 0 )
+        {
+            glDeleteTextures(1, &job->m_uploadTexture);
+        }
+        free(job->m_pixels);
+        delete job;
+    }
+}
+
+void AsyncTextureLoader::SetBudget(size_t budgetBytes, float budgetMillis)
+{
+    m_budgetBytes = budgetBytes;
+    m_budgetMillis = budgetMillis;
+}
+
+void AsyncTextureLoader::SetPlaceholderColor(uint8_t r, uint8_t g,
+                                             uint8_t b, uint8_t a)
+{
+    m_placeholderColor[0] = r;
+    m_placeholderColor[1] = g;
+    m_placeholderColor[2] = b;
+    m_placeholderColor[3] = a;
+}
+
+TextureHandle AsyncTextureLoader::Load(const char* imageName, bool clamp,
+                                       bool useMipmaps,
+                                       TextureLoadedCallback callback,
+                                       void* userData)
+{
+    // The placeholder is a single texel, so it needs no mipmaps
+    TextureHandle texture = g_resourceRegistry.CreateTexture();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, g_resourceRegistry.Get(texture));
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, m_placeholderColor);
+    SetTexture2DParameters(clamp, false);
+
+    Job* job = new Job;
+    job->m_imageName = imageName;
+    job->m_texture = texture;
+    job->m_clamp = clamp;
+    job->m_useMipmaps = useMipmaps;
+    job->m_callback = callback;
+    job->m_userData = userData;
+    job->m_pixels = NULL;
+    job->m_width = 0;
+    job->m_height = 0;
+    job->m_decoded = false;
+    job->m_uploadTexture = 0;
+    job->m_numRowsUploaded = 0;
+
+    m_numPending++;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_numDecoding++;
+    }
+    g_threadPool.Enqueue(std::function<void()>([this, job]() {
+        Decode(job);
+    }));
+
+    return texture;
+}
+
+void AsyncTextureLoader::Decode(Job* job)
+{
+    // Worker thread
+    job->m_decoded = LoadImageDataFromBundle(job->m_imageName.c_str(),
+                                             &job->m_pixels, &job->m_width,
+                                             &job->m_height);
+
+    // Empty images have no rows to upload in strips
+    if ( job->m_decoded && ((job->m_width <= 0) || (job->m_height <= 0)) )
+    {
+        LOG_DEBUG("AsyncTextureLoader: %s has no pixels (%dx%d)",
+                  job->m_imageName.c_str(), job->m_width, job->m_height);
+        job->m_decoded = false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_decodedJobs.push_back(job);
+    m_numDecoding--;
+    m_decodeCondition.notify_all();
+}
+
+void AsyncTextureLoader::Finish(Job* job, bool success)
+{
+    if ( job->m_uploadTexture != 0 )
+    {
+        glDeleteTextures(1, &job->m_uploadTexture);
+    }
+    free(job->m_pixels);
+    m_numPending--;
+
+    if ( job->m_callback != NULL )
+    {
+        job->m_callback(job->m_texture, success, job->m_userData);
+    }
+
+    delete job;
+}
+
+int AsyncTextureLoader::Update()
+{
+    TimeSample startTime;
+    size_t numBytesUploaded = 0;
+    int numCompleted = 0;
+
+    while ( true )
+    {
+        if ( m_currentJob == NULL )
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if ( m_decodedJobs.empty() )
+            {
+                break;
+            }
+            m_currentJob = m_decodedJobs.front();
+            m_decodedJobs.pop_front();
+        }
+
+        Job* job = m_currentJob;
+
+        // Failed decodes and textures released meanwhile cost nothing
+        if ( !job->m_decoded || !g_resourceRegistry.IsValid(job->m_texture) )
+        {
+            if ( !job->m_decoded )
+            {
+                LOG_DEBUG("AsyncTextureLoader: failed to load %s",
+                          job->m_imageName.c_str());
+            }
+            m_currentJob = NULL;
+            Finish(job, false);
+            continue;
+        }
+
+        // Out of budget; the first strip of the frame is always uploaded
+        size_t rowSize = job->m_width * RGBAPixelSize;
+        size_t bytesLeft = (numBytesUploaded < m_budgetBytes) ?
+                (m_budgetBytes - numBytesUploaded) : 0;
+        if ( (numBytesUploaded > 0) &&
+             ((bytesLeft < rowSize) ||
+              ((startTime.ElapsedTime() * 1000.0) >= m_budgetMillis)) )
+        {
+            break;
+        }
+
+        glActiveTexture(GL_TEXTURE0);
+        if ( job->m_uploadTexture == 0 )
+        {
+            glGenTextures(1, &job->m_uploadTexture);
+            glBindTexture(GL_TEXTURE_2D, job->m_uploadTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, job->m_width,
+                         job->m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        else
+        {
+            glBindTexture(GL_TEXTURE_2D, job->m_uploadTexture);
+        }
+
+        int numRows = bytesLeft / rowSize;
+        if ( numRows < 1 )
+        {
+            numRows = 1;
+        }
+        if ( numRows > (job->m_height - job->m_numRowsUploaded) )
+        {
+            numRows = job->m_height - job->m_numRowsUploaded;
+        }
+
+        const uint8_t* strip = (const uint8_t*)job->m_pixels +
+                job->m_numRowsUploaded * rowSize;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, job->m_numRowsUploaded,
+                        job->m_width, numRows, GL_RGBA, GL_UNSIGNED_BYTE,
+                        strip);
+        job->m_numRowsUploaded += numRows;
+        numBytesUploaded += numRows * rowSize;
+
+        if ( job->m_numRowsUploaded < job->m_height )
+        {
+            continue;
+        }
+
+        // Complete; swap it in place of the placeholder
+        SetTexture2DParameters(job->m_clamp, job->m_useMipmaps);
+        LOG_GL_ERROR();
+
+        bool success = g_resourceRegistry.Replace(job->m_texture,
+                                                  job->m_uploadTexture);
+        if ( success )
+        {
+            job->m_uploadTexture = 0;
+        }
+        m_currentJob = NULL;
+        Finish(job, success);
+        numCompleted++;
+    }
+
+    return numCompleted;
+}
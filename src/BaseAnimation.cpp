@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "BaseAnimation.h"
 
 BaseAnimation::BaseAnimation(float initialDelay, float duration)
@@ -28,6 +30,17 @@ bool BaseAnimation::IsActive(const TimeSample& time) const
     return ( HasBegun(time) && !HasCompleted(time) );
 }
 
+float BaseAnimation::TimeUntilNextUpdate(const TimeSample& time) const
+{
+    if ( HasCompleted(time) )
+    {
+        return -1.0;
+    }
+
+    float elapsed = time.ElapsedTimeSince(m_baseTime);
+    return std::max(m_initialDelay - elapsed, 0.0f);
+}
+
 void BaseAnimation::ResetTime()
 {
     m_baseTime.Reset();
@@ -8,6 +8,7 @@ BaseWidget::BaseWidget(WidgetType type, Rect bounds)
     : m_type(type),
       m_parent(NULL),
       m_bounds(bounds),
+      m_transformedRectDirty(true),
       m_isVisible(true),
       m_context(NULL)
 {
@@ -45,35 +46,41 @@ void BaseWidget::TouchDownInside(int x, int y)
     }
 }
 
-Rect BaseWidget::TransformedRect()
+const Rect& BaseWidget::TransformedRect()
 {
-    Rect rect(m_bounds);
-    BaseWidget* parent = m_parent;
-    while ( parent != NULL )
+    if ( m_transformedRectDirty )
     {
-        Rect parentBounds = parent->GetBounds();
-        rect.MoveBy(parentBounds.m_left, parentBounds.m_top);
-        parent = parent->m_parent;
+        m_transformedRect = m_bounds;
+        if ( m_parent != NULL )
+        {
+            const Rect& parentRect = m_parent->TransformedRect();
+            m_transformedRect.MoveBy(parentRect.m_left, parentRect.m_top);
+        }
+        m_transformedRectDirty = false;
     }
 
-    return rect;
+    return m_transformedRect;
+}
+
+void BaseWidget::InvalidateTransformedRect()
+{
+    m_transformedRectDirty = true;
+}
+
+void BaseWidget::ChildInvalidated()
+{
+    // No implementation
 }
 
 bool BaseWidget::HitTest(int x, int y)
 {
-    if ( m_parent == NULL )
-    {
-        return m_bounds.IsInside(x, y);
-    }
-    else
-    {
-        return TransformedRect().IsInside(x, y);
-    }
+    return TransformedRect().IsInside(x, y);
 }
 
 void BaseWidget::SetBounds(Rect bounds)
 {
     m_bounds = bounds;
+    Invalidate();
 }
 
 Rect BaseWidget::GetBounds()
@@ -83,12 +90,53 @@ Rect BaseWidget::GetBounds()
 
 void BaseWidget::SetVisible(bool visible)
 {
-    m_isVisible = visible;
+    if ( visible != m_isVisible )
+    {
+        m_isVisible = visible;
+        Invalidate();
+    }
 }
 
 void BaseWidget::SetContext(WidgetContext* context)
 {
+    Invalidate();
     m_context = context;
+    Invalidate();
+}
+
+void BaseWidget::Invalidate()
+{
+    InvalidateTransformedRect();
+
+    for ( BaseWidget* parent = m_parent; parent != NULL;
+          parent = parent->m_parent )
+    {
+        parent->ChildInvalidated();
+    }
+
+    // Children draw relative to their parents, so a change anywhere in the
+    // hierarchy is a change to the widgets of the topmost parent's context
+    BaseWidget* widget = this;
+    while ( (widget->m_context == NULL) && (widget->m_parent != NULL) )
+    {
+        widget = widget->m_parent;
+    }
+
+    if ( widget->m_context != NULL )
+    {
+        widget->m_context->m_widgetsChanged = true;
+    }
+
+    // Keep the hit testing index up to date
+    if ( (m_context != NULL) && (m_context->m_glController != NULL) )
+    {
+        m_context->m_glController->WidgetChanged(this);
+    }
+}
+
+bool BaseWidget::GetQuad(WidgetQuad* /*quad*/)
+{
+    return false;
 }
 
 void BaseWidget::AddTouchListener(WidgetTouchListener* listener)
@@ -0,0 +1,66 @@
+#include "BundleFileView.h"
+#include "CommonFunctions.h"
+
+BundleFileView::BundleFileView()
+    : m_data(NULL),
+      m_size(0),
+      m_release(NULL),
+      m_releaseContext(NULL)
+{
+}
+
+BundleFileView::~BundleFileView()
+{
+    Reset();
+}
+
+void BundleFileView::Reset()
+{
+    if ( (m_data != NULL) && (m_release != NULL) )
+    {
+        m_release(m_data, m_size, m_releaseContext);
+    }
+
+    m_data = NULL;
+    m_size = 0;
+    m_release = NULL;
+    m_releaseContext = NULL;
+}
+
+void BundleFileView::Set(const void* data, size_t size, ReleaseFunc release,
+                         void* context)
+{
+    Reset();
+
+    m_data = data;
+    m_size = size;
+    m_release = release;
+    m_releaseContext = context;
+}
+
+void BundleFileView::FreeData(const void* data, size_t /*size*/,
+                              void* /*context*/)
+{
+    free((void*)data);
+}
+
+bool BundleFileView::ReadCopy(const char* fileName, bool zeropad)
+{
+    size_t size;
+    void* data;
+    if ( !ReadBundleFile(fileName, zeropad, &size, &data) )
+    {
+        Reset();
+        return false;
+    }
+
+    // ReadBundleFile() counts the padding into the size
+    if ( zeropad )
+    {
+        size--;
+    }
+
+    Set(data, size, FreeData, NULL);
+
+    return true;
+}
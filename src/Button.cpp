@@ -5,7 +5,9 @@ namespace CommonGL {
 
 Button::Button(GLuint texture, ButtonListener* listener)
     : BaseWidget(TypeButton, Rect()),
-      m_texture(texture)
+      m_texture(texture),
+      m_atlas(NULL),
+      m_region(NULL)
 {
     if ( listener != NULL )
     {
@@ -15,7 +17,22 @@ Button::Button(GLuint texture, ButtonListener* listener)
 
 Button::Button(Rect bounds, GLuint texture, ButtonListener* listener)
     : BaseWidget(TypeButton, bounds),
-      m_texture(texture)
+      m_texture(texture),
+      m_atlas(NULL),
+      m_region(NULL)
+{
+    if ( listener != NULL )
+    {
+        m_listeners.push_back(listener);
+    }
+}
+
+Button::Button(Rect bounds, const TextureAtlas* atlas,
+               const AtlasRegion* region, ButtonListener* listener)
+    : BaseWidget(TypeButton, bounds),
+      m_texture(0),
+      m_atlas(atlas),
+      m_region(region)
 {
     if ( listener != NULL )
     {
@@ -49,13 +66,54 @@ void Button::TouchUpInside(int, int)
 
 void Button::Render()
 {
-    glActiveTexture(GL_TEXTURE0);
-    glUniform1i(m_context->m_textureShaderTextureLoc, 0);
-    glBindTexture(GL_TEXTURE_2D, m_texture);
+    if ( m_region != NULL )
+    {
+        GLuint texture = m_atlas->GetTexture(m_region->m_page);
+        if ( m_context->m_boundTexture != texture )
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            m_context->m_boundTexture = texture;
+        }
+
+        DrawImage2D(TransformedRect(), m_context->m_viewportWidth,
+                    m_context->m_viewportHeight, m_region->m_u1,
+                    m_region->m_v1, m_region->m_u2, m_region->m_v2);
+        return;
+    }
+
+    if ( m_context->m_boundTexture != m_texture )
+    {
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        m_context->m_boundTexture = m_texture;
+    }
 
     DrawImage2D(TransformedRect(), m_context->m_viewportWidth,
                 m_context->m_viewportHeight);
 }
 
+bool Button::GetQuad(WidgetQuad* quad)
+{
+    quad->m_rect = TransformedRect();
+    if ( m_region != NULL )
+    {
+        quad->m_texture = m_atlas->GetTexture(m_region->m_page);
+        quad->m_u1 = m_region->m_u1;
+        quad->m_v1 = m_region->m_v1;
+        quad->m_u2 = m_region->m_u2;
+        quad->m_v2 = m_region->m_v2;
+    }
+    else
+    {
+        quad->m_texture = m_texture;
+        quad->m_u1 = 0.0;
+        quad->m_v1 = 1.0;
+        quad->m_u2 = 1.0;
+        quad->m_v2 = 0.0;
+    }
+
+    // A button without a texture is drawn the way it always has been
+    return (quad->m_texture != 0);
+}
+
 } // namespace CommonGL
 
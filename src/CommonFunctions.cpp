@@ -3,11 +3,15 @@
 #include <string.h>
 
 #include "CommonFunctions.h"
+#include "GLResources.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
 #include "MatrixOperations.h"
 #include "Rect.h"
 
 // Vertex buffer for DrawImage2D()/DrawQuad2D()
-GLuint g_vertexBuffer;
+BufferHandle g_vertexBuffer;
 
 // Holds indices for two triangles representing a rectangle
 GLuint g_rectangleIndexBuffer;
@@ -17,11 +21,17 @@ GLuint g_rectangleIndexBuffer;
 // ie. in vertex shader just do gl_Position = in_coord
 GLuint g_rectangleCoordsVertexBuffer;
 
+// Registry handles owning the above rectangle buffers
+static BufferHandle s_rectangleIndexBufferHandle;
+static BufferHandle s_rectangleCoordsVertexBufferHandle;
+
 bool InitCommonData()
 {
     const GLushort RectIndices[] = { 0,1,3,  3,1,2 };
 
-    glGenBuffers(1, &g_rectangleIndexBuffer);
+    s_rectangleIndexBufferHandle = g_resourceRegistry.CreateBuffer();
+    g_rectangleIndexBuffer =
+            g_resourceRegistry.Get(s_rectangleIndexBufferHandle);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_rectangleIndexBuffer);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(RectIndices),
                  RectIndices, GL_STATIC_DRAW);
@@ -33,12 +43,14 @@ bool InitCommonData()
         { 1,   1, 0 }  // top right
     };
 
-    glGenBuffers(1, &g_rectangleCoordsVertexBuffer);
+    s_rectangleCoordsVertexBufferHandle = g_resourceRegistry.CreateBuffer();
+    g_rectangleCoordsVertexBuffer =
+            g_resourceRegistry.Get(s_rectangleCoordsVertexBufferHandle);
     glBindBuffer(GL_ARRAY_BUFFER, g_rectangleCoordsVertexBuffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices),
                  vertices, GL_STATIC_DRAW);
 
-    glGenBuffers(1, &g_vertexBuffer);
+    g_vertexBuffer = g_resourceRegistry.CreateBuffer();
 
     int error = glGetError();
     if ( error != GL_NO_ERROR )
@@ -50,9 +62,16 @@ bool InitCommonData()
 
 void DeinitCommonData()
 {
-    glDeleteBuffers(1, &g_rectangleIndexBuffer);
-    glDeleteBuffers(1, &g_rectangleCoordsVertexBuffer);
-    glDeleteBuffers(1, &g_vertexBuffer);
+    g_textureCache.Clear();
+    g_textureStreamer.Clear();
+    g_resourceRegistry.Release(&s_rectangleIndexBufferHandle);
+    g_resourceRegistry.Release(&s_rectangleCoordsVertexBufferHandle);
+    g_resourceRegistry.Release(&g_vertexBuffer);
+    g_rectangleIndexBuffer = 0;
+    g_rectangleCoordsVertexBuffer = 0;
+
+    // The context is going away; don't wait for the GPU
+    g_resourceRegistry.FlushAllDeletions();
 }
 
 void SetVertexAttribsTexCoordsPointers()
@@ -223,7 +242,7 @@ void DrawImage2D(const CommonGL::Rect& rect,
     glDisableVertexAttribArray(NORMAL_INDEX);
 
     // Upload vertex data for the image rectangle
-    glBindBuffer(GL_ARRAY_BUFFER, g_vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, g_resourceRegistry.Get(g_vertexBuffer));
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices),
                  vertices, GL_STREAM_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_rectangleIndexBuffer);
@@ -273,7 +292,7 @@ void DrawQuad2D(const CommonGL::Rect& rect,
     glDisableVertexAttribArray(TEXCOORD_INDEX);
 
     // Upload the quad geometry
-    glBindBuffer(GL_ARRAY_BUFFER, g_vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, g_resourceRegistry.Get(g_vertexBuffer));
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STREAM_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_rectangleIndexBuffer);
 
@@ -313,67 +332,45 @@ void DrawQuad2D(GLuint vertexBuffer, GLuint indexBuffer)
 bool LoadShaderFromBundle(const char* fileName, GLuint* program)
 {
     char buffer[256];
-    size_t fileSize;
-    char* vertexShader;
-    char* fragmentShader;
+    BundleFileView vertexShaderFile;
+    BundleFileView fragmentShaderFile;
 
     LOG_DEBUG("LoadShaderFromBundle(): loading '%s'..", fileName);
 
     // Load the vertex shader file
     snprintf(buffer, sizeof(buffer), "%s.vsh", fileName);
-    if ( !ReadBundleFile(buffer, true, &fileSize, (void**)&vertexShader) )
+    if ( !MapBundleFile(buffer, true, &vertexShaderFile) )
     {
         LOG_DEBUG("Failed to read vertex shader source file!");
         return false;
     }
 
-#ifdef __BUILD_DESKTOP__
-    // On desktop builds, prepend GLSL version header
-    char* buf = (char*)malloc(fileSize + 128);
-    sprintf(buf, "#version 120\n\n%s\n", vertexShader);
-    free(vertexShader);
-    vertexShader = buf;
-#endif
-
     // Load the fragment shader file
     snprintf(buffer, sizeof(buffer), "%s.fsh", fileName);
-    if ( !ReadBundleFile(buffer, true, &fileSize, (void**)&fragmentShader) )
+    if ( !MapBundleFile(buffer, true, &fragmentShaderFile) )
     {
         LOG_DEBUG("Failed to read fragment shader source file!");
-        free(vertexShader);
         return false;
     }
 
 #ifdef __BUILD_DESKTOP__
     // On desktop builds, prepend GLSL version header
-    buf = (char*)malloc(fileSize + 128);
-    sprintf(buf, "#version 120\n\n%s\n", fragmentShader);
-    free(fragmentShader);
-    fragmentShader = buf;
-#endif
+    std::string vertexShader =
+            std::string("#version 120\n\n") + vertexShaderFile.GetString();
+    std::string fragmentShader =
+            std::string("#version 120\n\n") + fragmentShaderFile.GetString();
 
     // Compile & load the shader into OpenGL
-    bool ret = LoadShader(program, vertexShader, fragmentShader);
-
-    // Deallocate memory
-    free(vertexShader);
-    free(fragmentShader);
-
-    return ret;
+    return LoadShader(program, vertexShader.c_str(), fragmentShader.c_str());
+#else
+    // Compile & load the shader into OpenGL
+    return LoadShader(program, vertexShaderFile.GetString(),
+                      fragmentShaderFile.GetString());
+#endif
 }
 
-bool Create2DTexture(int width, int height, void* data,
-                     GLuint* texture, bool clamp, bool useMipmaps)
+void SetTexture2DParameters(bool clamp, bool useMipmaps)
 {
-    glActiveTexture(GL_TEXTURE0);
-    glGenTextures(1, texture);
-    glBindTexture(GL_TEXTURE_2D, *texture);
-    if ( data != NULL )
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-                     GL_RGBA, GL_UNSIGNED_BYTE, data);
-    }
-
     if ( useMipmaps )
     {
         glGenerateMipmap(GL_TEXTURE_2D);
@@ -398,6 +395,58 @@ bool Create2DTexture(int width, int height, void* data,
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     }
+}
+
+ScopedUnpackAlignment::ScopedUnpackAlignment(GLint alignment)
+    : m_previousAlignment(4)
+{
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &m_previousAlignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+ScopedUnpackAlignment::~ScopedUnpackAlignment()
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, m_previousAlignment);
+}
+
+void SetTextureFiltering(GLenum target, bool useMipmaps, bool trilinear,
+                         float maxAnisotropy)
+{
+    GLint minFilter = GL_LINEAR;
+    if ( useMipmaps )
+    {
+        minFilter = trilinear ?
+                GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_NEAREST;
+    }
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if ( (maxAnisotropy > 1.0) &&
+         ExtensionPresent(AnisotropicFilteringExtension) )
+    {
+        GLfloat driverMax = 1.0;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &driverMax);
+        if ( maxAnisotropy > driverMax )
+        {
+            maxAnisotropy = driverMax;
+        }
+        glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
+    }
+}
+
+bool Create2DTexture(int width, int height, void* data,
+                     GLuint* texture, bool clamp, bool useMipmaps)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glGenTextures(1, texture);
+    glBindTexture(GL_TEXTURE_2D, *texture);
+    if ( data != NULL )
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, data);
+    }
+
+    SetTexture2DParameters(clamp, useMipmaps);
 
     int glError = glGetError();
     if ( glError != GL_NO_ERROR )
@@ -409,13 +458,76 @@ bool Create2DTexture(int width, int height, void* data,
     return true;
 }
 
-bool LoadCubeTextureFromBundle(const char* xnegImage,
-                               const char* xposImage,
-                               const char* ynegImage,
-                               const char* yposImage,
-                               const char* znegImage,
-                               const char* zposImage,
-                               GLuint* texture)
+bool Create2DTexture(int width, int height, const void* data,
+                     GLuint* texture, bool clamp, bool useMipmaps,
+                     TextureFormat format)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glGenTextures(1, texture);
+    glBindTexture(GL_TEXTURE_2D, *texture);
+    if ( data != NULL )
+    {
+        GLenum glFormat, glType;
+        GetTextureFormatGL(format, &glFormat, &glType);
+
+        // Rows of the smaller formats are not padded to 4 bytes
+        ScopedUnpackAlignment unpackAlignment(1);
+        glTexImage2D(GL_TEXTURE_2D, 0, glFormat, width, height, 0,
+                     glFormat, glType, data);
+    }
+
+    SetTexture2DParameters(clamp, useMipmaps);
+
+    int glError = glGetError();
+    if ( glError != GL_NO_ERROR )
+    {
+        LOG_DEBUG("Create2DTexture(): GL error: 0x%x", glError);
+        return false;
+    }
+
+    return true;
+}
+
+bool Load2DTextureFromBundle(const char* imageName, TextureHandle* texture,
+                             bool clamp, bool useMipmaps)
+{
+    GLuint textureId = 0;
+    if ( !Load2DTextureFromBundle(imageName, &textureId, clamp, useMipmaps) )
+    {
+        return false;
+    }
+
+    *texture = g_resourceRegistry.AdoptTexture(textureId);
+    return true;
+}
+
+bool Load2DTextureFromBundle(const char* imageName, TextureHandle* texture,
+                             bool clamp, bool useMipmaps,
+                             TextureFormat format, int conversionFlags)
+{
+    void* data;
+    int width, height;
+    if ( !LoadImageDataFromBundle(imageName, &data, &width, &height, format,
+                                  conversionFlags) )
+    {
+        return false;
+    }
+
+    GLuint textureId = 0;
+    bool success = Create2DTexture(width, height, data, &textureId, clamp,
+                                   useMipmaps, format);
+    free(data);
+
+    if ( !success )
+    {
+        return false;
+    }
+
+    *texture = g_resourceRegistry.AdoptTexture(textureId);
+    return true;
+}
+
+bool CreateCubeTexture(int faceSize, void* const faces[6], GLuint* texture)
 {
     GLuint cubeTexture;
     glActiveTexture(GL_TEXTURE0);
@@ -426,51 +538,151 @@ bool LoadCubeTextureFromBundle(const char* xnegImage,
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    if ( !LoadCubeMapTargetTexture(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, xnegImage) )
+    for ( int i = 0; i < 6; i++ )
     {
-        glDeleteTextures(1, &cubeTexture);
-        return false;
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA,
+                     faceSize, faceSize, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     faces[i]);
     }
-    if ( !LoadCubeMapTargetTexture(GL_TEXTURE_CUBE_MAP_POSITIVE_X, xposImage) )
+
+    int error = glGetError();
+    if ( error != GL_NO_ERROR )
     {
+        LOG_DEBUG("CreateCubeTexture(): GL error: 0x%x", error);
         glDeleteTextures(1, &cubeTexture);
         return false;
     }
-    if ( !LoadCubeMapTargetTexture(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, ynegImage) )
+
+    *texture = cubeTexture;
+    return true;
+}
+
+bool LoadCubeFaceDataFromBundle(const char* xnegImage,
+                                const char* xposImage,
+                                const char* ynegImage,
+                                const char* yposImage,
+                                const char* znegImage,
+                                const char* zposImage,
+                                void* faces[6], int* faceSize)
+{
+    // In the order of the GL_TEXTURE_CUBE_MAP_POSITIVE_X + i targets
+    const char* imageNames[6] = {
+        xposImage, xnegImage, yposImage, ynegImage, zposImage, znegImage
+    };
+    int widths[6];
+    int heights[6];
+
+    // Decode all faces in parallel
+    g_threadPool.ParallelFor(6, [&](int i) {
+        if ( !LoadImageDataFromBundle(imageNames[i], &faces[i], &widths[i],
+                                      &heights[i]) )
+        {
+            faces[i] = NULL;
+        }
+    });
+
+    bool success = true;
+    for ( int i = 0; (i < 6) && success; i++ )
     {
-        glDeleteTextures(1, &cubeTexture);
-        return false;
+        if ( faces[i] == NULL )
+        {
+            success = false;
+        }
+        else if ( (widths[i] != heights[i]) || (widths[i] != widths[0]) )
+        {
+            LOG_DEBUG("LoadCubeFaceDataFromBundle(): %s is %dx%d; faces "
+                      "must be square and of the same size", imageNames[i],
+                      widths[i], heights[i]);
+            success = false;
+        }
     }
-    if ( !LoadCubeMapTargetTexture(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, yposImage) )
+
+    if ( !success )
     {
-        glDeleteTextures(1, &cubeTexture);
+        for ( int i = 0; i < 6; i++ )
+        {
+            free(faces[i]);
+            faces[i] = NULL;
+        }
         return false;
     }
-    if ( !LoadCubeMapTargetTexture(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, znegImage) )
+
+    *faceSize = widths[0];
+    return true;
+}
+
+bool LoadCubeTextureFromBundle(const char* xnegImage,
+                               const char* xposImage,
+                               const char* ynegImage,
+                               const char* yposImage,
+                               const char* znegImage,
+                               const char* zposImage,
+                               GLuint* texture)
+{
+    // Nothing is uploaded until all faces have loaded
+    void* faces[6];
+    int faceSize;
+    if ( !LoadCubeFaceDataFromBundle(xnegImage, xposImage, ynegImage,
+                                     yposImage, znegImage, zposImage,
+                                     faces, &faceSize) )
     {
-        glDeleteTextures(1, &cubeTexture);
         return false;
     }
-    if ( !LoadCubeMapTargetTexture(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, zposImage) )
+
+    bool success = CreateCubeTexture(faceSize, faces, texture);
+
+    for ( int i = 0; i < 6; i++ )
     {
-        glDeleteTextures(1, &cubeTexture);
-        return false;
+        free(faces[i]);
     }
 
-    *texture = cubeTexture;
-    return true;
+    return success;
+}
+
+bool ExtensionPresent(const char* extension)
+{
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    return ( (extensions != NULL) && (strstr(extensions, extension) != NULL) );
 }
 
 bool DepthBufferExtensionPresent()
 {
-    return ( strstr((const char*)glGetString(GL_EXTENSIONS),
-                    DepthTextureExtension) != NULL );
+    return ExtensionPresent(DepthTextureExtension);
 }
 
 bool PackedDepthStencilExtensionPresent()
 {
-    return ( strstr((const char*)glGetString(GL_EXTENSIONS),
-                    PackedDepthStencilExtension) != NULL );
+    return ExtensionPresent(PackedDepthStencilExtension);
+}
+
+int GetGLESMajorVersion()
+{
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int major = 0;
+    if ( (version == NULL) ||
+         (sscanf(version, "OpenGL ES %d", &major) != 1) )
+    {
+        return 0;
+    }
+
+    return major;
+}
+
+size_t DefaultTextureBudget()
+{
+    // Share of the physical RAM used as the default budget
+    const size_t BudgetDivisor = 8;
+
+    // Budget used if the amount of RAM is not known
+    const size_t FallbackBudgetBytes = 64 * 1024 * 1024;
+
+    size_t totalRamKb = GetTotalRam();
+    if ( totalRamKb == 0 )
+    {
+        return FallbackBudgetBytes;
+    }
+
+    return (size_t)((uint64_t)totalRamKb * 1024 / BudgetDivisor);
 }
 
 bool CreateDepthTextureAndFBO(GLuint* fboId, GLuint* depthTextureId,
@@ -10,12 +10,17 @@
 #import "ImageHelper.h"
 
 #include "CommonFunctions.h"
-
-static const size_t RGBAPixelSize = 4;
+#include "ResourcePack.h"
 
 bool ReadBundleFile(const char* fileName, bool zeropad, 
                     size_t* size, void** buffer) 
 {
+    // Mounted resource packs take precedence over loose files
+    if ( ReadResourcePackFile(fileName, zeropad, size, buffer) )
+    {
+        return true;
+    }
+
     NSBundle* bundle = [NSBundle mainBundle];
     NSString* path = [bundle pathForResource:[NSString stringWithUTF8String:fileName] ofType:nil];
     if ( path == nil ) {
@@ -23,7 +28,14 @@ bool ReadBundleFile(const char* fileName, bool zeropad,
         return false;
     }
 
-    NSData* nsdata = [NSData dataWithContentsOfFile:path];
+    // Map the file so that it is only copied once, into our buffer
+    NSData* nsdata = [NSData dataWithContentsOfFile:path
+                                            options:NSDataReadingMappedIfSafe
+                                              error:nil];
+    if ( nsdata == nil ) {
+        LOG_DEBUG("ReadBundleFile(): Failed to read file: %s", fileName);
+        return false;
+    }
     
     size_t totalSize = nsdata.length;
     if ( zeropad ) 
@@ -39,8 +51,8 @@ bool ReadBundleFile(const char* fileName, bool zeropad,
     }
 
     // Copy the file data into the newly allocated buffer
-    memset(data, 0, totalSize);
-    memcpy(data, nsdata.bytes, nsdata.length);
+    [nsdata getBytes:data length:nsdata.length];
+    memset(data + nsdata.length, 0, totalSize - nsdata.length);
     
     // Fill in the caller's data
     *buffer = data;
@@ -49,39 +61,92 @@ bool ReadBundleFile(const char* fileName, bool zeropad,
     return true;
 }
 
-bool LoadImageFromBundle(const char* imageName, void** data, 
-                         int* imageWidth, int* imageHeight) 
+static void ReleaseNSData(const void* data, size_t size, void* context)
+{
+    [(NSData*)context release];
+}
+
+bool MapBundleFile(const char* fileName, bool zeropad, BundleFileView* view)
+{
+    if ( MapResourcePackFile(fileName, zeropad, view) )
+    {
+        return true;
+    }
+
+    // A mapped NSData carries no zero padding
+    if ( zeropad )
+    {
+        return view->ReadCopy(fileName, zeropad);
+    }
+
+    NSBundle* bundle = [NSBundle mainBundle];
+    NSString* path = [bundle pathForResource:[NSString stringWithUTF8String:fileName] ofType:nil];
+    if ( path == nil ) {
+        LOG_DEBUG("MapBundleFile(): Failed to find file: %s", fileName);
+        return false;
+    }
+
+    // The view keeps the NSData (and with it the mapping) alive
+    NSData* nsdata = [[NSData alloc] initWithContentsOfFile:path
+                                                    options:NSDataReadingMappedIfSafe
+                                                      error:nil];
+    if ( nsdata == nil ) {
+        LOG_DEBUG("MapBundleFile(): Failed to read file: %s", fileName);
+        return false;
+    }
+
+    view->Set(nsdata.bytes, nsdata.length, ReleaseNSData, nsdata);
+
+    return true;
+}
+
+bool LoadImageDataFromBundle(const char* imageName, void** data, 
+                             int* imageWidth, int* imageHeight,
+                             TextureFormat format, int conversionFlags) 
 {
-    UIImage* image = [UIImage imageNamed:[NSString stringWithUTF8String:imageName]];
-    if ( image == nil ) {
-        LOG_DEBUG("LoadImageFromBundle(): Failed to load texture file %s", imageName);
+    // Decoded straight from the file view, which also finds images in the
+    // mounted resource packs. imageWithData: (unlike imageNamed:) is safe
+    // to use off the main thread and does not keep the image cached
+    BundleFileView file;
+    if ( !MapBundleFile(imageName, false, &file) ) {
+        LOG_DEBUG("LoadImageDataFromBundle(): Failed to load texture file %s", imageName);
         return false;
     }
+
+    int width = 0;
+    int height = 0;
+    unsigned char* imageData = NULL;
+
+    // The image refers to the view's bytes; it must be gone before the view
+    @autoreleasepool {
+        NSData* fileData = [NSData dataWithBytesNoCopy:(void*)file.GetData()
+                                                length:file.GetSize()
+                                          freeWhenDone:NO];
+        UIImage* image = [UIImage imageWithData:fileData];
+        if ( image == nil ) {
+            LOG_DEBUG("LoadImageDataFromBundle(): Failed to decode texture file %s", imageName);
+            return false;
+        }
+
+        width = (int)image.size.width;
+        height = (int)image.size.height;
+
+        // Extract RGBA data
+        imageData = [ImageHelper convertUIImageToBitmapRGBA8:image];
+    }
     
-    int width = (int)image.size.width;
-    int height = (int)image.size.height;
-    int scanlineSize = width * RGBAPixelSize;
-    
-    // Extract RGBA data
-    unsigned char* imageData = [ImageHelper convertUIImageToBitmapRGBA8:image];
-    
-    // Flip the image data scanlines around to make it OpenGL format
-    unsigned char* flippedData = (unsigned char*)malloc(width * height * RGBAPixelSize);
+    // Flip the image data scanlines around to make it OpenGL format,
+    // converting it in the same pass
+    unsigned char* flippedData = (unsigned char*)malloc(width * height * GetTextureFormatPixelSize(format));
     if ( flippedData == NULL ) 
     {
-        LOG_DEBUG("LoadImageFromBundle(): memory allocation failed.");
+        LOG_DEBUG("LoadImageDataFromBundle(): memory allocation failed.");
+        free(imageData);
         return false;
     }
     
-    unsigned char* srcPtr = imageData + (height - 1) * scanlineSize;
-    unsigned char* dstPtr = flippedData; 
-    
-    for ( int i = 0; i < height; i++ ) 
-    {
-        memcpy(dstPtr, srcPtr, scanlineSize);
-        srcPtr -= scanlineSize;
-        dstPtr += scanlineSize;
-    }
+    ConvertTextureData(imageData, width, height, format,
+                       conversionFlags ^ ConvertFlip, flippedData);
     
     free(imageData);
     *data = flippedData;
@@ -99,7 +164,7 @@ bool Load2DTextureFromBundle(const char* imageName, GLuint* texture,
     
     LOG_DEBUG("Load2DTextureFromBundle(): imageName: %s", imageName);
     
-    if ( !LoadImageFromBundle(imageName, &data, &width, &height) ) 
+    if ( !LoadImageDataFromBundle(imageName, &data, &width, &height) ) 
     {
         return false;
     }
@@ -116,7 +181,7 @@ bool LoadCubeMapTargetTexture(GLenum target, const char* imageName)
     void* data; 
     int width, height; 
     
-    if ( !LoadImageFromBundle(imageName, &data, &width, &height) ) 
+    if ( !LoadImageDataFromBundle(imageName, &data, &width, &height) ) 
     {
         return false;
     }
@@ -129,6 +194,65 @@ bool LoadCubeMapTargetTexture(GLenum target, const char* imageName)
     return true;
 }
 
+bool GetBundleFileInfo(const char* fileName, size_t* size,
+                       int64_t* modificationTime)
+{
+    std::string packFileName;
+    if ( FindResourcePackFile(fileName, size, &packFileName) )
+    {
+        size_t packSize;
+        return GetBundleFileInfo(packFileName.c_str(), &packSize,
+                                 modificationTime);
+    }
+
+    NSString* path = [[NSBundle mainBundle]
+                      pathForResource:[NSString stringWithUTF8String:fileName]
+                      ofType:nil];
+    if ( path == nil ) {
+        return false;
+    }
+
+    NSDictionary* attributes = [[NSFileManager defaultManager]
+                                attributesOfItemAtPath:path error:nil];
+    if ( attributes == nil ) {
+        return false;
+    }
+
+    *size = (size_t)[attributes fileSize];
+    *modificationTime = (int64_t)
+            ([[attributes fileModificationDate] timeIntervalSince1970] * 1000);
+
+    return true;
+}
+
+std::string GetCacheDirectory()
+{
+    NSArray* paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory,
+                                                         NSUserDomainMask,
+                                                         YES);
+    if ( [paths count] == 0 ) {
+        return std::string();
+    }
+
+    NSString* path = [[paths objectAtIndex:0]
+                      stringByAppendingPathComponent:@"CommonGL"];
+    if ( ![[NSFileManager defaultManager] createDirectoryAtPath:path
+                                    withIntermediateDirectories:YES
+                                                     attributes:nil
+                                                          error:nil] ) {
+        LOG_DEBUG("GetCacheDirectory(): Failed to create the directory");
+        return std::string();
+    }
+
+    return std::string([path UTF8String]) + "/";
+}
+
+size_t GetTotalRam()
+{
+    unsigned long long totalRam = [NSProcessInfo processInfo].physicalMemory;
+    return (size_t)(totalRam / 1024);
+}
+
 std::string RandomUuid()
 {
     CFUUIDRef theUUID = CFUUIDCreate(NULL);
@@ -0,0 +1,661 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <png.h>
+#include <turbojpeg.h>
+
+#if defined(__BUILD_NULLGL__)
+  // No real context needed; see NullGL.h
+#elif defined(__USE_OSMESA__)
+  #include <GL/osmesa.h>
+#else
+  #include <EGL/egl.h>
+  #include <EGL/eglext.h>
+#endif
+
+#include "CommonFunctions.h"
+#include "ResourcePack.h"
+
+static const size_t RGBAPixelSize = 4;
+
+// Environment variable consulted for the initial resource root
+static const char* const ResourceRootEnvVariable = "COMMONGL_RESOURCE_ROOT";
+
+static std::string MakeDirectoryPath(const char* path)
+{
+    std::string directory = path;
+    if ( directory.empty() || (directory[directory.size() - 1] != '/') )
+    {
+        directory += '/';
+    }
+
+    return directory;
+}
+
+static std::string DefaultResourceRoot()
+{
+    const char* root = getenv(ResourceRootEnvVariable);
+    return MakeDirectoryPath((root != NULL) ? root : ".");
+}
+
+static std::string& ResourceRoot()
+{
+    // Thread safe initialization; files are loaded on worker threads too
+    static std::string root = DefaultResourceRoot();
+    return root;
+}
+
+std::string GetBundleFilePath(const char* fileName)
+{
+    return ResourceRoot() + fileName;
+}
+
+void SetResourceRoot(const char* path)
+{
+    ResourceRoot() = MakeDirectoryPath(path);
+}
+
+bool ReadBundleFile(const char* fileName, bool zeropad,
+                    size_t* size, void** buffer)
+{
+    // Mounted resource packs take precedence over loose files
+    if ( ReadResourcePackFile(fileName, zeropad, size, buffer) )
+    {
+        return true;
+    }
+
+    std::string path = GetBundleFilePath(fileName);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 )
+    {
+        LOG_DEBUG("ReadBundleFile(): Failed to open file: %s", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat(fd, &st) != 0 )
+    {
+        LOG_DEBUG("ReadBundleFile(): Failed to stat file: %s", path.c_str());
+        close(fd);
+        return false;
+    }
+
+    size_t fileSize = st.st_size;
+    size_t totalSize = fileSize;
+    if ( zeropad )
+    {
+        // One extra byte for zero padding just in case we're reading strings
+        totalSize++;
+    }
+
+    char* data = (char*)malloc(totalSize);
+    if ( data == NULL )
+    {
+        LOG_DEBUG("ReadBundleFile(): Failed to malloc() %d bytes", totalSize);
+        close(fd);
+        return false;
+    }
+
+    // Read the whole file; pread() may return less than asked for
+    size_t offset = 0;
+    while ( offset < fileSize )
+    {
+        ssize_t numRead = pread(fd, data + offset, fileSize - offset, offset);
+        if ( numRead < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            LOG_DEBUG("ReadBundleFile(): Failed to read file: %s", fileName);
+            free(data);
+            close(fd);
+            return false;
+        }
+        if ( numRead == 0 )
+        {
+            // File was truncated while reading
+            break;
+        }
+        offset += numRead;
+    }
+    close(fd);
+
+    // Only the padding needs clearing; the rest was just read over
+    memset(data + offset, 0, totalSize - offset);
+
+    // Fill in the caller's data
+    *buffer = data;
+    *size = totalSize;
+
+    return true;
+}
+
+static void UnmapRelease(const void* data, size_t size, void* /*context*/)
+{
+    munmap((void*)data, size);
+}
+
+bool MapBundleFile(const char* fileName, bool zeropad, BundleFileView* view)
+{
+    if ( MapResourcePackFile(fileName, zeropad, view) )
+    {
+        return true;
+    }
+
+    std::string path = GetBundleFilePath(fileName);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 )
+    {
+        LOG_DEBUG("MapBundleFile(): Failed to open file: %s", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat(fd, &st) != 0 )
+    {
+        LOG_DEBUG("MapBundleFile(): Failed to stat file: %s", path.c_str());
+        close(fd);
+        return false;
+    }
+
+    // The rest of the last page of a mapping reads as zeros, which provides
+    // the padding unless the file ends exactly at a page boundary
+    size_t fileSize = st.st_size;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    if ( (fileSize == 0) || (zeropad && ((fileSize % pageSize) == 0)) )
+    {
+        close(fd);
+        return view->ReadCopy(fileName, zeropad);
+    }
+
+    void* data = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( data == MAP_FAILED )
+    {
+        LOG_DEBUG("MapBundleFile(): mmap() failed for %s", path.c_str());
+        return view->ReadCopy(fileName, zeropad);
+    }
+
+    view->Set(data, fileSize, UnmapRelease, NULL);
+
+    return true;
+}
+
+bool GetBundleFileInfo(const char* fileName, size_t* size,
+                       int64_t* modificationTime)
+{
+    std::string packFileName;
+    if ( FindResourcePackFile(fileName, size, &packFileName) )
+    {
+        size_t packSize;
+        return GetBundleFileInfo(packFileName.c_str(), &packSize,
+                                 modificationTime);
+    }
+
+    struct stat st;
+    if ( stat(GetBundleFilePath(fileName).c_str(), &st) != 0 )
+    {
+        return false;
+    }
+
+    *size = st.st_size;
+    *modificationTime = (int64_t)st.st_mtim.tv_sec * 1000000000 +
+            st.st_mtim.tv_nsec;
+
+    return true;
+}
+
+std::string GetCacheDirectory()
+{
+    std::string path;
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if ( (cacheHome != NULL) && (cacheHome[0] != '\0') )
+    {
+        path = cacheHome;
+    }
+    else if ( (home != NULL) && (home[0] != '\0') )
+    {
+        path = std::string(home) + "/.cache";
+        mkdir(path.c_str(), 0700);
+    }
+    else
+    {
+        return std::string();
+    }
+
+    path += "/commongl";
+    if ( (mkdir(path.c_str(), 0700) != 0) && (errno != EEXIST) )
+    {
+        LOG_DEBUG("GetCacheDirectory(): Failed to create %s", path.c_str());
+        return std::string();
+    }
+
+    return path + "/";
+}
+
+/**
+ * Decodes a PNG image into RGBA. Passing a negative row stride makes libpng
+ * write the rows bottom-up, which is the order OpenGL expects.
+ */
+static bool DecodePng(const void* fileData, size_t fileSize, void** data,
+                      int* imageWidth, int* imageHeight)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+
+    if ( !png_image_begin_read_from_memory(&image, fileData, fileSize) )
+    {
+        LOG_DEBUG("DecodePng(): %s", image.message);
+        return false;
+    }
+
+    image.format = PNG_FORMAT_RGBA;
+    int scanlineSize = image.width * RGBAPixelSize;
+    void* pixels = malloc(scanlineSize * image.height);
+    if ( pixels == NULL )
+    {
+        LOG_DEBUG("DecodePng(): memory allocation failed.");
+        png_image_free(&image);
+        return false;
+    }
+
+    if ( !png_image_finish_read(&image, NULL, pixels, -scanlineSize, NULL) )
+    {
+        LOG_DEBUG("DecodePng(): %s", image.message);
+        free(pixels);
+        return false;
+    }
+
+    *data = pixels;
+    *imageWidth = image.width;
+    *imageHeight = image.height;
+
+    return true;
+}
+
+/** Decodes a JPEG image into RGBA, rows bottom-up. */
+static bool DecodeJpeg(const void* fileData, size_t fileSize, void** data,
+                       int* imageWidth, int* imageHeight)
+{
+    tjhandle decompressor = tjInitDecompress();
+    if ( decompressor == NULL )
+    {
+        LOG_DEBUG("DecodeJpeg(): %s", tjGetErrorStr());
+        return false;
+    }
+
+    int width, height, subsampling, colorspace;
+    if ( tjDecompressHeader3(decompressor, (const unsigned char*)fileData,
+                             fileSize, &width, &height, &subsampling,
+                             &colorspace) != 0 )
+    {
+        LOG_DEBUG("DecodeJpeg(): %s", tjGetErrorStr2(decompressor));
+        tjDestroy(decompressor);
+        return false;
+    }
+
+    void* pixels = malloc(width * height * RGBAPixelSize);
+    if ( pixels == NULL )
+    {
+        LOG_DEBUG("DecodeJpeg(): memory allocation failed.");
+        tjDestroy(decompressor);
+        return false;
+    }
+
+    if ( tjDecompress2(decompressor, (const unsigned char*)fileData, fileSize,
+                       (unsigned char*)pixels, width, 0, height, TJPF_RGBA,
+                       TJFLAG_BOTTOMUP | TJFLAG_FASTDCT) != 0 )
+    {
+        LOG_DEBUG("DecodeJpeg(): %s", tjGetErrorStr2(decompressor));
+        free(pixels);
+        tjDestroy(decompressor);
+        return false;
+    }
+    tjDestroy(decompressor);
+
+    *data = pixels;
+    *imageWidth = width;
+    *imageHeight = height;
+
+    return true;
+}
+
+bool LoadImageDataFromBundle(const char* imageName, void** data,
+                             int* imageWidth, int* imageHeight,
+                             TextureFormat format, int conversionFlags)
+{
+    BundleFileView file;
+    if ( !MapBundleFile(imageName, false, &file) )
+    {
+        LOG_DEBUG("LoadImageDataFromBundle(): Failed to load texture file %s",
+                  imageName);
+        return false;
+    }
+
+    const void* fileData = file.GetData();
+    size_t fileSize = file.GetSize();
+
+    // Identify the format by its signature rather than by the file name
+    static const unsigned char JpegSignature[] = { 0xff, 0xd8, 0xff };
+    bool success = false;
+    if ( (fileSize >= 8) &&
+         (png_sig_cmp((png_const_bytep)fileData, 0, 8) == 0) )
+    {
+        success = DecodePng(fileData, fileSize, data, imageWidth, imageHeight);
+    }
+    else if ( (fileSize >= sizeof(JpegSignature)) &&
+              (memcmp(fileData, JpegSignature, sizeof(JpegSignature)) == 0) )
+    {
+        success = DecodeJpeg(fileData, fileSize, data,
+                             imageWidth, imageHeight);
+    }
+    else
+    {
+        LOG_DEBUG("LoadImageDataFromBundle(): unsupported image format: %s",
+                  imageName);
+    }
+
+    // The decoders flipped the rows already; convert in place
+    if ( success && !ConvertTextureBuffer(data, *imageWidth, *imageHeight,
+                                          format, conversionFlags) )
+    {
+        LOG_DEBUG("LoadImageDataFromBundle(): memory allocation failed.");
+        free(*data);
+        success = false;
+    }
+
+    return success;
+}
+
+bool Load2DTextureFromBundle(const char* imageName, GLuint* texture,
+                             bool clamp, bool useMipmaps)
+{
+    void* data;
+    int width, height;
+
+    LOG_DEBUG("Load2DTextureFromBundle(): imageName: %s", imageName);
+
+    if ( !LoadImageDataFromBundle(imageName, &data, &width, &height) )
+    {
+        return false;
+    }
+
+    // Upload the texture to OpenGL and create the texture object
+    Create2DTexture(width, height, data, texture, clamp, useMipmaps);
+    free(data);
+
+    return true;
+}
+
+bool LoadCubeMapTargetTexture(GLenum target, const char* imageName)
+{
+    void* data;
+    int width, height;
+
+    if ( !LoadImageDataFromBundle(imageName, &data, &width, &height) )
+    {
+        return false;
+    }
+
+    // Upload the texture to OpenGL and create the texture object
+    glTexImage2D(target, 0, GL_RGBA, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, data);
+    free(data);
+
+    return true;
+}
+
+size_t GetTotalRam()
+{
+    long numPages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if ( (numPages < 0) || (pageSize < 0) )
+    {
+        return 0;
+    }
+
+    return (size_t)((uint64_t)numPages * pageSize / 1024);
+}
+
+std::string RandomUuid()
+{
+    unsigned char bytes[16];
+    bool success = false;
+
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if ( fd >= 0 )
+    {
+        success = (read(fd, bytes, sizeof(bytes)) == sizeof(bytes));
+        close(fd);
+    }
+
+    if ( !success )
+    {
+        LOG_DEBUG("RandomUuid(): /dev/urandom not available");
+        for ( size_t i = 0; i < sizeof(bytes); i++ )
+        {
+            bytes[i] = rand() & 0xff;
+        }
+    }
+
+    // Version 4 (random), RFC 4122 variant
+    bytes[6] = (bytes[6] & 0x0f) | 0x40;
+    bytes[8] = (bytes[8] & 0x3f) | 0x80;
+
+    char uuid[37];
+    snprintf(uuid, sizeof(uuid),
+             "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-"
+             "%02x%02x%02x%02x%02x%02x",
+             bytes[0], bytes[1], bytes[2], bytes[3], bytes[4], bytes[5],
+             bytes[6], bytes[7], bytes[8], bytes[9], bytes[10], bytes[11],
+             bytes[12], bytes[13], bytes[14], bytes[15]);
+
+    return std::string(uuid);
+}
+
+// Headless context
+
+#if defined(__BUILD_NULLGL__)
+
+bool CreateHeadlessContext(int width, int height)
+{
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+void DestroyHeadlessContext()
+{
+}
+
+#elif defined(__USE_OSMESA__)
+
+static OSMesaContext s_context = NULL;
+static void* s_colorBuffer = NULL;
+
+bool CreateHeadlessContext(int width, int height)
+{
+    s_context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+    if ( s_context == NULL )
+    {
+        LOG_DEBUG("CreateHeadlessContext(): OSMesaCreateContextExt() failed");
+        return false;
+    }
+
+    s_colorBuffer = malloc(width * height * RGBAPixelSize);
+    if ( (s_colorBuffer == NULL) ||
+         !OSMesaMakeCurrent(s_context, s_colorBuffer, GL_UNSIGNED_BYTE,
+                            width, height) )
+    {
+        LOG_DEBUG("CreateHeadlessContext(): OSMesaMakeCurrent() failed");
+        DestroyHeadlessContext();
+        return false;
+    }
+
+    // Rows bottom-up like any other GL framebuffer
+    OSMesaPixelStore(OSMESA_Y_UP, 1);
+
+    return true;
+}
+
+void DestroyHeadlessContext()
+{
+    if ( s_context != NULL )
+    {
+        OSMesaDestroyContext(s_context);
+        s_context = NULL;
+    }
+    free(s_colorBuffer);
+    s_colorBuffer = NULL;
+}
+
+#else
+
+static EGLDisplay s_display = EGL_NO_DISPLAY;
+static EGLContext s_context = EGL_NO_CONTEXT;
+static EGLSurface s_surface = EGL_NO_SURFACE;
+
+/**
+ * Opens a display that needs no window system; Mesa's surfaceless platform
+ * also works with the llvmpipe software rasterizer on machines with no GPU.
+ */
+static EGLDisplay OpenHeadlessDisplay()
+{
+#if defined(EGL_PLATFORM_SURFACELESS_MESA)
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+            eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if ( getPlatformDisplay != NULL )
+    {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                                EGL_DEFAULT_DISPLAY, NULL);
+        if ( display != EGL_NO_DISPLAY )
+        {
+            return display;
+        }
+    }
+#endif
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool CreateHeadlessContext(int width, int height)
+{
+    s_display = OpenHeadlessDisplay();
+    if ( (s_display == EGL_NO_DISPLAY) ||
+         !eglInitialize(s_display, NULL, NULL) )
+    {
+        LOG_DEBUG("CreateHeadlessContext(): failed to initialize EGL");
+        s_display = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8, EGL_DEPTH_SIZE, 24, EGL_STENCIL_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if ( !eglChooseConfig(s_display, configAttribs, &config, 1, &numConfigs) ||
+         (numConfigs == 0) )
+    {
+        LOG_DEBUG("CreateHeadlessContext(): no suitable EGL config");
+        DestroyHeadlessContext();
+        return false;
+    }
+
+    eglBindAPI(EGL_OPENGL_ES_API);
+    const EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    s_context = eglCreateContext(s_display, config, EGL_NO_CONTEXT,
+                                 contextAttribs);
+    if ( s_context == EGL_NO_CONTEXT )
+    {
+        LOG_DEBUG("CreateHeadlessContext(): eglCreateContext() failed: 0x%x",
+                  eglGetError());
+        DestroyHeadlessContext();
+        return false;
+    }
+
+    // The pbuffer acts as the default framebuffer. Without one the context
+    // is made current surfaceless and rendering must target an FBO.
+    const EGLint surfaceAttribs[] = {
+        EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE
+    };
+    s_surface = eglCreatePbufferSurface(s_display, config, surfaceAttribs);
+    if ( s_surface == EGL_NO_SURFACE )
+    {
+        LOG_DEBUG("CreateHeadlessContext(): no pbuffer, going surfaceless");
+    }
+
+    if ( !eglMakeCurrent(s_display, s_surface, s_surface, s_context) )
+    {
+        LOG_DEBUG("CreateHeadlessContext(): eglMakeCurrent() failed: 0x%x",
+                  eglGetError());
+        DestroyHeadlessContext();
+        return false;
+    }
+
+    return true;
+}
+
+void DestroyHeadlessContext()
+{
+    if ( s_display == EGL_NO_DISPLAY )
+    {
+        return;
+    }
+
+    eglMakeCurrent(s_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if ( s_surface != EGL_NO_SURFACE )
+    {
+        eglDestroySurface(s_display, s_surface);
+        s_surface = EGL_NO_SURFACE;
+    }
+    if ( s_context != EGL_NO_CONTEXT )
+    {
+        eglDestroyContext(s_display, s_context);
+        s_context = EGL_NO_CONTEXT;
+    }
+    eglTerminate(s_display);
+    s_display = EGL_NO_DISPLAY;
+}
+
+#endif
+
+void PrintLogDebug(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    char msg[1024*16];
+    vsnprintf(msg, sizeof(msg) - 1, fmt, args);
+    va_end(args);
+
+    // Timestamp with millisecond precision
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    struct tm localTime;
+    localtime_r(&now.tv_sec, &localTime);
+
+    fprintf(stderr, "%02d:%02d:%02d.%03ld %s\n", localTime.tm_hour,
+            localTime.tm_min, localTime.tm_sec, now.tv_nsec / 1000000, msg);
+}
+
+#ifdef DEBUG
+void DebugAssert(bool criteria)
+{
+    assert(criteria);
+}
+#endif
@@ -1,12 +1,35 @@
 #include <QDebug>
 #include <QFile>
+#include <QResource>
 #include <QUuid>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCoreApplication>
+#if QT_VERSION >= 0x050000
+  #include <QStandardPaths>
+#else
+  #include <QDesktopServices>
+#endif
+
+#if defined(Q_OS_WIN)
+  #include <windows.h>
+#elif defined(Q_OS_UNIX)
+  #include <unistd.h>
+#endif
 
 #include "CommonFunctions.h"
+#include "ResourcePack.h"
 
 bool ReadBundleFile(const char* fileName, bool zeropad,
                     size_t* size, void** buffer)
 {
+    // Mounted resource packs take precedence over loose files
+    if ( ReadResourcePackFile(fileName, zeropad, size, buffer) )
+    {
+        return true;
+    }
+
     QString resFileName = QString(":/") + fileName;
     QFile file(resFileName);
     if ( !file.open(QIODevice::ReadOnly) )
@@ -30,10 +53,16 @@ bool ReadBundleFile(const char* fileName, bool zeropad,
         return false;
     }
 
-    memset(data, 0, totalSize);
-    QByteArray byteArray = file.readAll();
-    memcpy(data, byteArray.constData(), file.size());
+    // Read straight into the buffer; only the padding needs clearing
+    qint64 numRead = file.read(data, file.size());
     file.close();
+    if ( numRead < 0 )
+    {
+        LOG_DEBUG("ReadBundleFile(): Failed to read file: %s", fileName);
+        free(data);
+        return false;
+    }
+    memset(data + numRead, 0, totalSize - numRead);
 
     // Fill in the caller's data
     *buffer = data;
@@ -42,13 +71,78 @@ bool ReadBundleFile(const char* fileName, bool zeropad,
     return true;
 }
 
+bool MapBundleFile(const char* fileName, bool zeropad, BundleFileView* view)
+{
+    if ( MapResourcePackFile(fileName, zeropad, view) )
+    {
+        return true;
+    }
+
+    // Uncompressed resources are compiled into the binary as is and can be
+    // used in place; they carry no zero padding though
+    QResource resource(QString(":/") + fileName);
+    if ( resource.isValid() && !resource.isCompressed() && !zeropad )
+    {
+        view->Set(resource.data(), resource.size(), NULL, NULL);
+        return true;
+    }
+
+    return view->ReadCopy(fileName, zeropad);
+}
+
+bool GetBundleFileInfo(const char* fileName, size_t* size,
+                       int64_t* modificationTime)
+{
+    std::string packFileName;
+    if ( FindResourcePackFile(fileName, size, &packFileName) )
+    {
+        size_t packSize;
+        return GetBundleFileInfo(packFileName.c_str(), &packSize,
+                                 modificationTime);
+    }
+
+    QFileInfo info(QString(":/") + fileName);
+    if ( !info.exists() )
+    {
+        return false;
+    }
+    *size = info.size();
+
+    // Resources are compiled into the binary, which changes when they do
+    QFileInfo binaryInfo(QCoreApplication::applicationFilePath());
+    *modificationTime = binaryInfo.lastModified().toMSecsSinceEpoch();
+
+    return true;
+}
+
+std::string GetCacheDirectory()
+{
+#if QT_VERSION >= 0x050000
+    QString path =
+            QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+#else
+    QString path =
+            QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+    if ( path.isEmpty() || !QDir().mkpath(path) )
+    {
+        LOG_DEBUG("GetCacheDirectory(): no cache directory available");
+        return std::string();
+    }
+
+    return std::string((path + "/").toUtf8());
+}
+
 bool LoadImageFromBundle(const char* imageName, QImage& image)
 {
     LOG_DEBUG("LoadImageFromBundle(): loading '%s'", imageName);
-    QString imageNameS = QString(imageName);
 
-    QString resImgName = QString(":/") + imageNameS;
-    if ( !image.load(resImgName) )
+    // Decoded straight from the file view; this also finds images in the
+    // mounted resource packs
+    BundleFileView file;
+    if ( !MapBundleFile(imageName, false, &file) ||
+         !image.loadFromData((const uchar*)file.GetData(),
+                             (int)file.GetSize()) )
     {
         LOG_DEBUG("failed to load texture: %s", imageName);
         return false;
@@ -64,6 +158,36 @@ bool LoadImageFromBundle(const char* imageName, QImage& image)
     return true;
 }
 
+bool LoadImageDataFromBundle(const char* imageName, void** data,
+                             int* width, int* height,
+                             TextureFormat format, int conversionFlags)
+{
+    QImage image;
+    if ( !LoadImageFromBundle(imageName, image) )
+    {
+        return false;
+    }
+
+    // convertToGLFormat() already gave us flipped RGBA; convert it while
+    // copying it out of the image
+    size_t size = image.width() * image.height() *
+            GetTextureFormatPixelSize(format);
+    void* pixels = malloc(size);
+    if ( pixels == NULL )
+    {
+        LOG_DEBUG("LoadImageDataFromBundle(): memory allocation failed.");
+        return false;
+    }
+    ConvertTextureData(image.constBits(), image.width(), image.height(),
+                       format, conversionFlags, pixels);
+
+    *data = pixels;
+    *width = image.width();
+    *height = image.height();
+
+    return true;
+}
+
 bool Load2DTextureFromBundle(const char* imageName, GLuint* texture,
                              bool clamp, bool useMipmaps)
 {
@@ -96,6 +220,31 @@ bool LoadCubeMapTargetTexture(GLenum target, const char* imageName)
     return true;
 }
 
+size_t GetTotalRam()
+{
+#if defined(Q_OS_WIN)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if ( !GlobalMemoryStatusEx(&status) )
+    {
+        return 0;
+    }
+
+    return (size_t)(status.ullTotalPhys / 1024);
+#elif defined(Q_OS_UNIX)
+    long numPages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if ( (numPages < 0) || (pageSize < 0) )
+    {
+        return 0;
+    }
+
+    return (size_t)((quint64)numPages * pageSize / 1024);
+#else
+    return 0;
+#endif
+}
+
 std::string RandomUuid()
 {
     // .mid(1,36) strips the curly braces added by toString(), duh
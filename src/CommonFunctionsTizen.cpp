@@ -1,3 +1,5 @@
+#include <unistd.h>
+
 #include <FBase.h>
 #include <FApp.h>
 #include <FIo.h>
@@ -5,6 +7,7 @@
 #include <FMedia.h>
 
 #include "CommonFunctions.h"
+#include "ResourcePack.h"
 
 using namespace Tizen::App;
 using namespace Tizen::Base;
@@ -16,6 +19,12 @@ using namespace Tizen::Media;
 bool ReadBundleFile(const char* fileName, bool zeropad,
                     size_t* size, void** buffer)
 {
+    // Mounted resource packs take precedence over loose files
+    if ( ReadResourcePackFile(fileName, zeropad, size, buffer) )
+    {
+	return true;
+    }
+
     String dirPath = App::GetInstance()->GetAppResourcePath();
     File file;
 
@@ -45,8 +54,13 @@ bool ReadBundleFile(const char* fileName, bool zeropad,
 	return false;
     }
 
-    memset(data, 0, totalSize);
-    file.Read(data, fileSize);
+    // Only the padding needs clearing; the rest is read over
+    int numRead = file.Read(data, fileSize);
+    if ( numRead < 0 )
+    {
+	numRead = 0;
+    }
+    memset(data + numRead, 0, totalSize - numRead);
 
     // Fill in the caller's data
     *buffer = data;
@@ -55,87 +69,166 @@ bool ReadBundleFile(const char* fileName, bool zeropad,
     return true;
 }
 
-Bitmap* ReadImageFromBundle(String fileName)
+bool MapBundleFile(const char* fileName, bool zeropad, BundleFileView* view)
 {
-    String filepath = App::GetInstance()->GetAppResourcePath() + fileName;
-    AppLogDebug("Loading image from path: %ls", filepath.GetPointer());
+    if ( MapResourcePackFile(fileName, zeropad, view) )
+    {
+	return true;
+    }
+
+    // No memory mapping available through the Tizen file API
+    return view->ReadCopy(fileName, zeropad);
+}
+
+bool LoadImageDataFromBundle(const char* imageName, void** data,
+                             int* width, int* height,
+                             TextureFormat format, int conversionFlags)
+{
+    // Decoded from the file view, so that images in the mounted resource
+    // packs are found too
+    BundleFileView file;
+    if ( !MapBundleFile(imageName, false, &file) )
+    {
+	LOG_DEBUG("LoadImageDataFromBundle(): Failed to read %s", imageName);
+	return false;
+    }
+
+    // Wraps the view's bytes without copying them
+    ByteBuffer source;
+    if ( source.Construct((const byte*)file.GetData(), 0, (int)file.GetSize(),
+                          (int)file.GetSize()) != E_SUCCESS )
+    {
+	LOG_DEBUG("LoadImageDataFromBundle(): Failed to read %s", imageName);
+	return false;
+    }
 
     Image image;
     image.Construct();
 
-    // Flip the image for OpenGL
     int imageWidth = 0;
     int imageHeight = 0;
-    std::unique_ptr<ByteBuffer> originalBuffer(image.DecodeToBufferN(filepath,
-                                                                     BITMAP_PIXEL_FORMAT_R8G8B8A8,
-                                                                     imageWidth, imageHeight));
-    result r;
-    Dimension dimension(imageWidth, imageHeight);
-    ByteBuffer flippedBuffer;
-    r = flippedBuffer.Construct(originalBuffer->GetCapacity());
-    if ( IsFailed(r) )
+    std::unique_ptr<ByteBuffer> buffer(image.DecodeToBufferN(source,
+                                                             BITMAP_PIXEL_FORMAT_R8G8B8A8,
+                                                             imageWidth, imageHeight));
+    if ( buffer.get() == NULL )
     {
-	LOG_INFO("Failed to Construct() bytebuffer; result: %d", r);
+	LOG_DEBUG("LoadImageDataFromBundle(): Failed to decode %s", imageName);
+	return false;
     }
 
-    r = ImageUtil::Flip(*originalBuffer, flippedBuffer, dimension, IMAGE_FLIP_VERTICAL,
-                        MEDIA_PIXEL_FORMAT_RGBA8888);
-    if ( IsFailed(r) )
+    void* pixels = malloc(imageWidth * imageHeight *
+                          GetTextureFormatPixelSize(format));
+    if ( pixels == NULL )
     {
-	LOG_INFO("Failed to flip bitmap; result: %d", r);
+	LOG_DEBUG("LoadImageDataFromBundle(): memory allocation failed.");
+	return false;
     }
 
-    Bitmap* bitmap = new (std::nothrow) Bitmap();
-    bitmap->Construct(flippedBuffer, dimension, BITMAP_PIXEL_FORMAT_ARGB8888);
+    // Flip the image for OpenGL, converting it in the same pass
+    ConvertTextureData(buffer->GetPointer(), imageWidth, imageHeight, format,
+                       conversionFlags ^ ConvertFlip, pixels);
 
-    return bitmap;
+    *data = pixels;
+    *width = imageWidth;
+    *height = imageHeight;
+
+    return true;
 }
 
 bool Load2DTextureFromBundle(const char* imageName, GLuint* texture,
 				 bool clamp, bool useMipmaps)
 {
-    std::unique_ptr<Bitmap> bitmap(ReadImageFromBundle(imageName));
-    BufferInfo bufferInfo;
-    if ( IsFailed(bitmap->Lock(bufferInfo)) )
+    void* data;
+    int width, height;
+    if ( !LoadImageDataFromBundle(imageName, &data, &width, &height) )
     {
-	LOG_DEBUG("Failed to lock the bitmap!");
 	return false;
     }
 
-    LOG_DEBUG("Read bitmap with dimensions: %d x %d",
-              bufferInfo.width, bufferInfo.height);
+    LOG_DEBUG("Read bitmap with dimensions: %d x %d", width, height);
 
     // Upload the texture to OpenGL and create the texture object
-    Create2DTexture(bufferInfo.width, bufferInfo.height, bufferInfo.pPixels,
-                    texture, clamp, useMipmaps);
+    Create2DTexture(width, height, data, texture, clamp, useMipmaps);
 
     LOG_GL_ERROR();
 
-    bitmap->Unlock();
+    free(data);
 
     return true;
 }
 
 bool LoadCubeMapTargetTexture(GLenum target, const char* imageName)
 {
-    std::unique_ptr<Bitmap> bitmap(ReadImageFromBundle(imageName));
-    BufferInfo bufferInfo;
-    if ( IsFailed(bitmap->Lock(bufferInfo)) )
+    void* data;
+    int width, height;
+    if ( !LoadImageDataFromBundle(imageName, &data, &width, &height) )
     {
-	LOG_DEBUG("Failed to lock the bitmap!");
 	return false;
     }
 
     // Upload the texture to OpenGL and create the texture object
-    glTexImage2D(target, 0, GL_RGBA,
-                 bufferInfo.width, bufferInfo.height, 0, GL_RGBA,
-                 GL_UNSIGNED_BYTE, bufferInfo.pPixels);
+    glTexImage2D(target, 0, GL_RGBA, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, data);
 
-    bitmap->Unlock();
+    free(data);
 
     return true;
 }
 
+bool GetBundleFileInfo(const char* fileName, size_t* size,
+                       int64_t* modificationTime)
+{
+    std::string packFileName;
+    if ( FindResourcePackFile(fileName, size, &packFileName) )
+    {
+	size_t packSize;
+	return GetBundleFileInfo(packFileName.c_str(), &packSize,
+	                         modificationTime);
+    }
+
+    String path = App::GetInstance()->GetAppResourcePath() + fileName;
+    FileAttributes attributes;
+    result r = File::GetAttributes(path, attributes);
+    if ( IsFailed(r) )
+    {
+	return false;
+    }
+
+    *size = (size_t)attributes.GetFileSize();
+    *modificationTime = attributes.GetLastModifiedTime().GetTicks();
+
+    return true;
+}
+
+std::string GetCacheDirectory()
+{
+    String path = App::GetInstance()->GetAppDataPath() + L"cache/";
+    if ( !File::IsFileExist(path) )
+    {
+	result r = Directory::Create(path, true);
+	if ( IsFailed(r) )
+	{
+	    LOG_DEBUG("GetCacheDirectory(): Failed to create the directory");
+	    return std::string();
+	}
+    }
+
+    std::unique_ptr<ByteBuffer> buffer(StringUtil::StringToUtf8N(path));
+    return std::string((const char*)buffer->GetPointer());
+}
+
+size_t GetTotalRam()
+{
+    long numPages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if ( (numPages < 0) || (pageSize < 0) )
+    {
+	return 0;
+    }
+
+    return (size_t)((unsigned long long)numPages * pageSize / 1024);
+}
+
 std::string RandomUuid()
 {
     std::unique_ptr<UuId> uuid(UuId::GenerateN());
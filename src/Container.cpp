@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "Container.h"
 #include "CommonFunctions.h"
 
@@ -5,14 +7,18 @@ namespace CommonGL {
 
 Container::Container(Rect bounds, WidgetTouchListener* listener)
     : BaseWidget(TypeContainer, bounds),
-      m_color()
+      m_color(),
+      m_cached(false),
+      m_cacheDirty(true)
 {
     AddTouchListener(listener);
 }
 
 Container::Container(WidgetTouchListener* listener)
     : BaseWidget(TypeContainer, Rect()),
-      m_color()
+      m_color(),
+      m_cached(false),
+      m_cacheDirty(true)
 {
     AddTouchListener(listener);
 }
@@ -26,20 +32,71 @@ void Container::Add(BaseWidget* child)
 {
     m_children.push_front(child);
     child->m_parent = this;
+    child->Invalidate();
 }
 
 void Container::Remove(BaseWidget* child)
 {
     m_children.remove(child);
     child->m_parent = NULL;
+    child->Invalidate();
+    Invalidate();
+}
+
+void Container::SetCached(bool cached)
+{
+    if ( cached != m_cached )
+    {
+        m_cached = cached;
+        m_cacheDirty = true;
+        Invalidate();
+    }
+}
+
+void Container::Invalidate()
+{
+    m_cacheDirty = true;
+    BaseWidget::Invalidate();
+}
+
+void Container::ChildInvalidated()
+{
+    m_cacheDirty = true;
 }
 
 void Container::Render()
 {
     glUniform4fv(m_context->m_colorShaderColorLoc, 1, m_color);
     //DrawQuad2D(m_context->m_fullscreenRectVertexBuffer, g_rectangleIndexBuffer);
-    DrawQuad2D(m_bounds,
+    DrawQuad2D(TransformedRect(),
                m_context->m_viewportWidth, m_context->m_viewportHeight);
 }
 
+void Container::InvalidateTransformedRect()
+{
+    // The children's caches cannot be valid if this one is not
+    if ( m_transformedRectDirty )
+    {
+        return;
+    }
+
+    BaseWidget::InvalidateTransformedRect();
+
+    std::list<BaseWidget*>::iterator iter;
+    for ( iter = m_children.begin(); iter != m_children.end(); iter++ )
+    {
+        (*iter)->InvalidateTransformedRect();
+    }
+}
+
+bool Container::GetQuad(WidgetQuad* quad)
+{
+    quad->m_rect = TransformedRect();
+    quad->m_texture = 0;
+    quad->m_u1 = quad->m_v1 = quad->m_u2 = quad->m_v2 = 0.0;
+    memcpy(quad->m_color, m_color, sizeof(m_color));
+
+    return true;
+}
+
 } // namespace CommonGL
@@ -0,0 +1,223 @@
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #include <arm_neon.h>
+  #define USE_NEON
+#endif
+
+#include "CubeMapConverter.h"
+#include "ThreadPool.h"
+#include "CommonFunctions.h"
+
+static const int RGBAPixelSize = 4;
+
+// Bilinear weights are fixed point with this many fractional bits per
+// axis; the four weights of a sample add up to 1 << (2 * WeightBits),
+// which must fit a signed 16-bit lane
+static const int WeightBits = 7;
+static const int WeightOne = 1 << WeightBits;
+
+/** The panorama being sampled. */
+struct Panorama
+{
+    const uint8_t* m_data;
+    int m_width;
+    int m_height;
+};
+
+/**
+ * Blends 4 RGBA8 texels with fixed point weights adding up to
+ * WeightOne * WeightOne.
+ */
+static inline uint32_t Blend(uint32_t p00, uint32_t p01, uint32_t p10,
+                             uint32_t p11, int w00, int w01, int w10, int w11)
+{
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+
+    // Interleave the texel pairs channel by channel so that a single
+    // multiply-add weighs both texels of a row
+    __m128i top = _mm_unpacklo_epi8(
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(p00), _mm_cvtsi32_si128(p01)),
+            zero);
+    __m128i bottom = _mm_unpacklo_epi8(
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(p10), _mm_cvtsi32_si128(p11)),
+            zero);
+    __m128i sum = _mm_add_epi32(
+            _mm_madd_epi16(top, _mm_set1_epi32((w01 << 16) | w00)),
+            _mm_madd_epi16(bottom, _mm_set1_epi32((w11 << 16) | w10)));
+    sum = _mm_srli_epi32(
+            _mm_add_epi32(sum, _mm_set1_epi32(1 << (2 * WeightBits - 1))),
+            2 * WeightBits);
+    sum = _mm_packs_epi32(sum, sum);
+
+    return _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+#elif defined(USE_NEON)
+    uint16x8_t top = vmovl_u8(vreinterpret_u8_u32(
+            vset_lane_u32(p01, vdup_n_u32(p00), 1)));
+    uint16x8_t bottom = vmovl_u8(vreinterpret_u8_u32(
+            vset_lane_u32(p11, vdup_n_u32(p10), 1)));
+    uint32x4_t sum = vmull_n_u16(vget_low_u16(top), w00);
+    sum = vmlal_n_u16(sum, vget_high_u16(top), w01);
+    sum = vmlal_n_u16(sum, vget_low_u16(bottom), w10);
+    sum = vmlal_n_u16(sum, vget_high_u16(bottom), w11);
+    uint16x4_t blended = vrshrn_n_u32(sum, 2 * WeightBits);
+
+    return vget_lane_u32(vreinterpret_u32_u8(
+            vmovn_u16(vcombine_u16(blended, blended))), 0);
+#else
+    uint32_t result = 0;
+    for ( int shift = 0; shift < 32; shift += 8 )
+    {
+        uint32_t value = ((p00 >> shift) & 0xff) * w00 +
+                ((p01 >> shift) & 0xff) * w01 +
+                ((p10 >> shift) & 0xff) * w10 +
+                ((p11 >> shift) & 0xff) * w11;
+        value = (value + (1 << (2 * WeightBits - 1))) >> (2 * WeightBits);
+        result |= value << shift;
+    }
+
+    return result;
+#endif
+}
+
+/** Samples the panorama bilinearly in the direction (x, y, z). */
+static inline uint32_t SamplePanorama(const Panorama& panorama, float x,
+                                      float y, float z)
+{
+    // Longitude 0 is at the center (-Z), latitude 0 at the horizon; the
+    // rows are bottom-up, so the last row is straight up
+    float longitude = atan2f(x, -z);
+    float latitude = atan2f(y, sqrtf(x * x + z * z));
+    float u = (0.5f + longitude * (float)(0.5 / M_PI)) * panorama.m_width
+            - 0.5f;
+    float v = (0.5f + latitude * (float)(1.0 / M_PI)) * panorama.m_height
+            - 0.5f;
+
+    float floorU = floorf(u);
+    float floorV = floorf(v);
+    int fracU = (int)((u - floorU) * WeightOne + 0.5f);
+    int fracV = (int)((v - floorV) * WeightOne + 0.5f);
+
+    // Wrap around horizontally, clamp vertically
+    int x0 = (int)floorU % panorama.m_width;
+    if ( x0 < 0 )
+    {
+        x0 += panorama.m_width;
+    }
+    int x1 = (x0 + 1 < panorama.m_width) ? (x0 + 1) : 0;
+    int y0 = (int)floorV;
+    int y1 = y0 + 1;
+    y0 = (y0 < 0) ? 0 : ((y0 >= panorama.m_height) ?
+                         (panorama.m_height - 1) : y0);
+    y1 = (y1 < 0) ? 0 : ((y1 >= panorama.m_height) ?
+                         (panorama.m_height - 1) : y1);
+
+    const uint8_t* row0 = panorama.m_data +
+            (size_t)y0 * panorama.m_width * RGBAPixelSize;
+    const uint8_t* row1 = panorama.m_data +
+            (size_t)y1 * panorama.m_width * RGBAPixelSize;
+    uint32_t p00, p01, p10, p11;
+    memcpy(&p00, row0 + x0 * RGBAPixelSize, sizeof(p00));
+    memcpy(&p01, row0 + x1 * RGBAPixelSize, sizeof(p01));
+    memcpy(&p10, row1 + x0 * RGBAPixelSize, sizeof(p10));
+    memcpy(&p11, row1 + x1 * RGBAPixelSize, sizeof(p11));
+
+    return Blend(p00, p01, p10, p11,
+                 (WeightOne - fracU) * (WeightOne - fracV),
+                 fracU * (WeightOne - fracV),
+                 (WeightOne - fracU) * fracV,
+                 fracU * fracV);
+}
+
+/** Resamples one row of a face; face is the index of its GL target. */
+static void ConvertFaceRow(const Panorama& panorama, int face, int row,
+                           int faceSize, uint8_t* target)
+{
+    // Cube map face coordinates (sc, tc) as in the OpenGL ES specification;
+    // row 0 is at t = 0
+    float scale = 2.0f / faceSize;
+    float tc = (row + 0.5f) * scale - 1.0f;
+
+    for ( int i = 0; i < faceSize; i++ )
+    {
+        float sc = (i + 0.5f) * scale - 1.0f;
+        float dir[3];
+        CubeFaceDirection(face, sc, tc, dir);
+
+#ifdef DEBUG
+        // GL must select this very texel for the direction
+        float s, t;
+        DEBUG_ASSERT(CubeDirectionToFace(dir[0], dir[1], dir[2], &s, &t) ==
+                     face);
+        DEBUG_ASSERT((int)(s * faceSize) == i);
+        DEBUG_ASSERT((int)(t * faceSize) == row);
+#endif
+
+        uint32_t pixel = SamplePanorama(panorama, dir[0], dir[1], dir[2]);
+        memcpy(target + i * RGBAPixelSize, &pixel, sizeof(pixel));
+    }
+}
+
+void EquirectToCubeMap(const void* data, int width, int height,
+                       int faceSize, void* const faces[6])
+{
+    Panorama panorama = { (const uint8_t*)data, width, height };
+
+    // Every row of every face is a task of its own; the trigonometry makes
+    // even small rows worth it
+    g_threadPool.ParallelFor(6 * faceSize, [&](int index) {
+        int face = index / faceSize;
+        int row = index % faceSize;
+        uint8_t* target = (uint8_t*)faces[face] +
+                (size_t)row * faceSize * RGBAPixelSize;
+        ConvertFaceRow(panorama, face, row, faceSize, target);
+    });
+}
+
+bool LoadEquirectCubeTextureFromBundle(const char* imageName, int faceSize,
+                                       GLuint* texture)
+{
+    void* data;
+    int width, height;
+    if ( !LoadImageDataFromBundle(imageName, &data, &width, &height) )
+    {
+        return false;
+    }
+
+    if ( faceSize <= 0 )
+    {
+        faceSize = (width >= 4) ? (width / 4) : 1;
+    }
+
+    void* faces[6] = { NULL, NULL, NULL, NULL, NULL, NULL };
+    size_t faceBytes = (size_t)faceSize * faceSize * RGBAPixelSize;
+    bool success = true;
+    for ( int i = 0; i < 6; i++ )
+    {
+        faces[i] = malloc(faceBytes);
+        if ( faces[i] == NULL )
+        {
+            LOG_DEBUG("LoadEquirectCubeTextureFromBundle(): memory "
+                      "allocation failed.");
+            success = false;
+        }
+    }
+
+    if ( success )
+    {
+        EquirectToCubeMap(data, width, height, faceSize, faces);
+        success = CreateCubeTexture(faceSize, faces, texture);
+    }
+
+    free(data);
+    for ( int i = 0; i < 6; i++ )
+    {
+        free(faces[i]);
+    }
+
+    return success;
+}
@@ -0,0 +1,485 @@
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #include <arm_neon.h>
+  #define USE_NEON
+#endif
+
+#include "CubeMapFilter.h"
+#include "CubeMapConverter.h"
+#include "MipmapGenerator.h"
+#include "ThreadPool.h"
+#include "CommonFunctions.h"
+
+static const int RGBAPixelSize = 4;
+
+// Number of spherical harmonics coefficients
+static const int NumSHCoefficients = 9;
+
+/** Adds value * weight to sum; both hold 4 floats. */
+static inline void Accumulate(float* sum, const float* value, float weight)
+{
+#if defined(__SSE2__)
+    _mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum),
+                                  _mm_mul_ps(_mm_loadu_ps(value),
+                                             _mm_set1_ps(weight))));
+#elif defined(USE_NEON)
+    vst1q_f32(sum, vmlaq_n_f32(vld1q_f32(sum), vld1q_f32(value), weight));
+#else
+    for ( int i = 0; i < 4; i++ )
+    {
+        sum[i] += value[i] * weight;
+    }
+#endif
+}
+
+/** Splits numRows into chunks for g_threadPool. */
+static int CountChunks(int numRows)
+{
+    int numChunks = (g_threadPool.GetNumThreads() + 1) * 4;
+    return (numChunks < numRows) ? numChunks : numRows;
+}
+
+void SHIrradiance::Evaluate(float x, float y, float z, float* rgb) const
+{
+    const float basis[NumSHCoefficients] = {
+        1.0f, y, z, x, x * y, y * z, 3.0f * z * z - 1.0f, x * z,
+        x * x - y * y
+    };
+
+    for ( int c = 0; c < 3; c++ )
+    {
+        float sum = 0.0f;
+        for ( int i = 0; i < NumSHCoefficients; i++ )
+        {
+            sum += m_coefficients[i][c] * basis[i];
+        }
+        rgb[c] = sum;
+    }
+}
+
+void ComputeSHIrradiance(int faceSize, const void* const faces[6], bool srgb,
+                         SHIrradiance* irradiance)
+{
+    const ColorTables& tables = ColorTables::Get();
+    const float* toFloat = srgb ? tables.m_srgbToLinear :
+            tables.m_byteToFloat;
+
+    // Per chunk sums: 9 RGBA coefficients and the total weight
+    const int SumSize = NumSHCoefficients * 4 + 1;
+    int numRows = 6 * faceSize;
+    int numChunks = CountChunks(numRows);
+    std::vector<float> sums(numChunks * SumSize, 0.0f);
+
+    g_threadPool.ParallelFor(numChunks, [&](int chunk) {
+        float* sum = &sums[chunk * SumSize];
+        float weightSum = 0.0f;
+        int firstRow = (int)((int64_t)numRows * chunk / numChunks);
+        int lastRow = (int)((int64_t)numRows * (chunk + 1) / numChunks);
+        float scale = 2.0f / faceSize;
+
+        for ( int row = firstRow; row < lastRow; row++ )
+        {
+            int face = row / faceSize;
+            int y = row % faceSize;
+            const uint8_t* source = (const uint8_t*)faces[face] +
+                    (size_t)y * faceSize * RGBAPixelSize;
+            float tc = (y + 0.5f) * scale - 1.0f;
+
+            for ( int x = 0; x < faceSize; x++ )
+            {
+                float sc = (x + 0.5f) * scale - 1.0f;
+                float dir[3];
+                CubeFaceDirection(face, sc, tc, dir);
+
+                // Solid angle of the texel, up to a constant factor
+                float lengthSquared = 1.0f + sc * sc + tc * tc;
+                float invLength = 1.0f / sqrtf(lengthSquared);
+                float weight = invLength / lengthSquared;
+                float nx = dir[0] * invLength;
+                float ny = dir[1] * invLength;
+                float nz = dir[2] * invLength;
+
+                const uint8_t* pixel = source + x * RGBAPixelSize;
+                float color[4] = {
+                    toFloat[pixel[0]], toFloat[pixel[1]], toFloat[pixel[2]],
+                    0.0f
+                };
+
+                Accumulate(sum + 0, color, weight);
+                Accumulate(sum + 4, color, weight * ny);
+                Accumulate(sum + 8, color, weight * nz);
+                Accumulate(sum + 12, color, weight * nx);
+                Accumulate(sum + 16, color, weight * nx * ny);
+                Accumulate(sum + 20, color, weight * ny * nz);
+                Accumulate(sum + 24, color,
+                           weight * (3.0f * nz * nz - 1.0f));
+                Accumulate(sum + 28, color, weight * nx * nz);
+                Accumulate(sum + 32, color, weight * (nx * nx - ny * ny));
+                weightSum += weight;
+            }
+        }
+
+        sum[NumSHCoefficients * 4] = weightSum;
+    });
+
+    // Merge the chunks
+    double total[SumSize];
+    memset(total, 0, sizeof(total));
+    for ( int chunk = 0; chunk < numChunks; chunk++ )
+    {
+        for ( int i = 0; i < SumSize; i++ )
+        {
+            total[i] += sums[chunk * SumSize + i];
+        }
+    }
+
+    // Squares of the basis function constants, times the cosine lobe
+    // convolution of the band (pi, 2pi/3, pi/4)
+    const double Factors[NumSHCoefficients] = {
+        0.282095 * 0.282095 * M_PI,
+        0.488603 * 0.488603 * 2.0 * M_PI / 3.0,
+        0.488603 * 0.488603 * 2.0 * M_PI / 3.0,
+        0.488603 * 0.488603 * 2.0 * M_PI / 3.0,
+        1.092548 * 1.092548 * M_PI / 4.0,
+        1.092548 * 1.092548 * M_PI / 4.0,
+        0.315392 * 0.315392 * M_PI / 4.0,
+        1.092548 * 1.092548 * M_PI / 4.0,
+        0.546274 * 0.546274 * M_PI / 4.0
+    };
+
+    // The weights add up to the full sphere
+    double weightSum = total[NumSHCoefficients * 4];
+    double normalization = (weightSum > 0.0) ? (4.0 * M_PI / weightSum) : 0.0;
+
+    for ( int i = 0; i < NumSHCoefficients; i++ )
+    {
+        for ( int c = 0; c < 3; c++ )
+        {
+            irradiance->m_coefficients[i][c] =
+                    (float)(total[i * 4 + c] * normalization * Factors[i]);
+        }
+    }
+}
+
+/** Linear RGBA float cube map level. */
+struct FloatCubeLevel
+{
+    int m_size;
+    std::vector<float> m_faces[6];
+};
+
+/** Samples a face of a level bilinearly, adding color * weight to sum. */
+static inline void SampleFace(const FloatCubeLevel& level, int face, float s,
+                              float t, float weight, float* sum)
+{
+    int size = level.m_size;
+    float u = s * size - 0.5f;
+    float v = t * size - 0.5f;
+    u = (u < 0.0f) ? 0.0f : ((u > size - 1) ? (size - 1) : u);
+    v = (v < 0.0f) ? 0.0f : ((v > size - 1) ? (size - 1) : v);
+
+    int x0 = (int)u;
+    int y0 = (int)v;
+    int x1 = (x0 + 1 < size) ? (x0 + 1) : x0;
+    int y1 = (y0 + 1 < size) ? (y0 + 1) : y0;
+    float fx = u - x0;
+    float fy = v - y0;
+
+    const float* data = &level.m_faces[face][0];
+    Accumulate(sum, data + (y0 * size + x0) * 4,
+               weight * (1.0f - fx) * (1.0f - fy));
+    Accumulate(sum, data + (y0 * size + x1) * 4, weight * fx * (1.0f - fy));
+    Accumulate(sum, data + (y1 * size + x0) * 4, weight * (1.0f - fx) * fy);
+    Accumulate(sum, data + (y1 * size + x1) * 4, weight * fx * fy);
+}
+
+/** Builds the linear, box filtered mip chain of a cube map. */
+static void BuildSourceChain(int faceSize, const void* const faces[6],
+                             bool srgb, std::vector<FloatCubeLevel>* chain)
+{
+    const ColorTables& tables = ColorTables::Get();
+    const float* toFloat = srgb ? tables.m_srgbToLinear :
+            tables.m_byteToFloat;
+
+    chain->resize(MipmapChain::CountLevels(faceSize, faceSize));
+    for ( size_t level = 0; level < chain->size(); level++ )
+    {
+        FloatCubeLevel& target = (*chain)[level];
+        target.m_size = (faceSize >> level) > 0 ? (faceSize >> level) : 1;
+        int size = target.m_size;
+
+        g_threadPool.ParallelFor(6, [&](int face) {
+            std::vector<float>& data = target.m_faces[face];
+            data.resize((size_t)size * size * 4);
+
+            if ( level == 0 )
+            {
+                const uint8_t* source = (const uint8_t*)faces[face];
+                for ( size_t i = 0; i < data.size(); i += 4 )
+                {
+                    data[i] = toFloat[source[i]];
+                    data[i + 1] = toFloat[source[i + 1]];
+                    data[i + 2] = toFloat[source[i + 2]];
+                    data[i + 3] = tables.m_byteToFloat[source[i + 3]];
+                }
+                return;
+            }
+
+            const FloatCubeLevel& parent = (*chain)[level - 1];
+            const float* source = &parent.m_faces[face][0];
+            int sourceSize = parent.m_size;
+            for ( int y = 0; y < size; y++ )
+            {
+                for ( int x = 0; x < size; x++ )
+                {
+                    float* out = &data[(y * size + x) * 4];
+                    const float* p0 = source + (2 * y * sourceSize + 2 * x) * 4;
+                    const float* p1 = p0 + sourceSize * 4;
+                    memset(out, 0, 4 * sizeof(float));
+                    Accumulate(out, p0, 0.25f);
+                    Accumulate(out, p0 + 4, 0.25f);
+                    Accumulate(out, p1, 0.25f);
+                    Accumulate(out, p1 + 4, 0.25f);
+                }
+            }
+        });
+    }
+}
+
+/** A GGX sample around +Z in tangent space. */
+struct GGXSample
+{
+    float m_direction[3];
+    float m_weight;
+    int m_sourceLevel;
+};
+
+/** Van der Corput radical inverse in base 2. */
+static float RadicalInverse(uint32_t bits)
+{
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555) << 1) | ((bits & 0xaaaaaaaa) >> 1);
+    bits = ((bits & 0x33333333) << 2) | ((bits & 0xcccccccc) >> 2);
+    bits = ((bits & 0x0f0f0f0f) << 4) | ((bits & 0xf0f0f0f0) >> 4);
+    bits = ((bits & 0x00ff00ff) << 8) | ((bits & 0xff00ff00) >> 8);
+
+    return (float)(bits * 2.3283064365386963e-10);
+}
+
+/**
+ * Importance samples the GGX lobe of a roughness with a Hammersley set,
+ * with the view direction equal to the normal. Each sample picks the
+ * source level whose texels match the solid angle it covers.
+ */
+static void BuildSamples(float roughness, int numSamples, int sourceSize,
+                         int numSourceLevels, std::vector<GGXSample>* samples)
+{
+    float alpha = roughness * roughness;
+    float alphaSquared = alpha * alpha;
+    double texelSolidAngle = 4.0 * M_PI / (6.0 * sourceSize * sourceSize);
+
+    samples->clear();
+    for ( int i = 0; i < numSamples; i++ )
+    {
+        float phi = 2.0f * (float)M_PI * ((float)i / numSamples);
+        float xi = RadicalInverse(i);
+        float cosTheta = sqrtf((1.0f - xi) /
+                               (1.0f + (alphaSquared - 1.0f) * xi));
+        float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+
+        // Reflect the view direction (the normal) about the half vector
+        GGXSample sample;
+        sample.m_direction[0] = 2.0f * cosTheta * sinTheta * cosf(phi);
+        sample.m_direction[1] = 2.0f * cosTheta * sinTheta * sinf(phi);
+        sample.m_direction[2] = 2.0f * cosTheta * cosTheta - 1.0f;
+        sample.m_weight = sample.m_direction[2];
+        if ( sample.m_weight <= 0.0f )
+        {
+            continue;
+        }
+
+        // pdf of the sample is D(h) / 4 when the view equals the normal
+        double d = cosTheta * cosTheta * (alphaSquared - 1.0) + 1.0;
+        double pdf = alphaSquared / (M_PI * d * d) / 4.0;
+        double sampleSolidAngle = 1.0 / (numSamples * pdf + 1e-6);
+        double lod = 0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0;
+        int sourceLevel = (int)(lod + 0.5);
+        sample.m_sourceLevel = (sourceLevel < 0) ? 0 :
+                ((sourceLevel >= numSourceLevels) ?
+                 (numSourceLevels - 1) : sourceLevel);
+
+        samples->push_back(sample);
+    }
+}
+
+/** Filters one row of a face of a level. */
+static void PrefilterRow(const std::vector<FloatCubeLevel>& chain,
+                         const std::vector<GGXSample>& samples, bool srgb,
+                         int face, int row, int size, uint8_t* target)
+{
+    const ColorTables& tables = ColorTables::Get();
+    float scale = 2.0f / size;
+    float tc = (row + 0.5f) * scale - 1.0f;
+
+    for ( int x = 0; x < size; x++ )
+    {
+        float n[3];
+        CubeFaceDirection(face, (x + 0.5f) * scale - 1.0f, tc, n);
+        float invLength = 1.0f / sqrtf(n[0] * n[0] + n[1] * n[1] +
+                                       n[2] * n[2]);
+        n[0] *= invLength;
+        n[1] *= invLength;
+        n[2] *= invLength;
+
+        // Tangent frame around the normal
+        float up[3] = { 0.0f, 0.0f, 1.0f };
+        if ( fabsf(n[2]) > 0.999f )
+        {
+            up[0] = 1.0f;
+            up[2] = 0.0f;
+        }
+        float t[3] = {
+            up[1] * n[2] - up[2] * n[1],
+            up[2] * n[0] - up[0] * n[2],
+            up[0] * n[1] - up[1] * n[0]
+        };
+        invLength = 1.0f / sqrtf(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+        t[0] *= invLength;
+        t[1] *= invLength;
+        t[2] *= invLength;
+        float b[3] = {
+            n[1] * t[2] - n[2] * t[1],
+            n[2] * t[0] - n[0] * t[2],
+            n[0] * t[1] - n[1] * t[0]
+        };
+
+        float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float weightSum = 0.0f;
+        for ( size_t i = 0; i < samples.size(); i++ )
+        {
+            const GGXSample& sample = samples[i];
+            const float* l = sample.m_direction;
+            float s, tt;
+            int sampleFace = CubeDirectionToFace(
+                    t[0] * l[0] + b[0] * l[1] + n[0] * l[2],
+                    t[1] * l[0] + b[1] * l[1] + n[1] * l[2],
+                    t[2] * l[0] + b[2] * l[1] + n[2] * l[2], &s, &tt);
+            SampleFace(chain[sample.m_sourceLevel], sampleFace, s, tt,
+                       sample.m_weight, sum);
+            weightSum += sample.m_weight;
+        }
+
+        uint8_t* out = target + x * RGBAPixelSize;
+        float invWeight = (weightSum > 0.0f) ? (1.0f / weightSum) : 0.0f;
+        for ( int c = 0; c < 4; c++ )
+        {
+            out[c] = tables.Encode(sum[c] * invWeight, srgb && (c < 3));
+        }
+    }
+}
+
+PrefilteredCubeMap::PrefilteredCubeMap()
+    : m_faceSize(0),
+      m_numLevels(0)
+{
+}
+
+PrefilteredCubeMap::~PrefilteredCubeMap()
+{
+}
+
+void PrefilteredCubeMap::Generate(int faceSize, const void* const faces[6],
+                                  bool srgb, int numSamples)
+{
+    m_faceSize = faceSize;
+    m_numLevels = MipmapChain::CountLevels(faceSize, faceSize);
+    m_faces.clear();
+    m_faces.resize(m_numLevels * 6);
+
+    // Level 0 is the mirror reflection; ie. the source itself
+    size_t faceBytes = (size_t)faceSize * faceSize * RGBAPixelSize;
+    for ( int face = 0; face < 6; face++ )
+    {
+        const uint8_t* source = (const uint8_t*)faces[face];
+        m_faces[face].assign(source, source + faceBytes);
+    }
+
+    if ( m_numLevels == 1 )
+    {
+        return;
+    }
+
+    std::vector<FloatCubeLevel> chain;
+    BuildSourceChain(faceSize, faces, srgb, &chain);
+
+    std::vector<GGXSample> samples;
+    for ( int level = 1; level < m_numLevels; level++ )
+    {
+        BuildSamples(GetRoughness(level), numSamples, faceSize,
+                     (int)chain.size(), &samples);
+
+        int size = GetLevelSize(level);
+        for ( int face = 0; face < 6; face++ )
+        {
+            m_faces[level * 6 + face].resize(
+                    (size_t)size * size * RGBAPixelSize);
+        }
+
+        // Every row of every face is a task of its own
+        g_threadPool.ParallelFor(6 * size, [&](int index) {
+            int face = index / size;
+            int row = index % size;
+            uint8_t* target = &m_faces[level * 6 + face][0] +
+                    (size_t)row * size * RGBAPixelSize;
+            PrefilterRow(chain, samples, srgb, face, row, size, target);
+        });
+    }
+}
+
+void PrefilteredCubeMap::Upload() const
+{
+    for ( int level = 0; level < m_numLevels; level++ )
+    {
+        int size = GetLevelSize(level);
+        for ( int face = 0; face < 6; face++ )
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level,
+                         GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         GetFaceData(level, face));
+        }
+    }
+}
+
+bool CreatePrefilteredCubeTexture(int faceSize, const void* const faces[6],
+                                  bool srgb, GLuint* texture)
+{
+    PrefilteredCubeMap cubeMap;
+    cubeMap.Generate(faceSize, faces, srgb);
+
+    GLuint cubeTexture;
+    glActiveTexture(GL_TEXTURE0);
+    glGenTextures(1, &cubeTexture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    cubeMap.Upload();
+
+    int error = glGetError();
+    if ( error != GL_NO_ERROR )
+    {
+        LOG_DEBUG("CreatePrefilteredCubeTexture(): GL error: 0x%x", error);
+        glDeleteTextures(1, &cubeTexture);
+        return false;
+    }
+
+    *texture = cubeTexture;
+    return true;
+}
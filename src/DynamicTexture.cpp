@@ -0,0 +1,264 @@
+#include <string.h>
+
+#include "DynamicTexture.h"
+#include "CommonFunctions.h"
+
+using namespace CommonGL;
+
+// Beyond this many separate dirty rectangles per buffer they are merged
+// into their bounding box; fewer, larger uploads are cheaper by then
+static const size_t MaxDirtyRects = 8;
+
+/** Whether the driver supports GL_UNPACK_ROW_LENGTH. */
+static bool UnpackRowLengthSupported()
+{
+    if ( GetGLESMajorVersion() >= 3 )
+    {
+        return true;
+    }
+
+    return ExtensionPresent(UnpackSubimageExtension);
+}
+
+/** Whether two rectangles overlap or share an edge. */
+static bool Touches(const Rect& a, const Rect& b)
+{
+    return ( (a.m_left <= b.m_right) && (b.m_left <= a.m_right) &&
+             (a.m_top <= b.m_bottom) && (b.m_top <= a.m_bottom) );
+}
+
+static void Unite(Rect* rect, const Rect& other)
+{
+    rect->Set((other.m_left < rect->m_left) ? other.m_left : rect->m_left,
+              (other.m_top < rect->m_top) ? other.m_top : rect->m_top,
+              (other.m_right > rect->m_right) ? other.m_right : rect->m_right,
+              (other.m_bottom > rect->m_bottom) ?
+              other.m_bottom : rect->m_bottom);
+}
+
+DynamicTexture::DynamicTexture()
+    : m_width(0),
+      m_height(0),
+      m_format(TextureFormatRGBA8888),
+      m_pixelSize(0),
+      m_numBuffers(0),
+      m_currentBuffer(0),
+      m_hasUnpackRowLength(false),
+      m_numBytesUploaded(0)
+{
+}
+
+DynamicTexture::~DynamicTexture()
+{
+    Destroy();
+}
+
+bool DynamicTexture::Create(int width, int height, TextureFormat format,
+                            int numBuffers, bool clamp)
+{
+    Destroy();
+
+    if ( (width <= 0) || (height <= 0) )
+    {
+        return false;
+    }
+
+    GLenum glFormat, glType;
+    GetTextureFormatGL(format, &glFormat, &glType);
+
+    m_width = width;
+    m_height = height;
+    m_format = format;
+    m_pixelSize = GetTextureFormatPixelSize(format);
+    m_numBuffers = (numBuffers < 1) ? 1 :
+            ((numBuffers > MaxBuffers) ? MaxBuffers : numBuffers);
+    m_currentBuffer = 0;
+    m_hasUnpackRowLength = UnpackRowLengthSupported();
+    m_shadow.assign((size_t)width * height * m_pixelSize, 0);
+
+    // Allocate the storage once; the initial (zero) contents are uploaded
+    // by the first Flush() of each buffer
+    glActiveTexture(GL_TEXTURE0);
+    for ( int i = 0; i < m_numBuffers; i++ )
+    {
+        m_textures[i] = g_resourceRegistry.CreateTexture();
+        glBindTexture(GL_TEXTURE_2D, g_resourceRegistry.Get(m_textures[i]));
+        glTexImage2D(GL_TEXTURE_2D, 0, glFormat, width, height, 0, glFormat,
+                     glType, NULL);
+        SetTexture2DParameters(clamp, false);
+        m_dirtyRects[i].push_back(Rect(0, 0, width, height));
+    }
+
+    int glError = glGetError();
+    if ( glError != GL_NO_ERROR )
+    {
+        LOG_DEBUG("DynamicTexture::Create(): GL error: 0x%x", glError);
+        Destroy();
+        return false;
+    }
+
+    return true;
+}
+
+void DynamicTexture::Destroy()
+{
+    for ( int i = 0; i < MaxBuffers; i++ )
+    {
+        g_resourceRegistry.Release(&m_textures[i]);
+        m_dirtyRects[i].clear();
+    }
+
+    m_shadow.clear();
+    m_staging.clear();
+    m_numBuffers = 0;
+    m_currentBuffer = 0;
+}
+
+void DynamicTexture::AddDirtyRect(std::vector<Rect>& dirtyRects, Rect rect)
+{
+    // Absorb the rectangles the new one touches; the union may reach
+    // further ones, so start over after each merge
+    bool merged = true;
+    while ( merged )
+    {
+        merged = false;
+        for ( size_t i = 0; i < dirtyRects.size(); i++ )
+        {
+            if ( Touches(rect, dirtyRects[i]) )
+            {
+                Unite(&rect, dirtyRects[i]);
+                dirtyRects.erase(dirtyRects.begin() + i);
+                merged = true;
+                break;
+            }
+        }
+    }
+
+    dirtyRects.push_back(rect);
+
+    if ( dirtyRects.size() > MaxDirtyRects )
+    {
+        Rect bounds = dirtyRects[0];
+        for ( size_t i = 1; i < dirtyRects.size(); i++ )
+        {
+            Unite(&bounds, dirtyRects[i]);
+        }
+        dirtyRects.assign(1, bounds);
+    }
+}
+
+void DynamicTexture::Update(int x, int y, int width, int height,
+                            const void* data, size_t pitch)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Clip to the texture
+    Rect rect(x, y, x + width, y + height);
+    int skipX = (x < 0) ? -x : 0;
+    int skipY = (y < 0) ? -y : 0;
+    rect.Set(x + skipX, y + skipY,
+             (rect.m_right > m_width) ? m_width : rect.m_right,
+             (rect.m_bottom > m_height) ? m_height : rect.m_bottom);
+    if ( (rect.GetWidth() <= 0) || (rect.GetHeight() <= 0) ||
+         m_shadow.empty() )
+    {
+        return;
+    }
+
+    if ( pitch == 0 )
+    {
+        pitch = (size_t)width * m_pixelSize;
+    }
+
+    const uint8_t* source = (const uint8_t*)data + skipY * pitch +
+            skipX * m_pixelSize;
+    size_t targetPitch = (size_t)m_width * m_pixelSize;
+    uint8_t* target = &m_shadow[0] + rect.m_top * targetPitch +
+            rect.m_left * m_pixelSize;
+    size_t rowSize = (size_t)rect.GetWidth() * m_pixelSize;
+    for ( int row = 0; row < rect.GetHeight(); row++ )
+    {
+        memcpy(target + row * targetPitch, source + row * pitch, rowSize);
+    }
+
+    for ( int i = 0; i < m_numBuffers; i++ )
+    {
+        AddDirtyRect(m_dirtyRects[i], rect);
+    }
+}
+
+void DynamicTexture::UploadRect(const Rect& rect, GLenum glFormat,
+                                GLenum glType)
+{
+    int width = rect.GetWidth();
+    int height = rect.GetHeight();
+    size_t pitch = (size_t)m_width * m_pixelSize;
+    size_t rowSize = (size_t)width * m_pixelSize;
+    const uint8_t* source = &m_shadow[0] + rect.m_top * pitch +
+            rect.m_left * m_pixelSize;
+
+    if ( width == m_width )
+    {
+        // Full rows are contiguous in the shadow copy
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, rect.m_top, width, height,
+                        glFormat, glType, source);
+    }
+    else if ( m_hasUnpackRowLength )
+    {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, m_width);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, rect.m_left, rect.m_top, width,
+                        height, glFormat, glType, source);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+    else
+    {
+        m_staging.resize(rowSize * height);
+        for ( int row = 0; row < height; row++ )
+        {
+            memcpy(&m_staging[row * rowSize], source + row * pitch, rowSize);
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, rect.m_left, rect.m_top, width,
+                        height, glFormat, glType, &m_staging[0]);
+    }
+
+    m_numBytesUploaded += rowSize * height;
+}
+
+bool DynamicTexture::Flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_numBytesUploaded = 0;
+    if ( m_numBuffers == 0 )
+    {
+        return false;
+    }
+
+    // A buffer with nothing missing means there have been no changes
+    // since the current one was written, which is then up to date too
+    int next = (m_currentBuffer + 1) % m_numBuffers;
+    std::vector<Rect>& dirtyRects = m_dirtyRects[next];
+    if ( dirtyRects.empty() )
+    {
+        return false;
+    }
+
+    GLenum glFormat, glType;
+    GetTextureFormatGL(m_format, &glFormat, &glType);
+
+    // Rows of the smaller formats are not padded to 4 bytes
+    ScopedUnpackAlignment unpackAlignment(1);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, g_resourceRegistry.Get(m_textures[next]));
+    for ( size_t i = 0; i < dirtyRects.size(); i++ )
+    {
+        UploadRect(dirtyRects[i], glFormat, glType);
+    }
+    LOG_GL_ERROR();
+
+    dirtyRects.clear();
+    m_currentBuffer = next;
+
+    return true;
+}
@@ -0,0 +1,254 @@
+#include <string.h>
+
+#include "GLCommandQueue.h"
+#include "CommonFunctions.h"
+#include "TimeSample.h"
+
+GLCommandQueue::GLCommandQueue()
+    : m_head(&m_stub),
+      m_tail(&m_stub)
+{
+}
+
+GLCommandQueue::~GLCommandQueue()
+{
+    // Discard anything left unexecuted; their futures become broken
+    GLCommand* command;
+    while ( (command = Dequeue()) != NULL )
+    {
+        delete command;
+    }
+}
+
+void GLCommandQueue::Enqueue(GLCommand* command)
+{
+    command->m_next.store(NULL, std::memory_order_relaxed);
+    GLCommand* previous = m_head.exchange(command, std::memory_order_acq_rel);
+    previous->m_next.store(command, std::memory_order_release);
+}
+
+GLCommand* GLCommandQueue::Dequeue()
+{
+    GLCommand* tail = m_tail;
+    GLCommand* next = tail->m_next.load(std::memory_order_acquire);
+
+    if ( tail == &m_stub )
+    {
+        if ( next == NULL )
+        {
+            // Empty
+            return NULL;
+        }
+        m_tail = next;
+        tail = next;
+        next = next->m_next.load(std::memory_order_acquire);
+    }
+
+    if ( next != NULL )
+    {
+        m_tail = next;
+        return tail;
+    }
+
+    if ( tail != m_head.load(std::memory_order_acquire) )
+    {
+        // A producer is in the middle of enqueuing; try again later
+        return NULL;
+    }
+
+    // Tail is the last command; put the stub back behind it to detach it
+    Enqueue(&m_stub);
+    next = tail->m_next.load(std::memory_order_acquire);
+    if ( next != NULL )
+    {
+        m_tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+bool GLCommandQueue::IsEmpty() const
+{
+    // The stub is both the tail and the head only when nothing is queued
+    return ( (m_tail == &m_stub) &&
+             (m_head.load(std::memory_order_acquire) == &m_stub) );
+}
+
+int GLCommandQueue::Drain(float budgetMillis)
+{
+    TimeSample startTime;
+    int count = 0;
+
+    GLCommand* command;
+    while ( (command = Dequeue()) != NULL )
+    {
+        command->Execute();
+        delete command;
+        count++;
+
+        if ( (budgetMillis >= 0.0) &&
+             ((startTime.ElapsedTime() * 1000.0) >= budgetMillis) )
+        {
+            break;
+        }
+    }
+
+    return count;
+}
+
+// Typed commands
+
+/** Creates a buffer object and uploads data into it. */
+class UploadBufferCommand : public GLCommand
+{
+public:
+    UploadBufferCommand(GLenum target, const void* data, size_t size,
+                        GLenum usage)
+        : m_target(target),
+          m_data(NULL),
+          m_size(size),
+          m_usage(usage)
+    {
+        if ( data != NULL )
+        {
+            m_data = malloc(size);
+            memcpy(m_data, data, size);
+        }
+    }
+
+    virtual ~UploadBufferCommand()
+    {
+        free(m_data);
+    }
+
+    virtual void Execute()
+    {
+        BufferHandle buffer = g_resourceRegistry.CreateBuffer();
+        glBindBuffer(m_target, g_resourceRegistry.Get(buffer));
+        glBufferData(m_target, m_size, m_data, m_usage);
+        m_promise.set_value(buffer);
+    }
+
+    std::promise<BufferHandle> m_promise;
+
+private:
+    GLenum m_target;
+    void* m_data;
+    size_t m_size;
+    GLenum m_usage;
+};
+
+/** Creates a 2D texture out of RGBA pixel data. */
+class CreateTextureCommand : public GLCommand
+{
+public:
+    CreateTextureCommand(int width, int height, void* pixels,
+                         bool clamp, bool useMipmaps)
+        : m_width(width),
+          m_height(height),
+          m_pixels(pixels),
+          m_clamp(clamp),
+          m_useMipmaps(useMipmaps)
+    {
+    }
+
+    virtual ~CreateTextureCommand()
+    {
+        free(m_pixels);
+    }
+
+    virtual void Execute()
+    {
+        TextureHandle handle;
+        GLuint texture = 0;
+        if ( Create2DTexture(m_width, m_height, m_pixels, &texture,
+                             m_clamp, m_useMipmaps) )
+        {
+            handle = g_resourceRegistry.AdoptTexture(texture);
+        }
+        else if ( texture != 0 )
+        {
+            glDeleteTextures(1, &texture);
+        }
+        m_promise.set_value(handle);
+    }
+
+    std::promise<TextureHandle> m_promise;
+
+private:
+    int m_width;
+    int m_height;
+    void* m_pixels;
+    bool m_clamp;
+    bool m_useMipmaps;
+};
+
+/** Compiles and links a shader program. */
+class LoadShaderCommand : public GLCommand
+{
+public:
+    LoadShaderCommand(const char* vertexShaderSource,
+                      const char* fragmentShaderSource)
+        : m_vertexShaderSource(vertexShaderSource),
+          m_fragmentShaderSource(fragmentShaderSource)
+    {
+    }
+
+    virtual void Execute()
+    {
+        ProgramHandle handle;
+        GLuint program = 0;
+        if ( ::LoadShader(&program, m_vertexShaderSource.c_str(),
+                          m_fragmentShaderSource.c_str()) )
+        {
+            handle = g_resourceRegistry.AdoptProgram(program);
+        }
+        else
+        {
+            LOG_DEBUG("LoadShaderCommand: failed to load shader");
+        }
+        m_promise.set_value(handle);
+    }
+
+    std::promise<ProgramHandle> m_promise;
+
+private:
+    std::string m_vertexShaderSource;
+    std::string m_fragmentShaderSource;
+};
+
+std::future<BufferHandle> GLCommandQueue::UploadBuffer(GLenum target,
+                                                       const void* data,
+                                                       size_t size,
+                                                       GLenum usage)
+{
+    UploadBufferCommand* command =
+            new UploadBufferCommand(target, data, size, usage);
+    std::future<BufferHandle> future = command->m_promise.get_future();
+    Enqueue(command);
+    return future;
+}
+
+std::future<TextureHandle> GLCommandQueue::CreateTexture(int width,
+                                                         int height,
+                                                         void* pixels,
+                                                         bool clamp,
+                                                         bool useMipmaps)
+{
+    CreateTextureCommand* command =
+            new CreateTextureCommand(width, height, pixels, clamp, useMipmaps);
+    std::future<TextureHandle> future = command->m_promise.get_future();
+    Enqueue(command);
+    return future;
+}
+
+std::future<ProgramHandle> GLCommandQueue::LoadShader(
+        const char* vertexShaderSource, const char* fragmentShaderSource)
+{
+    LoadShaderCommand* command =
+            new LoadShaderCommand(vertexShaderSource, fragmentShaderSource);
+    std::future<ProgramHandle> future = command->m_promise.get_future();
+    Enqueue(command);
+    return future;
+}
@@ -1,10 +1,15 @@
 #include <string.h>
+#include <algorithm>
 
 #include "GLController.h"
 #include "MatrixOperations.h"
 #include "CommonFunctions.h"
 #include "BaseWidget.h"
 #include "Container.h"
+#include "BaseAnimation.h"
+
+// Default time budget (ms) per frame for executing queued GL commands
+static const float DefaultCommandBudget = 4.0;
 
 GLController::GLController()
     : m_simpleColorProgram(0),
@@ -13,11 +18,20 @@ GLController::GLController()
       m_viewportWidth(-1),
       m_viewportHeight(-1),
       m_fullscreenRectVertexBuffer(0),
+      m_fullscreenRectVertexBufferHandle(),
       m_fullScreenRect(CommonGL::Rect()),
       m_hasDepthTextureExtension(false),
       m_widgetContext(CommonGL::WidgetContext()),
-      m_defaultFrameBuffer(DefaultFramebufferId)
+      m_defaultFrameBuffer(DefaultFramebufferId),
+      m_commandBudget(DefaultCommandBudget),
+      m_damaged(true),
+      m_fullDamage(true),
+      m_damageRect(),
+      m_frameTime(),
+      m_partialRedraw(false),
+      m_scissored(false)
 {
+    m_widgetBatch.SetRenderTargetPool(&m_renderTargetPool);
 }
 
 GLController::~GLController()
@@ -28,16 +42,27 @@ GLController::~GLController()
 
 CommonGL::BaseWidget* GLController::FindWidget(int x, int y)
 {
-    std::list<CommonGL::BaseWidget*>::iterator iter;
-    for ( iter = m_widgets.begin(); iter != m_widgets.end(); iter++ )
+    return m_widgetGrid.Find(x, y);
+}
+
+void GLController::SetPressedWidget(CommonGL::BaseWidget* widget)
+{
+    if ( widget != m_widgetContext.m_pressedWidget )
     {
-        if ( (*iter)->HitTest(x, y) && (*iter)->IsVisible() )
-        {
-            return *iter;
-        }
+        // The highlight changes on both
+        InvalidateWidget(m_widgetContext.m_pressedWidget);
+        InvalidateWidget(widget);
+        m_widgetContext.m_pressedWidget = widget;
     }
+}
 
-    return NULL;
+void GLController::InvalidateWidget(const CommonGL::BaseWidget* widget)
+{
+    CommonGL::Rect rect;
+    if ( (widget != NULL) && m_widgetGrid.GetRect(widget, &rect) )
+    {
+        Invalidate(rect);
+    }
 }
 
 bool GLController::TouchMoved(const void* /*touch*/, int x, int y)
@@ -47,10 +72,10 @@ bool GLController::TouchMoved(const void* /*touch*/, int x, int y)
     if ( m_widgetContext.m_pressedWidget != NULL )
     {
         // Check if touch is still inside the widget; if not, clear pressed
-        if ( !m_widgetContext.m_pressedWidget->HitTest(x, y) )
+        if ( !m_widgetGrid.Contains(m_widgetContext.m_pressedWidget, x, y) )
         {
             LOG_DEBUG("moved: touch outside, clearing!");
-            m_widgetContext.m_pressedWidget = NULL;
+            SetPressedWidget(NULL);
         }
         return true;
     }
@@ -78,7 +103,7 @@ bool GLController::TouchStarted(const void* /*touch*/, int x, int y)
             }
 
             LOG_DEBUG("start: press OK");
-            m_widgetContext.m_pressedWidget = widget;
+            SetPressedWidget(widget);
         }
         return true;
     }
@@ -96,18 +121,18 @@ bool GLController::TouchEnded(const void* /*touch*/, int x, int y)
 
     if ( m_widgetContext.m_pressedWidget != NULL )
     {
-        if ( m_widgetContext.m_pressedWidget->HitTest(x, y) )
+        if ( m_widgetGrid.Contains(m_widgetContext.m_pressedWidget, x, y) )
         {
             LOG_DEBUG("end: touch up OK!");
             // Signal the pressed widget about touch up and release it
             m_widgetContext.m_pressedWidget->TouchUpInside(x, y);
-            m_widgetContext.m_pressedWidget = NULL;
+            SetPressedWidget(NULL);
             return true;
         }
         else
         {
             // Touch up happened outside
-            m_widgetContext.m_pressedWidget = NULL;
+            SetPressedWidget(NULL);
             return false;
         }
     }
@@ -117,49 +142,167 @@ bool GLController::TouchEnded(const void* /*touch*/, int x, int y)
 
 void GLController::DrawWidgets()
 {
-    GLuint currentProgram = 0;
-    const float noHighlight[] = { 0.0, 0.0, 0.0 };
-    const float highlight[] = { 0.2, 0.2, 0.2 };
-
-    std::list<CommonGL::BaseWidget*>::reverse_iterator iter;
-    for ( iter = m_widgets.rbegin(); iter != m_widgets.rend(); iter++ )
+    // Cached renderings of the widgets are updated whole
+    if ( m_scissored )
+    {
+        glDisable(GL_SCISSOR_TEST);
+    }
+    m_widgetBatch.Update(m_widgets, &m_widgetContext);
+    if ( m_scissored )
     {
-        CommonGL::BaseWidget* widget = *iter;
+        glEnable(GL_SCISSOR_TEST);
+    }
+
+    m_widgetBatch.Draw(&m_widgetContext, m_orthoProjectionMatrix);
+}
+
+void GLController::InvalidateWidgets()
+{
+    m_widgetContext.m_widgetsChanged = true;
+    m_widgetBatch.InvalidateCaches();
+    Invalidate();
+}
 
-        if ( widget->IsVisible() )
+void GLController::UpdateWidget(CommonGL::BaseWidget* widget)
+{
+    // Both where the widget was and where it is now need redrawing
+    InvalidateWidget(widget);
+    m_widgetGrid.Update(widget);
+    InvalidateWidget(widget);
+}
+
+void GLController::WidgetChanged(CommonGL::BaseWidget* widget)
+{
+    UpdateWidget(widget);
+
+    // Widgets within a container move along with it
+    if ( widget->m_type == CommonGL::BaseWidget::TypeContainer )
+    {
+        std::list<CommonGL::BaseWidget*>::iterator iter;
+        for ( iter = m_widgets.begin(); iter != m_widgets.end(); iter++ )
         {
-            // Set up the widget rendering shader program
-            if ( widget->m_type == CommonGL::BaseWidget::TypeButton )
+            CommonGL::BaseWidget* parent = (*iter)->m_parent;
+            while ( (parent != NULL) && (parent != widget) )
             {
-                if ( currentProgram != m_widgetContext.m_textureShaderProgram )
-                {
-                    glUseProgram(m_widgetContext.m_textureShaderProgram);
-                    glUniformMatrix4fv(m_widgetContext.m_textureShaderMvpLoc,
-                                       1, GL_FALSE, m_orthoProjectionMatrix);
-                    currentProgram = m_widgetContext.m_textureShaderProgram;
-                }
-
-                const float* h =
-                 ( widget == m_widgetContext.m_pressedWidget ) ?
-                            highlight : noHighlight;
-                glUniform3fv(m_widgetContext.m_textureShaderHighlightLoc, 1, h);
+                parent = parent->m_parent;
             }
-            else
+
+            if ( parent != NULL )
             {
-//                LOG_DEBUG("drawing Container!");
-                if ( currentProgram != m_widgetContext.m_colorShaderProgram )
-                {
-                    glUseProgram(m_widgetContext.m_colorShaderProgram);
-                    glUniformMatrix4fv(m_widgetContext.m_colorShaderMvpLoc,
-                                       1, GL_FALSE, m_orthoProjectionMatrix);
-                    currentProgram = m_widgetContext.m_colorShaderProgram;
-                }
+                UpdateWidget(*iter);
             }
+        }
+    }
+}
 
-            // Render the widget
-            widget->Render();
+void GLController::Invalidate()
+{
+    m_damaged = true;
+    m_fullDamage = true;
+}
+
+void GLController::Invalidate(const CommonGL::Rect& rect)
+{
+    if ( m_fullDamage )
+    {
+        return;
+    }
+
+    if ( !m_damaged )
+    {
+        m_damageRect = rect;
+        m_damaged = true;
+    }
+    else
+    {
+        m_damageRect.Set(std::min(m_damageRect.m_left, rect.m_left),
+                         std::min(m_damageRect.m_top, rect.m_top),
+                         std::max(m_damageRect.m_right, rect.m_right),
+                         std::max(m_damageRect.m_bottom, rect.m_bottom));
+    }
+}
+
+void GLController::AddAnimation(BaseAnimation* animation)
+{
+    RemoveAnimation(animation);
+    m_animations.push_back(animation);
+}
+
+void GLController::RemoveAnimation(BaseAnimation* animation)
+{
+    m_animations.remove(animation);
+}
+
+float GLController::GetRedrawDelay()
+{
+    if ( m_damaged || !m_commandQueue.IsEmpty() ||
+         (m_textureLoader.GetNumPending() > 0) )
+    {
+        return 0.0;
+    }
+
+    TimeSample now;
+    float delay = -1.0;
+    std::list<BaseAnimation*>::iterator iter;
+    for ( iter = m_animations.begin(); iter != m_animations.end(); iter++ )
+    {
+        float animationDelay = (*iter)->TimeUntilNextUpdate(now);
+        if ( (animationDelay < 0.0) &&
+             ((*iter)->TimeUntilNextUpdate(m_frameTime) >= 0.0) )
+        {
+            // Completed since the last frame; its end state is yet to be
+            // drawn (or the timer to signal)
+            animationDelay = 0.0;
         }
+
+        if ( (animationDelay >= 0.0) &&
+             ((delay < 0.0) || (animationDelay < delay)) )
+        {
+            delay = animationDelay;
+        }
+    }
+
+    return delay;
+}
+
+bool GLController::NeedsRedraw()
+{
+    return ( GetRedrawDelay() == 0.0 );
+}
+
+void GLController::BeginFrame()
+{
+    // Whatever is invalidated from here on is drawn by the next frame
+    if ( m_partialRedraw && m_damaged && !m_fullDamage )
+    {
+        // Scissor box origin is lower left
+        int left = std::max(m_damageRect.m_left, 0);
+        int top = std::max(m_damageRect.m_top, 0);
+        int right = std::min(m_damageRect.m_right, m_viewportWidth);
+        int bottom = std::min(m_damageRect.m_bottom, m_viewportHeight);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(left, m_viewportHeight - bottom,
+                  std::max(right - left, 0), std::max(bottom - top, 0));
+        m_scissored = true;
     }
+    m_damaged = false;
+    m_fullDamage = false;
+    m_frameTime.Reset();
+
+    m_commandQueue.Drain(m_commandBudget);
+    m_textureLoader.Update();
+}
+
+void GLController::EndFrame()
+{
+    if ( m_scissored )
+    {
+        glDisable(GL_SCISSOR_TEST);
+        m_scissored = false;
+    }
+
+    m_renderTargetPool.EndFrame();
+    g_resourceRegistry.FlushDeletions();
 }
 
 void GLController::PinchGesture(float /*scaleFactor*/, float /*rotationAngle*/)
@@ -210,6 +353,7 @@ void GLController::DeinitWidgets()
 {
     UnloadShader(m_widgetContext.m_textureShaderProgram);
     m_widgetContext = CommonGL::WidgetContext();
+    m_widgetBatch.Release();
 }
 
 void GLController::Add(CommonGL::BaseWidget* widget)
@@ -217,8 +361,10 @@ void GLController::Add(CommonGL::BaseWidget* widget)
     // Attach the widget
     widget->SetContext(&m_widgetContext);
 
-    // Add the widget to the list
+    // Add the widget to the list, on top of the others
     m_widgets.push_front(widget);
+    m_widgetGrid.Add(widget);
+    InvalidateWidget(widget);
 }
 
 void GLController::Remove(CommonGL::BaseWidget* widget)
@@ -228,6 +374,7 @@ void GLController::Remove(CommonGL::BaseWidget* widget)
 
     // Remove the widget from the list
     m_widgets.remove(widget);
+    m_widgetGrid.Remove(widget);
 }
 
 bool GLController::InitController()
@@ -273,25 +420,30 @@ void GLController::ViewportResized(int width, int height)
     // Fullscreen rectangle
     m_fullScreenRect.Set(0, 0, m_viewportWidth, m_viewportHeight);
 
-    // Delete existing fader buffer
-    glDeleteBuffers(1, &m_fullscreenRectVertexBuffer);
+    // Release existing fader buffer
+    g_resourceRegistry.Release(&m_fullscreenRectVertexBufferHandle);
 
     // adjust x/y according to viewport size so that 0,0 is upper left
     int x = -m_viewportWidth / 2;
     int y = -m_viewportHeight + (m_viewportHeight / 2);
 
     VertexAttribsCoordsOnly faderVertices[] = {
-        { x, y + m_viewportHeight, 0                   },
-        { x, y, 0                                      },
-        { x + m_viewportWidth, y, 0                    },
-        { x + m_viewportWidth, y + m_viewportHeight, 0 }
+        { (GLfloat)x, (GLfloat)(y + m_viewportHeight), 0 },
+        { (GLfloat)x, (GLfloat)y, 0 },
+        { (GLfloat)(x + m_viewportWidth), (GLfloat)y, 0 },
+        { (GLfloat)(x + m_viewportWidth), (GLfloat)(y + m_viewportHeight), 0 }
     };
 
-    glGenBuffers(1, &m_fullscreenRectVertexBuffer);
+    m_fullscreenRectVertexBufferHandle = g_resourceRegistry.CreateBuffer();
+    m_fullscreenRectVertexBuffer =
+            g_resourceRegistry.Get(m_fullscreenRectVertexBufferHandle);
     glBindBuffer(GL_ARRAY_BUFFER, m_fullscreenRectVertexBuffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(faderVertices),
                  faderVertices, GL_STATIC_DRAW);
 
+    m_widgetGrid.SetSize(m_viewportWidth, m_viewportHeight);
+    Invalidate();
+
     // Update the widget context
     m_widgetContext.m_viewportWidth = m_viewportWidth;
     m_widgetContext.m_viewportHeight = m_viewportHeight;
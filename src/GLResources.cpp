@@ -0,0 +1,396 @@
+#include "GLResources.h"
+#include "CommonFunctions.h"
+
+// The global resource registry
+GLResourceRegistry g_resourceRegistry;
+
+// Handle bit layout
+static const uint32_t HandleIndexBits = 20;
+static const uint32_t HandleIndexMask = (1 << HandleIndexBits) - 1;
+static const uint32_t HandleGenerationMask = 0xfff;
+
+// Number of frames the GPU may lag behind; used to decide when released
+// objects may be deleted when fences are not available
+static const unsigned int MaxFramesInFlight = 2;
+
+static const char* const ResourceTypeNames[NumResourceTypes] = {
+    "buffer", "texture", "program"
+};
+
+GLResourceRegistry::GLResourceRegistry()
+    : m_frameCounter(0)
+{
+}
+
+GLResourceRegistry::~GLResourceRegistry()
+{
+    // The GL context is typically gone by now; just forget the objects
+    m_retired.clear();
+}
+
+uint32_t GLResourceRegistry::Allocate(GLResourceType type, GLuint id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<Slot>& slots = m_slots[type];
+    uint32_t index;
+    if ( !m_freeSlots[type].empty() )
+    {
+        index = m_freeSlots[type].back();
+        m_freeSlots[type].pop_back();
+    }
+    else
+    {
+        index = slots.size();
+        if ( index >= HandleIndexMask )
+        {
+            LOG_DEBUG("GLResourceRegistry: out of %s slots",
+                      ResourceTypeNames[type]);
+            return 0;
+        }
+        Slot slot = { 0, 0, false };
+        slots.push_back(slot);
+    }
+
+    Slot& slot = slots[index];
+    slot.m_id = id;
+    slot.m_inUse = true;
+
+    return ((uint32_t)slot.m_generation << HandleIndexBits) | (index + 1);
+}
+
+const GLResourceRegistry::Slot* GLResourceRegistry::FindSlot(
+        GLResourceType type, uint32_t value) const
+{
+    uint32_t index = (value & HandleIndexMask) - 1;
+    uint32_t generation = value >> HandleIndexBits;
+    const std::vector<Slot>& slots = m_slots[type];
+
+    if ( (value == 0) || (index >= slots.size()) || !slots[index].m_inUse ||
+         (slots[index].m_generation != generation) )
+    {
+        return NULL;
+    }
+
+    return &slots[index];
+}
+
+GLuint GLResourceRegistry::Lookup(GLResourceType type, uint32_t value) const
+{
+    if ( value == 0 )
+    {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const Slot* slot = FindSlot(type, value);
+    if ( slot == NULL )
+    {
+        LOG_DEBUG("GLResourceRegistry: stale %s handle 0x%x",
+                  ResourceTypeNames[type], value);
+        DEBUG_ASSERT(false);
+        return 0;
+    }
+
+    return slot->m_id;
+}
+
+bool GLResourceRegistry::IsLive(GLResourceType type, uint32_t value) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return (FindSlot(type, value) != NULL);
+}
+
+void GLResourceRegistry::Free(GLResourceType type, uint32_t* value)
+{
+    if ( *value == 0 )
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const Slot* found = FindSlot(type, *value);
+    uint32_t index = (*value & HandleIndexMask) - 1;
+    *value = 0;
+
+    if ( found == NULL )
+    {
+        LOG_DEBUG("GLResourceRegistry: releasing stale %s handle",
+                  ResourceTypeNames[type]);
+        DEBUG_ASSERT(false);
+        return;
+    }
+
+    // Queue the GL object for deletion and invalidate existing handles
+    Slot& slot = m_slots[type][index];
+    if ( slot.m_id != 0 )
+    {
+        m_released[type].push_back(slot.m_id);
+    }
+    slot.m_id = 0;
+    slot.m_inUse = false;
+    slot.m_generation = (slot.m_generation + 1) & HandleGenerationMask;
+    m_freeSlots[type].push_back(index);
+}
+
+bool GLResourceRegistry::Rebind(GLResourceType type, uint32_t value,
+                                GLuint id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if ( FindSlot(type, value) == NULL )
+    {
+        return false;
+    }
+
+    Slot& slot = m_slots[type][(value & HandleIndexMask) - 1];
+    if ( slot.m_id != 0 )
+    {
+        m_released[type].push_back(slot.m_id);
+    }
+    slot.m_id = id;
+
+    return true;
+}
+
+BufferHandle GLResourceRegistry::CreateBuffer()
+{
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+
+    return AdoptBuffer(buffer);
+}
+
+TextureHandle GLResourceRegistry::CreateTexture()
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+
+    return AdoptTexture(texture);
+}
+
+BufferHandle GLResourceRegistry::AdoptBuffer(GLuint buffer)
+{
+    return BufferHandle(Allocate(ResourceTypeBuffer, buffer));
+}
+
+TextureHandle GLResourceRegistry::AdoptTexture(GLuint texture)
+{
+    return TextureHandle(Allocate(ResourceTypeTexture, texture));
+}
+
+ProgramHandle GLResourceRegistry::AdoptProgram(GLuint program)
+{
+    return ProgramHandle(Allocate(ResourceTypeProgram, program));
+}
+
+GLuint GLResourceRegistry::Get(BufferHandle handle) const
+{
+    return Lookup(ResourceTypeBuffer, handle.m_value);
+}
+
+GLuint GLResourceRegistry::Get(TextureHandle handle) const
+{
+    return Lookup(ResourceTypeTexture, handle.m_value);
+}
+
+GLuint GLResourceRegistry::Get(ProgramHandle handle) const
+{
+    return Lookup(ResourceTypeProgram, handle.m_value);
+}
+
+bool GLResourceRegistry::IsValid(BufferHandle handle) const
+{
+    return IsLive(ResourceTypeBuffer, handle.m_value);
+}
+
+bool GLResourceRegistry::IsValid(TextureHandle handle) const
+{
+    return IsLive(ResourceTypeTexture, handle.m_value);
+}
+
+bool GLResourceRegistry::IsValid(ProgramHandle handle) const
+{
+    return IsLive(ResourceTypeProgram, handle.m_value);
+}
+
+bool GLResourceRegistry::Replace(BufferHandle handle, GLuint buffer)
+{
+    return Rebind(ResourceTypeBuffer, handle.m_value, buffer);
+}
+
+bool GLResourceRegistry::Replace(TextureHandle handle, GLuint texture)
+{
+    return Rebind(ResourceTypeTexture, handle.m_value, texture);
+}
+
+void GLResourceRegistry::Release(BufferHandle* handle)
+{
+    Free(ResourceTypeBuffer, &(handle->m_value));
+}
+
+void GLResourceRegistry::Release(TextureHandle* handle)
+{
+    Free(ResourceTypeTexture, &(handle->m_value));
+}
+
+void GLResourceRegistry::Release(ProgramHandle* handle)
+{
+    Free(ResourceTypeProgram, &(handle->m_value));
+}
+
+bool GLResourceRegistry::IsBatchComplete(RetiredBatch& batch) const
+{
+#ifdef HAVE_GL_FENCE_SYNC
+    if ( batch.m_fence != 0 )
+    {
+        GLenum status = glClientWaitSync(batch.m_fence, 0, 0);
+        return ((status == GL_ALREADY_SIGNALED) ||
+                (status == GL_CONDITION_SATISFIED));
+    }
+#endif
+
+    return ((m_frameCounter - batch.m_frame) >= MaxFramesInFlight);
+}
+
+void GLResourceRegistry::DeleteBatch(RetiredBatch& batch)
+{
+    std::vector<GLuint>& buffers = batch.m_ids[ResourceTypeBuffer];
+    if ( !buffers.empty() )
+    {
+        glDeleteBuffers(buffers.size(), &buffers[0]);
+    }
+
+    std::vector<GLuint>& textures = batch.m_ids[ResourceTypeTexture];
+    if ( !textures.empty() )
+    {
+        glDeleteTextures(textures.size(), &textures[0]);
+    }
+
+    // There is no batched deletion for programs
+    std::vector<GLuint>& programs = batch.m_ids[ResourceTypeProgram];
+    for ( size_t i = 0; i < programs.size(); i++ )
+    {
+        UnloadShader(programs[i]);
+    }
+
+#ifdef HAVE_GL_FENCE_SYNC
+    if ( batch.m_fence != 0 )
+    {
+        glDeleteSync(batch.m_fence);
+    }
+#endif
+}
+
+void GLResourceRegistry::FlushDeletions()
+{
+    std::list<RetiredBatch> completed;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Retire this frame's released objects behind a fence
+        bool hasReleased = false;
+        for ( int i = 0; i < NumResourceTypes; i++ )
+        {
+            hasReleased |= !m_released[i].empty();
+        }
+
+        if ( hasReleased )
+        {
+            m_retired.push_back(RetiredBatch());
+            RetiredBatch& batch = m_retired.back();
+            for ( int i = 0; i < NumResourceTypes; i++ )
+            {
+                batch.m_ids[i].swap(m_released[i]);
+            }
+            batch.m_frame = m_frameCounter;
+#ifdef HAVE_GL_FENCE_SYNC
+            batch.m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+        }
+
+        m_frameCounter++;
+
+        // Batches complete in order; stop at the first incomplete one
+        while ( !m_retired.empty() && IsBatchComplete(m_retired.front()) )
+        {
+            completed.splice(completed.end(), m_retired, m_retired.begin());
+        }
+    }
+
+    // Merge the completed batches into single delete calls
+    if ( completed.size() > 1 )
+    {
+        RetiredBatch& first = completed.front();
+        std::list<RetiredBatch>::iterator iter = completed.begin();
+        for ( iter++; iter != completed.end(); iter++ )
+        {
+            for ( int i = 0; i < NumResourceTypes; i++ )
+            {
+                first.m_ids[i].insert(first.m_ids[i].end(),
+                                      iter->m_ids[i].begin(),
+                                      iter->m_ids[i].end());
+                iter->m_ids[i].clear();
+            }
+        }
+    }
+
+    std::list<RetiredBatch>::iterator iter;
+    for ( iter = completed.begin(); iter != completed.end(); iter++ )
+    {
+        DeleteBatch(*iter);
+    }
+}
+
+void GLResourceRegistry::FlushAllDeletions()
+{
+    std::list<RetiredBatch> batches;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        batches.swap(m_retired);
+        batches.push_back(RetiredBatch());
+        RetiredBatch& batch = batches.back();
+        for ( int i = 0; i < NumResourceTypes; i++ )
+        {
+            batch.m_ids[i].swap(m_released[i]);
+        }
+        batch.m_frame = m_frameCounter;
+#ifdef HAVE_GL_FENCE_SYNC
+        batch.m_fence = 0;
+#endif
+    }
+
+    std::list<RetiredBatch>::iterator iter;
+    for ( iter = batches.begin(); iter != batches.end(); iter++ )
+    {
+        DeleteBatch(*iter);
+    }
+}
+
+size_t GLResourceRegistry::GetNumPendingDeletions() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t count = 0;
+    for ( int i = 0; i < NumResourceTypes; i++ )
+    {
+        count += m_released[i].size();
+    }
+
+    std::list<RetiredBatch>::const_iterator iter;
+    for ( iter = m_retired.begin(); iter != m_retired.end(); iter++ )
+    {
+        for ( int i = 0; i < NumResourceTypes; i++ )
+        {
+            count += iter->m_ids[i].size();
+        }
+    }
+
+    return count;
+}
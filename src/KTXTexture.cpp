@@ -0,0 +1,651 @@
+#include <string.h>
+#include <string>
+
+#if defined(__USE_ZSTD__)
+  #include <zstd.h>
+#endif
+
+#include "KTXTexture.h"
+#include "TextureCompression.h"
+#include "CommonFunctions.h"
+
+static const uint8_t KTX1Identifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+static const uint8_t KTX2Identifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+static const size_t KTX1HeaderSize = 64;
+static const size_t KTX2HeaderSize = 80;
+static const size_t KTX2LevelIndexEntrySize = 24;
+static const uint32_t KTX1Endianness = 0x04030201;
+static const int MaxNumLevels = 16;
+// Upper bound for the inflated size of a zstd supercompressed KTX2 file; the
+// level lengths come from the file and can not be trusted
+static const uint64_t MaxInflatedSize = 256 * 1024 * 1024;
+
+// KTX2 supercompression schemes
+static const uint32_t KTX2SupercompressionNone = 0;
+static const uint32_t KTX2SupercompressionZstd = 2;
+
+static const int RGBAPixelSize = 4;
+static const int RGB565PixelSize = 2;
+
+/** Maps a KTX2 (Vulkan) format into the matching OpenGL format. */
+struct VkFormatMapping
+{
+    uint32_t m_vkFormat;
+    GLenum m_internalFormat;
+    GLenum m_format;
+    GLenum m_type;
+};
+
+static const VkFormatMapping VkFormatMappings[] = {
+    { 37, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE },  // R8G8B8A8_UNORM
+    { 131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 0, 0 },
+    { 133, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 0, 0 },
+    { 135, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 0, 0 },
+    { 137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, 0 },
+    { 147, GL_COMPRESSED_RGB8_ETC2, 0, 0 },
+    { 148, GL_COMPRESSED_SRGB8_ETC2, 0, 0 },
+    { 149, GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2, 0, 0 },
+    { 151, GL_COMPRESSED_RGBA8_ETC2_EAC, 0, 0 },
+    { 152, GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC, 0, 0 },
+    { 157, GL_COMPRESSED_RGBA_ASTC_4x4_KHR, 0, 0 },
+    { 158, GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR, 0, 0 },
+    { 165, GL_COMPRESSED_RGBA_ASTC_6x6_KHR, 0, 0 },
+    { 171, GL_COMPRESSED_RGBA_ASTC_8x8_KHR, 0, 0 }
+};
+
+// Variants tried by LoadBestKTXTextureFromBundle(), best first
+static const char* const VariantNames[] = { "astc", "etc2", "dxt", "etc1" };
+static const char* const VariantExtensions[] = { "ktx2", "ktx" };
+
+static inline uint32_t ReadUint32(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint64_t ReadUint64(const uint8_t* data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+KTXTexture::KTXTexture()
+{
+    Clear();
+}
+
+KTXTexture::~KTXTexture()
+{
+}
+
+void KTXTexture::Clear()
+{
+    m_file.Reset();
+    m_inflated.clear();
+    m_images.clear();
+    m_internalFormat = 0;
+    m_format = 0;
+    m_type = 0;
+    m_width = 0;
+    m_height = 0;
+    m_numLevels = 0;
+    m_numFaces = 0;
+}
+
+bool KTXTexture::Load(const char* fileName)
+{
+    Clear();
+
+    if ( !MapBundleFile(fileName, false, &m_file) )
+    {
+        return false;
+    }
+
+    if ( !ParseData((const uint8_t*)m_file.GetData(), m_file.GetSize()) )
+    {
+        LOG_DEBUG("KTXTexture: invalid file: %s", fileName);
+        Clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool KTXTexture::Parse(const void* data, size_t size)
+{
+    Clear();
+
+    if ( !ParseData((const uint8_t*)data, size) )
+    {
+        Clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool KTXTexture::ParseData(const uint8_t* data, size_t size)
+{
+    if ( size < sizeof(KTX1Identifier) )
+    {
+        return false;
+    }
+
+    if ( memcmp(data, KTX1Identifier, sizeof(KTX1Identifier)) == 0 )
+    {
+        return ParseKTX1(data, size);
+    }
+
+    return ParseKTX2(data, size);
+}
+
+bool KTXTexture::AddImage(int level, const uint8_t* data, size_t size)
+{
+    int width = m_width >> level;
+    int height = m_height >> level;
+    KTXImage image;
+    image.m_data = data;
+    image.m_width = (width > 0) ? width : 1;
+    image.m_height = (height > 0) ? height : 1;
+
+    if ( IsCompressed() )
+    {
+        image.m_size = GetCompressedImageSize(m_internalFormat, image.m_width,
+                                              image.m_height);
+    }
+    else
+    {
+        image.m_size = (size_t)image.m_width * image.m_height *
+                RGBAPixelSize;
+    }
+
+    if ( (image.m_size == 0) || (size < image.m_size) )
+    {
+        LOG_DEBUG("KTXTexture: level %d is truncated", level);
+        return false;
+    }
+
+    m_images.push_back(image);
+
+    return true;
+}
+
+/** Adds the faces of a KTX2 level, which follow each other. */
+bool KTXTexture::AddLevel(int level, const uint8_t* data, size_t size)
+{
+    size_t faceSize = size / m_numFaces;
+    for ( int face = 0; face < m_numFaces; face++ )
+    {
+        if ( !AddImage(level, data + face * faceSize, faceSize) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool KTXTexture::ParseKTX1(const uint8_t* data, size_t size)
+{
+    if ( size < KTX1HeaderSize )
+    {
+        return false;
+    }
+
+    if ( ReadUint32(data + 12) != KTX1Endianness )
+    {
+        LOG_DEBUG("KTXTexture: byte swapped files are not supported");
+        return false;
+    }
+
+    uint32_t glType = ReadUint32(data + 16);
+    uint32_t glFormat = ReadUint32(data + 24);
+    uint32_t glInternalFormat = ReadUint32(data + 28);
+    uint32_t depth = ReadUint32(data + 44);
+    uint32_t numArrayElements = ReadUint32(data + 48);
+    uint32_t numFaces = ReadUint32(data + 52);
+    uint32_t numLevels = ReadUint32(data + 56);
+    uint32_t keyValueSize = ReadUint32(data + 60);
+
+    m_width = ReadUint32(data + 36);
+    m_height = ReadUint32(data + 40);
+
+    if ( (depth > 1) || (numArrayElements > 0) ||
+         ((numFaces != 1) && (numFaces != 6)) ||
+         (numLevels > MaxNumLevels) || (m_width <= 0) || (m_height <= 0) )
+    {
+        LOG_DEBUG("KTXTexture: only 2D textures and cube maps are supported");
+        return false;
+    }
+
+    if ( glType != 0 )
+    {
+        // Rows of uncompressed levels are padded to 4 bytes, which only
+        // matches the RGBA8 size computed by AddImage()
+        if ( (glType != GL_UNSIGNED_BYTE) || (glFormat != GL_RGBA) )
+        {
+            LOG_DEBUG("KTXTexture: unsupported format 0x%x / 0x%x",
+                      glFormat, glType);
+            return false;
+        }
+        m_internalFormat = GL_RGBA;
+        m_format = glFormat;
+        m_type = glType;
+    }
+    else
+    {
+        m_internalFormat = glInternalFormat;
+    }
+
+    m_numFaces = numFaces;
+    m_numLevels = (numLevels > 0) ? numLevels : 1;
+
+    size_t offset = KTX1HeaderSize + keyValueSize;
+    for ( int level = 0; level < m_numLevels; level++ )
+    {
+        if ( (offset + sizeof(uint32_t)) > size )
+        {
+            return false;
+        }
+
+        // For cube maps the size is that of one face; each face is padded
+        // to 4 bytes
+        size_t imageSize = ReadUint32(data + offset);
+        size_t paddedSize = (imageSize + 3) & ~(size_t)3;
+        offset += sizeof(uint32_t);
+
+        for ( int face = 0; face < m_numFaces; face++ )
+        {
+            if ( (offset > size) || (imageSize > (size - offset)) )
+            {
+                return false;
+            }
+
+            if ( !AddImage(level, data + offset, imageSize) )
+            {
+                return false;
+            }
+
+            offset += paddedSize;
+        }
+    }
+
+    return true;
+}
+
+bool KTXTexture::ParseKTX2(const uint8_t* data, size_t size)
+{
+    if ( (size < KTX2HeaderSize) ||
+         (memcmp(data, KTX2Identifier, sizeof(KTX2Identifier)) != 0) )
+    {
+        return false;
+    }
+
+    uint32_t vkFormat = ReadUint32(data + 12);
+    uint32_t depth = ReadUint32(data + 28);
+    uint32_t numLayers = ReadUint32(data + 32);
+    uint32_t numFaces = ReadUint32(data + 36);
+    uint32_t numLevels = ReadUint32(data + 40);
+    uint32_t supercompression = ReadUint32(data + 44);
+
+    m_width = ReadUint32(data + 20);
+    m_height = ReadUint32(data + 24);
+
+    if ( (depth > 1) || (numLayers > 0) ||
+         ((numFaces != 1) && (numFaces != 6)) ||
+         (numLevels > MaxNumLevels) || (m_width <= 0) || (m_height <= 0) )
+    {
+        LOG_DEBUG("KTXTexture: only 2D textures and cube maps are supported");
+        return false;
+    }
+
+    const VkFormatMapping* mapping = NULL;
+    for ( size_t i = 0;
+          i < sizeof(VkFormatMappings) / sizeof(VkFormatMappings[0]); i++ )
+    {
+        if ( VkFormatMappings[i].m_vkFormat == vkFormat )
+        {
+            mapping = VkFormatMappings + i;
+            break;
+        }
+    }
+
+    if ( mapping == NULL )
+    {
+        // Includes VK_FORMAT_UNDEFINED, ie. Basis Universal
+        LOG_DEBUG("KTXTexture: unsupported format %u", vkFormat);
+        return false;
+    }
+
+    m_internalFormat = mapping->m_internalFormat;
+    m_format = mapping->m_format;
+    m_type = mapping->m_type;
+    m_numFaces = numFaces;
+    m_numLevels = (numLevels > 0) ? numLevels : 1;
+
+    if ( (KTX2HeaderSize + m_numLevels * KTX2LevelIndexEntrySize) > size )
+    {
+        return false;
+    }
+
+    const uint8_t* levelIndex = data + KTX2HeaderSize;
+
+    if ( supercompression == KTX2SupercompressionZstd )
+    {
+#if defined(__USE_ZSTD__)
+        // Allocate for all levels first; the images point into the buffer
+        uint64_t inflatedSize = 0;
+        for ( int level = 0; level < m_numLevels; level++ )
+        {
+            uint64_t uncompressedLength = ReadUint64(levelIndex +
+                    level * KTX2LevelIndexEntrySize + 16);
+            if ( (uncompressedLength == 0) ||
+                 (uncompressedLength > (MaxInflatedSize - inflatedSize)) )
+            {
+                LOG_DEBUG("KTXTexture: bad uncompressed length for level %d",
+                          level);
+                return false;
+            }
+            inflatedSize += uncompressedLength;
+        }
+        m_inflated.resize((size_t)inflatedSize);
+
+        size_t inflatedOffset = 0;
+        for ( int level = 0; level < m_numLevels; level++ )
+        {
+            const uint8_t* entry = levelIndex +
+                    level * KTX2LevelIndexEntrySize;
+            uint64_t offset = ReadUint64(entry);
+            uint64_t length = ReadUint64(entry + 8);
+            uint64_t uncompressedLength = ReadUint64(entry + 16);
+            if ( (offset > size) || (length > (size - offset)) )
+            {
+                return false;
+            }
+
+            uint8_t* target = m_inflated.data() + inflatedOffset;
+            size_t result = ZSTD_decompress(target, (size_t)uncompressedLength,
+                                            data + offset, length);
+            if ( ZSTD_isError(result) || (result != uncompressedLength) ||
+                 !AddLevel(level, target, uncompressedLength) )
+            {
+                return false;
+            }
+            inflatedOffset += uncompressedLength;
+        }
+
+        return true;
+#else
+        LOG_DEBUG("KTXTexture: zstd supercompression needs __USE_ZSTD__");
+        return false;
+#endif
+    }
+    else if ( supercompression != KTX2SupercompressionNone )
+    {
+        LOG_DEBUG("KTXTexture: unsupported supercompression %u",
+                  supercompression);
+        return false;
+    }
+
+    for ( int level = 0; level < m_numLevels; level++ )
+    {
+        const uint8_t* entry = levelIndex + level * KTX2LevelIndexEntrySize;
+        uint64_t offset = ReadUint64(entry);
+        uint64_t length = ReadUint64(entry + 8);
+        if ( (offset > size) || (length > (size - offset)) ||
+             !AddLevel(level, data + offset, length) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool KTXTexture::IsFormatSupported() const
+{
+    return !IsCompressed() || CompressedFormatSupported(m_internalFormat);
+}
+
+bool KTXTexture::CanUpload() const
+{
+    if ( m_images.empty() )
+    {
+        return false;
+    }
+
+    if ( IsFormatSupported() )
+    {
+        return true;
+    }
+
+    CompressedFormatInfo info;
+    return ( GetCompressedFormatInfo(m_internalFormat, &info) &&
+             info.m_decodable );
+}
+
+bool KTXTexture::Upload(GLuint* texture, bool clamp, bool useMipmaps) const
+{
+    if ( !CanUpload() )
+    {
+        LOG_DEBUG("KTXTexture: format 0x%x is not supported",
+                  m_internalFormat);
+        return false;
+    }
+
+    bool decode = !IsFormatSupported();
+    CompressedFormatInfo info;
+    bool toRGB565 = false;
+    if ( decode )
+    {
+        GetCompressedFormatInfo(m_internalFormat, &info);
+        toRGB565 = info.m_opaque;
+        LOG_DEBUG("KTXTexture: decoding format 0x%x on the CPU",
+                  m_internalFormat);
+    }
+
+    // A mip chain missing from the file is generated from the first level
+    // when the uploaded format allows; compressed textures without a
+    // complete chain go without mipmaps, as they would be incomplete
+    int maxSize = (m_width > m_height) ? m_width : m_height;
+    int numFullLevels = 1;
+    while ( (maxSize >> numFullLevels) > 0 )
+    {
+        numFullLevels++;
+    }
+
+    int numLevels = 1;
+    bool generateMipmaps = false;
+    if ( useMipmaps )
+    {
+        if ( m_numLevels >= numFullLevels )
+        {
+            numLevels = numFullLevels;
+        }
+        else if ( !IsCompressed() || decode )
+        {
+            generateMipmaps = true;
+        }
+        else
+        {
+            LOG_DEBUG("KTXTexture: incomplete mip chain, mipmaps disabled");
+            useMipmaps = false;
+        }
+    }
+
+    GLenum target = (m_numFaces == 6) ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+
+    glGenTextures(1, texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(target, *texture);
+
+    GLint unpackAlignment = 4;
+    std::vector<uint8_t> pixels;
+    if ( decode )
+    {
+        // RGB565 rows are not padded to 4 bytes
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        pixels.resize((size_t)m_width * m_height *
+                      (toRGB565 ? RGB565PixelSize : RGBAPixelSize));
+    }
+
+    bool decodeFailed = false;
+    for ( int level = 0; (level < numLevels) && !decodeFailed; level++ )
+    {
+        for ( int face = 0; face < m_numFaces; face++ )
+        {
+            const KTXImage& image = GetImage(level, face);
+            GLenum imageTarget = (m_numFaces == 6) ?
+                    (GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) : GL_TEXTURE_2D;
+
+            if ( decode )
+            {
+                if ( !DecodeCompressedImage(m_internalFormat, image.m_data,
+                                            image.m_size, image.m_width,
+                                            image.m_height, toRGB565,
+                                            &pixels[0]) )
+                {
+                    LOG_DEBUG("KTXTexture: failed to decode level %d, "
+                              "face %d", level, face);
+                    decodeFailed = true;
+                    break;
+                }
+                GLenum format = toRGB565 ? GL_RGB : GL_RGBA;
+                GLenum type = toRGB565 ?
+                        GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE;
+                glTexImage2D(imageTarget, level, format, image.m_width,
+                             image.m_height, 0, format, type, &pixels[0]);
+            }
+            else if ( IsCompressed() )
+            {
+                glCompressedTexImage2D(imageTarget, level, m_internalFormat,
+                                       image.m_width, image.m_height, 0,
+                                       image.m_size, image.m_data);
+            }
+            else
+            {
+                glTexImage2D(imageTarget, level, m_format, image.m_width,
+                             image.m_height, 0, m_format, m_type,
+                             image.m_data);
+            }
+        }
+    }
+
+    if ( decode )
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+    }
+
+    if ( decodeFailed )
+    {
+        glDeleteTextures(1, texture);
+        *texture = 0;
+        return false;
+    }
+
+    if ( generateMipmaps )
+    {
+        glGenerateMipmap(target);
+    }
+
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER,
+                    useMipmaps ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLint wrap = clamp ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+
+    int glError = glGetError();
+    if ( glError != GL_NO_ERROR )
+    {
+        LOG_DEBUG("KTXTexture::Upload(): GL error: 0x%x", glError);
+        glDeleteTextures(1, texture);
+        *texture = 0;
+        return false;
+    }
+
+    return true;
+}
+
+bool LoadKTXTextureFromBundle(const char* fileName, TextureHandle* texture,
+                              bool clamp, bool useMipmaps)
+{
+    KTXTexture ktx;
+    GLuint textureId;
+    if ( !ktx.Load(fileName) || !ktx.Upload(&textureId, clamp, useMipmaps) )
+    {
+        return false;
+    }
+
+    *texture = g_resourceRegistry.AdoptTexture(textureId);
+
+    return true;
+}
+
+bool LoadBestKTXTextureFromBundle(const char* baseName,
+                                  TextureHandle* texture, bool clamp,
+                                  bool useMipmaps)
+{
+    // First variant that can only be decoded on the CPU
+    KTXTexture* fallback = NULL;
+    KTXTexture* selected = NULL;
+
+    int numVariants = sizeof(VariantNames) / sizeof(VariantNames[0]);
+    int numExtensions = sizeof(VariantExtensions) /
+            sizeof(VariantExtensions[0]);
+    for ( int i = 0; (i < numVariants) && (selected == NULL); i++ )
+    {
+        for ( int j = 0; j < numExtensions; j++ )
+        {
+            std::string fileName = std::string(baseName) + "." +
+                    VariantNames[i] + "." + VariantExtensions[j];
+            KTXTexture* ktx = new KTXTexture();
+            if ( ktx->Load(fileName.c_str()) )
+            {
+                if ( ktx->IsFormatSupported() )
+                {
+                    selected = ktx;
+                    break;
+                }
+                if ( (fallback == NULL) && ktx->CanUpload() )
+                {
+                    fallback = ktx;
+                    continue;
+                }
+            }
+            delete ktx;
+        }
+    }
+
+    if ( selected == NULL )
+    {
+        selected = fallback;
+        fallback = NULL;
+    }
+    delete fallback;
+
+    if ( selected == NULL )
+    {
+        LOG_DEBUG("LoadBestKTXTextureFromBundle(): no usable variant of %s",
+                  baseName);
+        return false;
+    }
+
+    GLuint textureId;
+    bool success = selected->Upload(&textureId, clamp, useMipmaps);
+    delete selected;
+    if ( success )
+    {
+        *texture = g_resourceRegistry.AdoptTexture(textureId);
+    }
+
+    return success;
+}
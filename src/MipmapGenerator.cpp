@@ -0,0 +1,456 @@
+#include <string.h>
+#include <math.h>
+#include <functional>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #include <arm_neon.h>
+  #define USE_NEON
+#endif
+
+#include "MipmapGenerator.h"
+#include "ThreadPool.h"
+#include "CommonFunctions.h"
+
+static const int RGBAPixelSize = 4;
+
+// Smallest number of output pixels worth a task of their own
+static const int MinPixelsPerTask = 16 * 1024;
+
+// Kaiser filter: taps per dimension, and the window shape
+static const int KaiserNumTaps = 8;
+static const double KaiserBeta = 4.0;
+
+ColorTables::ColorTables()
+{
+    for ( int i = 0; i < 256; i++ )
+    {
+        double value = i / 255.0;
+        m_byteToFloat[i] = (float)value;
+        m_srgbToLinear[i] = (float)((value <= 0.04045) ?
+                (value / 12.92) : pow((value + 0.055) / 1.055, 2.4));
+    }
+
+    for ( int i = 0; i < LinearToSrgbTableSize; i++ )
+    {
+        double value = (double)i / (LinearToSrgbTableSize - 1);
+        value = (value <= 0.0031308) ?
+                (value * 12.92) : (1.055 * pow(value, 1.0 / 2.4) - 0.055);
+        m_linearToSrgb[i] = (uint8_t)(value * 255.0 + 0.5);
+    }
+}
+
+const ColorTables& ColorTables::Get()
+{
+    // Thread safe initialization
+    static const ColorTables tables;
+    return tables;
+}
+
+/** Filter weights of the Kaiser filter; built once. */
+struct FilterTables
+{
+    FilterTables()
+    {
+        // Taps at source offsets -3..4 around 2x; d is the distance from
+        // the center of the output texel in source texels
+        double sum = 0.0;
+        double weights[KaiserNumTaps];
+        for ( int i = 0; i < KaiserNumTaps; i++ )
+        {
+            double d = i - 3.5;
+            double x = d * 0.5;
+            double sinc = sin(M_PI * x) / (M_PI * x);
+            double t = d / (KaiserNumTaps / 2);
+            double window = BesselI0(KaiserBeta * sqrt(1.0 - t * t)) /
+                    BesselI0(KaiserBeta);
+            weights[i] = sinc * window;
+            sum += weights[i];
+        }
+        for ( int i = 0; i < KaiserNumTaps; i++ )
+        {
+            m_kaiserWeights[i] = (float)(weights[i] / sum);
+        }
+    }
+
+    /** Modified Bessel function of the first kind, order 0. */
+    static double BesselI0(double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for ( int k = 1; k < 32; k++ )
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    float m_kaiserWeights[KaiserNumTaps];
+};
+
+static const FilterTables& GetFilterTables()
+{
+    // Thread safe initialization
+    static FilterTables tables;
+    return tables;
+}
+
+/** Source level and filter options of a downsampling pass. */
+struct DownsampleJob
+{
+    const uint8_t* m_source;
+    int m_sourceWidth;
+    int m_sourceHeight;
+    uint8_t* m_target;
+    int m_targetWidth;
+    int m_targetHeight;
+    bool m_wrap;
+
+    // Per channel decoding tables; sRGB or linear for the colors
+    const float* m_decode[RGBAPixelSize];
+    bool m_srgb;
+};
+
+/** Maps a texel coordinate outside the image back inside it. */
+static inline int EdgeIndex(int index, int size, bool wrap)
+{
+    if ( wrap )
+    {
+        index %= size;
+        return (index < 0) ? (index + size) : index;
+    }
+
+    return (index < 0) ? 0 : ((index >= size) ? (size - 1) : index);
+}
+
+/** Runs function(firstRow, lastRow) over row ranges on g_threadPool. */
+static void ParallelRows(int numRows, int rowWidth,
+                         const std::function<void(int, int)>& function)
+{
+    // Small levels are not worth the synchronization
+    int numChunks = (int)(((size_t)numRows * rowWidth) / MinPixelsPerTask);
+    int maxChunks = (g_threadPool.GetNumThreads() + 1) * 4;
+    if ( numChunks > maxChunks )
+    {
+        numChunks = maxChunks;
+    }
+    if ( numChunks > numRows )
+    {
+        numChunks = numRows;
+    }
+
+    if ( numChunks <= 1 )
+    {
+        function(0, numRows);
+        return;
+    }
+
+    g_threadPool.ParallelFor(numChunks, [&](int chunk) {
+        function((int)((int64_t)numRows * chunk / numChunks),
+                 (int)((int64_t)numRows * (chunk + 1) / numChunks));
+    });
+}
+
+/** 2x2 box filter of one row of 8-bit texels. */
+static void BoxFilterRow(const uint8_t* row0, const uint8_t* row1,
+                         uint8_t* target, int targetWidth, int sourceWidth)
+{
+    int x = 0;
+
+    // With a single source column both samples come from it
+    int step = (sourceWidth > 1) ? RGBAPixelSize : 0;
+
+#if defined(__SSE2__)
+    if ( step > 0 )
+    {
+        // Two target texels from four source texels of both rows
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16(2);
+        for ( ; (x + 2) <= targetWidth; x += 2 )
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+            __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+            __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+                                        _mm_unpacklo_epi8(b, zero));
+            __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+                                         _mm_unpackhi_epi8(b, zero));
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high),
+                                        _mm_unpackhi_epi64(low, high));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+            _mm_storel_epi64((__m128i*)(target + x * RGBAPixelSize),
+                             _mm_packus_epi16(sum, sum));
+        }
+    }
+#elif defined(USE_NEON)
+    if ( step > 0 )
+    {
+        // Eight target texels from sixteen source texels of both rows
+        for ( ; (x + 8) <= targetWidth; x += 8 )
+        {
+            uint8x16x4_t a = vld4q_u8(row0 + x * 8);
+            uint8x16x4_t b = vld4q_u8(row1 + x * 8);
+            uint8x8x4_t result;
+            for ( int c = 0; c < RGBAPixelSize; c++ )
+            {
+                uint16x8_t sum = vaddq_u16(vpaddlq_u8(a.val[c]),
+                                           vpaddlq_u8(b.val[c]));
+                result.val[c] = vrshrn_n_u16(sum, 2);
+            }
+            vst4_u8(target + x * RGBAPixelSize, result);
+        }
+    }
+#endif
+
+    for ( ; x < targetWidth; x++ )
+    {
+        const uint8_t* a = row0 + x * 2 * RGBAPixelSize;
+        const uint8_t* b = row1 + x * 2 * RGBAPixelSize;
+        uint8_t* texel = target + x * RGBAPixelSize;
+        for ( int c = 0; c < RGBAPixelSize; c++ )
+        {
+            texel[c] = (a[c] + a[c + step] + b[c] + b[c + step] + 2) >> 2;
+        }
+    }
+}
+
+static void BoxFilter(const DownsampleJob& job, int firstRow, int lastRow)
+{
+    size_t sourcePitch = (size_t)job.m_sourceWidth * RGBAPixelSize;
+    size_t targetPitch = (size_t)job.m_targetWidth * RGBAPixelSize;
+    int rowStep = (job.m_sourceHeight > 1) ? 1 : 0;
+
+    for ( int y = firstRow; y < lastRow; y++ )
+    {
+        const uint8_t* row0 = job.m_source + (size_t)y * 2 * sourcePitch;
+        const uint8_t* row1 = row0 + rowStep * sourcePitch;
+        BoxFilterRow(row0, row1, job.m_target + y * targetPitch,
+                     job.m_targetWidth, job.m_sourceWidth);
+    }
+}
+
+static void BoxFilterLinear(const DownsampleJob& job, int firstRow,
+                            int lastRow)
+{
+    const ColorTables& tables = ColorTables::Get();
+    size_t sourcePitch = (size_t)job.m_sourceWidth * RGBAPixelSize;
+    int rowStep = (job.m_sourceHeight > 1) ? 1 : 0;
+    int step = (job.m_sourceWidth > 1) ? RGBAPixelSize : 0;
+
+    for ( int y = firstRow; y < lastRow; y++ )
+    {
+        const uint8_t* row0 = job.m_source + (size_t)y * 2 * sourcePitch;
+        const uint8_t* row1 = row0 + rowStep * sourcePitch;
+        uint8_t* target = job.m_target +
+                (size_t)y * job.m_targetWidth * RGBAPixelSize;
+
+        for ( int x = 0; x < job.m_targetWidth; x++ )
+        {
+            const uint8_t* a = row0 + x * 2 * RGBAPixelSize;
+            const uint8_t* b = row1 + x * 2 * RGBAPixelSize;
+            for ( int c = 0; c < RGBAPixelSize; c++ )
+            {
+                const float* decode = job.m_decode[c];
+                float sum = decode[a[c]] + decode[a[c + step]] +
+                        decode[b[c]] + decode[b[c + step]];
+                target[x * RGBAPixelSize + c] =
+                        tables.Encode(sum * 0.25f, job.m_srgb && (c < 3));
+            }
+        }
+    }
+}
+
+static void KaiserFilter(const DownsampleJob& job, int firstRow,
+                         int lastRow)
+{
+    const ColorTables& tables = ColorTables::Get();
+    const float* weights = GetFilterTables().m_kaiserWeights;
+    size_t sourcePitch = (size_t)job.m_sourceWidth * RGBAPixelSize;
+
+    // Vertically filtered source row
+    std::vector<float> column(sourcePitch);
+
+    for ( int y = firstRow; y < lastRow; y++ )
+    {
+        const uint8_t* rows[KaiserNumTaps];
+        for ( int k = 0; k < KaiserNumTaps; k++ )
+        {
+            int row = EdgeIndex(y * 2 + k - 3, job.m_sourceHeight,
+                                job.m_wrap);
+            rows[k] = job.m_source + row * sourcePitch;
+        }
+
+        for ( size_t i = 0; i < sourcePitch; i++ )
+        {
+            const float* decode = job.m_decode[i & 3];
+            float sum = 0.0f;
+            for ( int k = 0; k < KaiserNumTaps; k++ )
+            {
+                sum += weights[k] * decode[rows[k][i]];
+            }
+            column[i] = sum;
+        }
+
+        uint8_t* target = job.m_target +
+                (size_t)y * job.m_targetWidth * RGBAPixelSize;
+        for ( int x = 0; x < job.m_targetWidth; x++ )
+        {
+            float sum[RGBAPixelSize] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for ( int k = 0; k < KaiserNumTaps; k++ )
+            {
+                const float* texel = &column[0] + RGBAPixelSize *
+                        EdgeIndex(x * 2 + k - 3, job.m_sourceWidth,
+                                  job.m_wrap);
+                for ( int c = 0; c < RGBAPixelSize; c++ )
+                {
+                    sum[c] += weights[k] * texel[c];
+                }
+            }
+
+            for ( int c = 0; c < RGBAPixelSize; c++ )
+            {
+                target[x * RGBAPixelSize + c] =
+                        tables.Encode(sum[c], job.m_srgb && (c < 3));
+            }
+        }
+    }
+}
+
+MipmapChain::MipmapChain()
+{
+}
+
+MipmapChain::~MipmapChain()
+{
+}
+
+int MipmapChain::CountLevels(int width, int height)
+{
+    int size = (width > height) ? width : height;
+    int numLevels = 1;
+    while ( (size >> numLevels) > 0 )
+    {
+        numLevels++;
+    }
+
+    return numLevels;
+}
+
+void MipmapChain::SetupLevels(int width, int height)
+{
+    int numLevels = CountLevels(width, height);
+    m_levels.resize(numLevels);
+
+    size_t offset = 0;
+    for ( int i = 0; i < numLevels; i++ )
+    {
+        Level& level = m_levels[i];
+        level.m_offset = offset;
+        level.m_width = ((width >> i) > 0) ? (width >> i) : 1;
+        level.m_height = ((height >> i) > 0) ? (height >> i) : 1;
+        offset += (size_t)level.m_width * level.m_height * RGBAPixelSize;
+    }
+
+    m_data.resize(offset);
+}
+
+void MipmapChain::Generate(const void* data, int width, int height,
+                           MipmapFilter filter, bool srgb, bool wrap)
+{
+    SetupLevels(width, height);
+    memcpy(&m_data[0], data, (size_t)width * height * RGBAPixelSize);
+
+    const ColorTables& tables = ColorTables::Get();
+
+    for ( int i = 1; i < GetNumLevels(); i++ )
+    {
+        DownsampleJob job;
+        job.m_source = &m_data[0] + m_levels[i - 1].m_offset;
+        job.m_sourceWidth = m_levels[i - 1].m_width;
+        job.m_sourceHeight = m_levels[i - 1].m_height;
+        job.m_target = &m_data[0] + m_levels[i].m_offset;
+        job.m_targetWidth = m_levels[i].m_width;
+        job.m_targetHeight = m_levels[i].m_height;
+        job.m_wrap = wrap;
+        job.m_srgb = srgb;
+        for ( int c = 0; c < RGBAPixelSize; c++ )
+        {
+            job.m_decode[c] = (srgb && (c < 3)) ?
+                    tables.m_srgbToLinear : tables.m_byteToFloat;
+        }
+
+        ParallelRows(job.m_targetHeight, job.m_targetWidth,
+                     [&job, filter](int firstRow, int lastRow) {
+            if ( filter == MipmapFilterKaiser )
+            {
+                KaiserFilter(job, firstRow, lastRow);
+            }
+            else if ( job.m_srgb )
+            {
+                BoxFilterLinear(job, firstRow, lastRow);
+            }
+            else
+            {
+                BoxFilter(job, firstRow, lastRow);
+            }
+        });
+    }
+}
+
+bool MipmapChain::SetData(const void* data, size_t size, int width,
+                          int height)
+{
+    SetupLevels(width, height);
+    if ( size != m_data.size() )
+    {
+        m_levels.clear();
+        m_data.clear();
+        return false;
+    }
+
+    memcpy(&m_data[0], data, size);
+
+    return true;
+}
+
+void MipmapChain::Upload(GLenum target) const
+{
+    for ( int i = 0; i < GetNumLevels(); i++ )
+    {
+        const Level& level = m_levels[i];
+        glTexImage2D(target, i, GL_RGBA, level.m_width, level.m_height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, &m_data[0] + level.m_offset);
+    }
+}
+
+bool CreateMipmapped2DTexture(int width, int height, const void* data,
+                              GLuint* texture, bool clamp,
+                              const MipmapSettings& settings)
+{
+    MipmapChain chain;
+    chain.Generate(data, width, height, settings.m_filter, settings.m_srgb,
+                   !clamp);
+
+    glGenTextures(1, texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, *texture);
+    chain.Upload(GL_TEXTURE_2D);
+
+    SetTextureFiltering(GL_TEXTURE_2D, true, settings.m_trilinear,
+                        settings.m_maxAnisotropy);
+    GLint wrap = clamp ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+
+    int glError = glGetError();
+    if ( glError != GL_NO_ERROR )
+    {
+        LOG_DEBUG("CreateMipmapped2DTexture(): GL error: 0x%x", glError);
+        glDeleteTextures(1, texture);
+        *texture = 0;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,693 @@
+#if defined(__BUILD_NULLGL__)
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "OpenGLAPI.h"
+#include "NullGL.h"
+
+#define NULLGL_NAME_ENTRY(name) #name,
+
+static const char* const EntryPointNames[NumNullGLEntryPoints] = {
+    NULLGL_ENTRY_POINTS(NULLGL_NAME_ENTRY)
+};
+
+#undef NULLGL_NAME_ENTRY
+
+// Values reported for GL_MAX_TEXTURE_SIZE and
+// GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+static const GLint MaxTextureSize = 4096;
+static const GLfloat MaxAnisotropy = 16.0;
+
+static NullGLStats s_stats;
+static FILE* s_recordStream = NULL;
+static const char* s_extensions =
+        "GL_OES_depth_texture GL_OES_packed_depth_stencil "
+        "GL_OES_compressed_ETC1_RGB8_texture GL_EXT_texture_compression_s3tc "
+        "GL_KHR_texture_compression_astc_ldr "
+        "GL_EXT_texture_filter_anisotropic";
+
+// Simulated state
+static GLuint s_nextObjectName = 1;
+static GLint s_boundFramebuffer = 0;
+static GLint s_viewport[4] = { 0, 0, 0, 0 };
+static GLint s_unpackAlignment = 4;
+static GLfloat s_clearColor[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+const NullGLStats& NullGLGetStats()
+{
+    return s_stats;
+}
+
+void NullGLResetStats()
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+const char* NullGLEntryPointName(int entryPoint)
+{
+    if ( (entryPoint < 0) || (entryPoint >= NumNullGLEntryPoints) )
+    {
+        return "?";
+    }
+
+    return EntryPointNames[entryPoint];
+}
+
+void NullGLSetRecordStream(FILE* stream)
+{
+    s_recordStream = stream;
+}
+
+void NullGLSetExtensions(const char* extensions)
+{
+    s_extensions = extensions;
+}
+
+void NullGLPrintStats(FILE* stream)
+{
+    for ( int i = 0; i < NumNullGLEntryPoints; i++ )
+    {
+        if ( s_stats.m_calls[i] > 0 )
+        {
+            fprintf(stream, "%-28s %llu\n", EntryPointNames[i],
+                    (unsigned long long)s_stats.m_calls[i]);
+        }
+    }
+
+    fprintf(stream, "total calls: %llu, draw calls: %llu, vertices: %llu\n",
+            (unsigned long long)s_stats.m_totalCalls,
+            (unsigned long long)s_stats.m_drawCalls,
+            (unsigned long long)s_stats.m_verticesDrawn);
+    fprintf(stream, "buffer bytes uploaded: %llu, texture bytes: %llu\n",
+            (unsigned long long)s_stats.m_bufferBytesUploaded,
+            (unsigned long long)s_stats.m_textureBytesUploaded);
+}
+
+// Counts a call and writes it into the record stream if one is set
+static void Record(NullGLEntryPoint entryPoint, const char* argFormat, ...)
+{
+    s_stats.m_calls[entryPoint]++;
+    s_stats.m_totalCalls++;
+
+    if ( s_recordStream != NULL )
+    {
+        fprintf(s_recordStream, "%s(", EntryPointNames[entryPoint]);
+        va_list args;
+        va_start(args, argFormat);
+        vfprintf(s_recordStream, argFormat, args);
+        va_end(args);
+        fprintf(s_recordStream, ")\n");
+    }
+}
+
+// Returns the size of a client side pixel rectangle in bytes
+static size_t PixelDataSize(GLsizei width, GLsizei height,
+                            GLenum format, GLenum type)
+{
+    int components;
+    switch ( format )
+    {
+        case GL_RGBA:
+            components = 4;
+            break;
+        case GL_RGB:
+            components = 3;
+            break;
+        case GL_LUMINANCE_ALPHA:
+            components = 2;
+            break;
+        default:
+            components = 1;
+            break;
+    }
+
+    int pixelSize;
+    switch ( type )
+    {
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+            pixelSize = 2;
+            break;
+        case GL_UNSIGNED_SHORT:
+            pixelSize = components * 2;
+            break;
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:
+            pixelSize = components * 4;
+            break;
+        default:
+            pixelSize = components;
+            break;
+    }
+
+    // Rows are padded to the unpack alignment
+    size_t rowSize = width * pixelSize;
+    rowSize = (rowSize + s_unpackAlignment - 1) & ~(s_unpackAlignment - 1);
+
+    return rowSize * height;
+}
+
+static void GenNames(GLsizei n, GLuint* names)
+{
+    for ( GLsizei i = 0; i < n; i++ )
+    {
+        names[i] = s_nextObjectName++;
+    }
+}
+
+extern "C" {
+
+void GL_APIENTRY glActiveTexture(GLenum texture)
+{
+    Record(NullGL_glActiveTexture, "0x%x", texture);
+}
+
+void GL_APIENTRY glAttachShader(GLuint program, GLuint shader)
+{
+    Record(NullGL_glAttachShader, "%u, %u", program, shader);
+}
+
+void GL_APIENTRY glBindAttribLocation(GLuint program, GLuint index,
+                                      const GLchar* name)
+{
+    Record(NullGL_glBindAttribLocation, "%u, %u, \"%s\"", program, index,
+           name);
+}
+
+void GL_APIENTRY glBindBuffer(GLenum target, GLuint buffer)
+{
+    Record(NullGL_glBindBuffer, "0x%x, %u", target, buffer);
+}
+
+void GL_APIENTRY glBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    Record(NullGL_glBindFramebuffer, "0x%x, %u", target, framebuffer);
+    s_boundFramebuffer = framebuffer;
+}
+
+void GL_APIENTRY glBindRenderbuffer(GLenum target, GLuint renderbuffer)
+{
+    Record(NullGL_glBindRenderbuffer, "0x%x, %u", target, renderbuffer);
+}
+
+void GL_APIENTRY glBindTexture(GLenum target, GLuint texture)
+{
+    Record(NullGL_glBindTexture, "0x%x, %u", target, texture);
+}
+
+void GL_APIENTRY glBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+    Record(NullGL_glBlendFunc, "0x%x, 0x%x", sfactor, dfactor);
+}
+
+void GL_APIENTRY glBlendFuncSeparate(GLenum srcRGB, GLenum dstRGB,
+                                     GLenum srcAlpha, GLenum dstAlpha)
+{
+    Record(NullGL_glBlendFuncSeparate, "0x%x, 0x%x, 0x%x, 0x%x", srcRGB,
+           dstRGB, srcAlpha, dstAlpha);
+}
+
+void GL_APIENTRY glBufferData(GLenum target, GLsizeiptr size,
+                              const void* data, GLenum usage)
+{
+    Record(NullGL_glBufferData, "0x%x, %ld, %p, 0x%x", target, (long)size,
+           data, usage);
+    if ( data != NULL )
+    {
+        s_stats.m_bufferBytesUploaded += size;
+    }
+}
+
+void GL_APIENTRY glBufferSubData(GLenum target, GLintptr offset,
+                                 GLsizeiptr size, const void* data)
+{
+    Record(NullGL_glBufferSubData, "0x%x, %ld, %ld, %p", target,
+           (long)offset, (long)size, data);
+    s_stats.m_bufferBytesUploaded += size;
+}
+
+GLenum GL_APIENTRY glCheckFramebufferStatus(GLenum target)
+{
+    Record(NullGL_glCheckFramebufferStatus, "0x%x", target);
+    return GL_FRAMEBUFFER_COMPLETE;
+}
+
+void GL_APIENTRY glClear(GLbitfield mask)
+{
+    Record(NullGL_glClear, "0x%x", mask);
+}
+
+void GL_APIENTRY glClearColor(GLfloat red, GLfloat green, GLfloat blue,
+                              GLfloat alpha)
+{
+    Record(NullGL_glClearColor, "%f, %f, %f, %f", red, green, blue, alpha);
+    s_clearColor[0] = red;
+    s_clearColor[1] = green;
+    s_clearColor[2] = blue;
+    s_clearColor[3] = alpha;
+}
+
+void GL_APIENTRY glClearDepthf(GLfloat d)
+{
+    Record(NullGL_glClearDepthf, "%f", d);
+}
+
+void GL_APIENTRY glClearStencil(GLint s)
+{
+    Record(NullGL_glClearStencil, "%d", s);
+}
+
+void GL_APIENTRY glColorMask(GLboolean red, GLboolean green, GLboolean blue,
+                             GLboolean alpha)
+{
+    Record(NullGL_glColorMask, "%d, %d, %d, %d", red, green, blue, alpha);
+}
+
+void GL_APIENTRY glCompileShader(GLuint shader)
+{
+    Record(NullGL_glCompileShader, "%u", shader);
+}
+
+void GL_APIENTRY glCompressedTexImage2D(GLenum target, GLint level,
+                                        GLenum internalformat, GLsizei width,
+                                        GLsizei height, GLint border,
+                                        GLsizei imageSize, const void* data)
+{
+    Record(NullGL_glCompressedTexImage2D, "0x%x, %d, 0x%x, %d, %d, %d, %d, %p",
+           target, level, internalformat, width, height, border, imageSize,
+           data);
+    s_stats.m_textureBytesUploaded += imageSize;
+}
+
+GLuint GL_APIENTRY glCreateProgram()
+{
+    Record(NullGL_glCreateProgram, "");
+    return s_nextObjectName++;
+}
+
+GLuint GL_APIENTRY glCreateShader(GLenum type)
+{
+    Record(NullGL_glCreateShader, "0x%x", type);
+    return s_nextObjectName++;
+}
+
+void GL_APIENTRY glCullFace(GLenum mode)
+{
+    Record(NullGL_glCullFace, "0x%x", mode);
+}
+
+void GL_APIENTRY glDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+    Record(NullGL_glDeleteBuffers, "%d, %p", n, buffers);
+}
+
+void GL_APIENTRY glDeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+{
+    Record(NullGL_glDeleteFramebuffers, "%d, %p", n, framebuffers);
+}
+
+void GL_APIENTRY glDeleteProgram(GLuint program)
+{
+    Record(NullGL_glDeleteProgram, "%u", program);
+}
+
+void GL_APIENTRY glDeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers)
+{
+    Record(NullGL_glDeleteRenderbuffers, "%d, %p", n, renderbuffers);
+}
+
+void GL_APIENTRY glDeleteShader(GLuint shader)
+{
+    Record(NullGL_glDeleteShader, "%u", shader);
+}
+
+void GL_APIENTRY glDeleteTextures(GLsizei n, const GLuint* textures)
+{
+    Record(NullGL_glDeleteTextures, "%d, %p", n, textures);
+}
+
+void GL_APIENTRY glDepthFunc(GLenum func)
+{
+    Record(NullGL_glDepthFunc, "0x%x", func);
+}
+
+void GL_APIENTRY glDepthMask(GLboolean flag)
+{
+    Record(NullGL_glDepthMask, "%d", flag);
+}
+
+void GL_APIENTRY glDisable(GLenum cap)
+{
+    Record(NullGL_glDisable, "0x%x", cap);
+}
+
+void GL_APIENTRY glDisableVertexAttribArray(GLuint index)
+{
+    Record(NullGL_glDisableVertexAttribArray, "%u", index);
+}
+
+void GL_APIENTRY glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    Record(NullGL_glDrawArrays, "0x%x, %d, %d", mode, first, count);
+    s_stats.m_drawCalls++;
+    s_stats.m_verticesDrawn += count;
+}
+
+void GL_APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type,
+                                const void* indices)
+{
+    Record(NullGL_glDrawElements, "0x%x, %d, 0x%x, %p", mode, count, type,
+           indices);
+    s_stats.m_drawCalls++;
+    s_stats.m_verticesDrawn += count;
+}
+
+void GL_APIENTRY glEnable(GLenum cap)
+{
+    Record(NullGL_glEnable, "0x%x", cap);
+}
+
+void GL_APIENTRY glEnableVertexAttribArray(GLuint index)
+{
+    Record(NullGL_glEnableVertexAttribArray, "%u", index);
+}
+
+void GL_APIENTRY glFinish()
+{
+    Record(NullGL_glFinish, "");
+}
+
+void GL_APIENTRY glFlush()
+{
+    Record(NullGL_glFlush, "");
+}
+
+void GL_APIENTRY glFramebufferRenderbuffer(GLenum target, GLenum attachment,
+                                           GLenum renderbuffertarget,
+                                           GLuint renderbuffer)
+{
+    Record(NullGL_glFramebufferRenderbuffer, "0x%x, 0x%x, 0x%x, %u", target,
+           attachment, renderbuffertarget, renderbuffer);
+}
+
+void GL_APIENTRY glFramebufferTexture2D(GLenum target, GLenum attachment,
+                                        GLenum textarget, GLuint texture,
+                                        GLint level)
+{
+    Record(NullGL_glFramebufferTexture2D, "0x%x, 0x%x, 0x%x, %u, %d", target,
+           attachment, textarget, texture, level);
+}
+
+void GL_APIENTRY glGenBuffers(GLsizei n, GLuint* buffers)
+{
+    Record(NullGL_glGenBuffers, "%d", n);
+    GenNames(n, buffers);
+}
+
+void GL_APIENTRY glGenFramebuffers(GLsizei n, GLuint* framebuffers)
+{
+    Record(NullGL_glGenFramebuffers, "%d", n);
+    GenNames(n, framebuffers);
+}
+
+void GL_APIENTRY glGenRenderbuffers(GLsizei n, GLuint* renderbuffers)
+{
+    Record(NullGL_glGenRenderbuffers, "%d", n);
+    GenNames(n, renderbuffers);
+}
+
+void GL_APIENTRY glGenTextures(GLsizei n, GLuint* textures)
+{
+    Record(NullGL_glGenTextures, "%d", n);
+    GenNames(n, textures);
+}
+
+void GL_APIENTRY glGenerateMipmap(GLenum target)
+{
+    Record(NullGL_glGenerateMipmap, "0x%x", target);
+}
+
+void GL_APIENTRY glGetAttachedShaders(GLuint program, GLsizei maxCount,
+                                      GLsizei* count, GLuint* shaders)
+{
+    Record(NullGL_glGetAttachedShaders, "%u, %d", program, maxCount);
+
+    // Pretend the shaders were created right before the program
+    GLsizei numShaders = (maxCount < 2) ? maxCount : 2;
+    for ( GLsizei i = 0; i < numShaders; i++ )
+    {
+        shaders[i] = program - numShaders + i;
+    }
+    if ( count != NULL )
+    {
+        *count = numShaders;
+    }
+}
+
+GLenum GL_APIENTRY glGetError()
+{
+    Record(NullGL_glGetError, "");
+    return GL_NO_ERROR;
+}
+
+void GL_APIENTRY glGetFloatv(GLenum pname, GLfloat* data)
+{
+    Record(NullGL_glGetFloatv, "0x%x", pname);
+
+    switch ( pname )
+    {
+        case GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT:
+            *data = MaxAnisotropy;
+            break;
+        case GL_COLOR_CLEAR_VALUE:
+            memcpy(data, s_clearColor, sizeof(s_clearColor));
+            break;
+        default:
+            *data = 0.0;
+            break;
+    }
+}
+
+void GL_APIENTRY glGetIntegerv(GLenum pname, GLint* data)
+{
+    Record(NullGL_glGetIntegerv, "0x%x", pname);
+
+    switch ( pname )
+    {
+        case GL_FRAMEBUFFER_BINDING:
+            *data = s_boundFramebuffer;
+            break;
+        case GL_MAX_TEXTURE_SIZE:
+            *data = MaxTextureSize;
+            break;
+        case GL_VIEWPORT:
+            memcpy(data, s_viewport, sizeof(s_viewport));
+            break;
+        case GL_UNPACK_ALIGNMENT:
+            *data = s_unpackAlignment;
+            break;
+        default:
+            *data = 0;
+            break;
+    }
+}
+
+void GL_APIENTRY glGetProgramInfoLog(GLuint program, GLsizei bufSize,
+                                     GLsizei* length, GLchar* infoLog)
+{
+    Record(NullGL_glGetProgramInfoLog, "%u, %d", program, bufSize);
+    if ( length != NULL )
+    {
+        *length = 0;
+    }
+    if ( bufSize > 0 )
+    {
+        infoLog[0] = '\0';
+    }
+}
+
+void GL_APIENTRY glGetProgramiv(GLuint program, GLenum pname, GLint* params)
+{
+    Record(NullGL_glGetProgramiv, "%u, 0x%x", program, pname);
+    *params = (pname == GL_LINK_STATUS) ? GL_TRUE : 0;
+}
+
+void GL_APIENTRY glGetShaderInfoLog(GLuint shader, GLsizei bufSize,
+                                    GLsizei* length, GLchar* infoLog)
+{
+    Record(NullGL_glGetShaderInfoLog, "%u, %d", shader, bufSize);
+    if ( length != NULL )
+    {
+        *length = 0;
+    }
+    if ( bufSize > 0 )
+    {
+        infoLog[0] = '\0';
+    }
+}
+
+void GL_APIENTRY glGetShaderiv(GLuint shader, GLenum pname, GLint* params)
+{
+    Record(NullGL_glGetShaderiv, "%u, 0x%x", shader, pname);
+    *params = (pname == GL_COMPILE_STATUS) ? GL_TRUE : 0;
+}
+
+const GLubyte* GL_APIENTRY glGetString(GLenum name)
+{
+    Record(NullGL_glGetString, "0x%x", name);
+
+    switch ( name )
+    {
+        case GL_EXTENSIONS:
+            return (const GLubyte*)s_extensions;
+        case GL_VENDOR:
+            return (const GLubyte*)"CommonGL";
+        case GL_RENDERER:
+            return (const GLubyte*)"NullGL";
+        case GL_VERSION:
+            return (const GLubyte*)"OpenGL ES 2.0 NullGL";
+        default:
+            return (const GLubyte*)"";
+    }
+}
+
+GLint GL_APIENTRY glGetUniformLocation(GLuint program, const GLchar* name)
+{
+    Record(NullGL_glGetUniformLocation, "%u, \"%s\"", program, name);
+    return 0;
+}
+
+void GL_APIENTRY glLinkProgram(GLuint program)
+{
+    Record(NullGL_glLinkProgram, "%u", program);
+}
+
+void GL_APIENTRY glPixelStorei(GLenum pname, GLint param)
+{
+    Record(NullGL_glPixelStorei, "0x%x, %d", pname, param);
+    if ( pname == GL_UNPACK_ALIGNMENT )
+    {
+        s_unpackAlignment = param;
+    }
+}
+
+void GL_APIENTRY glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height,
+                              GLenum format, GLenum type, void* pixels)
+{
+    Record(NullGL_glReadPixels, "%d, %d, %d, %d, 0x%x, 0x%x", x, y, width,
+           height, format, type);
+    memset(pixels, 0, PixelDataSize(width, height, format, type));
+}
+
+void GL_APIENTRY glRenderbufferStorage(GLenum target, GLenum internalformat,
+                                       GLsizei width, GLsizei height)
+{
+    Record(NullGL_glRenderbufferStorage, "0x%x, 0x%x, %d, %d", target,
+           internalformat, width, height);
+}
+
+void GL_APIENTRY glScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    Record(NullGL_glScissor, "%d, %d, %d, %d", x, y, width, height);
+}
+
+void GL_APIENTRY glShaderSource(GLuint shader, GLsizei count,
+                                const GLchar* const* string,
+                                const GLint* length)
+{
+    Record(NullGL_glShaderSource, "%u, %d, %p, %p", shader, count, string,
+           length);
+}
+
+void GL_APIENTRY glTexImage2D(GLenum target, GLint level, GLint internalformat,
+                              GLsizei width, GLsizei height, GLint border,
+                              GLenum format, GLenum type, const void* pixels)
+{
+    Record(NullGL_glTexImage2D, "0x%x, %d, 0x%x, %d, %d, %d, 0x%x, 0x%x, %p",
+           target, level, internalformat, width, height, border, format, type,
+           pixels);
+    if ( pixels != NULL )
+    {
+        s_stats.m_textureBytesUploaded +=
+                PixelDataSize(width, height, format, type);
+    }
+}
+
+void GL_APIENTRY glTexParameterf(GLenum target, GLenum pname, GLfloat param)
+{
+    Record(NullGL_glTexParameterf, "0x%x, 0x%x, %f", target, pname, param);
+}
+
+void GL_APIENTRY glTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+    Record(NullGL_glTexParameteri, "0x%x, 0x%x, 0x%x", target, pname, param);
+}
+
+void GL_APIENTRY glTexSubImage2D(GLenum target, GLint level, GLint xoffset,
+                                 GLint yoffset, GLsizei width, GLsizei height,
+                                 GLenum format, GLenum type,
+                                 const void* pixels)
+{
+    Record(NullGL_glTexSubImage2D, "0x%x, %d, %d, %d, %d, %d, 0x%x, 0x%x, %p",
+           target, level, xoffset, yoffset, width, height, format, type,
+           pixels);
+    s_stats.m_textureBytesUploaded +=
+            PixelDataSize(width, height, format, type);
+}
+
+void GL_APIENTRY glUniform1f(GLint location, GLfloat v0)
+{
+    Record(NullGL_glUniform1f, "%d, %f", location, v0);
+}
+
+void GL_APIENTRY glUniform1i(GLint location, GLint v0)
+{
+    Record(NullGL_glUniform1i, "%d, %d", location, v0);
+}
+
+void GL_APIENTRY glUniform3fv(GLint location, GLsizei count,
+                              const GLfloat* value)
+{
+    Record(NullGL_glUniform3fv, "%d, %d, %p", location, count, value);
+}
+
+void GL_APIENTRY glUniform4fv(GLint location, GLsizei count,
+                              const GLfloat* value)
+{
+    Record(NullGL_glUniform4fv, "%d, %d, %p", location, count, value);
+}
+
+void GL_APIENTRY glUniformMatrix4fv(GLint location, GLsizei count,
+                                    GLboolean transpose, const GLfloat* value)
+{
+    Record(NullGL_glUniformMatrix4fv, "%d, %d, %d, %p", location, count,
+           transpose, value);
+}
+
+void GL_APIENTRY glUseProgram(GLuint program)
+{
+    Record(NullGL_glUseProgram, "%u", program);
+}
+
+void GL_APIENTRY glVertexAttribPointer(GLuint index, GLint size, GLenum type,
+                                       GLboolean normalized, GLsizei stride,
+                                       const void* pointer)
+{
+    Record(NullGL_glVertexAttribPointer, "%u, %d, 0x%x, %d, %d, %p", index,
+           size, type, normalized, stride, pointer);
+}
+
+void GL_APIENTRY glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    Record(NullGL_glViewport, "%d, %d, %d, %d", x, y, width, height);
+    s_viewport[0] = x;
+    s_viewport[1] = y;
+    s_viewport[2] = width;
+    s_viewport[3] = height;
+}
+
+} // extern "C"
+
+#endif // __BUILD_NULLGL__
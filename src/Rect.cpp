@@ -96,7 +96,7 @@ void Rect::Set(int left, int top, int right, int bottom)
     m_bottom = bottom;
 }
 
-bool Rect::IsInside(int x, int y)
+bool Rect::IsInside(int x, int y) const
 {
 //    LOG_DEBUG("left = %d, right = %d, top = %d, bottom = %d, x,y = (%d,%d)",
 //              m_left, m_right, m_top, m_bottom, x, y);
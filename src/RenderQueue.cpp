@@ -0,0 +1,345 @@
+#include <string.h>
+
+#include "RenderQueue.h"
+#include "CommonFunctions.h"
+
+// Sort key field layout
+static const int LayerShift = 60;
+static const int TranslucentShift = 59;
+static const uint64_t ProgramMask = (1 << 9) - 1;
+static const uint64_t TextureMask = (1 << 14) - 1;
+static const uint64_t BufferMask = (1 << 12) - 1;
+static const uint64_t DepthMask = (1 << 24) - 1;
+
+// Radix sort digit size
+static const int RadixBits = 8;
+static const int RadixSize = 1 << RadixBits;
+static const int NumRadixPasses = 64 / RadixBits;
+
+// Vertex attribute arrays enabled by default elsewhere in the library
+static const unsigned int DefaultEnabledArrays =
+        (1 << COORD_INDEX) | (1 << TEXCOORD_INDEX) | (1 << NORMAL_INDEX);
+
+// Attribute arrays used by each RenderVertexFormat
+static const unsigned int VertexFormatArrays[] = {
+    (1 << COORD_INDEX),
+    (1 << COORD_INDEX) | (1 << TEXCOORD_INDEX),
+    (1 << COORD_INDEX) | (1 << TEXCOORD_INDEX) | (1 << NORMAL_INDEX),
+    (1 << COORD_INDEX) | (1 << TEXCOORD_INDEX) | (1 << NORMAL_INDEX) |
+    (1 << TANGENT_INDEX)
+};
+static const int NumVertexFormats =
+        sizeof(VertexFormatArrays) / sizeof(VertexFormatArrays[0]);
+static_assert(NumVertexFormats == VertexFormatTangent + 1,
+              "VertexFormatArrays must match RenderVertexFormat");
+
+static void SetEnabledArrays(unsigned int current, unsigned int wanted)
+{
+    unsigned int changed = current ^ wanted;
+    for ( int i = 0; changed != 0; i++, changed >>= 1 )
+    {
+        if ( (changed & 1) == 0 )
+        {
+            continue;
+        }
+
+        if ( wanted & (1 << i) )
+        {
+            glEnableVertexAttribArray(i);
+        }
+        else
+        {
+            glDisableVertexAttribArray(i);
+        }
+    }
+}
+
+RenderQueue::RenderQueue(size_t initialCapacity)
+    : m_sorted(true)
+{
+    m_commands.reserve(initialCapacity);
+    m_keys.reserve(initialCapacity);
+    m_order.reserve(initialCapacity);
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+RenderQueue::~RenderQueue()
+{
+}
+
+uint64_t RenderQueue::MakeSortKey(int layer, bool translucent, GLuint program,
+                                  GLuint texture, GLuint vertexBuffer,
+                                  float depth)
+{
+    if ( depth < 0.0 )
+    {
+        depth = 0.0;
+    }
+    else if ( depth > 1.0 )
+    {
+        depth = 1.0;
+    }
+
+    uint64_t key = ((uint64_t)(layer & 0xf) << LayerShift);
+    uint64_t quantizedDepth = (uint64_t)(depth * DepthMask);
+
+    if ( translucent )
+    {
+        // Back-to-front; depth takes precedence over state
+        key |= ((uint64_t)1 << TranslucentShift);
+        key |= ((DepthMask - quantizedDepth) << 35);
+        key |= ((program & ProgramMask) << 26);
+        key |= ((texture & TextureMask) << 12);
+        key |= (vertexBuffer & BufferMask);
+    }
+    else
+    {
+        // Group by state, then front-to-back
+        key |= ((program & ProgramMask) << 50);
+        key |= ((texture & TextureMask) << 36);
+        key |= ((vertexBuffer & BufferMask) << 24);
+        key |= quantizedDepth;
+    }
+
+    return key;
+}
+
+void RenderQueue::Submit(const RenderCommand& command)
+{
+    // Execute() looks up the attribute arrays by the format
+    if ( (command.m_vertexFormat < 0) ||
+         (command.m_vertexFormat >= NumVertexFormats) )
+    {
+        LOG_DEBUG("RenderQueue: dropping a command with vertex format %d",
+                  command.m_vertexFormat);
+        DEBUG_ASSERT(false);
+        return;
+    }
+
+    m_order.push_back(m_commands.size());
+    m_keys.push_back(command.m_sortKey);
+    m_commands.push_back(command);
+    m_sorted = false;
+}
+
+void RenderQueue::Clear()
+{
+    m_commands.clear();
+    m_keys.clear();
+    m_order.clear();
+    m_sorted = true;
+}
+
+void RenderQueue::Sort()
+{
+    if ( m_sorted )
+    {
+        return;
+    }
+
+    size_t count = m_keys.size();
+    m_keyScratch.resize(count);
+    m_orderScratch.resize(count);
+
+    // Build the histograms of all digits in a single sweep
+    uint32_t histograms[NumRadixPasses][RadixSize];
+    memset(histograms, 0, sizeof(histograms));
+    for ( size_t i = 0; i < count; i++ )
+    {
+        uint64_t key = m_keys[i];
+        for ( int pass = 0; pass < NumRadixPasses; pass++ )
+        {
+            histograms[pass][(key >> (pass * RadixBits)) & (RadixSize - 1)]++;
+        }
+    }
+
+    uint64_t* keys = &m_keys[0];
+    uint32_t* order = &m_order[0];
+    uint64_t* keysOut = &m_keyScratch[0];
+    uint32_t* orderOut = &m_orderScratch[0];
+
+    // LSD radix sort; stable, so equal keys keep their submission order
+    for ( int pass = 0; pass < NumRadixPasses; pass++ )
+    {
+        uint32_t* histogram = histograms[pass];
+        int shift = pass * RadixBits;
+
+        // Skip the pass if all keys share this digit
+        if ( histogram[(keys[0] >> shift) & (RadixSize - 1)] == count )
+        {
+            continue;
+        }
+
+        // Convert counts into starting offsets
+        uint32_t offset = 0;
+        for ( int i = 0; i < RadixSize; i++ )
+        {
+            uint32_t c = histogram[i];
+            histogram[i] = offset;
+            offset += c;
+        }
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            uint32_t dst = histogram[(keys[i] >> shift) & (RadixSize - 1)]++;
+            keysOut[dst] = keys[i];
+            orderOut[dst] = order[i];
+        }
+
+        uint64_t* tmpKeys = keys;
+        keys = keysOut;
+        keysOut = tmpKeys;
+        uint32_t* tmpOrder = order;
+        order = orderOut;
+        orderOut = tmpOrder;
+    }
+
+    // Make sure the result ends up in the primary arrays
+    if ( keys != &m_keys[0] )
+    {
+        m_keys.swap(m_keyScratch);
+        m_order.swap(m_orderScratch);
+    }
+
+    m_sorted = true;
+}
+
+void RenderQueue::SetVertexFormat(int vertexFormat)
+{
+    switch ( vertexFormat )
+    {
+        case VertexFormatCoordsOnly:
+            glVertexAttribPointer(COORD_INDEX, 3, GL_FLOAT, GL_FALSE,
+                                  sizeof(VertexAttribsCoordsOnly),
+                                  (const GLvoid*)offsetof(
+                                      VertexAttribsCoordsOnly, x));
+            break;
+        case VertexFormatTexCoords:
+            SetVertexAttribsTexCoordsPointers();
+            break;
+        case VertexFormatFull:
+            SetVertexAttribsPointers();
+            break;
+        case VertexFormatTangent:
+            SetVertexAttribsTangentPointers();
+            break;
+        default:
+            LOG_DEBUG("RenderQueue: unknown vertex format %d", vertexFormat);
+            break;
+    }
+}
+
+void RenderQueue::Execute()
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    if ( m_commands.empty() )
+    {
+        return;
+    }
+
+    Sort();
+
+    GLuint currentProgram = 0;
+    GLuint currentTexture = 0;
+    GLuint currentVertexBuffer = 0;
+    GLuint currentIndexBuffer = 0;
+    int currentVertexFormat = -1;
+    unsigned int enabledArrays = DefaultEnabledArrays;
+    bool blending = true;
+    bool first = true;
+
+    glActiveTexture(GL_TEXTURE0);
+
+    for ( size_t i = 0; i < m_order.size(); i++ )
+    {
+        const RenderCommand& command = m_commands[m_order[i]];
+
+        if ( first || (command.m_translucent != blending) )
+        {
+            // Opaque draws don't blend nor need to skip depth writes
+            blending = command.m_translucent;
+            if ( blending )
+            {
+                glEnable(GL_BLEND);
+                glDepthMask(GL_FALSE);
+            }
+            else
+            {
+                glDisable(GL_BLEND);
+                glDepthMask(GL_TRUE);
+            }
+            m_stats.m_blendChanges++;
+        }
+
+        if ( first || (command.m_program != currentProgram) )
+        {
+            glUseProgram(command.m_program);
+            currentProgram = command.m_program;
+            m_stats.m_programChanges++;
+        }
+
+        if ( first || (command.m_texture != currentTexture) )
+        {
+            glBindTexture(GL_TEXTURE_2D, command.m_texture);
+            currentTexture = command.m_texture;
+            m_stats.m_textureChanges++;
+        }
+
+        // Attribute pointers must be reset whenever the VBO changes
+        if ( first || (command.m_vertexBuffer != currentVertexBuffer) ||
+             (command.m_vertexFormat != currentVertexFormat) )
+        {
+            if ( first || (command.m_vertexBuffer != currentVertexBuffer) )
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, command.m_vertexBuffer);
+                currentVertexBuffer = command.m_vertexBuffer;
+                m_stats.m_vertexBufferChanges++;
+            }
+
+            unsigned int arrays = VertexFormatArrays[command.m_vertexFormat];
+            SetEnabledArrays(enabledArrays, arrays);
+            enabledArrays = arrays;
+
+            SetVertexFormat(command.m_vertexFormat);
+            currentVertexFormat = command.m_vertexFormat;
+        }
+
+        if ( (command.m_indexBuffer != 0) &&
+             (first || (command.m_indexBuffer != currentIndexBuffer)) )
+        {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, command.m_indexBuffer);
+            currentIndexBuffer = command.m_indexBuffer;
+            m_stats.m_indexBufferChanges++;
+        }
+
+        first = false;
+
+        if ( command.m_callback != NULL )
+        {
+            command.m_callback(command, command.m_userData);
+        }
+
+        if ( command.m_indexBuffer != 0 )
+        {
+            glDrawElements(command.m_primitive, command.m_count,
+                           GL_UNSIGNED_SHORT,
+                           (const GLvoid*)(command.m_first * sizeof(GLushort)));
+        }
+        else
+        {
+            glDrawArrays(command.m_primitive, command.m_first,
+                         command.m_count);
+        }
+        m_stats.m_numDraws++;
+    }
+
+    // Restore the state the rest of the library expects
+    SetEnabledArrays(enabledArrays, DefaultEnabledArrays);
+    glEnable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+
+    LOG_GL_ERROR();
+
+    Clear();
+}
@@ -0,0 +1,427 @@
+#include <algorithm>
+
+#include "RenderTargetPool.h"
+#include "CommonFunctions.h"
+
+// Orders transient targets by the pass they are first used in
+struct TransientFirstPassLess
+{
+    TransientFirstPassLess(const std::vector<int>& firstPasses)
+        : m_firstPasses(firstPasses) {}
+
+    bool operator()(int a, int b) const
+    {
+        return (m_firstPasses[a] < m_firstPasses[b]);
+    }
+
+    const std::vector<int>& m_firstPasses;
+};
+
+// Orders render targets by the frame they were last used in
+struct LastUsedFrameLess
+{
+    bool operator()(const RenderTarget* a, const RenderTarget* b) const
+    {
+        return (a->m_lastUsedFrame < b->m_lastUsedFrame);
+    }
+};
+
+RenderTargetPool::RenderTargetPool(unsigned int maxUnusedFrames)
+    : m_numPasses(0),
+      m_frame(0),
+      m_maxUnusedFrames(maxUnusedFrames),
+      m_currentMemory(0),
+      m_peakMemory(0),
+      m_budget(0)
+{
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+    std::list<RenderTarget*>::iterator iter;
+    for ( iter = m_targets.begin(); iter != m_targets.end(); iter++ )
+    {
+        DeleteTarget(*iter);
+    }
+    m_targets.clear();
+}
+
+size_t RenderTargetPool::GetTargetSize(const RenderTargetDesc& desc)
+{
+    size_t numPixels = (size_t)desc.m_width * desc.m_height;
+    size_t size = 0;
+
+    if ( desc.m_colorFormat == ColorFormatRGB565 )
+    {
+        size += numPixels * 2;
+    }
+    else if ( desc.m_colorFormat != ColorFormatNone )
+    {
+        size += numPixels * 4;
+    }
+
+    if ( desc.m_depthFormat == DepthFormatRenderbuffer16 )
+    {
+        size += numPixels * 2;
+    }
+    else if ( desc.m_depthFormat != DepthFormatNone )
+    {
+        size += numPixels * 4;
+    }
+
+    return size;
+}
+
+RenderTarget* RenderTargetPool::CreateTarget(const RenderTargetDesc& desc)
+{
+    if ( (desc.m_depthFormat == DepthFormatTexture) &&
+         !DepthBufferExtensionPresent() )
+    {
+        LOG_DEBUG("RenderTargetPool: depth textures not supported");
+        return NULL;
+    }
+
+    if ( (desc.m_depthFormat == DepthFormatDepth24Stencil8) &&
+         !PackedDepthStencilExtensionPresent() )
+    {
+        LOG_DEBUG("RenderTargetPool: packed depth/stencil not supported");
+        return NULL;
+    }
+
+    RenderTarget* target = new RenderTarget();
+    target->m_desc = desc;
+    target->m_framebuffer = 0;
+    target->m_colorTexture = 0;
+    target->m_depthTexture = 0;
+    target->m_depthRenderbuffer = 0;
+    target->m_sizeInBytes = GetTargetSize(desc);
+    target->m_inUse = false;
+    target->m_lastUsedFrame = m_frame;
+
+    // Don't disturb the caller's framebuffer binding
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+    glGenFramebuffers(1, &target->m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->m_framebuffer);
+
+    if ( desc.m_colorFormat != ColorFormatNone )
+    {
+        glGenTextures(1, &target->m_colorTexture);
+        glBindTexture(GL_TEXTURE_2D, target->m_colorTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        if ( desc.m_colorFormat == ColorFormatRGB565 )
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, desc.m_width, desc.m_height,
+                         0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, NULL);
+        }
+        else
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, desc.m_width,
+                         desc.m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, target->m_colorTexture, 0);
+    }
+
+    switch ( desc.m_depthFormat )
+    {
+        case DepthFormatRenderbuffer16:
+            glGenRenderbuffers(1, &target->m_depthRenderbuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, target->m_depthRenderbuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16,
+                                  desc.m_width, desc.m_height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                      GL_RENDERBUFFER,
+                                      target->m_depthRenderbuffer);
+            break;
+        case DepthFormatTexture:
+            glGenTextures(1, &target->m_depthTexture);
+            glBindTexture(GL_TEXTURE_2D, target->m_depthTexture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, desc.m_width,
+                         desc.m_height, 0, GL_DEPTH_COMPONENT,
+                         GL_UNSIGNED_INT, NULL);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                   GL_TEXTURE_2D, target->m_depthTexture, 0);
+            break;
+        case DepthFormatDepth24Stencil8:
+            glGenRenderbuffers(1, &target->m_depthRenderbuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, target->m_depthRenderbuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8,
+                                  desc.m_width, desc.m_height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                      GL_RENDERBUFFER,
+                                      target->m_depthRenderbuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT,
+                                      GL_RENDERBUFFER,
+                                      target->m_depthRenderbuffer);
+            break;
+        default:
+            break;
+    }
+
+    GLenum fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    if ( fboStatus != GL_FRAMEBUFFER_COMPLETE )
+    {
+        LOG_DEBUG("RenderTargetPool: FBO not complete: 0x%x", fboStatus);
+        DeleteTarget(target);
+        return NULL;
+    }
+
+    m_currentMemory += target->m_sizeInBytes;
+    m_peakMemory = std::max(m_peakMemory, m_currentMemory);
+
+    LOG_DEBUG("RenderTargetPool: created %dx%d target, %d kB held",
+              desc.m_width, desc.m_height, (int)(m_currentMemory / 1024));
+
+    return target;
+}
+
+void RenderTargetPool::DeleteTarget(RenderTarget* target)
+{
+    // Unused targets may still be read by queued GPU commands, eg. when
+    // purged or evicted for the budget; GL defers freeing the objects
+    // until those are done, so they can be deleted right away
+    glDeleteFramebuffers(1, &target->m_framebuffer);
+    if ( target->m_colorTexture != 0 )
+    {
+        glDeleteTextures(1, &target->m_colorTexture);
+    }
+    if ( target->m_depthTexture != 0 )
+    {
+        glDeleteTextures(1, &target->m_depthTexture);
+    }
+    if ( target->m_depthRenderbuffer != 0 )
+    {
+        glDeleteRenderbuffers(1, &target->m_depthRenderbuffer);
+    }
+
+    delete target;
+}
+
+RenderTarget* RenderTargetPool::Acquire(const RenderTargetDesc& desc)
+{
+    std::list<RenderTarget*>::iterator iter;
+    for ( iter = m_targets.begin(); iter != m_targets.end(); iter++ )
+    {
+        RenderTarget* target = *iter;
+        if ( !target->m_inUse && (target->m_desc == desc) )
+        {
+            target->m_inUse = true;
+            target->m_lastUsedFrame = m_frame;
+            return target;
+        }
+    }
+
+    if ( m_budget > 0 )
+    {
+        size_t size = GetTargetSize(desc);
+        if ( !MakeRoom(size) )
+        {
+            LOG_DEBUG("RenderTargetPool: %dx%d target exceeds the budget",
+                      desc.m_width, desc.m_height);
+            return NULL;
+        }
+    }
+
+    RenderTarget* target = CreateTarget(desc);
+    if ( target != NULL )
+    {
+        target->m_inUse = true;
+        m_targets.push_back(target);
+    }
+
+    return target;
+}
+
+bool RenderTargetPool::MakeRoom(size_t size)
+{
+    if ( (m_currentMemory + size) <= m_budget )
+    {
+        return true;
+    }
+
+    // Nothing is deleted unless deleting the unused targets makes room
+    std::vector<RenderTarget*> unused;
+    size_t unusedMemory = 0;
+    std::list<RenderTarget*>::iterator iter;
+    for ( iter = m_targets.begin(); iter != m_targets.end(); iter++ )
+    {
+        if ( !(*iter)->m_inUse )
+        {
+            unused.push_back(*iter);
+            unusedMemory += (*iter)->m_sizeInBytes;
+        }
+    }
+    if ( (m_currentMemory - unusedMemory + size) > m_budget )
+    {
+        return false;
+    }
+
+    // Longest unused first; those about to be deleted by EndFrame() anyway
+    // go before ones released this frame, which are likely needed again
+    std::stable_sort(unused.begin(), unused.end(), LastUsedFrameLess());
+    for ( size_t i = 0; (m_currentMemory + size) > m_budget; i++ )
+    {
+        m_currentMemory -= unused[i]->m_sizeInBytes;
+        m_targets.remove(unused[i]);
+        DeleteTarget(unused[i]);
+    }
+
+    return true;
+}
+
+void RenderTargetPool::Release(RenderTarget* target)
+{
+    if ( target != NULL )
+    {
+        target->m_inUse = false;
+        target->m_lastUsedFrame = m_frame;
+    }
+}
+
+int RenderTargetPool::AddPass()
+{
+    return m_numPasses++;
+}
+
+int RenderTargetPool::DeclareTransient(const RenderTargetDesc& desc,
+                                       int firstPass, int lastPass)
+{
+    TransientTarget transient;
+    transient.m_desc = desc;
+    transient.m_firstPass = firstPass;
+    transient.m_lastPass = std::max(firstPass, lastPass);
+    transient.m_target = NULL;
+    m_transients.push_back(transient);
+
+    return m_transients.size() - 1;
+}
+
+bool RenderTargetPool::Compile()
+{
+    // Release any previous assignments
+    for ( size_t i = 0; i < m_frameTargets.size(); i++ )
+    {
+        Release(m_frameTargets[i]);
+    }
+    m_frameTargets.clear();
+
+    // Assign in the order of first use
+    std::vector<int> firstPasses(m_transients.size());
+    std::vector<int> order(m_transients.size());
+    for ( size_t i = 0; i < m_transients.size(); i++ )
+    {
+        firstPasses[i] = m_transients[i].m_firstPass;
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     TransientFirstPassLess(firstPasses));
+
+    // Last pass using each of the frame targets so far
+    std::vector<int> busyUntil;
+    bool ok = true;
+
+    for ( size_t i = 0; i < order.size(); i++ )
+    {
+        TransientTarget& transient = m_transients[order[i]];
+        transient.m_target = NULL;
+
+        // Alias a frame target whose earlier users are all done
+        for ( size_t j = 0; j < m_frameTargets.size(); j++ )
+        {
+            if ( (m_frameTargets[j]->m_desc == transient.m_desc) &&
+                 (busyUntil[j] < transient.m_firstPass) )
+            {
+                transient.m_target = m_frameTargets[j];
+                busyUntil[j] = transient.m_lastPass;
+                break;
+            }
+        }
+
+        if ( transient.m_target == NULL )
+        {
+            RenderTarget* target = Acquire(transient.m_desc);
+            if ( target == NULL )
+            {
+                ok = false;
+                continue;
+            }
+            transient.m_target = target;
+            m_frameTargets.push_back(target);
+            busyUntil.push_back(transient.m_lastPass);
+        }
+    }
+
+    return ok;
+}
+
+RenderTarget* RenderTargetPool::GetTransient(int transientId)
+{
+    if ( (transientId < 0) || (transientId >= (int)m_transients.size()) )
+    {
+        return NULL;
+    }
+
+    return m_transients[transientId].m_target;
+}
+
+void RenderTargetPool::EndFrame()
+{
+    for ( size_t i = 0; i < m_frameTargets.size(); i++ )
+    {
+        Release(m_frameTargets[i]);
+    }
+    m_frameTargets.clear();
+    m_transients.clear();
+    m_numPasses = 0;
+    m_frame++;
+
+    // Delete targets that haven't been used in a while
+    std::list<RenderTarget*>::iterator iter = m_targets.begin();
+    while ( iter != m_targets.end() )
+    {
+        RenderTarget* target = *iter;
+        if ( !target->m_inUse &&
+             ((m_frame - target->m_lastUsedFrame) > m_maxUnusedFrames) )
+        {
+            m_currentMemory -= target->m_sizeInBytes;
+            DeleteTarget(target);
+            iter = m_targets.erase(iter);
+        }
+        else
+        {
+            iter++;
+        }
+    }
+}
+
+void RenderTargetPool::Purge()
+{
+    std::list<RenderTarget*>::iterator iter = m_targets.begin();
+    while ( iter != m_targets.end() )
+    {
+        RenderTarget* target = *iter;
+        if ( !target->m_inUse )
+        {
+            m_currentMemory -= target->m_sizeInBytes;
+            DeleteTarget(target);
+            iter = m_targets.erase(iter);
+        }
+        else
+        {
+            iter++;
+        }
+    }
+}
@@ -0,0 +1,496 @@
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__USE_ZSTD__)
+  #include <zstd.h>
+#endif
+
+#include "ResourcePack.h"
+#include "ThreadPool.h"
+#include "CommonFunctions.h"
+
+// The structs are read from the pack in place; this requires a little
+// endian host, which all supported platforms are
+static_assert(sizeof(ResourcePackHeader) == 64, "bad ResourcePackHeader");
+static_assert(sizeof(ResourcePackEntry) == 32, "bad ResourcePackEntry");
+
+static const char PackMagic[8] = { 'C', 'G', 'L', 'P', 'A', 'C', 'K', '\0' };
+static const uint32_t PackVersion = 1;
+
+typedef std::vector<std::shared_ptr<ResourcePack> > ResourcePackList;
+
+// Mounted packs, most recently mounted last
+static ResourcePackList s_mountedPacks;
+static std::mutex s_mountMutex;
+
+/**
+ * Decompresses an LZ4 block. Every read and write is bounds checked, so
+ * a corrupt pack cannot make this overrun either buffer.
+ *
+ * @return number of bytes written to dst, or -1 if the input is malformed
+ */
+static int DecompressLZ4(const uint8_t* src, size_t srcSize,
+                         uint8_t* dst, size_t dstSize)
+{
+    const uint8_t* ip = src;
+    const uint8_t* const srcEnd = src + srcSize;
+    uint8_t* op = dst;
+    uint8_t* const dstEnd = dst + dstSize;
+
+    while ( ip < srcEnd )
+    {
+        unsigned int token = *ip++;
+
+        // Literals
+        size_t length = token >> 4;
+        if ( length == 15 )
+        {
+            unsigned int b;
+            do
+            {
+                if ( ip >= srcEnd )
+                {
+                    return -1;
+                }
+                b = *ip++;
+                length += b;
+            } while ( b == 255 );
+        }
+        if ( (length > (size_t)(srcEnd - ip)) ||
+             (length > (size_t)(dstEnd - op)) )
+        {
+            return -1;
+        }
+        memcpy(op, ip, length);
+        ip += length;
+        op += length;
+
+        if ( ip == srcEnd )
+        {
+            // The last sequence has literals only
+            break;
+        }
+
+        // Match
+        if ( (srcEnd - ip) < 2 )
+        {
+            return -1;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if ( (offset == 0) || (offset > (size_t)(op - dst)) )
+        {
+            return -1;
+        }
+
+        length = token & 0x0f;
+        if ( length == 15 )
+        {
+            unsigned int b;
+            do
+            {
+                if ( ip >= srcEnd )
+                {
+                    return -1;
+                }
+                b = *ip++;
+                length += b;
+            } while ( b == 255 );
+        }
+        length += 4;
+        if ( length > (size_t)(dstEnd - op) )
+        {
+            return -1;
+        }
+
+        // Matches may overlap their output, so copy forwards byte by byte
+        // unless the source is far enough behind
+        const uint8_t* match = op - offset;
+        if ( offset >= length )
+        {
+            memcpy(op, match, length);
+            op += length;
+        }
+        else
+        {
+            for ( size_t i = 0; i < length; i++ )
+            {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return (int)(op - dst);
+}
+
+ResourcePack::ResourcePack()
+    : m_data(NULL),
+      m_entries(NULL),
+      m_names(NULL),
+      m_numEntries(0)
+{
+}
+
+ResourcePack::~ResourcePack()
+{
+}
+
+uint32_t ResourcePack::HashName(const char* name, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for ( size_t i = 0; i < length; i++ )
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+bool ResourcePack::Open(const char* fileName)
+{
+    if ( !MapBundleFile(fileName, false, &m_file) )
+    {
+        LOG_DEBUG("ResourcePack::Open(): failed to open %s", fileName);
+        return false;
+    }
+
+    const uint8_t* data = (const uint8_t*)m_file.GetData();
+    uint64_t size = m_file.GetSize();
+
+    const ResourcePackHeader* header = (const ResourcePackHeader*)data;
+    if ( (size < sizeof(ResourcePackHeader)) ||
+         (memcmp(header->m_magic, PackMagic, sizeof(PackMagic)) != 0) ||
+         (header->m_version != PackVersion) )
+    {
+        LOG_DEBUG("ResourcePack::Open(): %s is not a resource pack",
+                  fileName);
+        m_file.Reset();
+        return false;
+    }
+
+    uint64_t indexSize =
+            (uint64_t)header->m_numEntries * sizeof(ResourcePackEntry);
+    if ( (header->m_indexOffset > size) ||
+         (indexSize > (size - header->m_indexOffset)) ||
+         (header->m_namesOffset > size) ||
+         (header->m_namesSize > (size - header->m_namesOffset)) )
+    {
+        LOG_DEBUG("ResourcePack::Open(): %s has a corrupt index", fileName);
+        m_file.Reset();
+        return false;
+    }
+
+    const ResourcePackEntry* entries =
+            (const ResourcePackEntry*)(data + header->m_indexOffset);
+    for ( uint32_t i = 0; i < header->m_numEntries; i++ )
+    {
+        const ResourcePackEntry& entry = entries[i];
+        if ( (entry.m_dataOffset > size) ||
+             (entry.m_storedSize > (size - entry.m_dataOffset)) ||
+             ((uint64_t)entry.m_nameOffset + entry.m_nameLength >
+              header->m_namesSize) )
+        {
+            LOG_DEBUG("ResourcePack::Open(): %s has a corrupt entry %u",
+                      fileName, i);
+            m_file.Reset();
+            return false;
+        }
+    }
+
+    m_fileName = fileName;
+    m_data = data;
+    m_entries = entries;
+    m_names = (const char*)(data + header->m_namesOffset);
+    m_numEntries = header->m_numEntries;
+
+    LOG_DEBUG("ResourcePack::Open(): %s has %d entries",
+              fileName, m_numEntries);
+
+    return true;
+}
+
+const ResourcePackEntry* ResourcePack::Find(const char* name) const
+{
+    size_t nameLength = strlen(name);
+    uint32_t hash = HashName(name, nameLength);
+
+    // Find the first entry with a hash not less than ours
+    int low = 0;
+    int high = m_numEntries;
+    while ( low < high )
+    {
+        int middle = (low + high) / 2;
+        if ( m_entries[middle].m_nameHash < hash )
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    // Collisions are resolved by comparing the names
+    for ( int i = low; i < m_numEntries; i++ )
+    {
+        const ResourcePackEntry* entry = m_entries + i;
+        if ( entry->m_nameHash != hash )
+        {
+            break;
+        }
+        if ( (entry->m_nameLength == nameLength) &&
+             (memcmp(m_names + entry->m_nameOffset, name, nameLength) == 0) )
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+bool ResourcePack::Read(const ResourcePackEntry* entry, void* buffer,
+                        size_t bufferSize) const
+{
+    if ( bufferSize < entry->m_size )
+    {
+        LOG_DEBUG("ResourcePack::Read(): buffer too small");
+        return false;
+    }
+
+    const uint8_t* src = m_data + entry->m_dataOffset;
+
+    switch ( entry->m_compression )
+    {
+        case PackCompressionNone:
+            if ( entry->m_storedSize != entry->m_size )
+            {
+                return false;
+            }
+            memcpy(buffer, src, entry->m_size);
+            return true;
+
+        case PackCompressionLZ4:
+            return (DecompressLZ4(src, entry->m_storedSize, (uint8_t*)buffer,
+                                  entry->m_size) == (int)entry->m_size);
+
+#if defined(__USE_ZSTD__)
+        case PackCompressionZstd:
+        {
+            size_t result = ZSTD_decompress(buffer, entry->m_size,
+                                            src, entry->m_storedSize);
+            return (!ZSTD_isError(result) && (result == entry->m_size));
+        }
+#endif
+
+        default:
+            LOG_DEBUG("ResourcePack::Read(): unsupported compression %d",
+                      entry->m_compression);
+            return false;
+    }
+}
+
+bool ResourcePack::Read(const char* name, bool zeropad, size_t* size,
+                        void** buffer) const
+{
+    const ResourcePackEntry* entry = Find(name);
+    if ( entry == NULL )
+    {
+        return false;
+    }
+
+    size_t totalSize = entry->m_size;
+    if ( zeropad )
+    {
+        totalSize++;
+    }
+
+    char* data = (char*)malloc(totalSize);
+    if ( data == NULL )
+    {
+        LOG_DEBUG("ResourcePack::Read(): Failed to malloc() %d bytes",
+                  totalSize);
+        return false;
+    }
+
+    if ( !Read(entry, data, entry->m_size) )
+    {
+        LOG_DEBUG("ResourcePack::Read(): corrupt entry: %s", name);
+        free(data);
+        return false;
+    }
+
+    if ( zeropad )
+    {
+        data[entry->m_size] = '\0';
+    }
+
+    *buffer = data;
+    *size = totalSize;
+
+    return true;
+}
+
+bool ResourcePack::Map(const char* name, bool zeropad,
+                       BundleFileView* view) const
+{
+    const ResourcePackEntry* entry = Find(name);
+    if ( entry == NULL )
+    {
+        return false;
+    }
+
+    if ( (entry->m_compression == PackCompressionNone) && !zeropad )
+    {
+        view->Set(m_data + entry->m_dataOffset, entry->m_size, NULL, NULL);
+        return true;
+    }
+
+    size_t size;
+    void* data;
+    if ( !Read(name, zeropad, &size, &data) )
+    {
+        return false;
+    }
+
+    view->Set(data, entry->m_size, BundleFileView::FreeData, NULL);
+
+    return true;
+}
+
+void ResourcePack::ReleasePack(const void* /*data*/, size_t /*size*/,
+                               void* context)
+{
+    delete (std::shared_ptr<ResourcePack>*)context;
+}
+
+bool ResourcePack::Map(const std::shared_ptr<ResourcePack>& pack,
+                       const char* name, bool zeropad, BundleFileView* view)
+{
+    const ResourcePackEntry* entry = pack->Find(name);
+    if ( entry == NULL )
+    {
+        return false;
+    }
+
+    if ( (entry->m_compression == PackCompressionNone) && !zeropad )
+    {
+        // The view keeps the pack mapped until it is released
+        view->Set(pack->m_data + entry->m_dataOffset, entry->m_size,
+                  ReleasePack, new std::shared_ptr<ResourcePack>(pack));
+        return true;
+    }
+
+    return pack->Map(name, zeropad, view);
+}
+
+int ResourcePack::ReadBatch(ResourcePackRequest* requests, int count) const
+{
+    std::atomic<int> numSucceeded(0);
+
+    g_threadPool.ParallelFor(count, [&](int i) {
+        ResourcePackRequest& request = requests[i];
+        const ResourcePackEntry* entry = Find(request.m_name);
+        request.m_success = (entry != NULL) &&
+                Read(entry, request.m_buffer, request.m_bufferSize);
+        if ( request.m_success )
+        {
+            numSucceeded++;
+        }
+    });
+
+    return numSucceeded.load();
+}
+
+// Returns a snapshot of the mounted packs, so that reads need not hold the
+// lock while decompressing; the packs stay alive until the snapshot dies
+static ResourcePackList GetMountedPacks()
+{
+    std::lock_guard<std::mutex> lock(s_mountMutex);
+    return s_mountedPacks;
+}
+
+bool MountResourcePack(const char* fileName)
+{
+    std::shared_ptr<ResourcePack> pack(new ResourcePack());
+    if ( !pack->Open(fileName) )
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mountMutex);
+    s_mountedPacks.push_back(pack);
+
+    return true;
+}
+
+void UnmountResourcePacks()
+{
+    std::lock_guard<std::mutex> lock(s_mountMutex);
+    s_mountedPacks.clear();
+}
+
+bool ResourcePackHasFile(const char* fileName)
+{
+    ResourcePackList packs = GetMountedPacks();
+    for ( size_t i = 0; i < packs.size(); i++ )
+    {
+        if ( packs[i]->Find(fileName) != NULL )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool FindResourcePackFile(const char* fileName, size_t* size,
+                          std::string* packFileName)
+{
+    ResourcePackList packs = GetMountedPacks();
+    for ( int i = (int)packs.size() - 1; i >= 0; i-- )
+    {
+        const ResourcePackEntry* entry = packs[i]->Find(fileName);
+        if ( entry != NULL )
+        {
+            *size = entry->m_size;
+            *packFileName = packs[i]->GetFileName();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ReadResourcePackFile(const char* fileName, bool zeropad,
+                          size_t* size, void** buffer)
+{
+    ResourcePackList packs = GetMountedPacks();
+    for ( int i = (int)packs.size() - 1; i >= 0; i-- )
+    {
+        if ( packs[i]->Read(fileName, zeropad, size, buffer) )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool MapResourcePackFile(const char* fileName, bool zeropad,
+                         BundleFileView* view)
+{
+    ResourcePackList packs = GetMountedPacks();
+    for ( int i = (int)packs.size() - 1; i >= 0; i-- )
+    {
+        if ( ResourcePack::Map(packs[i], fileName, zeropad, view) )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
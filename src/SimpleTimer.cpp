@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "SimpleTimer.h"
 
 SimpleTimer::SimpleTimer(float initialDelay, float interval, void* userData,
@@ -49,3 +51,13 @@ bool SimpleTimer::HasCompleted(const TimeSample& time) const
     }
 }
 
+float SimpleTimer::TimeUntilNextUpdate(const TimeSample& time) const
+{
+    if ( HasCompleted(time) )
+    {
+        return -1.0;
+    }
+
+    float elapsed = time.ElapsedTimeSince(m_baseTime);
+    return std::max(m_nextSignalOffset - elapsed, 0.0f);
+}
@@ -11,14 +11,14 @@ static const int VerticesPerChar = 6;
 TextRenderer::TextRenderer(GLuint program, GLuint mvpLoc, GLuint textureLoc,
                            GLuint indexBuffer, int fontHeight)
     : m_indexBuffer(indexBuffer),
-      m_fontTextureAtlas(0),
+      m_fontTextureAtlas(),
       m_textProgram(program),
       m_textProgramTextureLoc(textureLoc),
       m_textProgramMvpLoc(mvpLoc),
       m_numAlphabet(0),
       m_alphabet(NULL),
       m_fontHeight(fontHeight),
-      m_vertexBuffer(0),
+      m_vertexBuffer(),
       m_textVertices(NULL),
       m_textVerticesCapacityInChars(0)
 {
@@ -27,8 +27,8 @@ TextRenderer::TextRenderer(GLuint program, GLuint mvpLoc, GLuint textureLoc,
 
 TextRenderer::~TextRenderer()
 {
-    glDeleteTextures(1, &m_fontTextureAtlas);
-    glDeleteBuffers(1, &m_vertexBuffer);
+    g_resourceRegistry.Release(&m_fontTextureAtlas);
+    g_resourceRegistry.Release(&m_vertexBuffer);
 
     delete m_textVertices;
     delete m_alphabet;
@@ -37,7 +37,7 @@ TextRenderer::~TextRenderer()
 bool TextRenderer::Setup()
 {
     EnsureCapacity(128);
-    glGenBuffers(1, &m_vertexBuffer);
+    m_vertexBuffer = g_resourceRegistry.CreateBuffer();
 
     return true;
 }
@@ -56,7 +56,7 @@ void TextRenderer::SetProgram()
 
 void TextRenderer::SetTexture()
 {
-    SetTexture(m_fontTextureAtlas);
+    SetTexture(g_resourceRegistry.Get(m_fontTextureAtlas));
 }
 
 void TextRenderer::SetTexture(GLuint texture)
@@ -202,7 +202,7 @@ void TextRenderer::DrawText(int x, int y, const char* text, float scale)
     glDisableVertexAttribArray(NORMAL_INDEX);
     
     // Upload the created vertex data into the VBO
-    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, g_resourceRegistry.Get(m_vertexBuffer));
     glBufferData(GL_ARRAY_BUFFER,
                  sizeof(VertexAttribsTexCoords) * VerticesPerChar * charCount,
                  m_textVertices, GL_STREAM_DRAW);
@@ -0,0 +1,374 @@
+#include <string.h>
+#include <algorithm>
+
+#include "TextureAtlas.h"
+#include "CommonFunctions.h"
+
+// Placement alignment of images on mipmapped pages; keeps the images apart
+// on the first two mip levels
+static const int MipmapAlignment = 4;
+
+TextureAtlas::TextureAtlas(int pageSize, int padding, bool useMipmaps)
+    : m_pageSize(pageSize),
+      m_padding(padding),
+      m_alignment(useMipmaps ? MipmapAlignment : 1),
+      m_useMipmaps(useMipmaps)
+{
+}
+
+TextureAtlas::~TextureAtlas()
+{
+    Clear();
+}
+
+TextureAtlas::Page* TextureAtlas::CreatePage()
+{
+    Page* page = new Page;
+    page->m_texture = new DynamicTexture;
+    if ( !page->m_texture->Create(m_pageSize, m_pageSize,
+                                  TextureFormatRGBA8888, 1, true) )
+    {
+        delete page->m_texture;
+        delete page;
+        return NULL;
+    }
+
+    SkylineNode node = { 0, 0, m_pageSize };
+    page->m_skyline.push_back(node);
+    page->m_usedArea = 0;
+    m_pages.push_back(page);
+
+    return page;
+}
+
+void TextureAtlas::ReleasePages(std::vector<Page*>& pages)
+{
+    for ( size_t i = 0; i < pages.size(); i++ )
+    {
+        delete pages[i]->m_texture;
+        delete pages[i];
+    }
+    pages.clear();
+}
+
+bool TextureAtlas::FindPosition(const Page& page, int width, int height,
+                                int* x, int* y) const
+{
+    // Bottom-left rule: the lowest position, the narrowest span on ties
+    const std::vector<SkylineNode>& skyline = page.m_skyline;
+    int bestTop = m_pageSize + 1;
+    int bestWidth = m_pageSize + 1;
+    bool found = false;
+
+    for ( size_t i = 0; i < skyline.size(); i++ )
+    {
+        if ( skyline[i].m_x + width > m_pageSize )
+        {
+            break;
+        }
+
+        // The image rests on the highest node of the span it covers
+        int top = 0;
+        int widthLeft = width;
+        for ( size_t j = i; widthLeft > 0; j++ )
+        {
+            top = std::max(top, skyline[j].m_y);
+            widthLeft -= skyline[j].m_width;
+        }
+
+        if ( (top + height <= m_pageSize) &&
+             ((top + height < bestTop) ||
+              ((top + height == bestTop) &&
+               (skyline[i].m_width < bestWidth))) )
+        {
+            bestTop = top + height;
+            bestWidth = skyline[i].m_width;
+            *x = skyline[i].m_x;
+            *y = top;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+void TextureAtlas::Allocate(Page& page, int x, int y, int width, int height)
+{
+    std::vector<SkylineNode>& skyline = page.m_skyline;
+
+    size_t index = 0;
+    while ( skyline[index].m_x != x )
+    {
+        index++;
+    }
+
+    SkylineNode node = { x, y + height, width };
+    skyline.insert(skyline.begin() + index, node);
+
+    // Cut the nodes now under the image
+    size_t i = index + 1;
+    while ( i < skyline.size() )
+    {
+        int overlap = (x + width) - skyline[i].m_x;
+        if ( overlap <= 0 )
+        {
+            break;
+        }
+
+        if ( overlap < skyline[i].m_width )
+        {
+            skyline[i].m_x += overlap;
+            skyline[i].m_width -= overlap;
+            break;
+        }
+
+        skyline.erase(skyline.begin() + i);
+    }
+
+    // Join neighbours of the same height
+    for ( i = 0; i + 1 < skyline.size(); )
+    {
+        if ( skyline[i].m_y == skyline[i + 1].m_y )
+        {
+            skyline[i].m_width += skyline[i + 1].m_width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    page.m_usedArea += (size_t)width * height;
+}
+
+int TextureAtlas::GetBlockSize(int size) const
+{
+    // Size of the image with its gutter, on the placement alignment
+    size += 2 * m_padding;
+    return (size + m_alignment - 1) / m_alignment * m_alignment;
+}
+
+void TextureAtlas::FreeArea(const AtlasRegion& region)
+{
+    // The space stays allocated until defragmented
+    m_pages[region.m_page]->m_usedArea -=
+            (size_t)GetBlockSize(region.m_width) *
+            GetBlockSize(region.m_height);
+}
+
+bool TextureAtlas::Place(AtlasRegion* region, int width, int height,
+                         const void* data)
+{
+    int blockWidth = GetBlockSize(width);
+    int blockHeight = GetBlockSize(height);
+    if ( (width <= 0) || (height <= 0) || (blockWidth > m_pageSize) ||
+         (blockHeight > m_pageSize) )
+    {
+        return false;
+    }
+
+    int pageIndex = 0;
+    int x = 0;
+    int y = 0;
+    while ( (pageIndex < (int)m_pages.size()) &&
+            !FindPosition(*m_pages[pageIndex], blockWidth, blockHeight,
+                          &x, &y) )
+    {
+        pageIndex++;
+    }
+
+    if ( pageIndex == (int)m_pages.size() )
+    {
+        Page* page = CreatePage();
+        if ( (page == NULL) ||
+             !FindPosition(*page, blockWidth, blockHeight, &x, &y) )
+        {
+            return false;
+        }
+    }
+
+    // Fill the gutter with the nearest edge pixels of the image
+    const uint32_t* pixels = (const uint32_t*)data;
+    m_block.resize((size_t)blockWidth * blockHeight);
+    for ( int row = 0; row < blockHeight; row++ )
+    {
+        int sourceRow = std::min(std::max(row - m_padding, 0), height - 1);
+        const uint32_t* source = pixels + (size_t)sourceRow * width;
+        uint32_t* target = &m_block[(size_t)row * blockWidth];
+
+        for ( int col = 0; col < m_padding; col++ )
+        {
+            target[col] = source[0];
+        }
+        memcpy(target + m_padding, source, width * sizeof(uint32_t));
+        for ( int col = m_padding + width; col < blockWidth; col++ )
+        {
+            target[col] = source[width - 1];
+        }
+    }
+
+    Page* page = m_pages[pageIndex];
+    page->m_texture->Update(x, y, blockWidth, blockHeight, &m_block[0]);
+    Allocate(*page, x, y, blockWidth, blockHeight);
+
+    float scale = 1.0 / m_pageSize;
+    region->m_page = pageIndex;
+    region->m_x = x + m_padding;
+    region->m_y = y + m_padding;
+    region->m_width = width;
+    region->m_height = height;
+    region->m_u1 = region->m_x * scale;
+    region->m_v1 = (region->m_y + height) * scale;
+    region->m_u2 = (region->m_x + width) * scale;
+    region->m_v2 = region->m_y * scale;
+
+    return true;
+}
+
+const AtlasRegion* TextureAtlas::Add(const char* name, int width, int height,
+                                     const void* data)
+{
+    // Placed apart first, so that an existing image stays if the new one
+    // does not fit
+    AtlasRegion placed;
+    if ( !Place(&placed, width, height, data) )
+    {
+        LOG_DEBUG("TextureAtlas: no room for %s (%dx%d)", name, width,
+                  height);
+        return NULL;
+    }
+
+    // An existing region is updated in place, so that references to it
+    // stay valid
+    AtlasRegion& region = m_regions[name];
+    if ( region.IsValid() )
+    {
+        FreeArea(region);
+    }
+    region = placed;
+
+    return &region;
+}
+
+const AtlasRegion* TextureAtlas::AddImage(const char* imageName)
+{
+    void* data;
+    int width, height;
+    if ( !LoadImageDataFromBundle(imageName, &data, &width, &height) )
+    {
+        return NULL;
+    }
+
+    const AtlasRegion* region = Add(imageName, width, height, data);
+    free(data);
+
+    return region;
+}
+
+void TextureAtlas::Remove(const char* name)
+{
+    RegionMap::iterator iter = m_regions.find(name);
+    if ( iter == m_regions.end() )
+    {
+        return;
+    }
+
+    FreeArea(iter->second);
+    m_regions.erase(iter);
+}
+
+const AtlasRegion* TextureAtlas::Find(const char* name) const
+{
+    RegionMap::const_iterator iter = m_regions.find(name);
+    return (iter != m_regions.end()) ? &iter->second : NULL;
+}
+
+void TextureAtlas::Upload()
+{
+    for ( size_t i = 0; i < m_pages.size(); i++ )
+    {
+        DynamicTexture* texture = m_pages[i]->m_texture;
+        if ( texture->Flush() && m_useMipmaps )
+        {
+            // Flush() selected texture unit 0
+            glBindTexture(GL_TEXTURE_2D,
+                          g_resourceRegistry.Get(texture->GetTexture()));
+            SetTexture2DParameters(true, true);
+        }
+    }
+}
+
+void TextureAtlas::Defragment()
+{
+    std::vector<Page*> oldPages;
+    oldPages.swap(m_pages);
+
+    // Tallest first packs the skyline most tightly
+    std::vector<AtlasRegion*> regions;
+    for ( RegionMap::iterator iter = m_regions.begin();
+          iter != m_regions.end(); iter++ )
+    {
+        regions.push_back(&iter->second);
+    }
+
+    std::sort(regions.begin(), regions.end(),
+              [](const AtlasRegion* a, const AtlasRegion* b) {
+        return ( (a->m_height > b->m_height) ||
+                 ((a->m_height == b->m_height) && (a->m_width > b->m_width)) );
+    });
+
+    std::vector<uint32_t> image;
+    size_t pitch = m_pageSize;
+    for ( size_t i = 0; i < regions.size(); i++ )
+    {
+        AtlasRegion* region = regions[i];
+        const uint32_t* source =
+                (const uint32_t*)oldPages[region->m_page]->m_texture->GetData();
+        source += region->m_y * pitch + region->m_x;
+
+        image.resize((size_t)region->m_width * region->m_height);
+        for ( int row = 0; row < region->m_height; row++ )
+        {
+            memcpy(&image[(size_t)row * region->m_width], source + row * pitch,
+                   region->m_width * sizeof(uint32_t));
+        }
+
+        // Every image fitted on a page of its own before; it still does
+        Place(region, region->m_width, region->m_height, &image[0]);
+    }
+
+    ReleasePages(oldPages);
+}
+
+void TextureAtlas::Clear()
+{
+    ReleasePages(m_pages);
+    m_regions.clear();
+}
+
+GLuint TextureAtlas::GetTexture(int page) const
+{
+    if ( (page < 0) || (page >= (int)m_pages.size()) )
+    {
+        return 0;
+    }
+
+    return g_resourceRegistry.Get(m_pages[page]->m_texture->GetTexture());
+}
+
+float TextureAtlas::GetOccupancy() const
+{
+    if ( m_pages.empty() )
+    {
+        return 0.0;
+    }
+
+    size_t usedArea = 0;
+    for ( size_t i = 0; i < m_pages.size(); i++ )
+    {
+        usedArea += m_pages[i]->m_usedArea;
+    }
+
+    return (float)usedArea / ((float)m_pageSize * m_pageSize * m_pages.size());
+}
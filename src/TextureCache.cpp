@@ -0,0 +1,207 @@
+#include "TextureCache.h"
+#include "CommonFunctions.h"
+
+// The global texture cache
+TextureCache g_textureCache;
+
+TextureCache::TextureCache(size_t budgetBytes)
+    : m_budgetBytes((budgetBytes > 0) ? budgetBytes : DefaultTextureBudget()),
+      m_residentBytes(0),
+      m_numReferenced(0),
+      m_hits(0),
+      m_misses(0),
+      m_evictions(0)
+{
+}
+
+TextureCache::~TextureCache()
+{
+    // The GL context is typically gone by now; just forget the textures
+}
+
+std::string TextureCache::MakeKey(const char* imageName, bool clamp,
+                                  bool useMipmaps, TextureFormat format)
+{
+    char params[16];
+    snprintf(params, sizeof(params), "|%d%d%d", clamp, useMipmaps, format);
+
+    return std::string(imageName) + params;
+}
+
+size_t TextureCache::EstimateSize(int width, int height,
+                                  TextureFormat format, bool useMipmaps)
+{
+    size_t pixelSize = GetTextureFormatPixelSize(format);
+    size_t size = (size_t)width * height * pixelSize;
+
+    while ( useMipmaps && ((width > 1) || (height > 1)) )
+    {
+        width = (width > 1) ? (width / 2) : 1;
+        height = (height > 1) ? (height / 2) : 1;
+        size += (size_t)width * height * pixelSize;
+    }
+
+    return size;
+}
+
+TextureHandle TextureCache::Acquire(const char* imageName, bool clamp,
+                                    bool useMipmaps, TextureFormat format)
+{
+    std::string key = MakeKey(imageName, clamp, useMipmaps, format);
+
+    std::map<std::string, EntryList::iterator>::iterator found =
+            m_entriesByKey.find(key);
+    if ( found != m_entriesByKey.end() )
+    {
+        // Move to the front of the LRU order
+        EntryList::iterator iter = found->second;
+        m_entries.splice(m_entries.begin(), m_entries, iter);
+        if ( iter->m_refCount == 0 )
+        {
+            m_numReferenced++;
+        }
+        iter->m_refCount++;
+        m_hits++;
+
+        return iter->m_texture;
+    }
+
+    m_misses++;
+
+    void* data;
+    int width, height;
+    if ( !LoadImageDataFromBundle(imageName, &data, &width, &height, format) )
+    {
+        return TextureHandle();
+    }
+
+    GLuint textureId = 0;
+    bool success = Create2DTexture(width, height, data, &textureId, clamp,
+                                   useMipmaps, format);
+    free(data);
+
+    if ( !success )
+    {
+        return TextureHandle();
+    }
+
+    Entry entry;
+    entry.m_key = key;
+    entry.m_texture = g_resourceRegistry.AdoptTexture(textureId);
+    entry.m_size = EstimateSize(width, height, format, useMipmaps);
+    entry.m_refCount = 1;
+
+    m_entries.push_front(entry);
+    m_entriesByKey[key] = m_entries.begin();
+    m_entriesByTexture[entry.m_texture.m_value] = m_entries.begin();
+    m_residentBytes += entry.m_size;
+    m_numReferenced++;
+
+    if ( m_residentBytes > m_budgetBytes )
+    {
+        Trim(m_budgetBytes);
+    }
+
+    return entry.m_texture;
+}
+
+void TextureCache::Release(TextureHandle* handle)
+{
+    if ( handle->IsNull() )
+    {
+        return;
+    }
+
+    std::map<uint32_t, EntryList::iterator>::iterator found =
+            m_entriesByTexture.find(handle->m_value);
+    *handle = TextureHandle();
+
+    if ( (found == m_entriesByTexture.end()) ||
+         (found->second->m_refCount == 0) )
+    {
+        LOG_DEBUG("TextureCache: releasing a texture not acquired");
+        DEBUG_ASSERT(false);
+        return;
+    }
+
+    EntryList::iterator iter = found->second;
+    iter->m_refCount--;
+    if ( iter->m_refCount == 0 )
+    {
+        m_numReferenced--;
+
+        // A texture over the budget is only kept while referenced
+        if ( m_residentBytes > m_budgetBytes )
+        {
+            Trim(m_budgetBytes);
+        }
+    }
+}
+
+void TextureCache::Evict(EntryList::iterator iter)
+{
+    m_entriesByKey.erase(iter->m_key);
+    m_entriesByTexture.erase(iter->m_texture.m_value);
+    m_residentBytes -= iter->m_size;
+    g_resourceRegistry.Release(&iter->m_texture);
+    m_entries.erase(iter);
+}
+
+void TextureCache::Trim(size_t targetBytes)
+{
+    EntryList::iterator iter = m_entries.end();
+    while ( (m_residentBytes > targetBytes) && (iter != m_entries.begin()) )
+    {
+        iter--;
+        if ( iter->m_refCount == 0 )
+        {
+            EntryList::iterator evicted = iter;
+            iter++;
+            Evict(evicted);
+            m_evictions++;
+        }
+    }
+
+    if ( m_residentBytes > targetBytes )
+    {
+        LOG_DEBUG("TextureCache: %u bytes referenced, over the target of %u",
+                  (unsigned int)m_residentBytes, (unsigned int)targetBytes);
+    }
+}
+
+void TextureCache::Clear()
+{
+    while ( !m_entries.empty() )
+    {
+        Evict(m_entries.begin());
+    }
+
+    m_numReferenced = 0;
+}
+
+void TextureCache::SetBudget(size_t budgetBytes)
+{
+    m_budgetBytes = (budgetBytes > 0) ? budgetBytes : DefaultTextureBudget();
+    Trim(m_budgetBytes);
+}
+
+TextureCacheStats TextureCache::GetStats() const
+{
+    TextureCacheStats stats;
+    stats.m_hits = m_hits;
+    stats.m_misses = m_misses;
+    stats.m_evictions = m_evictions;
+    stats.m_numTextures = m_entries.size();
+    stats.m_numReferenced = m_numReferenced;
+    stats.m_residentBytes = m_residentBytes;
+    stats.m_budgetBytes = m_budgetBytes;
+
+    return stats;
+}
+
+void TextureCache::ResetStats()
+{
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+}
@@ -0,0 +1,420 @@
+#include <string.h>
+#include <map>
+#include <vector>
+
+#include "TextureCompression.h"
+#include "CommonFunctions.h"
+
+static const int RGBAPixelSize = 4;
+static const int RGB565PixelSize = 2;
+
+// ETC1 intensity modifier tables, indexed by the table codeword and the
+// pixel index
+static const int ETC1Modifiers[8][4] = {
+    { 2, 8, -2, -8 },
+    { 5, 17, -5, -17 },
+    { 9, 29, -9, -29 },
+    { 13, 42, -13, -42 },
+    { 18, 60, -18, -60 },
+    { 24, 80, -24, -80 },
+    { 33, 106, -33, -106 },
+    { 47, 183, -47, -183 }
+};
+
+// Formats whose support has been checked
+static std::map<GLenum, bool> s_supportedFormats;
+
+bool GetCompressedFormatInfo(GLenum internalFormat,
+                             CompressedFormatInfo* info)
+{
+    info->m_blockWidth = 4;
+    info->m_blockHeight = 4;
+    info->m_blockSize = 16;
+    info->m_opaque = false;
+    info->m_decodable = false;
+
+    switch ( internalFormat )
+    {
+        case GL_ETC1_RGB8_OES:
+            info->m_blockSize = 8;
+            info->m_opaque = true;
+            info->m_decodable = true;
+            break;
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            info->m_blockSize = 8;
+            info->m_opaque = true;
+            info->m_decodable = true;
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+            info->m_blockSize = 8;
+            info->m_decodable = true;
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            info->m_decodable = true;
+            break;
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_SRGB8_ETC2:
+            info->m_blockSize = 8;
+            info->m_opaque = true;
+            break;
+        case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+            info->m_blockSize = 8;
+            break;
+        case GL_COMPRESSED_RGBA8_ETC2_EAC:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+        case GL_COMPRESSED_RGBA_ASTC_4x4_KHR:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR:
+            break;
+        case GL_COMPRESSED_RGBA_ASTC_6x6_KHR:
+            info->m_blockWidth = 6;
+            info->m_blockHeight = 6;
+            break;
+        case GL_COMPRESSED_RGBA_ASTC_8x8_KHR:
+            info->m_blockWidth = 8;
+            info->m_blockHeight = 8;
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+size_t GetCompressedImageSize(GLenum internalFormat, int width, int height)
+{
+    CompressedFormatInfo info;
+    if ( !GetCompressedFormatInfo(internalFormat, &info) )
+    {
+        return 0;
+    }
+
+    size_t numBlocksX = (width + info.m_blockWidth - 1) / info.m_blockWidth;
+    size_t numBlocksY = (height + info.m_blockHeight - 1) / info.m_blockHeight;
+
+    return numBlocksX * numBlocksY * info.m_blockSize;
+}
+
+static bool OpenGLES3Context()
+{
+    int major = GetGLESMajorVersion();
+    if ( major > 0 )
+    {
+        return (major >= 3);
+    }
+
+    return ExtensionPresent("ARB_ES3_compatibility");
+}
+
+static bool DriverListsFormat(GLenum internalFormat)
+{
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &numFormats);
+    if ( numFormats <= 0 )
+    {
+        return false;
+    }
+
+    std::vector<GLint> formats(numFormats);
+    glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, &formats[0]);
+    for ( int i = 0; i < numFormats; i++ )
+    {
+        if ( (GLenum)formats[i] == internalFormat )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CompressedFormatSupported(GLenum internalFormat)
+{
+    std::map<GLenum, bool>::const_iterator it =
+            s_supportedFormats.find(internalFormat);
+    if ( it != s_supportedFormats.end() )
+    {
+        return it->second;
+    }
+
+    bool supported = false;
+    switch ( internalFormat )
+    {
+        case GL_ETC1_RGB8_OES:
+            // ETC1 data is valid ETC2 data
+            supported = ExtensionPresent(ETC1TextureExtension) ||
+                    OpenGLES3Context();
+            break;
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_SRGB8_ETC2:
+        case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+        case GL_COMPRESSED_RGBA8_ETC2_EAC:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+            supported = OpenGLES3Context();
+            break;
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            supported = ExtensionPresent(S3TCTextureExtension);
+            break;
+        case GL_COMPRESSED_RGBA_ASTC_4x4_KHR:
+        case GL_COMPRESSED_RGBA_ASTC_6x6_KHR:
+        case GL_COMPRESSED_RGBA_ASTC_8x8_KHR:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR:
+            supported = ExtensionPresent(ASTCTextureExtension);
+            break;
+        default:
+            break;
+    }
+
+    // Some drivers support formats without advertising the extension
+    if ( !supported )
+    {
+        supported = DriverListsFormat(internalFormat);
+    }
+
+    s_supportedFormats[internalFormat] = supported;
+
+    return supported;
+}
+
+static inline uint8_t Clamp255(int value)
+{
+    return (value < 0) ? 0 : ((value > 255) ? 255 : value);
+}
+
+/** Decodes a 4x4 ETC1 block into RGBA8 texels. */
+static void DecodeETC1Block(const uint8_t* block, uint8_t* texels)
+{
+    uint32_t high = (block[0] << 24) | (block[1] << 16) |
+            (block[2] << 8) | block[3];
+    uint32_t low = (block[4] << 24) | (block[5] << 16) |
+            (block[6] << 8) | block[7];
+
+    int colors[2][3];
+    if ( high & 0x2 )
+    {
+        // Differential mode: 5-bit base color and a 3-bit signed delta
+        for ( int c = 0; c < 3; c++ )
+        {
+            int shift = 27 - c * 8;
+            int base = (high >> shift) & 0x1f;
+            int delta = (high >> (shift - 3)) & 0x7;
+            if ( delta >= 4 )
+            {
+                delta -= 8;
+            }
+            int second = (base + delta) & 0x1f;
+            colors[0][c] = (base << 3) | (base >> 2);
+            colors[1][c] = (second << 3) | (second >> 2);
+        }
+    }
+    else
+    {
+        // Individual mode: two 4-bit colors
+        for ( int c = 0; c < 3; c++ )
+        {
+            int shift = 28 - c * 8;
+            int first = (high >> shift) & 0xf;
+            int second = (high >> (shift - 4)) & 0xf;
+            colors[0][c] = (first << 4) | first;
+            colors[1][c] = (second << 4) | second;
+        }
+    }
+
+    int tables[2] = { (int)((high >> 5) & 0x7), (int)((high >> 2) & 0x7) };
+    bool flip = (high & 0x1) != 0;
+
+    // Pixel indices are stored column by column
+    for ( int x = 0; x < 4; x++ )
+    {
+        for ( int y = 0; y < 4; y++ )
+        {
+            int i = x * 4 + y;
+            int index = (((low >> (i + 16)) & 0x1) << 1) | ((low >> i) & 0x1);
+            int subblock = flip ? (y >= 2) : (x >= 2);
+            int modifier = ETC1Modifiers[tables[subblock]][index];
+
+            uint8_t* texel = texels + (y * 4 + x) * RGBAPixelSize;
+            texel[0] = Clamp255(colors[subblock][0] + modifier);
+            texel[1] = Clamp255(colors[subblock][1] + modifier);
+            texel[2] = Clamp255(colors[subblock][2] + modifier);
+            texel[3] = 255;
+        }
+    }
+}
+
+/**
+ * Decodes the color part of a DXT block into RGBA8 texels.
+ *
+ * @param allowTransparent whether the 3-color mode with a transparent black
+ * is in use; it is only in DXT1
+ */
+static void DecodeDXTColorBlock(const uint8_t* block, uint8_t* texels,
+                                bool allowTransparent)
+{
+    int color0 = block[0] | (block[1] << 8);
+    int color1 = block[2] | (block[3] << 8);
+
+    uint8_t palette[4][4];
+    for ( int i = 0; i < 2; i++ )
+    {
+        int color = (i == 0) ? color0 : color1;
+        int r = (color >> 11) & 0x1f;
+        int g = (color >> 5) & 0x3f;
+        int b = color & 0x1f;
+        palette[i][0] = (r << 3) | (r >> 2);
+        palette[i][1] = (g << 2) | (g >> 4);
+        palette[i][2] = (b << 3) | (b >> 2);
+        palette[i][3] = 255;
+    }
+
+    bool fourColors = !allowTransparent || (color0 > color1);
+    for ( int c = 0; c < 3; c++ )
+    {
+        if ( fourColors )
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = fourColors ? 255 : 0;
+
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) |
+            ((uint32_t)block[7] << 24);
+    for ( int i = 0; i < 16; i++ )
+    {
+        memcpy(texels + i * RGBAPixelSize, palette[(indices >> (i * 2)) & 0x3],
+               RGBAPixelSize);
+    }
+}
+
+/** Decodes the interpolated alpha part of a DXT5 block. */
+static void DecodeDXT5AlphaBlock(const uint8_t* block, uint8_t* texels)
+{
+    int alpha[8];
+    alpha[0] = block[0];
+    alpha[1] = block[1];
+    if ( alpha[0] > alpha[1] )
+    {
+        for ( int i = 1; i < 7; i++ )
+        {
+            alpha[i + 1] = ((7 - i) * alpha[0] + i * alpha[1]) / 7;
+        }
+    }
+    else
+    {
+        for ( int i = 1; i < 5; i++ )
+        {
+            alpha[i + 1] = ((5 - i) * alpha[0] + i * alpha[1]) / 5;
+        }
+        alpha[6] = 0;
+        alpha[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for ( int i = 0; i < 6; i++ )
+    {
+        indices |= (uint64_t)block[2 + i] << (i * 8);
+    }
+    for ( int i = 0; i < 16; i++ )
+    {
+        texels[i * RGBAPixelSize + 3] = alpha[(indices >> (i * 3)) & 0x7];
+    }
+}
+
+/** Decodes the explicit 4-bit alpha part of a DXT3 block. */
+static void DecodeDXT3AlphaBlock(const uint8_t* block, uint8_t* texels)
+{
+    for ( int i = 0; i < 16; i++ )
+    {
+        int alpha = (block[i / 2] >> ((i & 1) * 4)) & 0xf;
+        texels[i * RGBAPixelSize + 3] = (alpha << 4) | alpha;
+    }
+}
+
+bool DecodeCompressedImage(GLenum internalFormat, const void* data,
+                           size_t size, int width, int height, bool toRGB565,
+                           void* output)
+{
+    CompressedFormatInfo info;
+    if ( !GetCompressedFormatInfo(internalFormat, &info) || !info.m_decodable )
+    {
+        LOG_DEBUG("DecodeCompressedImage(): cannot decode format 0x%x",
+                  internalFormat);
+        return false;
+    }
+
+    if ( size < GetCompressedImageSize(internalFormat, width, height) )
+    {
+        LOG_DEBUG("DecodeCompressedImage(): too little data");
+        return false;
+    }
+
+    const uint8_t* block = (const uint8_t*)data;
+    int pixelSize = toRGB565 ? RGB565PixelSize : RGBAPixelSize;
+    uint8_t texels[16 * RGBAPixelSize];
+
+    for ( int blockY = 0; blockY < height; blockY += 4 )
+    {
+        for ( int blockX = 0; blockX < width; blockX += 4 )
+        {
+            switch ( internalFormat )
+            {
+                case GL_ETC1_RGB8_OES:
+                    DecodeETC1Block(block, texels);
+                    break;
+                case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+                    DecodeDXTColorBlock(block, texels, true);
+                    for ( int i = 0; i < 16; i++ )
+                    {
+                        texels[i * RGBAPixelSize + 3] = 255;
+                    }
+                    break;
+                case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+                    DecodeDXTColorBlock(block, texels, true);
+                    break;
+                case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+                    DecodeDXTColorBlock(block + 8, texels, false);
+                    DecodeDXT3AlphaBlock(block, texels);
+                    break;
+                case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                    DecodeDXTColorBlock(block + 8, texels, false);
+                    DecodeDXT5AlphaBlock(block, texels);
+                    break;
+            }
+            block += info.m_blockSize;
+
+            // Copy the texels inside the image, converting if needed
+            for ( int y = 0; (y < 4) && (blockY + y < height); y++ )
+            {
+                uint8_t* row = (uint8_t*)output +
+                        ((size_t)(blockY + y) * width + blockX) * pixelSize;
+                for ( int x = 0; (x < 4) && (blockX + x < width); x++ )
+                {
+                    const uint8_t* texel = texels + (y * 4 + x) * RGBAPixelSize;
+                    if ( toRGB565 )
+                    {
+                        uint16_t pixel = ((texel[0] >> 3) << 11) |
+                                ((texel[1] >> 2) << 5) | (texel[2] >> 3);
+                        memcpy(row + x * RGB565PixelSize, &pixel,
+                               RGB565PixelSize);
+                    }
+                    else
+                    {
+                        memcpy(row + x * RGBAPixelSize, texel, RGBAPixelSize);
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
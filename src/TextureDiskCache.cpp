@@ -0,0 +1,510 @@
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+
+#if !defined(_WIN32)
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #define HAVE_MMAP
+#endif
+
+#include "TextureDiskCache.h"
+#include "MipmapGenerator.h"
+#include "BundleFileView.h"
+#include "ResourcePack.h"
+#include "ThreadPool.h"
+#include "CommonFunctions.h"
+
+// The global texture disk cache
+TextureDiskCache g_textureDiskCache;
+
+static_assert(sizeof(TextureCacheFileHeader) == 64,
+              "bad TextureCacheFileHeader");
+
+static const char CacheFileMagic[8] = {
+    'C', 'G', 'L', 'T', 'E', 'X', 'C', '\0'
+};
+static const uint32_t CacheFileVersion = 1;
+
+// Alignment of the pixel data in a cache file
+static const size_t DataAlignment = 16;
+
+#ifdef HAVE_MMAP
+static void UnmapRelease(const void* data, size_t size, void* /*context*/)
+{
+    munmap((void*)data, size);
+}
+#endif
+
+/** Maps a cache file into a view; read into memory where mmap() is not. */
+static bool MapCacheFile(const std::string& path, BundleFileView* view)
+{
+#ifdef HAVE_MMAP
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    struct stat st;
+    if ( (fstat(fd, &st) != 0) ||
+         ((size_t)st.st_size < sizeof(TextureCacheFileHeader)) )
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( data == MAP_FAILED )
+    {
+        return false;
+    }
+
+    view->Set(data, st.st_size, UnmapRelease, NULL);
+    return true;
+#else
+    FILE* file = fopen(path.c_str(), "rb");
+    if ( file == NULL )
+    {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    void* data = (size > 0) ? malloc(size) : NULL;
+    if ( (data == NULL) || (fread(data, 1, size, file) != (size_t)size) )
+    {
+        free(data);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+
+    view->Set(data, size, BundleFileView::FreeData, NULL);
+    return true;
+#endif
+}
+
+/** Returns the total size of the levels of an image. */
+static size_t GetLevelsSize(int width, int height, int numLevels,
+                            TextureFormat format)
+{
+    size_t pixelSize = GetTextureFormatPixelSize(format);
+    size_t size = 0;
+    for ( int level = 0; level < numLevels; level++ )
+    {
+        size += (size_t)width * height * pixelSize;
+        width = (width > 1) ? (width / 2) : 1;
+        height = (height > 1) ? (height / 2) : 1;
+    }
+
+    return size;
+}
+
+/** Uploads the levels of an image into a new texture. */
+static bool UploadLevels(const uint8_t* data, int width, int height,
+                         int numLevels, TextureFormat format, bool clamp,
+                         GLuint* texture)
+{
+    GLenum glFormat, glType;
+    GetTextureFormatGL(format, &glFormat, &glType);
+    size_t pixelSize = GetTextureFormatPixelSize(format);
+
+    glGenTextures(1, texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, *texture);
+
+    // Rows of the smaller formats are not padded to 4 bytes
+    ScopedUnpackAlignment unpackAlignment(1);
+    for ( int level = 0; level < numLevels; level++ )
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, glFormat, width, height, 0,
+                     glFormat, glType, data);
+        data += (size_t)width * height * pixelSize;
+        width = (width > 1) ? (width / 2) : 1;
+        height = (height > 1) ? (height / 2) : 1;
+    }
+
+    SetTextureFiltering(GL_TEXTURE_2D, (numLevels > 1), false, 1.0);
+    GLint wrap = clamp ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+
+    int glError = glGetError();
+    if ( glError != GL_NO_ERROR )
+    {
+        LOG_DEBUG("TextureDiskCache: GL error: 0x%x", glError);
+        glDeleteTextures(1, texture);
+        *texture = 0;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Checks a mapped cache file against the source file and the options.
+ *
+ * @return the header if the file is valid, NULL otherwise
+ */
+static const TextureCacheFileHeader* ValidateCacheFile(
+        const BundleFileView& view, const char* imageName, size_t sourceSize,
+        int64_t sourceModificationTime, bool useMipmaps, TextureFormat format,
+        int conversionFlags)
+{
+    const TextureCacheFileHeader* header =
+            (const TextureCacheFileHeader*)view.GetData();
+    size_t size = view.GetSize();
+    size_t nameLength = strlen(imageName);
+
+    if ( (size < sizeof(TextureCacheFileHeader)) ||
+         (memcmp(header->m_magic, CacheFileMagic,
+                 sizeof(CacheFileMagic)) != 0) ||
+         (header->m_version != CacheFileVersion) ||
+         (header->m_format != (uint32_t)format) ||
+         (header->m_conversionFlags != (uint32_t)conversionFlags) ||
+         (header->m_sourceSize != sourceSize) ||
+         (header->m_sourceModificationTime != sourceModificationTime) ||
+         (header->m_nameLength != nameLength) ||
+         (header->m_dataOffset > size) ||
+         (header->m_dataSize > (size - header->m_dataOffset)) ||
+         (sizeof(TextureCacheFileHeader) + nameLength > header->m_dataOffset) )
+    {
+        return NULL;
+    }
+
+    // Guard against hash collisions of the file names
+    const char* name = (const char*)(header + 1);
+    if ( memcmp(name, imageName, nameLength) != 0 )
+    {
+        return NULL;
+    }
+
+    int width = header->m_width;
+    int height = header->m_height;
+    int numLevels = useMipmaps ? MipmapChain::CountLevels(width, height) : 1;
+    if ( (width <= 0) || (height <= 0) ||
+         (header->m_numLevels != (uint32_t)numLevels) ||
+         (header->m_dataSize !=
+          GetLevelsSize(width, height, numLevels, format)) )
+    {
+        return NULL;
+    }
+
+    return header;
+}
+
+/**
+ * Decodes an image into a cache file in memory: header, name and the
+ * converted levels.
+ */
+static bool BuildCacheFile(const char* imageName, bool useMipmaps,
+                           TextureFormat format, int conversionFlags,
+                           std::vector<uint8_t>* file)
+{
+    // Mipmaps are generated from RGBA8 and dithered, if at all, during the
+    // final conversion of each level
+    TextureFormat decodeFormat =
+            useMipmaps ? TextureFormatRGBA8888 : format;
+    int decodeFlags =
+            useMipmaps ? (conversionFlags & ~ConvertDither) : conversionFlags;
+
+    void* pixels;
+    int width, height;
+    if ( !LoadImageDataFromBundle(imageName, &pixels, &width, &height,
+                                  decodeFormat, decodeFlags) )
+    {
+        return false;
+    }
+
+    MipmapChain chain;
+    int numLevels = 1;
+    if ( useMipmaps )
+    {
+        chain.Generate(pixels, width, height, MipmapFilterBox, false, false);
+        numLevels = chain.GetNumLevels();
+    }
+
+    size_t nameLength = strlen(imageName);
+    size_t dataOffset = sizeof(TextureCacheFileHeader) + nameLength;
+    dataOffset = (dataOffset + DataAlignment - 1) & ~(DataAlignment - 1);
+    size_t dataSize = GetLevelsSize(width, height, numLevels, format);
+    file->assign(dataOffset + dataSize, 0);
+
+    TextureCacheFileHeader* header = (TextureCacheFileHeader*)&(*file)[0];
+    memcpy(header->m_magic, CacheFileMagic, sizeof(CacheFileMagic));
+    header->m_version = CacheFileVersion;
+    header->m_format = format;
+    header->m_conversionFlags = conversionFlags;
+    header->m_numLevels = numLevels;
+    header->m_width = width;
+    header->m_height = height;
+    header->m_nameLength = nameLength;
+    header->m_dataOffset = dataOffset;
+    header->m_dataSize = dataSize;
+    memcpy(header + 1, imageName, nameLength);
+
+    uint8_t* data = &(*file)[dataOffset];
+    if ( useMipmaps )
+    {
+        int pixelSize = GetTextureFormatPixelSize(format);
+        for ( int level = 0; level < numLevels; level++ )
+        {
+            int levelWidth = chain.GetLevelWidth(level);
+            int levelHeight = chain.GetLevelHeight(level);
+            ConvertTextureData(chain.GetLevelData(level), levelWidth,
+                               levelHeight, format,
+                               conversionFlags & ConvertDither, data);
+            data += (size_t)levelWidth * levelHeight * pixelSize;
+        }
+    }
+    else
+    {
+        memcpy(data, pixels, dataSize);
+    }
+    free(pixels);
+
+    return true;
+}
+
+TextureDiskCache::TextureDiskCache()
+    : m_numHits(0),
+      m_numMisses(0),
+      m_writeState(new WriteState())
+{
+    // Resolved up front, as the cache is used from worker threads
+    SetDirectory(GetCacheDirectory().c_str());
+}
+
+TextureDiskCache::~TextureDiskCache()
+{
+    // Queued writes are not waited for here; g_threadPool may be gone by
+    // now. They hold on to the write state, and files are renamed into
+    // place, so an unwritten one is just lost.
+}
+
+void TextureDiskCache::SetDirectory(const char* path)
+{
+    m_directory = path;
+    if ( !m_directory.empty() &&
+         (m_directory[m_directory.size() - 1] != '/') )
+    {
+        m_directory += '/';
+    }
+}
+
+std::string TextureDiskCache::GetFilePath(const char* imageName,
+                                          bool useMipmaps,
+                                          TextureFormat format,
+                                          int conversionFlags)
+{
+    if ( m_directory.empty() )
+    {
+        return std::string();
+    }
+
+    char fileName[64];
+    snprintf(fileName, sizeof(fileName), "%08x-%d-%d-%d.tex",
+             ResourcePack::HashName(imageName, strlen(imageName)), format,
+             conversionFlags, useMipmaps);
+
+    return m_directory + fileName;
+}
+
+bool TextureDiskCache::Load2DTexture(const char* imageName,
+                                     TextureHandle* texture, bool clamp,
+                                     bool useMipmaps, TextureFormat format,
+                                     int conversionFlags)
+{
+    std::string path = GetFilePath(imageName, useMipmaps, format,
+                                   conversionFlags);
+    size_t sourceSize = 0;
+    int64_t sourceModificationTime = 0;
+    bool cacheable = !path.empty() &&
+            GetBundleFileInfo(imageName, &sourceSize,
+                              &sourceModificationTime);
+
+    GLuint textureId = 0;
+    if ( cacheable )
+    {
+        BundleFileView view;
+        const TextureCacheFileHeader* header = NULL;
+        if ( MapCacheFile(path, &view) )
+        {
+            header = ValidateCacheFile(view, imageName, sourceSize,
+                                       sourceModificationTime, useMipmaps,
+                                       format, conversionFlags);
+        }
+
+        if ( header != NULL )
+        {
+            m_numHits++;
+            const uint8_t* data =
+                    (const uint8_t*)view.GetData() + header->m_dataOffset;
+            if ( !UploadLevels(data, header->m_width, header->m_height,
+                               header->m_numLevels, format, clamp,
+                               &textureId) )
+            {
+                return false;
+            }
+
+            *texture = g_resourceRegistry.AdoptTexture(textureId);
+            return true;
+        }
+    }
+
+    m_numMisses++;
+
+    std::shared_ptr<std::vector<uint8_t> > file(new std::vector<uint8_t>());
+    if ( !BuildCacheFile(imageName, useMipmaps, format, conversionFlags,
+                         file.get()) )
+    {
+        return false;
+    }
+
+    TextureCacheFileHeader* header = (TextureCacheFileHeader*)&(*file)[0];
+    if ( !UploadLevels(&(*file)[header->m_dataOffset], header->m_width,
+                       header->m_height, header->m_numLevels, format, clamp,
+                       &textureId) )
+    {
+        return false;
+    }
+    *texture = g_resourceRegistry.AdoptTexture(textureId);
+
+    if ( cacheable )
+    {
+        header->m_sourceSize = sourceSize;
+        header->m_sourceModificationTime = sourceModificationTime;
+
+        std::shared_ptr<WriteState> state = m_writeState;
+        {
+            std::lock_guard<std::mutex> lock(state->m_mutex);
+            state->m_numPendingWrites++;
+        }
+
+        g_threadPool.Enqueue(std::function<void()>([state, path, file]() {
+            Write(path, *file, *state);
+
+            std::lock_guard<std::mutex> lock(state->m_mutex);
+            state->m_numPendingWrites--;
+            state->m_writeCondition.notify_all();
+        }));
+    }
+
+    return true;
+}
+
+bool TextureDiskCache::Map(const char* imageName, bool useMipmaps,
+                           TextureFormat format, int conversionFlags,
+                           BundleFileView* view)
+{
+    std::string path = GetFilePath(imageName, useMipmaps, format,
+                                   conversionFlags);
+    size_t sourceSize = 0;
+    int64_t sourceModificationTime = 0;
+    bool cacheable = !path.empty() &&
+            GetBundleFileInfo(imageName, &sourceSize,
+                              &sourceModificationTime);
+
+    if ( cacheable && MapCacheFile(path, view) &&
+         (ValidateCacheFile(*view, imageName, sourceSize,
+                            sourceModificationTime, useMipmaps, format,
+                            conversionFlags) != NULL) )
+    {
+        m_numHits++;
+        return true;
+    }
+
+    m_numMisses++;
+    view->Reset();
+
+    std::vector<uint8_t> file;
+    if ( !BuildCacheFile(imageName, useMipmaps, format, conversionFlags,
+                         &file) )
+    {
+        return false;
+    }
+
+    if ( cacheable )
+    {
+        TextureCacheFileHeader* header = (TextureCacheFileHeader*)&file[0];
+        header->m_sourceSize = sourceSize;
+        header->m_sourceModificationTime = sourceModificationTime;
+
+        // Mapping the written file rather than keeping the heap copy lets
+        // the system page the data out instead of swapping it
+        if ( Write(path, file, *m_writeState) && MapCacheFile(path, view) )
+        {
+            return true;
+        }
+    }
+
+    void* data = malloc(file.size());
+    if ( data == NULL )
+    {
+        return false;
+    }
+    memcpy(data, &file[0], file.size());
+    view->Set(data, file.size(), BundleFileView::FreeData, NULL);
+
+    return true;
+}
+
+bool TextureDiskCache::Write(const std::string& path,
+                             const std::vector<uint8_t>& data,
+                             WriteState& state)
+{
+    // Concurrent writers of the same file each use a name of their own
+    std::string tempPath = path + "." + RandomUuid();
+
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if ( file == NULL )
+    {
+        LOG_DEBUG("TextureDiskCache: failed to create %s", tempPath.c_str());
+        return false;
+    }
+
+    bool success = (fwrite(&data[0], 1, data.size(), file) == data.size());
+    success = (fclose(file) == 0) && success;
+
+    // rename() does not replace existing files on every platform
+    if ( success && (rename(tempPath.c_str(), path.c_str()) != 0) )
+    {
+        remove(path.c_str());
+        success = (rename(tempPath.c_str(), path.c_str()) == 0);
+    }
+
+    if ( !success )
+    {
+        LOG_DEBUG("TextureDiskCache: failed to write %s", path.c_str());
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    state.m_numWrites++;
+    return true;
+}
+
+void TextureDiskCache::WaitForWrites()
+{
+    std::unique_lock<std::mutex> lock(m_writeState->m_mutex);
+    while ( m_writeState->m_numPendingWrites > 0 )
+    {
+        m_writeState->m_writeCondition.wait(lock);
+    }
+}
+
+void TextureDiskCache::Remove(const char* imageName, bool useMipmaps,
+                              TextureFormat format, int conversionFlags)
+{
+    std::string path = GetFilePath(imageName, useMipmaps, format,
+                                   conversionFlags);
+    if ( !path.empty() )
+    {
+        remove(path.c_str());
+    }
+}
@@ -0,0 +1,371 @@
+#include <string.h>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #include <arm_neon.h>
+  #define USE_NEON
+#endif
+
+#include "TextureFormat.h"
+
+static const int RGBAPixelSize = 4;
+
+// 4x4 ordered dither thresholds (Bayer matrix), 0..15
+static const uint8_t DitherMatrix[4][4] = {
+    { 0, 8, 2, 10 },
+    { 12, 4, 14, 6 },
+    { 3, 11, 1, 9 },
+    { 15, 7, 13, 5 }
+};
+
+int GetTextureFormatPixelSize(TextureFormat format)
+{
+    switch ( format )
+    {
+        case TextureFormatRGBA8888:
+            return 4;
+        case TextureFormatRGB888:
+            return 3;
+        case TextureFormatRGB565:
+        case TextureFormatRGBA4444:
+        case TextureFormatLA88:
+            return 2;
+        case TextureFormatL8:
+        case TextureFormatA8:
+            return 1;
+    }
+
+    return 4;
+}
+
+void GetTextureFormatGL(TextureFormat format, GLenum* glFormat,
+                        GLenum* glType)
+{
+    *glType = GL_UNSIGNED_BYTE;
+
+    switch ( format )
+    {
+        case TextureFormatRGBA8888:
+            *glFormat = GL_RGBA;
+            break;
+        case TextureFormatRGB888:
+            *glFormat = GL_RGB;
+            break;
+        case TextureFormatRGB565:
+            *glFormat = GL_RGB;
+            *glType = GL_UNSIGNED_SHORT_5_6_5;
+            break;
+        case TextureFormatRGBA4444:
+            *glFormat = GL_RGBA;
+            *glType = GL_UNSIGNED_SHORT_4_4_4_4;
+            break;
+        case TextureFormatLA88:
+            *glFormat = GL_LUMINANCE_ALPHA;
+            break;
+        case TextureFormatL8:
+            *glFormat = GL_LUMINANCE;
+            break;
+        case TextureFormatA8:
+            *glFormat = GL_ALPHA;
+            break;
+    }
+}
+
+/** Multiplies a color channel by alpha; exact division by 255. */
+static inline int Premultiply(int value, int alpha)
+{
+    int product = value * alpha + 128;
+    return (product + (product >> 8)) >> 8;
+}
+
+/** Adds a dither threshold scaled to the step of a channel of bits. */
+static inline int Dither(int value, int threshold, int bits)
+{
+    value += (threshold << (8 - bits)) >> 4;
+    return (value > 255) ? 255 : value;
+}
+
+/** Rec. 601 luma. */
+static inline int Luminance(int r, int g, int b)
+{
+    return (77 * r + 150 * g + 29 * b + 128) >> 8;
+}
+
+/**
+ * Converts the start of a row with SIMD; only the plain reductions without
+ * premultiplying or dithering are vectorized.
+ *
+ * @return number of pixels converted
+ */
+static int ConvertRowSimd(const uint8_t* source, uint8_t* target, int width,
+                          TextureFormat format)
+{
+    int x = 0;
+
+#if defined(__SSE2__)
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+
+    switch ( format )
+    {
+        case TextureFormatRGB565:
+        case TextureFormatRGBA4444:
+            for ( ; (x + 8) <= width; x += 8 )
+            {
+                __m128i packed[2];
+                for ( int i = 0; i < 2; i++ )
+                {
+                    __m128i pixels = _mm_loadu_si128(
+                            (const __m128i*)(source + (x + i * 4) * 4));
+                    __m128i r = _mm_and_si128(pixels, byteMask);
+                    __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 8),
+                                              byteMask);
+                    __m128i b = _mm_and_si128(_mm_srli_epi32(pixels, 16),
+                                              byteMask);
+                    __m128i value;
+                    if ( format == TextureFormatRGB565 )
+                    {
+                        value = _mm_or_si128(
+                                _mm_slli_epi32(_mm_srli_epi32(r, 3), 11),
+                                _mm_or_si128(
+                                    _mm_slli_epi32(_mm_srli_epi32(g, 2), 5),
+                                    _mm_srli_epi32(b, 3)));
+                    }
+                    else
+                    {
+                        __m128i a = _mm_srli_epi32(pixels, 24);
+                        value = _mm_or_si128(
+                                _mm_or_si128(
+                                    _mm_slli_epi32(_mm_srli_epi32(r, 4), 12),
+                                    _mm_slli_epi32(_mm_srli_epi32(g, 4), 8)),
+                                _mm_or_si128(
+                                    _mm_slli_epi32(_mm_srli_epi32(b, 4), 4),
+                                    _mm_srli_epi32(a, 4)));
+                    }
+
+                    // Sign extend the 16-bit values so that the saturating
+                    // pack keeps them as they are
+                    packed[i] = _mm_srai_epi32(_mm_slli_epi32(value, 16), 16);
+                }
+                _mm_storeu_si128((__m128i*)(target + x * 2),
+                                 _mm_packs_epi32(packed[0], packed[1]));
+            }
+            break;
+        case TextureFormatA8:
+            for ( ; (x + 16) <= width; x += 16 )
+            {
+                __m128i alpha[4];
+                for ( int i = 0; i < 4; i++ )
+                {
+                    alpha[i] = _mm_srli_epi32(_mm_loadu_si128(
+                            (const __m128i*)(source + (x + i * 4) * 4)), 24);
+                }
+                __m128i low = _mm_packs_epi32(alpha[0], alpha[1]);
+                __m128i high = _mm_packs_epi32(alpha[2], alpha[3]);
+                _mm_storeu_si128((__m128i*)(target + x),
+                                 _mm_packus_epi16(low, high));
+            }
+            break;
+        default:
+            break;
+    }
+#elif defined(USE_NEON)
+    switch ( format )
+    {
+        case TextureFormatRGB565:
+        case TextureFormatRGBA4444:
+            for ( ; (x + 8) <= width; x += 8 )
+            {
+                uint8x8x4_t pixels = vld4_u8(source + x * 4);
+                uint16x8_t value;
+                if ( format == TextureFormatRGB565 )
+                {
+                    value = vshlq_n_u16(vmovl_u8(vshr_n_u8(pixels.val[0], 3)),
+                                        11);
+                    value = vorrq_u16(value, vshlq_n_u16(
+                            vmovl_u8(vshr_n_u8(pixels.val[1], 2)), 5));
+                    value = vorrq_u16(value,
+                                      vmovl_u8(vshr_n_u8(pixels.val[2], 3)));
+                }
+                else
+                {
+                    value = vshlq_n_u16(vmovl_u8(vshr_n_u8(pixels.val[0], 4)),
+                                        12);
+                    value = vorrq_u16(value, vshlq_n_u16(
+                            vmovl_u8(vshr_n_u8(pixels.val[1], 4)), 8));
+                    value = vorrq_u16(value, vshlq_n_u16(
+                            vmovl_u8(vshr_n_u8(pixels.val[2], 4)), 4));
+                    value = vorrq_u16(value,
+                                      vmovl_u8(vshr_n_u8(pixels.val[3], 4)));
+                }
+                vst1q_u16((uint16_t*)(target + x * 2), value);
+            }
+            break;
+        case TextureFormatA8:
+            for ( ; (x + 16) <= width; x += 16 )
+            {
+                uint8x16x4_t pixels = vld4q_u8(source + x * 4);
+                vst1q_u8(target + x, pixels.val[3]);
+            }
+            break;
+        default:
+            break;
+    }
+#else
+    (void)source;
+    (void)target;
+    (void)width;
+    (void)format;
+#endif
+
+    return x;
+}
+
+static void ConvertRow(const uint8_t* source, uint8_t* target, int width,
+                       int y, TextureFormat format, int flags)
+{
+    bool premultiply = (flags & ConvertPremultiply) != 0;
+    bool dither = (flags & ConvertDither) != 0;
+    const uint8_t* thresholds = DitherMatrix[y & 3];
+
+    if ( (format == TextureFormatRGBA8888) && !premultiply )
+    {
+        // Conversion in place passes the same row
+        memmove(target, source, width * RGBAPixelSize);
+        return;
+    }
+
+    int x = 0;
+    if ( !premultiply && !dither )
+    {
+        x = ConvertRowSimd(source, target, width, format);
+    }
+
+    for ( ; x < width; x++ )
+    {
+        const uint8_t* pixel = source + x * RGBAPixelSize;
+        int r = pixel[0];
+        int g = pixel[1];
+        int b = pixel[2];
+        int a = pixel[3];
+        if ( premultiply )
+        {
+            r = Premultiply(r, a);
+            g = Premultiply(g, a);
+            b = Premultiply(b, a);
+        }
+
+        switch ( format )
+        {
+            case TextureFormatRGBA8888:
+            {
+                uint8_t* out = target + x * 4;
+                out[0] = r;
+                out[1] = g;
+                out[2] = b;
+                out[3] = a;
+                break;
+            }
+            case TextureFormatRGB888:
+            {
+                uint8_t* out = target + x * 3;
+                out[0] = r;
+                out[1] = g;
+                out[2] = b;
+                break;
+            }
+            case TextureFormatRGB565:
+            {
+                if ( dither )
+                {
+                    int threshold = thresholds[x & 3];
+                    r = Dither(r, threshold, 5);
+                    g = Dither(g, threshold, 6);
+                    b = Dither(b, threshold, 5);
+                }
+                uint16_t value = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+                memcpy(target + x * 2, &value, sizeof(value));
+                break;
+            }
+            case TextureFormatRGBA4444:
+            {
+                if ( dither )
+                {
+                    int threshold = thresholds[x & 3];
+                    r = Dither(r, threshold, 4);
+                    g = Dither(g, threshold, 4);
+                    b = Dither(b, threshold, 4);
+                    a = Dither(a, threshold, 4);
+                }
+                uint16_t value = ((r >> 4) << 12) | ((g >> 4) << 8) |
+                        ((b >> 4) << 4) | (a >> 4);
+                memcpy(target + x * 2, &value, sizeof(value));
+                break;
+            }
+            case TextureFormatLA88:
+                target[x * 2] = Luminance(r, g, b);
+                target[x * 2 + 1] = a;
+                break;
+            case TextureFormatL8:
+                target[x] = Luminance(r, g, b);
+                break;
+            case TextureFormatA8:
+                target[x] = a;
+                break;
+        }
+    }
+}
+
+void ConvertTextureData(const void* data, int width, int height,
+                        TextureFormat format, int flags, void* output)
+{
+    size_t sourcePitch = (size_t)width * RGBAPixelSize;
+    size_t targetPitch = (size_t)width * GetTextureFormatPixelSize(format);
+    bool flip = (flags & ConvertFlip) != 0;
+
+    for ( int y = 0; y < height; y++ )
+    {
+        int sourceRow = flip ? (height - 1 - y) : y;
+        ConvertRow((const uint8_t*)data + sourceRow * sourcePitch,
+                   (uint8_t*)output + y * targetPitch, width, y, format,
+                   flags);
+    }
+}
+
+bool ConvertTextureBuffer(void** data, int width, int height,
+                          TextureFormat format, int flags)
+{
+    if ( (format == TextureFormatRGBA8888) && (flags == 0) )
+    {
+        return true;
+    }
+
+    size_t size = (size_t)width * height * GetTextureFormatPixelSize(format);
+
+    if ( (flags & ConvertFlip) == 0 )
+    {
+        ConvertTextureData(*data, width, height, format, flags, *data);
+        if ( format != TextureFormatRGBA8888 )
+        {
+            // Keep the original buffer if shrinking fails
+            void* shrunk = realloc(*data, (size > 0) ? size : 1);
+            if ( shrunk != NULL )
+            {
+                *data = shrunk;
+            }
+        }
+        return true;
+    }
+
+    void* converted = malloc((size > 0) ? size : 1);
+    if ( converted == NULL )
+    {
+        return false;
+    }
+
+    ConvertTextureData(*data, width, height, format, flags, converted);
+    free(*data);
+    *data = converted;
+
+    return true;
+}
@@ -0,0 +1,466 @@
+#include <math.h>
+#include <algorithm>
+#include <queue>
+
+#include "TextureStreamer.h"
+#include "Camera.h"
+#include "MatrixOperations.h"
+#include "CommonFunctions.h"
+
+// The global texture streamer
+TextureStreamer g_textureStreamer;
+
+// Default upload limit per frame
+static const size_t DefaultMaxUploadBytes = 4 * 1024 * 1024;
+
+/** Whether the driver supports GL_TEXTURE_BASE_LEVEL. */
+static bool BaseLevelSupported()
+{
+    return (GetGLESMajorVersion() >= 3);
+}
+
+TextureStreamer::TextureStreamer(size_t budgetBytes)
+    : m_budgetBytes((budgetBytes > 0) ? budgetBytes : DefaultTextureBudget()),
+      m_maxUploadBytes(DefaultMaxUploadBytes),
+      m_residentBytes(0),
+      m_numBytesUploaded(0),
+      m_frame(0),
+      m_hasBaseLevel(false),
+      m_capsChecked(false)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    // The GL context is typically gone by now; just forget the textures
+    for ( EntryMap::iterator iter = m_entries.begin();
+          iter != m_entries.end(); iter++ )
+    {
+        delete iter->second;
+    }
+}
+
+TextureStreamer::Entry* TextureStreamer::FindEntry(
+        TextureHandle texture) const
+{
+    EntryMap::const_iterator iter = m_entries.find(texture.m_value);
+    return (iter != m_entries.end()) ? iter->second : NULL;
+}
+
+size_t TextureStreamer::GetLevelsSize(const Entry* entry, int level) const
+{
+    return entry->m_levelOffsets[entry->m_numLevels] -
+            entry->m_levelOffsets[level];
+}
+
+TextureHandle TextureStreamer::Add(const char* imageName, bool clamp,
+                                   TextureFormat format, int conversionFlags,
+                                   int initialSize)
+{
+    if ( !m_capsChecked )
+    {
+        m_hasBaseLevel = BaseLevelSupported();
+        m_capsChecked = true;
+    }
+
+    Entry* entry = new Entry;
+    if ( !g_textureDiskCache.Map(imageName, true, format, conversionFlags,
+                                 &entry->m_file) )
+    {
+        delete entry;
+        return TextureHandle();
+    }
+
+    const TextureCacheFileHeader* header =
+            (const TextureCacheFileHeader*)entry->m_file.GetData();
+    entry->m_header = header;
+    entry->m_clamp = clamp;
+    entry->m_numLevels = header->m_numLevels;
+    entry->m_minLevel = entry->m_numLevels - 1;
+    entry->m_requestedLevel = NoRequest;
+    entry->m_lastRequestFrame = m_frame;
+
+    size_t pixelSize = GetTextureFormatPixelSize(format);
+    int width = header->m_width;
+    int height = header->m_height;
+    size_t offset = 0;
+    for ( int level = 0; level < entry->m_numLevels; level++ )
+    {
+        if ( (width <= initialSize) && (height <= initialSize) &&
+             (level < entry->m_minLevel) )
+        {
+            entry->m_minLevel = level;
+        }
+
+        entry->m_levelOffsets.push_back(offset);
+        offset += (size_t)width * height * pixelSize;
+        width = (width > 1) ? (width / 2) : 1;
+        height = (height > 1) ? (height / 2) : 1;
+    }
+    entry->m_levelOffsets.push_back(offset);
+
+    // Nothing is resident until specified
+    entry->m_residentLevel = entry->m_numLevels;
+    entry->m_targetLevel = entry->m_minLevel;
+    if ( !Specify(entry, entry->m_minLevel) )
+    {
+        delete entry;
+        return TextureHandle();
+    }
+
+    m_entries[entry->m_texture.m_value] = entry;
+
+    return entry->m_texture;
+}
+
+void TextureStreamer::Remove(TextureHandle* texture)
+{
+    EntryMap::iterator iter = m_entries.find(texture->m_value);
+    if ( iter == m_entries.end() )
+    {
+        return;
+    }
+
+    Entry* entry = iter->second;
+    m_residentBytes -= GetLevelsSize(entry, entry->m_residentLevel);
+    g_resourceRegistry.Release(&entry->m_texture);
+    m_entries.erase(iter);
+    delete entry;
+
+    *texture = TextureHandle();
+}
+
+void TextureStreamer::Clear()
+{
+    for ( EntryMap::iterator iter = m_entries.begin();
+          iter != m_entries.end(); iter++ )
+    {
+        g_resourceRegistry.Release(&iter->second->m_texture);
+        delete iter->second;
+    }
+
+    m_entries.clear();
+    m_residentBytes = 0;
+    m_capsChecked = false;
+}
+
+void TextureStreamer::SetBudget(size_t budgetBytes)
+{
+    m_budgetBytes = (budgetBytes > 0) ? budgetBytes : DefaultTextureBudget();
+}
+
+int TextureStreamer::GetResidentLevel(TextureHandle texture) const
+{
+    const Entry* entry = FindEntry(texture);
+    return (entry != NULL) ? entry->m_residentLevel : -1;
+}
+
+void TextureStreamer::RequestLevel(TextureHandle texture, int level)
+{
+    Entry* entry = FindEntry(texture);
+    if ( (entry != NULL) && (level < entry->m_requestedLevel) )
+    {
+        entry->m_requestedLevel = level;
+    }
+}
+
+void TextureStreamer::RequestLevel(TextureHandle texture, Camera* camera,
+                                   const float* center, float radius,
+                                   int viewportHeight)
+{
+    const Entry* entry = FindEntry(texture);
+    if ( entry == NULL )
+    {
+        return;
+    }
+
+    int textureSize = std::max(entry->m_header->m_width,
+                               entry->m_header->m_height);
+    RequestLevel(texture, EstimateLevel(textureSize, camera, center, radius,
+                                        viewportHeight));
+}
+
+int TextureStreamer::EstimateLevel(int textureSize, Camera* camera,
+                                   const float* center, float radius,
+                                   int viewportHeight)
+{
+    float viewCenter[3];
+    Transformv3(camera->GetInverseCameraMatrix(), center, viewCenter);
+
+    // Clip space w of the center; the distance along the view direction
+    // for a perspective projection, 1 for an orthographic one
+    const float* projection = camera->GetProjectionMatrix();
+    float w = viewCenter[2] * projection[11] + projection[15];
+    if ( w <= radius * fabsf(projection[11]) )
+    {
+        return 0;
+    }
+
+    // Diameter of the bounds on screen, at least a pixel
+    float screenSize = radius * projection[5] * viewportHeight / w;
+    if ( screenSize < 1.0 )
+    {
+        screenSize = 1.0;
+    }
+
+    float level = log2f(textureSize / screenSize);
+
+    return (level > 0.0) ? (int)level : 0;
+}
+
+void TextureStreamer::UploadLevel(const Entry* entry, int level, int glLevel)
+{
+    TextureFormat format = (TextureFormat)entry->m_header->m_format;
+    GLenum glFormat, glType;
+    GetTextureFormatGL(format, &glFormat, &glType);
+
+    int width = std::max((int)entry->m_header->m_width >> level, 1);
+    int height = std::max((int)entry->m_header->m_height >> level, 1);
+    const uint8_t* data = (const uint8_t*)entry->m_file.GetData() +
+            entry->m_header->m_dataOffset + entry->m_levelOffsets[level];
+
+    glTexImage2D(GL_TEXTURE_2D, glLevel, glFormat, width, height, 0,
+                 glFormat, glType, data);
+
+    m_numBytesUploaded += entry->m_levelOffsets[level + 1] -
+            entry->m_levelOffsets[level];
+}
+
+void TextureStreamer::SetResidentLevel(Entry* entry, int level)
+{
+    m_residentBytes -= GetLevelsSize(entry, entry->m_residentLevel);
+    m_residentBytes += GetLevelsSize(entry, level);
+    entry->m_residentLevel = level;
+}
+
+bool TextureStreamer::Specify(Entry* entry, int level)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    // Rows of the smaller formats are not padded to 4 bytes
+    ScopedUnpackAlignment unpackAlignment(1);
+
+    // With a base level the levels keep their indices; otherwise the
+    // first resident level becomes level 0
+    int firstGlLevel = m_hasBaseLevel ? level : 0;
+    for ( int i = level; i < entry->m_numLevels; i++ )
+    {
+        UploadLevel(entry, i, firstGlLevel + i - level);
+    }
+
+    if ( m_hasBaseLevel )
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                        entry->m_numLevels - 1);
+    }
+
+    SetTextureFiltering(GL_TEXTURE_2D, (entry->m_numLevels > 1), false, 1.0);
+    GLint wrap = entry->m_clamp ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+
+    int glError = glGetError();
+    if ( glError != GL_NO_ERROR )
+    {
+        LOG_DEBUG("TextureStreamer: GL error: 0x%x", glError);
+        glDeleteTextures(1, &texture);
+        return false;
+    }
+
+    // Swap the new texture in behind the existing handle, if any
+    if ( entry->m_texture.IsNull() )
+    {
+        entry->m_texture = g_resourceRegistry.AdoptTexture(texture);
+    }
+    else if ( !g_resourceRegistry.Replace(entry->m_texture, texture) )
+    {
+        glDeleteTextures(1, &texture);
+        return false;
+    }
+
+    SetResidentLevel(entry, level);
+
+    return true;
+}
+
+void TextureStreamer::ApplyBudget()
+{
+    size_t totalBytes = 0;
+    for ( EntryMap::iterator iter = m_entries.begin();
+          iter != m_entries.end(); iter++ )
+    {
+        totalBytes += GetLevelsSize(iter->second, iter->second->m_targetLevel);
+    }
+
+    if ( totalBytes <= m_budgetBytes )
+    {
+        return;
+    }
+
+    // Textures not requested this frame lose their detail first, the least
+    // recently requested first
+    std::vector<Entry*> idle;
+    for ( EntryMap::iterator iter = m_entries.begin();
+          iter != m_entries.end(); iter++ )
+    {
+        Entry* entry = iter->second;
+        if ( (entry->m_lastRequestFrame != m_frame) &&
+             (entry->m_targetLevel < entry->m_minLevel) )
+        {
+            idle.push_back(entry);
+        }
+    }
+
+    std::sort(idle.begin(), idle.end(), [](Entry* a, Entry* b) {
+        return (a->m_lastRequestFrame < b->m_lastRequestFrame);
+    });
+
+    for ( size_t i = 0; (i < idle.size()) && (totalBytes > m_budgetBytes);
+          i++ )
+    {
+        Entry* entry = idle[i];
+        totalBytes -= GetLevelsSize(entry, entry->m_targetLevel) -
+                GetLevelsSize(entry, entry->m_minLevel);
+        entry->m_targetLevel = entry->m_minLevel;
+    }
+
+    // Then drop the largest levels until the rest fit
+    typedef std::pair<size_t, Entry*> Candidate;
+    std::priority_queue<Candidate> candidates;
+    for ( EntryMap::iterator iter = m_entries.begin();
+          iter != m_entries.end(); iter++ )
+    {
+        Entry* entry = iter->second;
+        if ( entry->m_targetLevel < entry->m_minLevel )
+        {
+            int level = entry->m_targetLevel;
+            candidates.push(Candidate(entry->m_levelOffsets[level + 1] -
+                                      entry->m_levelOffsets[level], entry));
+        }
+    }
+
+    while ( (totalBytes > m_budgetBytes) && !candidates.empty() )
+    {
+        Candidate candidate = candidates.top();
+        candidates.pop();
+
+        Entry* entry = candidate.second;
+        totalBytes -= candidate.first;
+        entry->m_targetLevel++;
+
+        int level = entry->m_targetLevel;
+        if ( level < entry->m_minLevel )
+        {
+            candidates.push(Candidate(entry->m_levelOffsets[level + 1] -
+                                      entry->m_levelOffsets[level], entry));
+        }
+    }
+}
+
+void TextureStreamer::Update()
+{
+    m_numBytesUploaded = 0;
+
+    // Textures not requested this frame keep streaming towards their
+    // previous target
+    for ( EntryMap::iterator iter = m_entries.begin();
+          iter != m_entries.end(); iter++ )
+    {
+        Entry* entry = iter->second;
+        if ( entry->m_requestedLevel != NoRequest )
+        {
+            entry->m_targetLevel = std::min(std::max(entry->m_requestedLevel,
+                                                     0), entry->m_minLevel);
+            entry->m_lastRequestFrame = m_frame;
+            entry->m_requestedLevel = NoRequest;
+        }
+    }
+
+    ApplyBudget();
+
+    // The textures are bound on texture unit 0, as in Specify()
+    glActiveTexture(GL_TEXTURE0);
+
+    // Drop levels first, so that their memory is free for the uploads
+    std::vector<Entry*> loads;
+    for ( EntryMap::iterator iter = m_entries.begin();
+          iter != m_entries.end(); iter++ )
+    {
+        Entry* entry = iter->second;
+        if ( entry->m_targetLevel < entry->m_residentLevel )
+        {
+            loads.push_back(entry);
+        }
+        else if ( entry->m_targetLevel > entry->m_residentLevel )
+        {
+            if ( !m_hasBaseLevel )
+            {
+                Specify(entry, entry->m_targetLevel);
+                continue;
+            }
+
+            // Zero sized levels free their storage
+            TextureFormat format = (TextureFormat)entry->m_header->m_format;
+            GLenum glFormat, glType;
+            GetTextureFormatGL(format, &glFormat, &glType);
+
+            glBindTexture(GL_TEXTURE_2D,
+                          g_resourceRegistry.Get(entry->m_texture));
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL,
+                            entry->m_targetLevel);
+            for ( int level = entry->m_residentLevel;
+                  level < entry->m_targetLevel; level++ )
+            {
+                glTexImage2D(GL_TEXTURE_2D, level, glFormat, 0, 0, 0,
+                             glFormat, glType, NULL);
+            }
+            SetResidentLevel(entry, entry->m_targetLevel);
+        }
+    }
+
+    // Stream in the textures furthest from their target first
+    std::sort(loads.begin(), loads.end(), [](Entry* a, Entry* b) {
+        return ((a->m_residentLevel - a->m_targetLevel) >
+                (b->m_residentLevel - b->m_targetLevel));
+    });
+
+    ScopedUnpackAlignment unpackAlignment(1);
+
+    for ( size_t i = 0; i < loads.size(); i++ )
+    {
+        Entry* entry = loads[i];
+
+        // A level at a time with a base level; the whole chain down to the
+        // target when re-specifying, as that uploads every level anyway
+        int level = m_hasBaseLevel ? (entry->m_residentLevel - 1) :
+                entry->m_targetLevel;
+        size_t uploadBytes = m_hasBaseLevel ?
+                (entry->m_levelOffsets[level + 1] -
+                 entry->m_levelOffsets[level]) :
+                GetLevelsSize(entry, level);
+        if ( (m_numBytesUploaded > 0) &&
+             (m_numBytesUploaded + uploadBytes > m_maxUploadBytes) )
+        {
+            continue;
+        }
+
+        if ( !m_hasBaseLevel )
+        {
+            Specify(entry, level);
+            continue;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, g_resourceRegistry.Get(entry->m_texture));
+        UploadLevel(entry, level, level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        SetResidentLevel(entry, level);
+    }
+
+    LOG_GL_ERROR();
+
+    m_frame++;
+}
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <atomic>
+
+#include "ThreadPool.h"
+
+ThreadPool g_threadPool;
+
+// Shared between the participants of a ParallelFor()
+struct ParallelForState
+{
+    ParallelForState(int count, const std::function<void(int)>& function)
+        : m_function(function),
+          m_count(count),
+          m_nextIndex(0),
+          m_numCompleted(0) {}
+
+    // Runs iterations until none are left
+    void Run()
+    {
+        int index;
+        while ( (index = m_nextIndex.fetch_add(1)) < m_count )
+        {
+            m_function(index);
+            if ( (m_numCompleted.fetch_add(1) + 1) == m_count )
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_condition.notify_all();
+            }
+        }
+    }
+
+    std::function<void(int)> m_function;
+    int m_count;
+    std::atomic<int> m_nextIndex;
+    std::atomic<int> m_numCompleted;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+};
+
+ThreadPool::ThreadPool(int numThreads)
+    : m_numThreads(numThreads),
+      m_started(false),
+      m_stopping(false)
+{
+    if ( m_numThreads <= 0 )
+    {
+        m_numThreads = std::thread::hardware_concurrency();
+        if ( m_numThreads <= 0 )
+        {
+            m_numThreads = 1;
+        }
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+
+    for ( size_t i = 0; i < m_threads.size(); i++ )
+    {
+        m_threads[i].join();
+    }
+}
+
+void ThreadPool::Start()
+{
+    // Called with m_mutex held
+    for ( int i = 0; i < m_numThreads; i++ )
+    {
+        m_threads.push_back(std::thread(&ThreadPool::WorkerMain, this));
+    }
+    m_started = true;
+}
+
+void ThreadPool::Enqueue(const std::function<void()>& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if ( !m_started )
+        {
+            Start();
+        }
+        m_tasks.push_back(task);
+    }
+    m_condition.notify_one();
+}
+
+void ThreadPool::ParallelFor(int count,
+                             const std::function<void(int)>& function)
+{
+    if ( count <= 0 )
+    {
+        return;
+    }
+
+    // The helpers may outlive this call if they start after the work ran out
+    std::shared_ptr<ParallelForState> state =
+            std::make_shared<ParallelForState>(count, function);
+
+    int numHelpers = std::min(count - 1, m_numThreads);
+    for ( int i = 0; i < numHelpers; i++ )
+    {
+        Enqueue(std::function<void()>([state]() { state->Run(); }));
+    }
+
+    state->Run();
+
+    std::unique_lock<std::mutex> lock(state->m_mutex);
+    while ( state->m_numCompleted.load() < count )
+    {
+        state->m_condition.wait(lock);
+    }
+}
+
+void ThreadPool::WorkerMain()
+{
+    while ( true )
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while ( !m_stopping && m_tasks.empty() )
+            {
+                m_condition.wait(lock);
+            }
+            if ( m_tasks.empty() )
+            {
+                // Stopping
+                return;
+            }
+            task = m_tasks.front();
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
+}
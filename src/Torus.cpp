@@ -6,13 +6,13 @@
 Torus::~Torus()
 {
     // Release all OpenGL resources
-    glDeleteBuffers(1, &m_vertexBuffer);
-    glDeleteBuffers(1, &m_indexBuffer);
+    g_resourceRegistry.Release(&m_vertexBuffer);
+    g_resourceRegistry.Release(&m_indexBuffer);
 }
 
 Torus::Torus()
-    : m_vertexBuffer(0),
-      m_indexBuffer(0),
+    : m_vertexBuffer(),
+      m_indexBuffer(),
       m_numIndices(0)
 {
 }
@@ -87,11 +87,12 @@ bool Torus::Setup(int numRotateDivides, int numCircleDivides,
     }
     
     // Create vertex/index buffers
-    glGenBuffers(1, &m_vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    m_vertexBuffer = g_resourceRegistry.CreateBuffer();
+    glBindBuffer(GL_ARRAY_BUFFER, g_resourceRegistry.Get(m_vertexBuffer));
     
-    glGenBuffers(1, &m_indexBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    m_indexBuffer = g_resourceRegistry.CreateBuffer();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                 g_resourceRegistry.Get(m_indexBuffer));
     
     // Upload geometry
     glBufferData(GL_ARRAY_BUFFER, numCoords * sizeof(VertexAttribsCoordsOnly),
@@ -111,8 +112,9 @@ void Torus::Render(bool filled)
     glDisableVertexAttribArray(TEXCOORD_INDEX);
     glDisableVertexAttribArray(NORMAL_INDEX);
     
-    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, g_resourceRegistry.Get(m_vertexBuffer));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                 g_resourceRegistry.Get(m_indexBuffer));
     
     glVertexAttribPointer(COORD_INDEX, 3, GL_FLOAT, GL_FALSE,
                           sizeof(VertexAttribsCoordsOnly),
@@ -0,0 +1,567 @@
+#include <string.h>
+
+#include "WidgetBatch.h"
+#include "Container.h"
+#include "CommonFunctions.h"
+#include "MatrixOperations.h"
+
+namespace CommonGL {
+
+// Most quads addressable with 16-bit indices
+static const int MaxQuads = 65536 / 4;
+
+// Highlight of the pressed widget
+static const float Highlight[] = { 0.2, 0.2, 0.2 };
+static const float NoHighlight[] = { 0.0, 0.0, 0.0 };
+
+WidgetBatch::WidgetBatch()
+    : m_numQuads(0),
+      m_indexCapacity(0),
+      m_valid(false),
+      m_pressedWidget(NULL),
+      m_viewportWidth(0),
+      m_viewportHeight(0),
+      m_currentProgram(0),
+      m_renderTargetPool(NULL),
+      m_numDrawCalls(0),
+      m_numBuilds(0),
+      m_numCacheRenders(0)
+{
+}
+
+WidgetBatch::~WidgetBatch()
+{
+    Release();
+}
+
+void WidgetBatch::Release()
+{
+    g_resourceRegistry.Release(&m_vertexBuffer);
+    g_resourceRegistry.Release(&m_indexBuffer);
+    m_indexCapacity = 0;
+    m_valid = false;
+
+    for ( CacheMap::iterator iter = m_caches.begin();
+          iter != m_caches.end(); iter++ )
+    {
+        ReleaseCache(iter->second);
+    }
+    m_caches.clear();
+}
+
+void WidgetBatch::ReleaseCache(Cache& cache)
+{
+    if ( (cache.m_target != NULL) && (m_renderTargetPool != NULL) )
+    {
+        m_renderTargetPool->Release(cache.m_target);
+        cache.m_target = NULL;
+    }
+    delete cache.m_batch;
+    cache.m_batch = NULL;
+}
+
+Container* WidgetBatch::FindCachedContainer(BaseWidget* widget) const
+{
+    if ( m_renderTargetPool == NULL )
+    {
+        return NULL;
+    }
+
+    // The topmost cached container wins
+    Container* container = NULL;
+    for ( ; widget != NULL; widget = widget->m_parent )
+    {
+        if ( widget->m_type == BaseWidget::TypeContainer )
+        {
+            Container* candidate = (Container*)widget;
+            if ( candidate->m_cached && candidate->IsVisible() )
+            {
+                container = candidate;
+            }
+        }
+    }
+
+    return container;
+}
+
+void WidgetBatch::InvalidateCaches()
+{
+    for ( CacheMap::iterator iter = m_caches.begin();
+          iter != m_caches.end(); iter++ )
+    {
+        iter->second.m_dirty = true;
+    }
+    m_valid = false;
+}
+
+void WidgetBatch::UpdateCaches(const std::list<BaseWidget*>& widgets,
+                               WidgetContext* context)
+{
+    for ( CacheMap::iterator iter = m_caches.begin();
+          iter != m_caches.end(); iter++ )
+    {
+        iter->second.m_used = false;
+    }
+
+    std::list<BaseWidget*>::const_iterator iter;
+    for ( iter = widgets.begin(); iter != widgets.end(); iter++ )
+    {
+        BaseWidget* widget = *iter;
+        if ( FindCachedContainer(widget) != widget )
+        {
+            continue;
+        }
+
+        CacheMap::iterator cacheIter = m_caches.find(widget);
+        if ( cacheIter == m_caches.end() )
+        {
+            Cache cache;
+            cache.m_batch = NULL;
+            cache.m_target = NULL;
+            cache.m_pressedWidget = NULL;
+            cache.m_viewportWidth = 0;
+            cache.m_viewportHeight = 0;
+            cache.m_dirty = true;
+            cacheIter = m_caches.insert(std::make_pair(widget, cache)).first;
+        }
+        cacheIter->second.m_used = true;
+        UpdateCache((Container*)widget, cacheIter->second, widgets, context);
+    }
+
+    // Give back the renderings of containers no longer cached
+    CacheMap::iterator cacheIter = m_caches.begin();
+    while ( cacheIter != m_caches.end() )
+    {
+        if ( !cacheIter->second.m_used )
+        {
+            ReleaseCache(cacheIter->second);
+            m_caches.erase(cacheIter++);
+        }
+        else
+        {
+            cacheIter++;
+        }
+    }
+}
+
+void WidgetBatch::UpdateCache(Container* container, Cache& cache,
+                              const std::list<BaseWidget*>& widgets,
+                              WidgetContext* context)
+{
+    const Rect& rect = container->TransformedRect();
+    RenderTargetDesc desc;
+    desc.m_width = rect.GetWidth();
+    desc.m_height = rect.GetHeight();
+    desc.m_colorFormat = ColorFormatRGBA8888;
+    desc.m_depthFormat = DepthFormatNone;
+
+    // A resized container needs a new target
+    if ( (cache.m_target != NULL) && !(cache.m_target->m_desc == desc) )
+    {
+        m_renderTargetPool->Release(cache.m_target);
+        cache.m_target = NULL;
+    }
+
+    if ( (desc.m_width <= 0) || (desc.m_height <= 0) )
+    {
+        return;
+    }
+
+    // The highlight of a pressed widget within the container is part of
+    // the rendering
+    BaseWidget* pressedWidget = context->m_pressedWidget;
+    if ( FindCachedContainer(pressedWidget) != container )
+    {
+        pressedWidget = NULL;
+    }
+
+    if ( (cache.m_target != NULL) && !cache.m_dirty &&
+         !container->m_cacheDirty &&
+         (cache.m_pressedWidget == pressedWidget) &&
+         (cache.m_viewportWidth == context->m_viewportWidth) &&
+         (cache.m_viewportHeight == context->m_viewportHeight) )
+    {
+        return;
+    }
+
+    if ( cache.m_target == NULL )
+    {
+        cache.m_target = m_renderTargetPool->Acquire(desc);
+        if ( cache.m_target == NULL )
+        {
+            // Out of budget; drawn uncached
+            return;
+        }
+    }
+
+    // The container and the widgets within it, topmost first; drawn
+    // without caching any containers within
+    std::list<BaseWidget*> cachedWidgets;
+    std::list<BaseWidget*>::const_iterator iter;
+    for ( iter = widgets.begin(); iter != widgets.end(); iter++ )
+    {
+        if ( FindCachedContainer(*iter) == container )
+        {
+            cachedWidgets.push_back(*iter);
+        }
+    }
+
+    if ( cache.m_batch == NULL )
+    {
+        cache.m_batch = new WidgetBatch();
+    }
+    cache.m_batch->Build(cachedWidgets, context);
+    RenderCache(container, cache, context);
+
+    container->m_cacheDirty = false;
+    cache.m_dirty = false;
+    cache.m_pressedWidget = pressedWidget;
+    cache.m_viewportWidth = context->m_viewportWidth;
+    cache.m_viewportHeight = context->m_viewportHeight;
+}
+
+void WidgetBatch::RenderCache(Container* container, Cache& cache,
+                              WidgetContext* context)
+{
+    const Rect& rect = container->TransformedRect();
+    const RenderTarget* target = cache.m_target;
+
+    // Don't disturb the caller's framebuffer binding or clear color
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    GLfloat clearColor[4] = { 0.0, 0.0, 0.0, 0.0 };
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target->m_framebuffer);
+    glViewport(0, 0, target->m_desc.m_width, target->m_desc.m_height);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // Project the container's area of the viewport onto the target
+    int halfWidth = context->m_viewportWidth / 2;
+    int halfHeight = context->m_viewportHeight / 2;
+    float projectionMatrix[16];
+    MatrixOrthographicProjection(projectionMatrix,
+                                 rect.m_left - halfWidth,
+                                 rect.m_right - halfWidth,
+                                 halfHeight - rect.m_bottom,
+                                 halfHeight - rect.m_top,
+                                 -halfWidth, halfWidth);
+
+    // Store premultiplied colors, so that the rendering can be blended as
+    // the widgets would have been
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                        GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    cache.m_batch->Draw(context, projectionMatrix);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(0, 0, context->m_viewportWidth, context->m_viewportHeight);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    m_numCacheRenders++;
+}
+
+bool WidgetBatch::Update(const std::list<BaseWidget*>& widgets,
+                         WidgetContext* context)
+{
+    if ( m_valid && !context->m_widgetsChanged &&
+         (context->m_pressedWidget == m_pressedWidget) &&
+         (context->m_viewportWidth == m_viewportWidth) &&
+         (context->m_viewportHeight == m_viewportHeight) )
+    {
+        return false;
+    }
+
+    Build(widgets, context);
+    context->m_widgetsChanged = false;
+
+    return true;
+}
+
+void WidgetBatch::AddQuad(const WidgetQuad& quad, bool highlight,
+                          bool premultiplied, const WidgetContext* context)
+{
+    // Extend the current run if the quad draws alike
+    bool textured = (quad.m_texture != 0);
+    Run* run = m_runs.empty() ? NULL : &m_runs.back();
+    if ( (run == NULL) || (run->m_widget != NULL) ||
+         (run->m_texture != quad.m_texture) ||
+         (textured && (run->m_highlight != highlight)) ||
+         (run->m_premultiplied != premultiplied) ||
+         (!textured &&
+          (memcmp(run->m_color, quad.m_color, sizeof(quad.m_color)) != 0)) )
+    {
+        Run newRun;
+        newRun.m_widget = NULL;
+        newRun.m_texture = quad.m_texture;
+        newRun.m_highlight = highlight;
+        newRun.m_premultiplied = premultiplied;
+        memcpy(newRun.m_color, quad.m_color, sizeof(quad.m_color));
+        newRun.m_firstQuad = m_numQuads;
+        newRun.m_numQuads = 0;
+        m_runs.push_back(newRun);
+        run = &m_runs.back();
+    }
+
+    // Adjust x/y according to viewport size so that 0,0 is upper left,
+    // as DrawImage2D() does
+    const Rect& rect = quad.m_rect;
+    float width = rect.GetWidth();
+    float height = rect.GetHeight();
+    float x = rect.m_left - context->m_viewportWidth / 2;
+    float y = -rect.m_top + (context->m_viewportHeight / 2) - height;
+
+    VertexAttribsTexCoords vertices[] = {
+        { x, y + height, 0,         quad.m_u1, quad.m_v1 },
+        { x, y, 0,                  quad.m_u1, quad.m_v2 },
+        { x + width, y, 0,          quad.m_u2, quad.m_v2 },
+        { x + width, y + height, 0, quad.m_u2, quad.m_v1 }
+    };
+    m_vertices.insert(m_vertices.end(), vertices, vertices + 4);
+
+    run->m_numQuads++;
+    m_numQuads++;
+}
+
+void WidgetBatch::Build(const std::list<BaseWidget*>& widgets,
+                        WidgetContext* context)
+{
+    m_runs.clear();
+    m_vertices.clear();
+    m_numQuads = 0;
+
+    UpdateCaches(widgets, context);
+
+    // Bottommost first
+    std::list<BaseWidget*>::const_reverse_iterator iter;
+    for ( iter = widgets.rbegin(); iter != widgets.rend(); iter++ )
+    {
+        BaseWidget* widget = *iter;
+        if ( !widget->IsVisible() )
+        {
+            continue;
+        }
+
+        // Widgets within a rendered cached container are drawn by it
+        CacheMap::const_iterator cacheIter =
+                m_caches.find(FindCachedContainer(widget));
+        if ( cacheIter != m_caches.end() )
+        {
+            const Cache& cache = cacheIter->second;
+            Container* container = (Container*)cacheIter->first;
+            if ( (cache.m_target != NULL) && (m_numQuads < MaxQuads) )
+            {
+                if ( widget == container )
+                {
+                    WidgetQuad quad;
+                    quad.m_rect = container->TransformedRect();
+                    quad.m_texture = cache.m_target->m_colorTexture;
+                    quad.m_u1 = 0.0;
+                    quad.m_v1 = 1.0;
+                    quad.m_u2 = 1.0;
+                    quad.m_v2 = 0.0;
+                    AddQuad(quad, false, true, context);
+                }
+                continue;
+            }
+        }
+
+        WidgetQuad quad;
+        if ( (m_numQuads < MaxQuads) && widget->GetQuad(&quad) )
+        {
+            AddQuad(quad, (widget == context->m_pressedWidget), false,
+                    context);
+        }
+        else
+        {
+            Run run;
+            memset(&run, 0, sizeof(run));
+            run.m_widget = widget;
+            m_runs.push_back(run);
+        }
+    }
+
+    if ( m_numQuads > 0 )
+    {
+        if ( m_vertexBuffer.IsNull() )
+        {
+            m_vertexBuffer = g_resourceRegistry.CreateBuffer();
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, g_resourceRegistry.Get(m_vertexBuffer));
+        glBufferData(GL_ARRAY_BUFFER,
+                     m_vertices.size() * sizeof(VertexAttribsTexCoords),
+                     &m_vertices[0], GL_STATIC_DRAW);
+    }
+
+    // The indices of a quad are those of g_rectangleIndexBuffer; grow the
+    // buffer in powers of two
+    if ( m_numQuads > m_indexCapacity )
+    {
+        int capacity = 64;
+        while ( capacity < m_numQuads )
+        {
+            capacity *= 2;
+        }
+
+        std::vector<GLushort> indices(capacity * 6);
+        for ( int i = 0; i < capacity; i++ )
+        {
+            GLushort base = i * 4;
+            GLushort* quadIndices = &indices[i * 6];
+            quadIndices[0] = base;
+            quadIndices[1] = base + 1;
+            quadIndices[2] = base + 3;
+            quadIndices[3] = base + 3;
+            quadIndices[4] = base + 1;
+            quadIndices[5] = base + 2;
+        }
+
+        if ( m_indexBuffer.IsNull() )
+        {
+            m_indexBuffer = g_resourceRegistry.CreateBuffer();
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                     g_resourceRegistry.Get(m_indexBuffer));
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                     indices.size() * sizeof(GLushort), &indices[0],
+                     GL_STATIC_DRAW);
+        m_indexCapacity = capacity;
+    }
+
+    m_valid = true;
+    m_pressedWidget = context->m_pressedWidget;
+    m_viewportWidth = context->m_viewportWidth;
+    m_viewportHeight = context->m_viewportHeight;
+    m_numBuilds++;
+}
+
+void WidgetBatch::SetupBuffers()
+{
+    glDisable(GL_DEPTH_TEST);
+    glDisableVertexAttribArray(NORMAL_INDEX);
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_resourceRegistry.Get(m_vertexBuffer));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                 g_resourceRegistry.Get(m_indexBuffer));
+
+    glVertexAttribPointer(COORD_INDEX, 3, GL_FLOAT, GL_FALSE,
+                          sizeof(VertexAttribsTexCoords),
+                          (const GLvoid*)offsetof(VertexAttribsTexCoords, x));
+    glVertexAttribPointer(TEXCOORD_INDEX, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(VertexAttribsTexCoords),
+                          (const GLvoid*)offsetof(VertexAttribsTexCoords, u));
+}
+
+void WidgetBatch::UseProgram(WidgetContext* context, GLuint program,
+                             const float* mvpMatrix)
+{
+    if ( program == m_currentProgram )
+    {
+        return;
+    }
+
+    glUseProgram(program);
+    if ( program == context->m_textureShaderProgram )
+    {
+        glUniformMatrix4fv(context->m_textureShaderMvpLoc, 1, GL_FALSE,
+                           mvpMatrix);
+        glUniform1i(context->m_textureShaderTextureLoc, 0);
+    }
+    else
+    {
+        glUniformMatrix4fv(context->m_colorShaderMvpLoc, 1, GL_FALSE,
+                           mvpMatrix);
+    }
+    m_currentProgram = program;
+}
+
+void WidgetBatch::Draw(WidgetContext* context, const float* mvpMatrix)
+{
+    m_numDrawCalls = 0;
+    m_currentProgram = 0;
+    bool buffersSet = false;
+
+    // Textures may have been bound since the last frame
+    glActiveTexture(GL_TEXTURE0);
+    context->m_boundTexture = 0;
+
+    for ( size_t i = 0; i < m_runs.size(); i++ )
+    {
+        const Run& run = m_runs[i];
+
+        if ( run.m_widget != NULL )
+        {
+            BaseWidget* widget = run.m_widget;
+            if ( widget->m_type == BaseWidget::TypeButton )
+            {
+                UseProgram(context, context->m_textureShaderProgram,
+                           mvpMatrix);
+                glUniform3fv(context->m_textureShaderHighlightLoc, 1,
+                             (widget == context->m_pressedWidget) ?
+                             Highlight : NoHighlight);
+            }
+            else
+            {
+                UseProgram(context, context->m_colorShaderProgram,
+                           mvpMatrix);
+            }
+
+            // The widget sets up the buffers and binds textures its own way,
+            // possibly also selecting another program or texture unit; none
+            // of the state cached here holds afterwards
+            widget->Render();
+            buffersSet = false;
+            m_currentProgram = 0;
+            glActiveTexture(GL_TEXTURE0);
+            context->m_boundTexture = 0;
+            m_numDrawCalls++;
+            continue;
+        }
+
+        if ( !buffersSet )
+        {
+            SetupBuffers();
+            buffersSet = true;
+        }
+
+        if ( run.m_premultiplied )
+        {
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        }
+
+        if ( run.m_texture != 0 )
+        {
+            UseProgram(context, context->m_textureShaderProgram, mvpMatrix);
+            glUniform3fv(context->m_textureShaderHighlightLoc, 1,
+                         run.m_highlight ? Highlight : NoHighlight);
+            if ( context->m_boundTexture != run.m_texture )
+            {
+                glBindTexture(GL_TEXTURE_2D, run.m_texture);
+                context->m_boundTexture = run.m_texture;
+            }
+        }
+        else
+        {
+            UseProgram(context, context->m_colorShaderProgram, mvpMatrix);
+            glUniform4fv(context->m_colorShaderColorLoc, 1, run.m_color);
+        }
+
+        glDrawElements(GL_TRIANGLES, run.m_numQuads * 6, GL_UNSIGNED_SHORT,
+                       (const GLvoid*)(run.m_firstQuad * 6 *
+                                       sizeof(GLushort)));
+        m_numDrawCalls++;
+
+        if ( run.m_premultiplied )
+        {
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+    }
+
+    if ( buffersSet )
+    {
+        glEnableVertexAttribArray(NORMAL_INDEX);
+        glEnable(GL_DEPTH_TEST);
+    }
+}
+
+} // namespace CommonGL
@@ -0,0 +1,188 @@
+#include <algorithm>
+
+#include "WidgetGrid.h"
+#include "BaseWidget.h"
+
+namespace CommonGL {
+
+// Width and height of a grid cell (in pixels)
+static const int CellSize = 64;
+
+WidgetGrid::WidgetGrid()
+    : m_cells(1),
+      m_numColumns(1),
+      m_numRows(1),
+      m_nextOrder(0)
+{
+}
+
+WidgetGrid::~WidgetGrid()
+{
+}
+
+void WidgetGrid::SetSize(int width, int height)
+{
+    m_numColumns = std::max((width + CellSize - 1) / CellSize, 1);
+    m_numRows = std::max((height + CellSize - 1) / CellSize, 1);
+    m_cells.assign(m_numColumns * m_numRows, Cell());
+
+    for ( EntryMap::iterator iter = m_entries.begin();
+          iter != m_entries.end(); iter++ )
+    {
+        if ( iter->second.m_inCells )
+        {
+            iter->second.m_inCells = false;
+            Insert((BaseWidget*)iter->first, iter->second);
+        }
+    }
+}
+
+void WidgetGrid::GetCellRange(const Rect& rect, int* col1, int* row1,
+                              int* col2, int* row2) const
+{
+    *col1 = std::min(std::max(rect.m_left / CellSize, 0), m_numColumns - 1);
+    *row1 = std::min(std::max(rect.m_top / CellSize, 0), m_numRows - 1);
+    *col2 = std::min(std::max(rect.m_right / CellSize, 0), m_numColumns - 1);
+    *row2 = std::min(std::max(rect.m_bottom / CellSize, 0), m_numRows - 1);
+}
+
+int WidgetGrid::GetCellIndex(int x, int y) const
+{
+    int col = std::min(std::max(x / CellSize, 0), m_numColumns - 1);
+    int row = std::min(std::max(y / CellSize, 0), m_numRows - 1);
+
+    return row * m_numColumns + col;
+}
+
+void WidgetGrid::Insert(BaseWidget* widget, Entry& entry)
+{
+    // Cells are kept in z order, bottommost first
+    CellItem item;
+    item.m_order = entry.m_order;
+    item.m_widget = widget;
+    item.m_rect = entry.m_rect;
+    int col1, row1, col2, row2;
+    GetCellRange(entry.m_rect, &col1, &row1, &col2, &row2);
+    for ( int row = row1; row <= row2; row++ )
+    {
+        for ( int col = col1; col <= col2; col++ )
+        {
+            Cell& cell = m_cells[row * m_numColumns + col];
+            cell.insert(std::upper_bound(cell.begin(), cell.end(), item),
+                        item);
+        }
+    }
+    entry.m_inCells = true;
+}
+
+void WidgetGrid::Erase(const BaseWidget* widget, Entry& entry)
+{
+    if ( !entry.m_inCells )
+    {
+        return;
+    }
+
+    CellItem item;
+    item.m_order = entry.m_order;
+    int col1, row1, col2, row2;
+    GetCellRange(entry.m_rect, &col1, &row1, &col2, &row2);
+    for ( int row = row1; row <= row2; row++ )
+    {
+        for ( int col = col1; col <= col2; col++ )
+        {
+            Cell& cell = m_cells[row * m_numColumns + col];
+            Cell::iterator iter = std::lower_bound(cell.begin(), cell.end(),
+                                                   item);
+            if ( (iter != cell.end()) && (iter->m_widget == widget) )
+            {
+                cell.erase(iter);
+            }
+        }
+    }
+    entry.m_inCells = false;
+}
+
+void WidgetGrid::Add(BaseWidget* widget)
+{
+    Remove(widget);
+
+    Entry& entry = m_entries[widget];
+    entry.m_order = m_nextOrder++;
+    entry.m_inCells = false;
+    Update(widget);
+}
+
+void WidgetGrid::Remove(BaseWidget* widget)
+{
+    EntryMap::iterator iter = m_entries.find(widget);
+    if ( iter != m_entries.end() )
+    {
+        Erase(widget, iter->second);
+        m_entries.erase(iter);
+    }
+}
+
+void WidgetGrid::Update(BaseWidget* widget)
+{
+    EntryMap::iterator iter = m_entries.find(widget);
+    if ( iter == m_entries.end() )
+    {
+        return;
+    }
+
+    Entry& entry = iter->second;
+    Erase(widget, entry);
+    entry.m_rect = widget->TransformedRect();
+    if ( widget->IsVisible() )
+    {
+        Insert(widget, entry);
+    }
+}
+
+void WidgetGrid::Clear()
+{
+    m_entries.clear();
+    m_cells.assign(m_numColumns * m_numRows, Cell());
+}
+
+BaseWidget* WidgetGrid::Find(int x, int y) const
+{
+    const Cell& cell = m_cells[GetCellIndex(x, y)];
+    for ( Cell::const_reverse_iterator iter = cell.rbegin();
+          iter != cell.rend(); iter++ )
+    {
+        Rect rect = iter->m_rect;
+        if ( rect.IsInside(x, y) )
+        {
+            return iter->m_widget;
+        }
+    }
+
+    return NULL;
+}
+
+bool WidgetGrid::Contains(const BaseWidget* widget, int x, int y) const
+{
+    EntryMap::const_iterator iter = m_entries.find(widget);
+    if ( (iter == m_entries.end()) || !iter->second.m_inCells )
+    {
+        return false;
+    }
+
+    Rect rect = iter->second.m_rect;
+    return rect.IsInside(x, y);
+}
+
+bool WidgetGrid::GetRect(const BaseWidget* widget, Rect* rect) const
+{
+    EntryMap::const_iterator iter = m_entries.find(widget);
+    if ( (iter == m_entries.end()) || !iter->second.m_inCells )
+    {
+        return false;
+    }
+
+    *rect = iter->second.m_rect;
+    return true;
+}
+
+} // namespace CommonGL
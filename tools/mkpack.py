@@ -0,0 +1,221 @@
+"""
+ Resource pack creation tool; see include/ResourcePack.h for the format.
+
+ Usage: mkpack.py [-c none|lz4|zstd] [-l level] -o <output.pack> <dir>...
+
+ Every file under the given directories is stored under its path relative
+ to that directory. Entries are compressed with the chosen method unless
+ compression saves less than an eighth of their size.
+"""
+from __future__ import print_function
+import os
+import sys
+import struct
+
+###############################
+# Global data
+###############################
+
+PACK_MAGIC = b"CGLPACK\0"
+PACK_VERSION = 1
+ENTRY_ALIGNMENT = 64
+
+COMPRESSION_NONE = 0
+COMPRESSION_LZ4 = 1
+COMPRESSION_ZSTD = 2
+
+compression_names = { "none": COMPRESSION_NONE,
+                      "lz4": COMPRESSION_LZ4,
+                      "zstd": COMPRESSION_ZSTD }
+
+# command line parameters
+output_file = None
+input_dirs = []
+compression = COMPRESSION_LZ4
+compression_level = 19
+
+###############################
+# Functions
+###############################
+
+def fnv1a(data):
+    """ 32-bit FNV-1a hash, matching ResourcePack::HashName() """
+    h = 2166136261
+    for b in bytearray(data):
+        h ^= b
+        h = (h * 16777619) & 0xffffffff
+    return h
+
+def write_lz4_length(out, length):
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+def lz4_compress(data):
+    """ Greedy LZ4 block compressor """
+    data = bytes(data)
+    n = len(data)
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+
+    # The last match must start at least 12 bytes before the end and the
+    # last 5 bytes are always literals
+    match_limit = n - 12
+    while i < match_limit:
+        key = data[i:i + 4]
+        ref = table.get(key)
+        table[key] = i
+        if ref is None or i - ref > 65535:
+            i += 1
+            continue
+
+        match_length = 4
+        max_length = n - 5 - i
+        while (match_length < max_length and
+               data[ref + match_length] == data[i + match_length]):
+            match_length += 1
+
+        literal_length = i - anchor
+        token = (min(literal_length, 15) << 4) | min(match_length - 4, 15)
+        out.append(token)
+        if literal_length >= 15:
+            write_lz4_length(out, literal_length - 15)
+        out += data[anchor:i]
+        out += struct.pack("<H", i - ref)
+        if match_length - 4 >= 15:
+            write_lz4_length(out, match_length - 4 - 15)
+
+        i += match_length
+        anchor = i
+
+    literal_length = n - anchor
+    out.append(min(literal_length, 15) << 4)
+    if literal_length >= 15:
+        write_lz4_length(out, literal_length - 15)
+    out += data[anchor:]
+
+    return bytes(out)
+
+def zstd_compress(data):
+    try:
+        import zstandard
+    except ImportError:
+        print("Error: zstd compression needs the 'zstandard' module")
+        sys.exit(1)
+    compressor = zstandard.ZstdCompressor(level=compression_level)
+    return compressor.compress(data)
+
+def compress(data):
+    """ Returns (compression method, stored data) for an entry """
+    if compression == COMPRESSION_NONE or len(data) == 0:
+        return (COMPRESSION_NONE, data)
+
+    if compression == COMPRESSION_LZ4:
+        stored = lz4_compress(data)
+    else:
+        stored = zstd_compress(data)
+
+    if len(stored) > len(data) - len(data) // 8:
+        return (COMPRESSION_NONE, data)
+
+    return (compression, stored)
+
+def collect_files():
+    """ Returns a list of (name, path) tuples """
+    files = {}
+    for input_dir in input_dirs:
+        for root, dirs, names in os.walk(input_dir):
+            dirs.sort()
+            for name in sorted(names):
+                path = os.path.join(root, name)
+                rel = os.path.relpath(path, input_dir).replace(os.sep, "/")
+                if rel in files:
+                    print("Warning: '%s' found twice, using %s" % (rel, path))
+                files[rel] = path
+    return sorted(files.items())
+
+def pad_to(f, alignment):
+    pos = f.tell()
+    padding = (alignment - pos % alignment) % alignment
+    f.write(b"\0" * padding)
+    return pos + padding
+
+def write_pack(files):
+    entries = []
+    names = bytearray()
+    total_size = 0
+    total_stored = 0
+
+    f = open(output_file, "wb")
+
+    # Header is written last, once the offsets are known
+    f.write(b"\0" * 64)
+
+    for name, path in files:
+        data = open(path, "rb").read()
+        method, stored = compress(data)
+        offset = pad_to(f, ENTRY_ALIGNMENT)
+        f.write(stored)
+
+        encoded_name = name.encode("utf-8")
+        entries.append((fnv1a(encoded_name), encoded_name, offset,
+                        len(stored), len(data), len(names), method))
+        names += encoded_name
+        total_size += len(data)
+        total_stored += len(stored)
+
+    # Index sorted by hash, then name, for binary search
+    entries.sort(key=lambda e: (e[0], e[1]))
+    index_offset = pad_to(f, ENTRY_ALIGNMENT)
+    for (name_hash, name, offset, stored_size, size, name_offset,
+         method) in entries:
+        f.write(struct.pack("<QIIIIHB5x", offset, stored_size, size,
+                            name_hash, name_offset, len(name), method))
+
+    names_offset = f.tell()
+    f.write(names)
+
+    f.seek(0)
+    f.write(struct.pack("<8sIIQQI28x", PACK_MAGIC, PACK_VERSION,
+                        len(entries), index_offset, names_offset,
+                        len(names)))
+    f.close()
+
+    print("Wrote %s: %d files, %d bytes stored of %d" %
+          (output_file, len(entries), total_stored, total_size))
+
+def usage():
+    print("Usage: %s [-c none|lz4|zstd] [-l level] -o <output.pack> "
+          "<dir>..." % sys.argv[0])
+    sys.exit(1)
+
+def main():
+    global output_file, compression, compression_level
+
+    args = sys.argv[1:]
+    while len(args) > 0:
+        arg = args.pop(0)
+        if arg == "-o" and len(args) > 0:
+            output_file = args.pop(0)
+        elif arg == "-c" and len(args) > 0:
+            method = args.pop(0)
+            if method not in compression_names:
+                usage()
+            compression = compression_names[method]
+        elif arg == "-l" and len(args) > 0:
+            compression_level = int(args.pop(0))
+        elif arg.startswith("-"):
+            usage()
+        else:
+            input_dirs.append(arg)
+
+    if output_file == None or len(input_dirs) == 0:
+        usage()
+
+    write_pack(collect_files())
+
+if __name__ == "__main__":
+    main()